@@ -0,0 +1,639 @@
+#include <string.h>
+#include <algorithm>
+
+#include "Ancillary.h"
+#include "Clock.h"
+#include "DisplayModes.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ANCILLARY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ANCILLARY_TARGET(isa)
+#else
+#define ANCILLARY_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+EAncillaryType AncillaryType( uint8_t did, uint8_t sdid )
+{
+    switch( did << 8 | sdid )
+    {
+    case 0x6101:  return kAncillaryCaption708;
+    case 0x6102:  return kAncillaryCaption608;
+    case 0x4105:  return kAncillaryAfd;
+    case 0x4107:  return kAncillaryScte104;
+    default:      return kAncillaryOther;
+    }
+}
+
+//=====================================================================================================================
+// A line being scanned. Samples are those of the multiplexed stream, sample s in bits 10 * (s % 3) of word s / 3.
+struct SAncillaryLine
+{
+    const uint32_t*    pWords;
+    size_t             samples;       // within the width
+    bool               multiplexed;
+    SAncillaryPacket*  pPackets;
+    unsigned           maxPackets;
+    unsigned           count;
+    unsigned           errors;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline unsigned Sample( const uint32_t* pWords, size_t s )
+{
+    return ( pWords[s / 3] >> ( s % 3 * 10 ) ) & 0x3FF;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline void PutSample( uint32_t* pWords, size_t s, unsigned value )
+{
+    const unsigned shift = (unsigned)( s % 3 * 10 );
+
+    pWords[s / 3] = ( pWords[s / 3] & ~( 0x3FFu << shift ) ) | ( value << shift );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A word carrying 8 bits: even parity in bit 8, its inverse in bit 9.
+static inline unsigned ParityWord( unsigned byte )
+{
+    unsigned parity = byte;
+
+    parity ^= parity >> 4;
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+    parity &= 1;
+
+    return byte | parity << 8 | ( parity ^ 1 ) << 9;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline bool ParityOk( unsigned word )
+{
+    return ParityWord( word & 0xFF ) == word;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// At sample s, a 000 of the multiplexed stream. It starts a packet if the next two samples of its own stream are 3FF;
+// the packet is decoded from the words it occupies.
+static void ParsePacket( SAncillaryLine* pLine, size_t s )
+{
+    const size_t step = pLine->multiplexed ? 1 : 2;
+    const uint32_t* pWords = pLine->pWords;
+
+    if( s + 5 * step >= pLine->samples || Sample( pWords, s + step ) != 0x3FF ||
+        Sample( pWords, s + 2 * step ) != 0x3FF || pLine->count == pLine->maxPackets )
+    {
+        return;
+    }
+
+    const unsigned did = Sample( pWords, s + 3 * step );
+    const unsigned sdid = Sample( pWords, s + 4 * step );
+    const unsigned dc = Sample( pWords, s + 5 * step );
+    const unsigned count = dc & 0xFF;
+
+    if( !ParityOk(did) || !ParityOk(sdid) || !ParityOk(dc) || s + ( 6 + count ) * step >= pLine->samples )
+    {
+        ++pLine->errors;
+        return;
+    }
+
+    SAncillaryPacket* pPacket = &pLine->pPackets[pLine->count];
+    unsigned sum = ( did & 0x1FF ) + ( sdid & 0x1FF ) + ( dc & 0x1FF );
+
+    for( unsigned k = 0; k < count; ++k )
+    {
+        const unsigned word = Sample( pWords, s + ( 6 + k ) * step );
+
+        sum += word & 0x1FF;
+        pPacket->data[k] = (uint8_t)word;
+    }
+
+    const unsigned checksum = Sample( pWords, s + ( 6 + count ) * step );
+
+    if( ( checksum & 0x1FF ) != ( sum & 0x1FF ) || ( ( checksum >> 9 ) & 1 ) == ( ( checksum >> 8 ) & 1 ) )
+    {
+        ++pLine->errors;
+        return;
+    }
+
+    pPacket->stream = (uint8_t)( pLine->multiplexed ? kAncillaryMultiplexed : ( s & 1 ) ? kAncillaryLuma
+                                                                                         : kAncillaryChroma );
+    pPacket->did = (uint8_t)did;
+    pPacket->sdid = (uint8_t)sdid;
+    pPacket->count = (uint8_t)count;
+    pPacket->type = (uint8_t)AncillaryType( pPacket->did, pPacket->sdid );
+    ++pLine->count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline bool HasZeroField( uint32_t word )
+{
+    return ( word & 0x3FF ) == 0 || ( word & 0xFFC00 ) == 0 || ( word & 0x3FF00000 ) == 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void ParseWord( SAncillaryLine* pLine, size_t w )
+{
+    for( size_t f = 0; f < 3; ++f )
+    {
+        if( ( ( pLine->pWords[w] >> ( f * 10 ) ) & 0x3FF ) == 0 && 3 * w + f < pLine->samples )
+        {
+            ParsePacket( pLine, 3 * w + f );
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Plain C, also used for the words after the last 8 the SIMD kernel can read.
+static void ScanScalar( SAncillaryLine* pLine, size_t first, size_t words )
+{
+    for( size_t w = first; w < words; ++w )
+    {
+        if( HasZeroField( pLine->pWords[w] ) )
+        {
+            ParseWord( pLine, w );
+        }
+    }
+}
+
+#ifdef ANCILLARY_X86
+//---------------------------------------------------------------------------------------------------------------------
+// A word has a field of 000 if any of its three fields, masked in place, compares equal to zero.
+ANCILLARY_TARGET("avx2")
+static size_t ScanAvx2( SAncillaryLine* pLine, size_t words )
+{
+    const __m256i kField = _mm256_set1_epi32(0x3FF);
+    const __m256i kZero = _mm256_setzero_si256();
+    size_t w = 0;
+
+    for( ; w + 8 <= words; w += 8 )
+    {
+        const __m256i v = _mm256_loadu_si256( (const __m256i*)( pLine->pWords + w ) );
+        const __m256i zero = _mm256_or_si256(
+                                 _mm256_or_si256( _mm256_cmpeq_epi32( _mm256_and_si256( v, kField ), kZero ),
+                                                  _mm256_cmpeq_epi32( _mm256_and_si256( _mm256_srli_epi32( v, 10 ),
+                                                                                        kField ), kZero ) ),
+                                 _mm256_cmpeq_epi32( _mm256_and_si256( _mm256_srli_epi32( v, 20 ), kField ), kZero ) );
+        unsigned mask = (unsigned)_mm256_movemask_ps( _mm256_castsi256_ps(zero) );
+
+        while( mask != 0 )
+        {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward( &bit, mask );
+#else
+            const unsigned bit = (unsigned)__builtin_ctz(mask);
+#endif
+            ParseWord( pLine, w + bit );
+            mask &= mask - 1;
+        }
+    }
+
+    return w;
+}
+#endif // ANCILLARY_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+// Parity words of the user data; returns the sum of their low 9 bits, for the checksum.
+static unsigned EncodeScalar( const uint8_t* pData, size_t first, size_t count, uint16_t* pWords )
+{
+    unsigned sum = 0;
+
+    for( size_t k = first; k < count; ++k )
+    {
+        pWords[k] = (uint16_t)ParityWord( pData[k] );
+        sum += pWords[k] & 0x1FF;
+    }
+
+    return sum;
+}
+
+#ifdef ANCILLARY_X86
+//---------------------------------------------------------------------------------------------------------------------
+// 32 bytes at a time: the parity of each nibble from a table, the high byte of each word 01 or 10 from the parity of
+// the byte, and the sum from two sums of absolute differences (the bytes, and 256 times the parity bits).
+ANCILLARY_TARGET("avx2")
+static unsigned EncodeAvx2( const uint8_t* pData, size_t count, uint16_t* pWords, size_t* pDone )
+{
+    const __m256i kParity = _mm256_setr_epi8( 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
+                                              0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0 );
+    const __m256i kNibble = _mm256_set1_epi8(0x0F);
+    const __m256i kTwo = _mm256_set1_epi8(2);
+    const __m256i kZero = _mm256_setzero_si256();
+    __m256i bytes = kZero, parities = kZero;
+    size_t k = 0;
+
+    for( ; k + 32 <= count; k += 32 )
+    {
+        // quadwords 0 2 1 3, so that unpacking within the lanes yields the words in order
+        const __m256i v = _mm256_permute4x64_epi64( _mm256_loadu_si256( (const __m256i*)( pData + k ) ), 0xD8 );
+        const __m256i parity = _mm256_xor_si256(
+                                   _mm256_shuffle_epi8( kParity, _mm256_and_si256( v, kNibble ) ),
+                                   _mm256_shuffle_epi8( kParity, _mm256_and_si256( _mm256_srli_epi16( v, 4 ),
+                                                                                   kNibble ) ) );
+        const __m256i high = _mm256_xor_si256( parity, kTwo );
+
+        _mm256_storeu_si256( (__m256i*)( pWords + k ), _mm256_unpacklo_epi8( v, high ) );
+        _mm256_storeu_si256( (__m256i*)( pWords + k + 16 ), _mm256_unpackhi_epi8( v, high ) );
+        bytes = _mm256_add_epi64( bytes, _mm256_sad_epu8( v, kZero ) );
+        parities = _mm256_add_epi64( parities, _mm256_sad_epu8( parity, kZero ) );
+    }
+
+    uint64_t sums[4];
+
+    _mm256_storeu_si256( (__m256i*)sums, _mm256_add_epi64( bytes, _mm256_slli_epi64( parities, 8 ) ) );
+    *pDone = k;
+    return (unsigned)( sums[0] + sums[1] + sums[2] + sums[3] );
+}
+#endif // ANCILLARY_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+static unsigned EncodeWords( const uint8_t* pData, size_t count, uint16_t* pWords, ECpuIsa isa )
+{
+    size_t done = 0;
+    unsigned sum = 0;
+
+#ifdef ANCILLARY_X86
+    if( isa >= kIsaAvx2 && count >= 32 && HasAvx2() )
+    {
+        sum = EncodeAvx2( pData, count, pWords, &done );
+    }
+#endif
+
+    return sum + EncodeScalar( pData, done, count, pWords );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+unsigned ScanAncillaryLine( const void* pLine, long width, bool multiplexed, SAncillaryPacket* pPackets,
+                            unsigned maxPackets, unsigned* pErrors, ECpuIsa isa )
+{
+    SAncillaryLine line;
+
+    line.pWords = (const uint32_t*)pLine;
+    line.samples = (size_t)width * 2;
+    line.multiplexed = multiplexed;
+    line.pPackets = pPackets;
+    line.maxPackets = maxPackets;
+    line.count = 0;
+    line.errors = 0;
+
+    const size_t words = ( line.samples + 2 ) / 3;
+    size_t done = 0;
+
+#ifdef ANCILLARY_X86
+    if( isa >= kIsaAvx2 && HasAvx2() )
+    {
+        done = ScanAvx2( &line, words );
+    }
+#endif
+
+    ScanScalar( &line, done, words );
+
+    *pErrors = line.errors;
+    return line.count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Line numbers of SMPTE 125 (525 lines), ITU-R BT.656 (625), SMPTE 296 (720p) and SMPTE 274 (1080); segmented frames
+// are numbered as interlaced ones.
+unsigned AncillaryLines( BMDDisplayMode mode, uint16_t* pLines, unsigned maxLines )
+{
+    struct SRange { unsigned first, last; };
+
+    static const SRange k486i[] = { { 10, 20 }, { 273, 282 } };
+    static const SRange k576i[] = { { 7, 22 }, { 320, 335 } };
+    static const SRange k720p[] = { { 8, 25 } };
+    static const SRange k1080i[] = { { 9, 20 }, { 571, 583 } };
+    static const SRange k1080p[] = { { 9, 41 } };
+
+    const SDisplayModeDesc* pDesc = FindDisplayMode(mode);
+    const SRange* pRanges = NULL;
+    unsigned ranges = 0, count = 0;
+
+    if( pDesc == NULL )
+    {
+        return 0;
+    }
+
+    const bool fields = ( pDesc->fieldDominance != bmdProgressiveFrame );
+
+    if( pDesc->height == 486 && fields )             { pRanges = k486i;  ranges = 2; }
+    else if( pDesc->height == 576 && fields )        { pRanges = k576i;  ranges = 2; }
+    else if( pDesc->height == 720 && !fields )       { pRanges = k720p;  ranges = 1; }
+    else if( pDesc->height == 1080 && fields )       { pRanges = k1080i; ranges = 2; }
+    else if( pDesc->height == 1080 )                 { pRanges = k1080p; ranges = 1; }
+
+    for( unsigned r = 0; r < ranges; ++r )
+    {
+        for( unsigned line = pRanges[r].first; line <= pRanges[r].last; ++line )
+        {
+            if( count == maxLines )
+            {
+                return 0;
+            }
+
+            pLines[count++] = (uint16_t)line;
+        }
+    }
+
+    return count;
+}
+
+//=====================================================================================================================
+CAncillaryQueue::CAncillaryQueue( unsigned capacity, ECpuIsa isa )
+    : m_RefCount(1), m_Isa(isa), m_Queue(capacity), m_Mode((BMDDisplayMode)0), m_Width(0), m_Multiplexed(false),
+      m_LineCount(0), m_Frames(0), m_ScannedLines(0), m_Packets(0), m_Errors(0), m_Overruns(0), m_Unsupported(0),
+      m_ScanNs(0)
+{
+    for( int i = 0; i < kAncillaryTypeCount; ++i )
+    {
+        m_Types[i].store(0);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The lines are looked up again whenever the mode changes.
+void CAncillaryQueue::Scan( IDeckLinkVideoInputFrame* pFrame, uint64_t frame )
+{
+    const uint64_t start = MonotonicNs();
+    IDeckLinkVideoFrameAncillary* pAncillary = NULL;
+
+    if( pFrame->GetAncillaryData(&pAncillary) != S_OK || pAncillary == NULL )
+    {
+        Increment(m_Unsupported);
+        return;
+    }
+
+    if( pAncillary->GetPixelFormat() != bmdFormat10BitYUV )
+    {
+        pAncillary->Release();
+        Increment(m_Unsupported);
+        return;
+    }
+
+    if( pAncillary->GetDisplayMode() != m_Mode )
+    {
+        const SDisplayModeDesc* pDesc = FindDisplayMode( pAncillary->GetDisplayMode() );
+
+        m_Mode = pAncillary->GetDisplayMode();
+        m_Width = pDesc ? pDesc->width : 0;
+        m_Multiplexed = ( pDesc != NULL && pDesc->height <= 576 );
+        m_LineCount = AncillaryLines( m_Mode, m_Lines, kMaxLines );
+    }
+
+    uint64_t lines = 0, packets = 0;
+
+    for( unsigned i = 0; i < m_LineCount; ++i )
+    {
+        void* pBuffer = NULL;
+        unsigned errors = 0;
+
+        if( pAncillary->GetBufferForVerticalBlankingLine( m_Lines[i], &pBuffer ) != S_OK || pBuffer == NULL )
+        {
+            continue;
+        }
+
+        const unsigned count = ScanAncillaryLine( pBuffer, m_Width, m_Multiplexed, m_Scratch, kMaxPacketsPerLine,
+                                                  &errors, m_Isa );
+        ++lines;
+        packets += count;
+
+        if( errors != 0 )
+        {
+            Increment( m_Errors, errors );
+        }
+
+        for( unsigned k = 0; k < count; ++k )
+        {
+            m_Scratch[k].frame = frame;
+            m_Scratch[k].line = m_Lines[i];
+            Increment( m_Types[ m_Scratch[k].type ] );
+
+            if( !m_Queue.TryPush( m_Scratch[k] ) )
+            {
+                Increment(m_Overruns);
+            }
+        }
+    }
+
+    pAncillary->Release();
+
+    Increment(m_Frames);
+    Increment( m_ScannedLines, lines );
+    Increment( m_Packets, packets );
+    Increment( m_ScanNs, MonotonicNs() - start );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAncillaryQueue::GetStats( SStats* pStats )
+{
+    pStats->frames = m_Frames.load( std::memory_order_relaxed );
+    pStats->lines = m_ScannedLines.load( std::memory_order_relaxed );
+    pStats->packets = m_Packets.load( std::memory_order_relaxed );
+
+    for( int i = 0; i < kAncillaryTypeCount; ++i )
+    {
+        pStats->types[i] = m_Types[i].load( std::memory_order_relaxed );
+    }
+
+    pStats->errors = m_Errors.load( std::memory_order_relaxed );
+    pStats->overruns = m_Overruns.load( std::memory_order_relaxed );
+    pStats->unsupported = m_Unsupported.load( std::memory_order_relaxed );
+    pStats->scanNs = m_ScanNs.load( std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG CAncillaryQueue::AddRef()
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG CAncillaryQueue::Release()
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+CAncillaryInserter::CAncillaryInserter( const SAncillarySlot* pSlots, unsigned slotCount, ECpuIsa isa )
+    : m_Isa(isa), m_SlotCount( std::min<unsigned>( slotCount, kMaxSlots ) ), m_Mode((BMDDisplayMode)0),
+      m_Multiplexed(false), m_Samples(0), m_LineCount(0), m_Placed(0), m_PlacedStat(0), m_Frames(0), m_Packets(0),
+      m_Bytes(0), m_Failures(0), m_InsertNs(0)
+{
+    memcpy( m_Slots, pSlots, m_SlotCount * sizeof(m_Slots[0]) );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// At *pNext, the first sample of the line not taken, which is always that of an even word: the slot's part of the line
+// shares no word with another's, and the blank samples of its template are in the same places as on the line.
+bool CAncillaryInserter::Place( STemplate* pTemplate, unsigned slot, size_t* pNext )
+{
+    const SAncillarySlot& config = m_Slots[slot];
+    const size_t step = m_Multiplexed ? 1 : 2;
+    const size_t first = *pNext + ( ( !m_Multiplexed && config.stream != kAncillaryChroma ) ? 1 : 0 );
+    const size_t last = first + ( 6 + config.maxCount ) * step;
+
+    if( last >= m_Samples )
+    {
+        return false;
+    }
+
+    pTemplate->slot = slot;
+    pTemplate->line = m_Lines[config.line];
+    pTemplate->firstSample = first;
+    pTemplate->step = step;
+    pTemplate->firstWord = *pNext / 3;
+    pTemplate->words = last / 3 - pTemplate->firstWord + 1;
+    memcpy( pTemplate->packed, &m_Blank[pTemplate->firstWord], pTemplate->words * sizeof(uint32_t) );
+
+    const unsigned did = ParityWord(config.did);
+    const unsigned sdid = ParityWord(config.sdid);
+    const size_t s = first - *pNext;
+
+    PutSample( pTemplate->packed, s, 0x000 );
+    PutSample( pTemplate->packed, s + step, 0x3FF );
+    PutSample( pTemplate->packed, s + 2 * step, 0x3FF );
+    PutSample( pTemplate->packed, s + 3 * step, did );
+    PutSample( pTemplate->packed, s + 4 * step, sdid );
+    pTemplate->headerSum = ( did & 0x1FF ) + ( sdid & 0x1FF );
+
+    *pNext = ( last / 6 + 1 ) * 6;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+unsigned CAncillaryInserter::Prepare( BMDDisplayMode mode )
+{
+    const SDisplayModeDesc* pDesc = FindDisplayMode(mode);
+
+    m_Mode = mode;
+    m_Multiplexed = ( pDesc != NULL && pDesc->height <= 576 );
+    m_LineCount = AncillaryLines( mode, m_Lines, CAncillaryQueue::kMaxLines );
+    m_Placed = 0;
+
+    if( pDesc != NULL && m_LineCount != 0 )
+    {
+        size_t next[CAncillaryQueue::kMaxLines] = { 0 };
+
+        m_Samples = (size_t)pDesc->width * 2;
+        m_Blank.assign( RowBytesForPixelFormat( bmdFormat10BitYUV, pDesc->width ) / 4, 0 );
+
+        for( size_t s = 0; s < m_Samples; ++s )
+        {
+            PutSample( m_Blank.data(), s, ( s & 1 ) ? 0x040 : 0x200 );
+        }
+
+        for( unsigned i = 0; i < m_SlotCount; ++i )
+        {
+            if( m_Slots[i].line < m_LineCount && Place( &m_Templates[m_Placed], i, &next[ m_Slots[i].line ] ) )
+            {
+                ++m_Placed;
+            }
+        }
+    }
+
+    m_PlacedStat.store( m_Placed, std::memory_order_relaxed );
+    return m_Placed;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CAncillaryInserter::Blank( IDeckLinkVideoFrameAncillary* pAncillary )
+{
+    if( pAncillary->GetPixelFormat() != bmdFormat10BitYUV || m_Blank.empty() )
+    {
+        return false;
+    }
+
+    for( unsigned i = 0; i < m_LineCount; ++i )
+    {
+        void* pBuffer = NULL;
+
+        if( pAncillary->GetBufferForVerticalBlankingLine( m_Lines[i], &pBuffer ) == S_OK && pBuffer != NULL )
+        {
+            memcpy( pBuffer, m_Blank.data(), m_Blank.size() * sizeof(uint32_t) );
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The checksum is the 9-bit sum from the DID to the last user data word, with bit 9 the inverse of bit 8.
+bool CAncillaryInserter::Insert( IDeckLinkVideoFrameAncillary* pAncillary, const SAncillaryPacket* pPackets )
+{
+    const uint64_t start = MonotonicNs();
+    uint64_t packets = 0, bytes = 0;
+    bool ok = ( pAncillary != NULL && pAncillary->GetPixelFormat() == bmdFormat10BitYUV );
+
+    for( unsigned i = 0; ok && i < m_Placed; ++i )
+    {
+        const STemplate& t = m_Templates[i];
+        const SAncillaryPacket& packet = pPackets[t.slot];
+        const unsigned count = std::min<unsigned>( packet.count, m_Slots[t.slot].maxCount );
+        void* pBuffer = NULL;
+
+        if( pAncillary->GetBufferForVerticalBlankingLine( t.line, &pBuffer ) != S_OK || pBuffer == NULL )
+        {
+            ok = false;
+            break;
+        }
+
+        uint32_t* pLine = (uint32_t*)pBuffer;
+
+        if( count == 0 )
+        {
+            memcpy( pLine + t.firstWord, &m_Blank[t.firstWord], t.words * sizeof(uint32_t) );
+            continue;
+        }
+
+        memcpy( pLine + t.firstWord, t.packed, t.words * sizeof(uint32_t) );
+
+        m_Words[0] = (uint16_t)ParityWord(count);
+
+        unsigned sum = t.headerSum + ( m_Words[0] & 0x1FF ) + EncodeWords( packet.data, count, m_Words + 1, m_Isa );
+
+        sum &= 0x1FF;
+        m_Words[count + 1] = (uint16_t)( sum | ( ( ~sum >> 8 ) & 1 ) << 9 );
+
+        for( unsigned k = 0; k < count + 2; ++k )
+        {
+            PutSample( pLine, t.firstSample + ( 5 + k ) * t.step, m_Words[k] );
+        }
+
+        ++packets;
+        bytes += count;
+    }
+
+    if( !ok )
+    {
+        Increment(m_Failures);
+    }
+
+    Increment(m_Frames);
+    Increment( m_Packets, packets );
+    Increment( m_Bytes, bytes );
+    Increment( m_InsertNs, MonotonicNs() - start );
+    return ok;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAncillaryInserter::GetStats( SStats* pStats )
+{
+    pStats->slots = m_PlacedStat.load( std::memory_order_relaxed );
+    pStats->frames = m_Frames.load( std::memory_order_relaxed );
+    pStats->packets = m_Packets.load( std::memory_order_relaxed );
+    pStats->bytes = m_Bytes.load( std::memory_order_relaxed );
+    pStats->failures = m_Failures.load( std::memory_order_relaxed );
+    pStats->insertNs = m_InsertNs.load( std::memory_order_relaxed );
+}
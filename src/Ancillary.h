@@ -0,0 +1,252 @@
+#ifndef ANCILLARY_H
+#define ANCILLARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "DeckLinkPlatform.h"
+#include "SpscQueue.h"
+
+//=====================================================================================================================
+// SMPTE 291 ancillary data packets in the vertical blanking lines of IDeckLinkVideoFrameAncillary, in v210.
+//
+// A packet is a run of 10-bit words in one data stream of the line: the ancillary data flag 000 3FF 3FF, the data ID,
+// the secondary data ID (or data block number), the data count, that many user data words and a checksum. HD lines
+// carry packets in the luma and the chroma stream separately, SD lines in the multiplexed Cb Y Cr Y stream. All words
+// after the flag hold 8 bits with even parity in bit 8 and its inverse in bit 9, and blanking is 040 and 200, so a
+// field of 000 occurs in a VANC line only where a packet starts.
+//
+// A v210 word holds three consecutive samples of the multiplexed stream, so the scanner looks for 000 in the three
+// fields of whole words, 8 words (32 samples) at a time with AVX2, and decodes in place only the words of the packets
+// it finds: a line of blanking costs a few instructions per 32 samples, with no unpacking. The kernels are chosen at
+// run time with CpuFeatures.h and find the same packets.
+//
+// Inserting goes the other way with templates: the words of a packet that do not change from frame to frame are
+// packed into v210 once, and each frame only the user data, its parity bits (32 words at a time with AVX2) and the
+// checksum are written over a copy of the template.
+enum EAncillaryStream
+{
+    kAncillaryLuma,
+    kAncillaryChroma,
+    kAncillaryMultiplexed,            // SD
+};
+
+enum EAncillaryType
+{
+    kAncillaryOther,
+    kAncillaryCaption708,             // 61h/01h, CEA-708 caption distribution packet (SMPTE 334)
+    kAncillaryCaption608,             // 61h/02h, CEA-608 (SMPTE 334)
+    kAncillaryAfd,                    // 41h/05h, active format description and bar data (SMPTE 2016)
+    kAncillaryScte104,                // 41h/07h, SCTE-104 messages (SMPTE 2010)
+
+    kAncillaryTypeCount,
+};
+
+struct SAncillaryPacket
+{
+    uint64_t  frame;                  // frames the input delivered before the one carrying the packet
+    uint16_t  line;                   // SMPTE line number
+    uint8_t   stream;                 // EAncillaryStream
+    uint8_t   type;                   // EAncillaryType
+    uint8_t   did;                    // without the parity bits
+    uint8_t   sdid;
+    uint8_t   count;                  // of data
+    uint8_t   data[255];              // user data words, the low 8 bits
+};
+
+EAncillaryType AncillaryType( uint8_t did, uint8_t sdid );
+
+// Packets in a VANC line of width pixels, at most maxPackets, in the order they start on the line; multiplexed for an
+// SD line. Packets with a bad parity, data count or checksum are left out and counted in *pErrors. isa: the highest
+// kernels to use, kIsaCount = the best the CPU has.
+unsigned ScanAncillaryLine( const void* pLine, long width, bool multiplexed, SAncillaryPacket* pPackets,
+                            unsigned maxPackets, unsigned* pErrors, ECpuIsa isa = kIsaCount );
+
+// SMPTE numbers of the VANC lines of the mode, from the first line after the switching point to the last before the
+// active picture, of both fields; 0 if there are none known or more than maxLines.
+unsigned AncillaryLines( BMDDisplayMode mode, uint16_t* pLines, unsigned maxLines );
+
+//=====================================================================================================================
+// The ancillary packets of one device, scanned out of every frame on the capture callback, for one consumer.
+//
+// The writer pushes each packet into a single-producer single-consumer queue; a full queue drops the packet and counts
+// it, so a slow consumer never delays the driver. Frames in another pixel format than v210 have no packets the scanner
+// can find and are counted as such.
+class CAncillaryQueue
+{
+public:
+    enum { kMaxLines = 64 };
+    enum { kMaxPacketsPerLine = 16 };
+
+    struct SStats
+    {
+        uint64_t  frames;             // scanned
+        uint64_t  lines;
+        uint64_t  packets;            // found
+        uint64_t  types[kAncillaryTypeCount];
+        uint64_t  errors;             // packets left out for a bad parity, data count or checksum
+        uint64_t  overruns;           // packets dropped because the queue was full
+        uint64_t  unsupported;        // frames without ancillary data in v210
+        uint64_t  scanNs;             // spent in Scan()
+    };
+
+private:
+    std::atomic<ULONG>             m_RefCount;
+    ECpuIsa                        m_Isa;
+    CSpscQueue<SAncillaryPacket>   m_Queue;
+
+    // writer only
+    BMDDisplayMode                 m_Mode;
+    long                           m_Width;
+    bool                           m_Multiplexed;
+    unsigned                       m_LineCount;
+    uint16_t                       m_Lines[kMaxLines];
+    SAncillaryPacket               m_Scratch[kMaxPacketsPerLine];
+
+    // written by the writer only
+    std::atomic<uint64_t>          m_Frames;
+    std::atomic<uint64_t>          m_ScannedLines;
+    std::atomic<uint64_t>          m_Packets;
+    std::atomic<uint64_t>          m_Types[kAncillaryTypeCount];
+    std::atomic<uint64_t>          m_Errors;
+    std::atomic<uint64_t>          m_Overruns;
+    std::atomic<uint64_t>          m_Unsupported;
+    std::atomic<uint64_t>          m_ScanNs;
+
+    CAncillaryQueue( const CAncillaryQueue& );
+    CAncillaryQueue& operator=( const CAncillaryQueue& );
+
+    ~CAncillaryQueue()  {}
+
+    static void Increment( std::atomic<uint64_t>& counter, uint64_t n = 1 )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+    }
+
+public:
+    // capacity: packets queued at most. isa: as for ScanAncillaryLine().
+    explicit CAncillaryQueue( unsigned capacity, ECpuIsa isa = kIsaCount );
+
+    // Writer. frame: the number of frames before this one, for SAncillaryPacket::frame.
+    void Scan( IDeckLinkVideoInputFrame* pFrame, uint64_t frame );
+
+    // Reader. false if there is no packet.
+    bool Pop( SAncillaryPacket* pPacket )  { return m_Queue.TryPop(pPacket); }
+
+    void GetStats( SStats* pStats );
+
+    ULONG AddRef();
+    ULONG Release();
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// A packet a CAncillaryInserter writes into every frame.
+struct SAncillarySlot
+{
+    uint8_t   line;                   // index into the VANC lines of the mode as AncillaryLines() lists them, so that
+                                      // one slot fits every mode
+    uint8_t   stream;                 // EAncillaryStream; SD lines only have the multiplexed one, and HD lines take
+                                      // the luma stream for it
+    uint8_t   did;
+    uint8_t   sdid;
+    uint8_t   maxCount;               // user data words the packet can carry
+};
+
+//=====================================================================================================================
+// Writes the packets of a set of slots into the ancillary data of output frames, in v210.
+//
+// Prepare() places the slots of each line one after another, from the start of the line, and packs a template for each:
+// the words of the slot's part of the line, blank, with the flag, the DID and the SDID in place. Insert() then writes
+// only those words: a copy of the template, the data count, the user data and the checksum. A slot whose packet is
+// left out of a frame is blanked. The rest of the VANC lines are blanked once by Blank(), when the ancillary object is
+// created; the picture is never touched.
+//
+// The IDeckLinkVideoFrameAncillary objects belong to the caller, which is expected to keep one per frame it recycles,
+// so that inserting allocates nothing. One writer; GetStats() for any thread.
+class CAncillaryInserter
+{
+public:
+    enum { kMaxSlots = 4 };
+
+    struct SStats
+    {
+        unsigned  slots;              // placed in the current mode
+        uint64_t  frames;
+        uint64_t  packets;            // written
+        uint64_t  bytes;              // of user data
+        uint64_t  failures;           // frames without ancillary data in v210, or without a buffer for a slot's line
+        uint64_t  insertNs;           // spent in Insert()
+    };
+
+private:
+    enum { kMaxTemplateWords = ( ( 7 + 255 ) * 2 + 5 ) / 3 + 1 };
+
+    struct STemplate
+    {
+        unsigned  slot;               // index into m_Slots
+        uint16_t  line;               // SMPTE line number
+        size_t    firstSample;        // of the flag, in the multiplexed stream
+        size_t    step;               // 2 = one of the HD streams
+        size_t    firstWord;
+        size_t    words;
+        unsigned  headerSum;          // DID and SDID, for the checksum
+        uint32_t  packed[kMaxTemplateWords];
+    };
+
+    ECpuIsa                        m_Isa;
+    SAncillarySlot                 m_Slots[kMaxSlots];
+    unsigned                       m_SlotCount;
+
+    // writer only
+    BMDDisplayMode                 m_Mode;
+    bool                           m_Multiplexed;
+    size_t                         m_Samples;     // of the multiplexed stream within the width
+    unsigned                       m_LineCount;
+    uint16_t                       m_Lines[CAncillaryQueue::kMaxLines];
+    std::vector<uint32_t>          m_Blank;       // a blank line, sized by Prepare()
+    STemplate                      m_Templates[kMaxSlots];
+    unsigned                       m_Placed;
+    uint16_t                       m_Words[1 + 255 + 1];      // data count, user data, checksum
+
+    // written by the writer only
+    std::atomic<unsigned>          m_PlacedStat;
+    std::atomic<uint64_t>          m_Frames;
+    std::atomic<uint64_t>          m_Packets;
+    std::atomic<uint64_t>          m_Bytes;
+    std::atomic<uint64_t>          m_Failures;
+    std::atomic<uint64_t>          m_InsertNs;
+
+    CAncillaryInserter( const CAncillaryInserter& );
+    CAncillaryInserter& operator=( const CAncillaryInserter& );
+
+    static void Increment( std::atomic<uint64_t>& counter, uint64_t n = 1 )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+    }
+
+    bool Place( STemplate* pTemplate, unsigned slot, size_t* pNext );
+
+public:
+    // isa: as for ScanAncillaryLine().
+    CAncillaryInserter( const SAncillarySlot* pSlots, unsigned slotCount, ECpuIsa isa = kIsaCount );
+
+    // Writer. Places the slots and packs their templates for the mode; the number of slots placed, 0 if the mode has
+    // no VANC lines known. Slots which do not fit on their line, or refer to a line the mode does not have, are left
+    // out.
+    unsigned Prepare( BMDDisplayMode mode );
+
+    // Writer. Blanks every VANC line of a new ancillary object in the mode of the last Prepare(). false if it is not
+    // in v210.
+    bool Blank( IDeckLinkVideoFrameAncillary* pAncillary );
+
+    // Writer. pPackets[i] for slot i: the user data in data[] and count, 0 = no packet in this frame. The rest of the
+    // packet is the slot's; data beyond the slot's maxCount is cut off. false on a failure.
+    bool Insert( IDeckLinkVideoFrameAncillary* pAncillary, const SAncillaryPacket* pPackets );
+
+    void GetStats( SStats* pStats );
+};
+
+#endif // ANCILLARY_H
@@ -0,0 +1,372 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "AudioPlayout.h"
+#include "Clock.h"
+
+const double CAudioPlayout::kMaxCorrection = 500e-6;
+const double CAudioPlayout::kSettleSeconds = 20.0;
+
+static const double kNsPerFrame = 1e9 / bmdAudioSampleRate48kHz;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Interleaved float samples to the output's integers, rounded and saturated.
+static void FloatToSamples( const float* pSrc, size_t count, BMDAudioSampleType type, void* pDst )
+{
+    if( type == bmdAudioSampleType16bitInteger )
+    {
+        int16_t* pOut = (int16_t*)pDst;
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            const float v = std::min( std::max( pSrc[i] * 32768.0f, -32768.0f ), 32767.0f );
+            pOut[i] = (int16_t)lrintf(v);
+        }
+    }
+    else
+    {
+        int32_t* pOut = (int32_t*)pDst;
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            // 2147483520 is the largest float below 2^31
+            const float v = std::min( std::max( pSrc[i] * 2147483648.0f, -2147483648.0f ), 2147483520.0f );
+            pOut[i] = (int32_t)lrintf(v);
+        }
+    }
+}
+
+//=====================================================================================================================
+CAudioPlayout::CAudioPlayout( IDeckLinkOutput* pOutput, unsigned channels, BMDAudioSampleType type, long target,
+                              long latency, CAudioRing* pSource )
+    : m_RefCount(1), m_pOutput(pOutput), m_Channels(channels), m_Type(type), m_Target(target),
+      m_Latency( std::max( latency, target ) ), m_pSource(pSource), m_Reader(-1),
+      m_Resampler( channels, m_Latency + bmdAudioSampleRate48kHz ), m_Mixed( (size_t)target * channels ),
+      m_Samples( (size_t)target * channels ), m_StreamTime(0), m_Appended(0), m_ArrivalNs(0), m_Primed(false),
+      m_Ratio(1.0), m_DriftValid(false), m_Drift(0.0), m_WindowNs(0), m_LastValid(false), m_LastSourceEnd(0),
+      m_Scheduled(0),
+      m_Silence(0), m_Underruns(0), m_Skipped(0), m_SourceGaps(0), m_Buffered(0), m_LatencyNow(0), m_DriftPpm(0.0),
+      m_RatioPpm(0.0), m_Prerolled(false), m_Stopped(false)
+{
+    m_pOutput->AddRef();
+
+    if( m_pSource != NULL )
+    {
+        m_pSource->AddRef();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CAudioPlayout::~CAudioPlayout()
+{
+    if( m_pSource != NULL )
+    {
+        m_pSource->Release();
+    }
+
+    m_pOutput->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CAudioPlayout::Start()
+{
+    if( m_pOutput->EnableAudioOutput( bmdAudioSampleRate48kHz, m_Type, m_Channels,
+                                      bmdAudioOutputStreamTimestamped ) != S_OK )
+    {
+        return false;
+    }
+
+    // without a free reader the output plays silence
+    if( m_pSource != NULL )
+    {
+        m_Reader = m_pSource->AddReader();
+    }
+
+    m_pOutput->SetAudioCallback(this);
+
+    if( m_pOutput->BeginAudioPreroll() != S_OK )
+    {
+        Stop();
+        return false;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioPlayout::EndPreroll()
+{
+    m_pOutput->EndAudioPreroll();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioPlayout::Stop()
+{
+    m_Stopped.store(true);
+    m_pOutput->SetAudioCallback(NULL);
+    m_pOutput->DisableAudioOutput();
+
+    if( m_Reader >= 0 )
+    {
+        m_pSource->RemoveReader(m_Reader);
+        m_Reader = -1;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioPlayout::GetStats( SAudioPlayoutStats* pStats )
+{
+    pStats->channels = m_Channels;
+    pStats->source = ( m_Reader >= 0 );
+    pStats->scheduled = m_Scheduled.load( std::memory_order_relaxed );
+    pStats->silence = m_Silence.load( std::memory_order_relaxed );
+    pStats->underruns = m_Underruns.load( std::memory_order_relaxed );
+    pStats->skipped = m_Skipped.load( std::memory_order_relaxed );
+    pStats->sourceGaps = m_SourceGaps.load( std::memory_order_relaxed );
+    pStats->buffered = m_Buffered.load( std::memory_order_relaxed );
+    pStats->latency = m_LatencyNow.load( std::memory_order_relaxed );
+    pStats->driftPpm = m_DriftPpm.load( std::memory_order_relaxed );
+    pStats->ratioPpm = m_RatioPpm.load( std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Moves the blocks the ring has for us into the resampler.
+void CAudioPlayout::Pull()
+{
+    CAudioRing::SBlock block;
+
+    while( m_Reader >= 0 && m_pSource->Peek( m_Reader, &block ) )
+    {
+        const long taken = m_Resampler.Write( block.pPlane, block.channels, m_pSource->Format(), block.frames );
+
+        Increment( m_SourceGaps, block.dropped );
+        Increment( m_Skipped, (uint64_t)( block.frames - taken ) );
+
+        m_Appended += (uint64_t)taken;
+        m_ArrivalNs = block.arrivalNs;
+
+        const BMDTimeValue end = block.packetTime + block.frames;
+        const double delay = (double)block.arrivalNs - (double)end * kNsPerFrame;
+
+        // a source which starts over has nothing to do with the last window
+        if( end < m_LastSourceEnd )
+        {
+            m_WindowNs = 0;
+            m_LastValid = false;
+        }
+        else if( m_WindowNs != 0 && delay < m_Window.source )
+        {
+            m_Window.source = delay;
+            m_Window.sourceNs = block.arrivalNs;
+        }
+
+        m_LastSourceEnd = end;
+
+        m_pSource->Advance(m_Reader);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A delay is a host time less the position of a clock at that time, in ns: it falls by the clock's deviation from
+// 48 kHz per ns, so the drift between source and output is the difference of how fast the two delays fall.
+void CAudioPlayout::MeasureDrift()
+{
+    BMDTimeValue hardware, timeInFrame, ticksPerFrame;
+
+    if( m_pOutput->GetHardwareReferenceClock( bmdAudioSampleRate48kHz, &hardware, &timeInFrame,
+                                              &ticksPerFrame ) != S_OK )
+    {
+        return;
+    }
+
+    const uint64_t now = MonotonicNs();
+    const double delay = (double)now - (double)hardware * kNsPerFrame;
+
+    if( m_WindowNs == 0 )
+    {
+        m_WindowNs = now;
+        m_Window.source = DBL_MAX;
+        m_Window.sourceNs = 0;
+        m_Window.output = DBL_MAX;
+    }
+
+    if( delay < m_Window.output )
+    {
+        m_Window.output = delay;
+        m_Window.outputNs = now;
+    }
+
+    if( now - m_WindowNs < (uint64_t)kWindowMs * 1000000 || m_Window.sourceNs == 0 )
+    {
+        return;
+    }
+
+    if( m_LastValid )
+    {
+        const double source = ( m_Window.source - m_Last.source ) / (double)( m_Window.sourceNs - m_Last.sourceNs );
+        const double output = ( m_Window.output - m_Last.output ) / (double)( m_Window.outputNs - m_Last.outputNs );
+        const double drift = output - source;
+
+        // a thousandth is no drift between clocks but a source which is not real time
+        if( fabs(drift) < 1e-3 )
+        {
+            m_Drift = m_DriftValid ? m_Drift + ( drift - m_Drift ) / 4.0 : drift;
+            m_DriftValid = true;
+            m_DriftPpm.store( m_Drift * 1e6, std::memory_order_relaxed );
+        }
+    }
+
+    m_Last = m_Window;
+    m_LastValid = true;
+    m_WindowNs = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// frames output sample frames into m_Mixed, silence where the source has none. The latency is that of the source
+// sample arriving now: the source's position extrapolated from the last block's arrival, less the position of the
+// sample the output plays now, buffered output sample frames before the resampler's.
+long CAudioPlayout::Render( long frames, uint32_t buffered, uint64_t hostNs )
+{
+    long produced = 0;
+
+    if( m_Reader >= 0 && m_Appended != 0 )
+    {
+        const uint64_t sinceArrival = std::min<uint64_t>( hostNs - std::min( hostNs, m_ArrivalNs ), 100000000 );
+        const double source = (double)m_Appended + (double)sinceArrival * bmdAudioSampleRate48kHz / 1e9;
+        const double playing = (double)m_Resampler.Position() / 4294967296.0 - m_Ratio * buffered;
+        double latency = source - playing;
+
+        if( !m_Primed && latency >= m_Latency )
+        {
+            m_Primed = true;
+        }
+
+        if( m_Primed )
+        {
+            // a quarter of a second late is beyond correcting by resampling
+            if( latency - m_Latency > bmdAudioSampleRate48kHz / 4 )
+            {
+                const long skipped = m_Resampler.Skip( (long)( latency - m_Latency ) );
+
+                Increment( m_Skipped, (uint64_t)skipped );
+                latency -= skipped;
+            }
+
+            const double correction = std::min( std::max( ( latency - m_Latency ) /
+                                                          ( bmdAudioSampleRate48kHz * kSettleSeconds ),
+                                                          -kMaxCorrection ), kMaxCorrection );
+
+            m_Ratio = ( 1.0 + ( m_DriftValid ? m_Drift : 0.0 ) ) * ( 1.0 + correction );
+            produced = m_Resampler.Read( m_Mixed.data(), frames, (uint64_t)llround( m_Ratio * 4294967296.0 ) );
+
+            if( produced < frames )
+            {
+                Increment(m_Underruns);
+                m_Primed = false;
+            }
+        }
+
+        m_LatencyNow.store( (long)latency, std::memory_order_relaxed );
+        m_RatioPpm.store( ( m_Ratio - 1.0 ) * 1e6, std::memory_order_relaxed );
+    }
+
+    std::fill( m_Mixed.begin() + (size_t)produced * m_Channels, m_Mixed.begin() + (size_t)frames * m_Channels, 0.0f );
+    Increment( m_Silence, (uint64_t)( frames - produced ) );
+    return frames;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioPlayout::Schedule( long frames )
+{
+    uint32_t written = 0;
+
+    FloatToSamples( m_Mixed.data(), (size_t)frames * m_Channels, m_Type, m_Samples.data() );
+
+    if( m_pOutput->ScheduleAudioSamples( m_Samples.data(), (uint32_t)frames, m_StreamTime, bmdAudioSampleRate48kHz,
+                                         &written ) != S_OK )
+    {
+        written = 0;
+    }
+
+    m_StreamTime += written;
+    Increment( m_Scheduled, written );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// On the driver's thread, which must not wait: no locks, no allocation, nothing but the driver's own calls.
+HRESULT STDMETHODCALLTYPE CAudioPlayout::RenderAudioSamples( bool preroll )
+{
+    uint32_t buffered = 0;
+
+    if( m_Stopped.load() || m_pOutput->GetBufferedAudioSampleFrameCount(&buffered) != S_OK )
+    {
+        return S_OK;
+    }
+
+    const uint64_t hostNs = MonotonicNs();
+
+    // once the output has run dry, scheduling from where it stopped would only schedule into the past
+    BMDTimeValue streamTime;
+    double speed;
+
+    if( !preroll && buffered == 0 &&
+        m_pOutput->GetScheduledStreamTime( bmdAudioSampleRate48kHz, &streamTime, &speed ) == S_OK &&
+        streamTime > m_StreamTime )
+    {
+        m_StreamTime = streamTime;
+    }
+
+    Pull();
+    MeasureDrift();
+
+    const long frames = m_Target - (long)buffered;
+
+    if( frames > 0 )
+    {
+        Schedule( Render( frames, buffered, hostNs ) );
+    }
+
+    m_Buffered.store( buffered, std::memory_order_relaxed );
+
+    if( preroll && frames <= 0 )
+    {
+        m_Prerolled.store(true);
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CAudioPlayout::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkAudioOutputCallback ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkAudioOutputCallback*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CAudioPlayout::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CAudioPlayout::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
@@ -0,0 +1,143 @@
+#ifndef AUDIO_PLAYOUT_H
+#define AUDIO_PLAYOUT_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "AudioRing.h"
+#include "DeckLinkPlatform.h"
+#include "PolyphaseResampler.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SAudioPlayoutStats
+{
+    unsigned   channels;
+    bool       source;            // playing a ring; silence otherwise
+    uint64_t   scheduled;         // sample frames
+    uint64_t   silence;           // ... of which silence for want of source samples
+    uint64_t   underruns;         // times the source ran dry, after which it is buffered up to the latency again
+    uint64_t   skipped;           // source sample frames dropped to catch up with the latency
+    uint64_t   sourceGaps;        // packets the source ring dropped before this reader got them
+    uint32_t   buffered;          // by the output, as last seen
+    long       latency;           // sample frames from the arrival of a source sample to its output
+    double     driftPpm;          // of the source's clock against the output's, as measured
+    double     ratioPpm;          // resampling ratio applied, less 1
+};
+
+//=====================================================================================================================
+// Timestamped audio playout on one output, from a CAudioRing clocked by another device (or by nothing at all).
+//
+// The driver's RenderAudioSamples() callback does all the work, without ever blocking: it takes the blocks the ring
+// has for its reader, tops GetBufferedAudioSampleFrameCount() up to the target with ScheduleAudioSamples(), stream
+// time continuing where the last samples ended, and goes back to the driver.
+//
+// The source's clock and the output's never run at exactly the same rate, so the samples are resampled by their
+// ratio. Both are measured against the host's steady clock, which cancels out: the source's from the packet times and
+// arrival times of the ring's blocks, the output's from GetHardwareReferenceClock(). Each is read late by whatever
+// the scheduler did in between, so only the least delay in windows of a few seconds counts, and the drift is how the
+// two least delays move from one window to the next. On top of that a small correction, at most kMaxCorrection, steers the latency from the arrival
+// of a source sample to its output towards the configured latency; the latency is computed from the continuous
+// positions of both clocks rather than from the bursty levels of the buffers, so that the correction stays smooth.
+// A source too far ahead is skipped, one which runs dry is filled with silence and buffered up again.
+class CAudioPlayout : public IDeckLinkAudioOutputCallback
+{
+public:
+    enum { kWindowMs = 4000 };
+    static const double kMaxCorrection;       // 500 ppm
+    static const double kSettleSeconds;       // to take out a latency error, unless that exceeds kMaxCorrection
+
+private:
+    std::atomic<ULONG>      m_RefCount;
+    IDeckLinkOutput*        m_pOutput;        // AddRef'ed
+    unsigned                m_Channels;
+    BMDAudioSampleType      m_Type;
+    long                    m_Target;         // sample frames the output keeps buffered
+    long                    m_Latency;
+    CAudioRing*             m_pSource;        // AddRef'ed, NULL = silence
+    int                     m_Reader;
+
+    // owned by the callback
+    CPolyphaseResampler     m_Resampler;
+    std::vector<float>      m_Mixed;
+    std::vector<int32_t>    m_Samples;        // interleaved, as scheduled; 16-bit ones packed in the first half
+    BMDTimeValue            m_StreamTime;     // of the next sample frame scheduled, 48 kHz
+    uint64_t                m_Appended;       // source sample frames appended to the resampler since its Reset()
+    uint64_t                m_ArrivalNs;      // of the last block appended
+    bool                    m_Primed;         // the resampler holds the latency's worth of source samples
+    double                  m_Ratio;
+    bool                    m_DriftValid;
+    double                  m_Drift;
+
+    // drift windows: the least delays of the source's blocks and of the output's clock against the host's clock,
+    // and when they were seen; this window's and the last one's
+    struct SDelay
+    {
+        double              source;
+        uint64_t            sourceNs;
+        double              output;
+        uint64_t            outputNs;
+    };
+
+    uint64_t                m_WindowNs;       // when this window opened, 0 = none open
+    SDelay                  m_Window;
+    bool                    m_LastValid;
+    SDelay                  m_Last;
+    BMDTimeValue            m_LastSourceEnd;  // of the last block appended
+
+    // written by the callback only
+    std::atomic<uint64_t>   m_Scheduled;
+    std::atomic<uint64_t>   m_Silence;
+    std::atomic<uint64_t>   m_Underruns;
+    std::atomic<uint64_t>   m_Skipped;
+    std::atomic<uint64_t>   m_SourceGaps;
+    std::atomic<uint32_t>   m_Buffered;
+    std::atomic<long>       m_LatencyNow;
+    std::atomic<double>     m_DriftPpm;
+    std::atomic<double>     m_RatioPpm;
+    std::atomic<bool>       m_Prerolled;
+    std::atomic<bool>       m_Stopped;
+
+    CAudioPlayout( const CAudioPlayout& );
+    CAudioPlayout& operator=( const CAudioPlayout& );
+
+    virtual ~CAudioPlayout();
+
+    void Pull();
+    void MeasureDrift();
+    long Render( long frames, uint32_t buffered, uint64_t hostNs );
+    void Schedule( long frames );
+
+    static void Increment( std::atomic<uint64_t>& counter, uint64_t n = 1 )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+    }
+
+public:
+    // target: sample frames to keep buffered by the output, more than its callbacks are apart. latency: from the
+    // arrival of a source sample to its output, at least target plus a source packet. pSource may be NULL.
+    CAudioPlayout( IDeckLinkOutput* pOutput, unsigned channels, BMDAudioSampleType type, long target, long latency,
+                   CAudioRing* pSource );
+
+    // Enables audio output and begins the preroll; false if the output cannot do the format. Once Prerolled(), end
+    // the preroll and start scheduled playback.
+    bool Start();
+    bool Prerolled() const  { return m_Prerolled.load(); }
+    void EndPreroll();
+
+    // With scheduled playback stopped; disables audio output.
+    void Stop();
+
+    void GetStats( SAudioPlayoutStats* pStats );
+
+    // overrides IDeckLinkAudioOutputCallback
+    virtual HRESULT STDMETHODCALLTYPE RenderAudioSamples( bool preroll );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+#endif // AUDIO_PLAYOUT_H
@@ -0,0 +1,444 @@
+#include <string.h>
+#include <algorithm>
+
+#include "AudioRing.h"
+#include "Clock.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AUDIO_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define AUDIO_TARGET(isa)
+#else
+#define AUDIO_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+static const float kScale16 = 1.0f / 32768.0f;
+static const float kScale32 = 1.0f / 2147483648.0f;
+
+//=====================================================================================================================
+// Channels [firstChannel, lastChannel) of frames [firstFrame, frames).
+static void DeinterleaveC( const void* pSrc, BMDAudioSampleType type, unsigned channels, unsigned firstChannel,
+                           unsigned lastChannel, long firstFrame, long frames, EAudioFormat format, void* const* ppDst )
+{
+    for( unsigned c = firstChannel; c < lastChannel; ++c )
+    {
+        if( type == bmdAudioSampleType16bitInteger )
+        {
+            const int16_t* p = (const int16_t*)pSrc + c;
+
+            for( long f = firstFrame; f < frames; ++f )
+            {
+                if( format == kAudioInt32 )
+                {
+                    ( (int32_t*)ppDst[c] )[f] = (int32_t)( (uint32_t)(int32_t)p[f * channels] << 16 );
+                }
+                else
+                {
+                    ( (float*)ppDst[c] )[f] = (float)p[f * channels] * kScale16;
+                }
+            }
+        }
+        else
+        {
+            const int32_t* p = (const int32_t*)pSrc + c;
+
+            for( long f = firstFrame; f < frames; ++f )
+            {
+                if( format == kAudioInt32 )
+                {
+                    ( (int32_t*)ppDst[c] )[f] = p[f * channels];
+                }
+                else
+                {
+                    ( (float*)ppDst[c] )[f] = (float)p[f * channels] * kScale32;
+                }
+            }
+        }
+    }
+}
+
+#ifdef AUDIO_X86
+//=====================================================================================================================
+// 8 samples, sign-extended to 32 bits, of one channel; kShift brings them to full scale.
+template< EAudioFormat kFormat, int kShift >
+AUDIO_TARGET("avx2")
+static inline void Store8( void* pDst, __m256i v )
+{
+    if( kFormat == kAudioInt32 )
+    {
+        _mm256_storeu_si256( (__m256i*)pDst, kShift ? _mm256_slli_epi32( v, kShift ) : v );
+    }
+    else
+    {
+        _mm256_storeu_ps( (float*)pDst, _mm256_mul_ps( _mm256_cvtepi32_ps(v),
+                                                       _mm256_set1_ps( kShift ? kScale16 : kScale32 ) ) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Frames [0, frames) of channels [0, simdChannels): stereo, or groups of 8 channels; frames a multiple of 8.
+template< EAudioFormat kFormat >
+AUDIO_TARGET("avx2")
+static void Deinterleave16Avx2( const void* pSrc, unsigned channels, unsigned simdChannels, long frames,
+                                void* const* ppDst )
+{
+    const int16_t* pIn = (const int16_t*)pSrc;
+
+    if( channels == 2 )
+    {
+        // each 32-bit lane holds left in the low half, right in the high half
+        for( long f = 0; f < frames; f += 8 )
+        {
+            const __m256i x = _mm256_loadu_si256( (const __m256i*)( pIn + f * 2 ) );
+
+            Store8<kFormat, 16>( (uint32_t*)ppDst[0] + f, _mm256_srai_epi32( _mm256_slli_epi32( x, 16 ), 16 ) );
+            Store8<kFormat, 16>( (uint32_t*)ppDst[1] + f, _mm256_srai_epi32( x, 16 ) );
+        }
+
+        return;
+    }
+
+    for( unsigned k = 0; k < simdChannels; k += 8 )
+    {
+        for( long f = 0; f < frames; f += 8 )
+        {
+            // rows: frames, columns: channels k .. k + 7
+            const int16_t* p = pIn + f * channels + k;
+            __m128i r[8], t[8], u[8];
+
+            for( int i = 0; i < 8; ++i )
+            {
+                r[i] = _mm_loadu_si128( (const __m128i*)( p + i * channels ) );
+            }
+
+            for( int i = 0; i < 8; i += 2 )
+            {
+                t[i] = _mm_unpacklo_epi16( r[i], r[i + 1] );
+                t[i + 1] = _mm_unpackhi_epi16( r[i], r[i + 1] );
+            }
+
+            for( int i = 0; i < 8; i += 4 )
+            {
+                u[i] = _mm_unpacklo_epi32( t[i], t[i + 2] );
+                u[i + 1] = _mm_unpackhi_epi32( t[i], t[i + 2] );
+                u[i + 2] = _mm_unpacklo_epi32( t[i + 1], t[i + 3] );
+                u[i + 3] = _mm_unpackhi_epi32( t[i + 1], t[i + 3] );
+            }
+
+            // u[j] holds channels 2j and 2j + 1 of frames 0..3, u[j + 4] of frames 4..7
+            for( int j = 0; j < 4; ++j )
+            {
+                const __m128i even = _mm_unpacklo_epi64( u[j], u[j + 4] );
+                const __m128i odd = _mm_unpackhi_epi64( u[j], u[j + 4] );
+
+                Store8<kFormat, 16>( (uint32_t*)ppDst[k + 2 * j] + f, _mm256_cvtepi16_epi32(even) );
+                Store8<kFormat, 16>( (uint32_t*)ppDst[k + 2 * j + 1] + f, _mm256_cvtepi16_epi32(odd) );
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template< EAudioFormat kFormat >
+AUDIO_TARGET("avx2")
+static void Deinterleave32Avx2( const void* pSrc, unsigned channels, unsigned simdChannels, long frames,
+                                void* const* ppDst )
+{
+    const int32_t* pIn = (const int32_t*)pSrc;
+
+    if( channels == 2 )
+    {
+        for( long f = 0; f < frames; f += 8 )
+        {
+            const __m256 a = _mm256_castsi256_ps( _mm256_loadu_si256( (const __m256i*)( pIn + f * 2 ) ) );
+            const __m256 b = _mm256_castsi256_ps( _mm256_loadu_si256( (const __m256i*)( pIn + f * 2 + 8 ) ) );
+
+            // L0 L1 L4 L5 | L2 L3 L6 L7 within the lanes, put in order by the permute
+            const __m256i left = _mm256_castps_si256( _mm256_shuffle_ps( a, b, 0x88 ) );
+            const __m256i right = _mm256_castps_si256( _mm256_shuffle_ps( a, b, 0xDD ) );
+
+            Store8<kFormat, 0>( (uint32_t*)ppDst[0] + f, _mm256_permute4x64_epi64( left, 0xD8 ) );
+            Store8<kFormat, 0>( (uint32_t*)ppDst[1] + f, _mm256_permute4x64_epi64( right, 0xD8 ) );
+        }
+
+        return;
+    }
+
+    for( unsigned k = 0; k < simdChannels; k += 8 )
+    {
+        for( long f = 0; f < frames; f += 8 )
+        {
+            const int32_t* p = pIn + f * channels + k;
+            __m256i r[8], t[8], u[8];
+
+            for( int i = 0; i < 8; ++i )
+            {
+                r[i] = _mm256_loadu_si256( (const __m256i*)( p + i * channels ) );
+            }
+
+            for( int i = 0; i < 8; i += 2 )
+            {
+                t[i] = _mm256_unpacklo_epi32( r[i], r[i + 1] );
+                t[i + 1] = _mm256_unpackhi_epi32( r[i], r[i + 1] );
+            }
+
+            for( int i = 0; i < 8; i += 4 )
+            {
+                u[i] = _mm256_unpacklo_epi64( t[i], t[i + 2] );
+                u[i + 1] = _mm256_unpackhi_epi64( t[i], t[i + 2] );
+                u[i + 2] = _mm256_unpacklo_epi64( t[i + 1], t[i + 3] );
+                u[i + 3] = _mm256_unpackhi_epi64( t[i + 1], t[i + 3] );
+            }
+
+            // u[j] holds channel j of frames 0..3 in its low lane and channel j + 4 in its high lane
+            for( int j = 0; j < 4; ++j )
+            {
+                Store8<kFormat, 0>( (uint32_t*)ppDst[k + j] + f, _mm256_permute2x128_si256( u[j], u[j + 4], 0x20 ) );
+                Store8<kFormat, 0>( (uint32_t*)ppDst[k + j + 4] + f,
+                                    _mm256_permute2x128_si256( u[j], u[j + 4], 0x31 ) );
+            }
+        }
+    }
+}
+#endif // AUDIO_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+void DeinterleaveAudio( const void* pSrc, BMDAudioSampleType type, unsigned channels, long frames, EAudioFormat format,
+                        void* const* ppDst, ECpuIsa isa )
+{
+    unsigned simdChannels = 0;
+    long simdFrames = 0;
+
+#ifdef AUDIO_X86
+    if( isa >= kIsaAvx2 && HasAvx2() )
+    {
+        void (*pKernel)( const void*, unsigned, unsigned, long, void* const* );
+
+        if( type == bmdAudioSampleType16bitInteger )
+        {
+            pKernel = ( format == kAudioInt32 ) ? Deinterleave16Avx2<kAudioInt32> : Deinterleave16Avx2<kAudioFloat32>;
+        }
+        else
+        {
+            pKernel = ( format == kAudioInt32 ) ? Deinterleave32Avx2<kAudioInt32> : Deinterleave32Avx2<kAudioFloat32>;
+        }
+
+        simdChannels = ( channels == 2 ) ? 2 : channels / 8 * 8;
+        simdFrames = frames / 8 * 8;
+
+        if( simdChannels != 0 && simdFrames != 0 )
+        {
+            pKernel( pSrc, channels, simdChannels, simdFrames, ppDst );
+        }
+    }
+#endif
+
+    DeinterleaveC( pSrc, type, channels, 0, simdChannels, simdFrames, frames, format, ppDst );
+    DeinterleaveC( pSrc, type, channels, simdChannels, channels, 0, frames, format, ppDst );
+}
+
+//=====================================================================================================================
+CAudioRing::CAudioRing( unsigned channels, EAudioFormat format, long capacity, ECpuIsa isa )
+    : m_RefCount(1), m_Channels( std::min( channels, (unsigned)kMaxChannels ) ), m_Format(format), m_Isa(isa),
+      m_Capacity( ( capacity + 15 ) / 16 * 16 ), m_WritePos(0), m_Dropped(0), m_Written(0), m_Packets(0),
+      m_Frames(0), m_Overruns(0)
+{
+    // planes start on cache lines as far as the allocation does
+    m_Samples.resize( (size_t)m_Channels * m_Capacity );
+    memset( m_Blocks, 0, sizeof(m_Blocks) );
+
+    for( int i = 0; i < kMaxReaders; ++i )
+    {
+        m_Readers[i].store(kNoReader);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CAudioRing::~CAudioRing()
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CAudioRing::Write( const void* pSrc, BMDAudioSampleType type, unsigned channels, long frames,
+                        BMDTimeValue packetTime, uint64_t arrivalNs )
+{
+    if( channels != m_Channels || frames <= 0 || frames > m_Capacity / 2 ||
+        ( type != bmdAudioSampleType16bitInteger && type != bmdAudioSampleType32bitInteger ) )
+    {
+        ++m_Dropped;
+        Increment(m_Overruns);
+        return false;
+    }
+
+    const uint64_t written = m_Written.load( std::memory_order_relaxed );
+    uint64_t slowest = written;
+
+    for( int i = 0; i < kMaxReaders; ++i )
+    {
+        slowest = std::min( slowest, m_Readers[i].load() );
+    }
+
+    // a block never wraps: it starts over at the beginning of the planes if it would
+    long offset = (long)( m_WritePos % m_Capacity );
+    const long pad = ( offset + frames > m_Capacity ) ? m_Capacity - offset : 0;
+    const uint64_t oldest = ( slowest < written ) ? m_Blocks[ slowest % kMaxBlocks ].start : m_WritePos;
+
+    if( written - slowest >= kMaxBlocks || m_WritePos + pad + frames - oldest > (uint64_t)m_Capacity )
+    {
+        ++m_Dropped;
+        Increment(m_Overruns);
+        return false;
+    }
+
+    offset = ( pad != 0 ) ? 0 : offset;
+
+    void* pPlanes[kMaxChannels];
+
+    for( unsigned c = 0; c < m_Channels; ++c )
+    {
+        pPlanes[c] = &m_Samples[ (size_t)c * m_Capacity + offset ];
+    }
+
+    DeinterleaveAudio( pSrc, type, channels, frames, m_Format, pPlanes, m_Isa );
+
+    SBlockDesc& block = m_Blocks[ written % kMaxBlocks ];
+
+    block.start = m_WritePos + pad;
+    block.frames = frames;
+    block.packetTime = packetTime;
+    block.arrivalNs = arrivalNs;
+    block.dropped = m_Dropped;
+
+    m_WritePos = block.start + frames;
+    m_Dropped = 0;
+    m_Written.store( written + 1, std::memory_order_release );
+
+    Increment(m_Packets);
+    m_Frames.store( m_Frames.load( std::memory_order_relaxed ) + frames, std::memory_order_relaxed );
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CAudioRing::Write( IDeckLinkAudioInputPacket* pPacket, BMDAudioSampleType type )
+{
+    const uint64_t arrivalNs = MonotonicNs();
+    void* pBytes = NULL;
+    BMDTimeValue packetTime = 0;
+
+    if( pPacket->GetBytes(&pBytes) != S_OK || pBytes == NULL )
+    {
+        ++m_Dropped;
+        Increment(m_Overruns);
+        return false;
+    }
+
+    pPacket->GetPacketTime( &packetTime, bmdAudioSampleRate48kHz );
+    return Write( pBytes, type, m_Channels, pPacket->GetSampleFrameCount(), packetTime, arrivalNs );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The packet being written meanwhile may not take the new reader into account; it becomes the reader's first block
+// or an earlier one, so its space is not the reader's concern.
+int CAudioRing::AddReader()
+{
+    for( int i = 0; i < kMaxReaders; ++i )
+    {
+        uint64_t unused = kNoReader;
+
+        if( m_Readers[i].compare_exchange_strong( unused, m_Written.load() ) )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioRing::RemoveReader( int reader )
+{
+    if( reader >= 0 && reader < kMaxReaders )
+    {
+        m_Readers[reader].store(kNoReader);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CAudioRing::Peek( int reader, SBlock* pBlock )
+{
+    const uint64_t next = m_Readers[reader].load( std::memory_order_relaxed );
+
+    if( next == m_Written.load( std::memory_order_acquire ) )
+    {
+        return false;
+    }
+
+    const SBlockDesc& block = m_Blocks[ next % kMaxBlocks ];
+    const long offset = (long)( block.start % m_Capacity );
+
+    for( unsigned c = 0; c < m_Channels; ++c )
+    {
+        pBlock->pPlane[c] = &m_Samples[ (size_t)c * m_Capacity + offset ];
+    }
+
+    pBlock->channels = m_Channels;
+    pBlock->frames = block.frames;
+    pBlock->packetTime = block.packetTime;
+    pBlock->arrivalNs = block.arrivalNs;
+    pBlock->dropped = block.dropped;
+    pBlock->sequence = next;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioRing::Advance( int reader )
+{
+    const uint64_t next = m_Readers[reader].load( std::memory_order_relaxed );
+
+    if( next != m_Written.load( std::memory_order_acquire ) )
+    {
+        m_Readers[reader].store( next + 1, std::memory_order_release );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CAudioRing::GetStats( SStats* pStats )
+{
+    pStats->channels = m_Channels;
+    pStats->format = m_Format;
+    pStats->capacity = m_Capacity;
+    pStats->packets = m_Packets.load( std::memory_order_relaxed );
+    pStats->frames = m_Frames.load( std::memory_order_relaxed );
+    pStats->overruns = m_Overruns.load( std::memory_order_relaxed );
+    pStats->readers = 0;
+
+    for( int i = 0; i < kMaxReaders; ++i )
+    {
+        if( m_Readers[i].load( std::memory_order_relaxed ) != kNoReader )
+        {
+            ++pStats->readers;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG CAudioRing::AddRef()
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG CAudioRing::Release()
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
@@ -0,0 +1,137 @@
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "DeckLinkPlatform.h"
+
+//=====================================================================================================================
+// Planar audio, as loudness meters and encoders take it, from the interleaved packets of IDeckLinkAudioInputPacket.
+//
+// Deinterleaving is a transpose of 8 x 8 samples at a time in AVX2 registers for every group of 8 channels, and a
+// pair of shifts for stereo; other channel counts and the last few frames go through plain C, which gives identical
+// results. The kernels are chosen at run time with CpuFeatures.h.
+enum EAudioFormat
+{
+    kAudioFloat32,            // -1.0 .. 1.0, as the sample divided by 2^15 or 2^31
+    kAudioInt32,              // left-justified: 16-bit samples shifted up by 16 bits
+};
+
+// frames sample frames of channels interleaved samples of type into channels planes of format. isa: the highest
+// kernels to use, kIsaCount = the best the CPU has.
+void DeinterleaveAudio( const void* pSrc, BMDAudioSampleType type, unsigned channels, long frames, EAudioFormat format,
+                        void* const* ppDst, ECpuIsa isa = kIsaCount );
+
+//=====================================================================================================================
+// The audio of one device, deinterleaved once by the capture callback and read by any number of consumers.
+//
+// One writer and up to kMaxReaders readers, none of which ever waits or takes a lock. Each packet becomes a block:
+// the same number of contiguous samples in every channel's plane, never wrapping around the end of the ring, with the
+// packet's time. Readers see the blocks in order and in place, with no copy; each has its own position, published
+// when it is done with a block. A packet which does not fit because the slowest reader is too far behind is dropped,
+// counted, and reported on the next block, so that a slow consumer never delays the driver.
+class CAudioRing
+{
+public:
+    enum { kMaxChannels = 64 };
+    enum { kMaxReaders = 8 };
+    enum { kMaxBlocks = 256 };        // packets the ring holds at most, whatever their size
+
+    struct SBlock
+    {
+        const void*   pPlane[kMaxChannels];   // frames samples each in the ring's format; valid until Advance()
+        unsigned      channels;
+        long          frames;
+        BMDTimeValue  packetTime;             // GetPacketTime() in sample frames, i.e. with a time scale of 48000
+        uint64_t      arrivalNs;              // steady clock when it was written, to relate the source's clock to others
+        uint64_t      dropped;                // packets lost to overruns just before this one
+        uint64_t      sequence;               // blocks written before this one
+    };
+
+    struct SStats
+    {
+        unsigned      channels;
+        EAudioFormat  format;
+        long          capacity;               // sample frames per channel
+        uint64_t      packets;                // written
+        uint64_t      frames;                 // ... sample frames of them
+        uint64_t      overruns;               // packets dropped
+        unsigned      readers;
+    };
+
+private:
+    struct SBlockDesc
+    {
+        uint64_t      start;                  // of the samples, in sample frames written to the ring, padding included
+        long          frames;
+        BMDTimeValue  packetTime;
+        uint64_t      arrivalNs;
+        uint64_t      dropped;
+    };
+
+    static const uint64_t kNoReader = ~(uint64_t)0;
+
+    std::atomic<ULONG>     m_RefCount;
+    unsigned               m_Channels;
+    EAudioFormat           m_Format;
+    ECpuIsa                m_Isa;
+    long                   m_Capacity;
+    std::vector<uint32_t>  m_Samples;                 // m_Channels planes of m_Capacity samples
+    SBlockDesc             m_Blocks[kMaxBlocks];
+
+    // writer only
+    uint64_t               m_WritePos;
+    uint64_t               m_Dropped;                 // since the last block written
+    char                   m_Pad0[64];
+
+    std::atomic<uint64_t>  m_Written;                 // blocks
+    std::atomic<uint64_t>  m_Packets;
+    std::atomic<uint64_t>  m_Frames;
+    std::atomic<uint64_t>  m_Overruns;
+    char                   m_Pad1[64];
+
+    std::atomic<uint64_t>  m_Readers[kMaxReaders];    // next block of each reader, kNoReader = slot free
+
+    CAudioRing( const CAudioRing& );
+    CAudioRing& operator=( const CAudioRing& );
+
+    ~CAudioRing();
+
+    static void Increment( std::atomic<uint64_t>& counter )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+
+public:
+    // capacity: sample frames per channel, at least two of the largest packets. isa: as for DeinterleaveAudio().
+    CAudioRing( unsigned channels, EAudioFormat format, long capacity, ECpuIsa isa = kIsaCount );
+
+    unsigned Channels() const  { return m_Channels; }
+    EAudioFormat Format() const  { return m_Format; }
+
+    // Writer. false if the packet was dropped: an overrun, or the wrong channel count or size. arrivalNs: when the
+    // packet arrived, on the clock of std::chrono::steady_clock; the second form stamps it with the time of the call.
+    bool Write( const void* pSrc, BMDAudioSampleType type, unsigned channels, long frames, BMDTimeValue packetTime,
+                uint64_t arrivalNs );
+    bool Write( IDeckLinkAudioInputPacket* pPacket, BMDAudioSampleType type );
+
+    // A reader starts with the next block written; -1 if kMaxReaders are attached. Each reader is used by one
+    // thread at a time.
+    int AddReader();
+    void RemoveReader( int reader );
+
+    // The reader's next block, false if there is none yet; the block stays valid, and the next Peek() returns it
+    // again, until Advance().
+    bool Peek( int reader, SBlock* pBlock );
+    void Advance( int reader );
+
+    void GetStats( SStats* pStats );
+
+    ULONG AddRef();
+    ULONG Release();
+};
+
+#endif // AUDIO_RING_H
@@ -0,0 +1,873 @@
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include "CaptureEngine.h"
+#include "DisplayModes.h"
+#include "SpscQueue.h"
+
+//=====================================================================================================================
+// A frame of a channel's conversion ring: a buffer of the channel's allocator, with the geometry of the converted
+// frame; the flags, timecodes and ancillary data are those of the captured frame it was converted from. Lives as long
+// as the channel.
+class CConvertedFrame : public IDeckLinkVideoFrame
+{
+    IDeckLinkVideoInputFrame*  m_pSource;
+    void*                      m_pBytes;
+    long                       m_RowBytes;
+    BMDPixelFormat             m_Format;
+
+public:
+    CConvertedFrame() : m_pSource(NULL), m_pBytes(NULL), m_RowBytes(0), m_Format(bmdFormat10BitYUV)  {}
+    virtual ~CConvertedFrame()  {}
+
+    // pSource is not AddRef'ed: the channel holds it for as long as this frame is in use.
+    void Attach( IDeckLinkVideoInputFrame* pSource, void* pBytes, long rowBytes, BMDPixelFormat format )
+    {
+        m_pSource = pSource;
+        m_pBytes = pBytes;
+        m_RowBytes = rowBytes;
+        m_Format = format;
+    }
+
+    void* Bytes() const  { return m_pBytes; }
+
+    // overrides IDeckLinkVideoFrame
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return m_pSource->GetWidth(); }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return m_pSource->GetHeight(); }
+    virtual long STDMETHODCALLTYPE GetRowBytes(void)  { return m_RowBytes; }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return m_Format; }
+    virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void)  { return m_pSource->GetFlags(); }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer )  { *buffer = m_pBytes; return S_OK; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode )
+    {
+        return m_pSource->GetTimecode( format, timecode );
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary )
+    {
+        return m_pSource->GetAncillaryData(ancillary);
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// What the callback hands to the consumer thread; pConverted NULL if the frame is not converted.
+struct SCapturedFrame
+{
+    IDeckLinkVideoInputFrame*  pFrame;         // AddRef'ed
+    CConvertedFrame*           pConverted;
+    CFrameAllocator*           pAllocator;     // of pConverted, which may belong to the plan of an earlier mode
+    CConversionFuture          converted;
+};
+
+//=====================================================================================================================
+// Capture from one device: the driver's callback is the producer of the queue, m_Thread its consumer.
+class CCaptureChannel : public IDeckLinkInputCallback
+{
+    std::atomic<ULONG>                      m_RefCount;
+    SDeviceInfo                             m_Info;         // m_Info.pDev AddRef'ed
+    ICaptureConsumer*                       m_pConsumer;
+    bool                                    m_FramePool;    // false = the driver's buffers
+    CConversionScheduler*                   m_pScheduler;   // NULL = no conversion
+    BMDPixelFormat                          m_ConvertFormat;
+    BMDDisplayMode                          m_WarmModes[CFormatSwitcher::kMaxPlans - 2];
+    CAudioRing*                             m_pAudioRing;   // NULL = no audio
+    BMDAudioSampleType                      m_AudioType;
+    CAncillaryQueue*                        m_pAncillary;   // NULL = no VANC
+    CTimecodeLog*                           m_pTimecodes;   // NULL = no timecode
+    CCaptureRecorder*                       m_pRecorder;    // NULL = no recording
+    IDeckLinkInput*                         m_pInput;
+    std::atomic<BMDPixelFormat>             m_Format;
+    BMDPixelFormat                          m_YuvFormat;    // captured from a YCbCr 4:2:2 signal
+    BMDPixelFormat                          m_RgbFormat;    // ... and from an RGB 4:4:4 one
+    BMDVideoInputFlags                      m_Flags;
+    std::atomic<BMDDisplayMode>             m_Mode;
+
+    CSpscQueue<SCapturedFrame>              m_Queue;
+    CFormatSwitcher                         m_Switcher;     // frame pools and conversion parameters of each format
+    std::vector<CConvertedFrame>            m_Converted;    // one per frame the queue and the consumer can hold
+    size_t                                  m_NextConverted;
+    std::thread                             m_Thread;
+    std::mutex                              m_WakeMutex;
+    std::condition_variable                 m_WakeCond;
+    std::atomic<bool>                       m_Waiting;
+    std::atomic<bool>                       m_Stop;
+
+    // written by the callback only
+    std::atomic<uint64_t>                   m_Arrived;
+    std::atomic<uint64_t>                   m_NoInput;
+    std::atomic<uint64_t>                   m_Dropped;
+    std::atomic<uint64_t>                   m_ConvertFailures;
+    CSyncTracker                            m_Sync;
+
+    // written by the consumer thread only
+    std::atomic<uint64_t>                   m_Consumed;
+
+    CCaptureChannel( const CCaptureChannel& );
+    CCaptureChannel& operator=( const CCaptureChannel& );
+
+    ~CCaptureChannel();
+
+    void ConsumerMain();
+    void Convert( SCapturedFrame* pItem );
+    void ReleaseItem( const SCapturedFrame& item );
+
+    static void Increment( std::atomic<uint64_t>& counter )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+
+public:
+    // pScheduler: NULL, or the scheduler to convert the frames to config.convertFormat on
+    CCaptureChannel( const SDeviceInfo& info, ICaptureConsumer* pConsumer, const SCaptureConfig& config,
+                     CConversionScheduler* pScheduler );
+
+    IDeckLink* Device() const  { return m_Info.pDev; }
+    int64_t PersistentId() const  { return m_Info.persistentId; }
+    CAudioRing* AudioRing() const  { return m_pAudioRing; }
+    CAncillaryQueue* AncillaryQueue() const  { return m_pAncillary; }
+    CTimecodeLog* TimecodeLog() const  { return m_pTimecodes; }
+
+    // Returns false if the input could not be started, the channel is then unusable.
+    bool Start( BMDDisplayMode mode, BMDPixelFormat format );
+    void Stop();
+
+    void GetStats( SCaptureStats* pStats );
+
+    // overrides IDeckLinkInputCallback
+    virtual HRESULT STDMETHODCALLTYPE VideoInputFormatChanged( BMDVideoInputFormatChangedEvents events,
+                                                               IDeckLinkDisplayMode* pMode,
+                                                               BMDDetectedVideoInputFormatFlags detectedFlags );
+    virtual HRESULT STDMETHODCALLTYPE VideoInputFrameArrived( IDeckLinkVideoInputFrame* pFrame,
+                                                              IDeckLinkAudioInputPacket* pAudio );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CCaptureChannel::CCaptureChannel( const SDeviceInfo& info, ICaptureConsumer* pConsumer, const SCaptureConfig& config,
+                                  CConversionScheduler* pScheduler )
+    : m_RefCount(1), m_Info(info), m_pConsumer(pConsumer), m_FramePool(config.framePool), m_pScheduler(pScheduler),
+      m_ConvertFormat(config.convertFormat), m_pAudioRing(NULL), m_AudioType(config.audioSampleType),
+      m_pAncillary(NULL), m_pTimecodes(NULL),
+      m_pRecorder( config.recordDir ? new CCaptureRecorder( config.recordDir, info.persistentId, config.recordDepth,
+                                                            config.timecodeFormat ) : NULL ),
+      m_pInput(NULL), m_Format(bmdFormat10BitYUV), m_YuvFormat(bmdFormat10BitYUV), m_RgbFormat(bmdFormat10BitRGB),
+      m_Flags((BMDVideoInputFlags)bmdVideoInputFlagDefault),
+      m_Mode((BMDDisplayMode)0), m_Queue(config.queueDepth),
+      // the driver keeps a few buffers in flight, the consumer holds one, the queue the rest, the recorder its own;
+      // converted frames are only ever in the queue or with the consumer
+      m_Switcher( config.numaNode,
+                  config.framePool ? (unsigned)m_Queue.Capacity() + 4 + ( m_pRecorder ? m_pRecorder->MaxHeld() : 0 )
+                                   : 0,
+                  pScheduler ? config.convertFormat : 0, (unsigned)m_Queue.Capacity() + 1 ),
+      m_NextConverted(0), m_Waiting(false), m_Stop(false), m_Arrived(0), m_NoInput(0), m_Dropped(0),
+      m_ConvertFailures(0), m_Consumed(0)
+{
+    m_Info.pDev->AddRef();
+    memcpy( m_WarmModes, config.warmModes, sizeof(m_WarmModes) );
+
+    if( m_pScheduler != NULL )
+    {
+        m_Converted.resize( m_Queue.Capacity() + 1 );
+    }
+
+    if( config.audioChannels != 0 )
+    {
+        const long frames = ( config.audioFrames > 0 ) ? config.audioFrames : (long)bmdAudioSampleRate48kHz;
+        m_pAudioRing = new CAudioRing( config.audioChannels, config.audioFormat, frames );
+    }
+
+    if( config.ancillaryPackets != 0 )
+    {
+        m_pAncillary = new CAncillaryQueue( config.ancillaryPackets );
+    }
+
+    if( config.timecodeFormat != 0 )
+    {
+        m_pTimecodes = new CTimecodeLog( config.timecodeFormat, config.timecodeRuns ? config.timecodeRuns : 4096 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CCaptureChannel::~CCaptureChannel()
+{
+    if( m_pAudioRing != NULL )
+    {
+        m_pAudioRing->Release();
+    }
+
+    if( m_pAncillary != NULL )
+    {
+        m_pAncillary->Release();
+    }
+
+    if( m_pTimecodes != NULL )
+    {
+        m_pTimecodes->Release();
+    }
+
+    delete m_pRecorder;
+    m_Info.pDev->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CCaptureChannel::Start( BMDDisplayMode mode, BMDPixelFormat format )
+{
+    if( m_Info.pDev->QueryInterface( IID_IDeckLinkInput, (void**)&m_pInput ) != S_OK )
+    {
+        m_pInput = NULL;
+        return false;
+    }
+
+    IDeckLinkAttributes* pAttr = NULL;
+
+    if( m_Info.pDev->QueryInterface( IID_IDeckLinkAttributes, (void**)&pAttr ) == S_OK )
+    {
+        bool detection = false;
+
+        if( pAttr->GetFlag( BMDDeckLinkSupportsInputFormatDetection, &detection ) == S_OK && detection )
+        {
+            m_Flags = (BMDVideoInputFlags)bmdVideoInputEnableFormatDetection;
+        }
+
+        pAttr->Release();
+    }
+
+    m_Format.store(format);
+    m_Mode.store(mode);
+
+    // a signal of the other kind is captured in the 10-bit format of that kind, as the SDK samples do
+    m_YuvFormat = IsYuvPixelFormat(format) ? format : (BMDPixelFormat)bmdFormat10BitYUV;
+    m_RgbFormat = IsYuvPixelFormat(format) ? (BMDPixelFormat)bmdFormat10BitRGB : format;
+
+    if( m_pTimecodes != NULL )
+    {
+        m_pTimecodes->SetMode(mode);
+    }
+
+    const SFormatPlan* pPlan = m_Switcher.Prepare( mode, format, false );
+
+    // the source can only switch to them with format detection
+    if( m_Flags & bmdVideoInputEnableFormatDetection )
+    {
+        for( int i = 0; i < CFormatSwitcher::kMaxPlans - 2; ++i )
+        {
+            if( m_WarmModes[i] != 0 && m_WarmModes[i] != mode )
+            {
+                m_Switcher.Prepare( m_WarmModes[i], format, true );
+            }
+        }
+    }
+
+    m_Switcher.Activate(pPlan);
+
+    if( m_FramePool && pPlan != NULL )
+    {
+        m_pInput->SetVideoInputFrameMemoryAllocator( pPlan->pCapture );
+    }
+
+    if( pPlan == NULL || m_pInput->EnableVideoInput( mode, format, m_Flags ) != S_OK )
+    {
+        m_pInput->SetVideoInputFrameMemoryAllocator(NULL);
+        m_pInput->Release();
+        m_pInput = NULL;
+        m_Switcher.Clear();
+        return false;
+    }
+
+    // video goes on without audio if the input cannot do it
+    if( m_pAudioRing != NULL &&
+        m_pInput->EnableAudioInput( bmdAudioSampleRate48kHz, m_AudioType, m_pAudioRing->Channels() ) != S_OK )
+    {
+        m_pAudioRing->Release();
+        m_pAudioRing = NULL;
+    }
+
+    // capture goes on without recording if it cannot write; the stats tell
+    if( m_pRecorder != NULL )
+    {
+        m_pRecorder->Start( format, m_pAudioRing ? m_pAudioRing->Channels() : 0, m_AudioType );
+    }
+
+    m_Thread = std::thread( &CCaptureChannel::ConsumerMain, this );
+    m_pInput->SetCallback(this);
+
+    if( m_pInput->StartStreams() != S_OK )
+    {
+        Stop();
+        return false;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Once the driver has let go of the callback, nothing is pushed any more; frames still queued are released unseen.
+void CCaptureChannel::Stop()
+{
+    if( m_pInput != NULL )
+    {
+        m_pInput->StopStreams();
+        m_pInput->SetCallback(NULL);
+        m_pInput->DisableVideoInput();
+
+        if( m_pAudioRing != NULL )
+        {
+            m_pInput->DisableAudioInput();
+        }
+
+        m_pInput->SetVideoInputFrameMemoryAllocator(NULL);
+        m_pInput->Release();
+        m_pInput = NULL;
+    }
+
+    // the callback has stopped pushing; what is queued is written before the take closes
+    if( m_pRecorder != NULL )
+    {
+        m_pRecorder->Stop();
+    }
+
+    if( m_Thread.joinable() )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_WakeMutex);
+            m_Stop.store(true);
+            m_WakeCond.notify_one();
+        }
+
+        m_Thread.join();
+    }
+
+    SCapturedFrame item;
+
+    while( m_Queue.TryPop(&item) )
+    {
+        ReleaseItem(item);
+    }
+
+    m_Switcher.Clear();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureChannel::ConsumerMain()
+{
+    InitCom();
+
+    for( ;; )
+    {
+        SCapturedFrame item;
+
+        if( m_Queue.TryPop(&item) )
+        {
+            if( m_pConsumer != NULL )
+            {
+                m_pConsumer->OnFrame( m_Info, item.pFrame, item.converted.Wait() ? item.pConverted : NULL );
+            }
+
+            ReleaseItem(item);
+            Increment(m_Consumed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_WakeMutex);
+
+        if( m_Stop.load() )
+        {
+            break;
+        }
+
+        // pairs with the fence in VideoInputFrameArrived(): either the producer sees m_Waiting, or we see its frame
+        m_Waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if( m_Queue.Size() == 0 )
+        {
+            m_WakeCond.wait(lock);
+        }
+
+        m_Waiting.store(false);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// On the callback's thread: starts converting the frame into the next frame of the ring, which is free because the
+// queue has room for the item. The plan of the mode has the buffers and the parameters. On failure the item goes on
+// without a converted frame.
+void CCaptureChannel::Convert( SCapturedFrame* pItem )
+{
+    IDeckLinkVideoInputFrame* pFrame = pItem->pFrame;
+    const SFormatPlan* pPlan = m_Switcher.Current();
+    CConvertedFrame* pConverted = &m_Converted[m_NextConverted];
+    void* pBytes = NULL;
+
+    if( pPlan == NULL || pFrame->GetWidth() != pPlan->pDesc->width || pFrame->GetHeight() != pPlan->pDesc->height ||
+        pPlan->pConvert->AllocateBuffer( pPlan->convertSize, &pBytes ) != S_OK )
+    {
+        Increment(m_ConvertFailures);
+        return;
+    }
+
+    pConverted->Attach( pFrame, pBytes, pPlan->convertRowBytes, m_ConvertFormat );
+    pItem->converted = m_pScheduler->Submit( pFrame, pConverted, pPlan->colorspace );
+
+    if( !pItem->converted.Valid() )
+    {
+        pPlan->pConvert->ReleaseBuffer(pBytes);
+        Increment(m_ConvertFailures);
+        return;
+    }
+
+    pItem->pConverted = pConverted;
+    pItem->pAllocator = pPlan->pConvert;
+    m_NextConverted = ( m_NextConverted + 1 ) % m_Converted.size();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Once its conversion is done: the converted buffer goes back to the allocator, the captured frame to the driver.
+void CCaptureChannel::ReleaseItem( const SCapturedFrame& item )
+{
+    if( item.pConverted != NULL )
+    {
+        item.converted.Wait();
+        item.pAllocator->ReleaseBuffer( item.pConverted->Bytes() );
+    }
+
+    item.pFrame->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureChannel::GetStats( SCaptureStats* pStats )
+{
+    pStats->persistentId = m_Info.persistentId;
+    memcpy( pStats->displayName, m_Info.displayName, sizeof(pStats->displayName) );
+    pStats->mode = m_Mode.load( std::memory_order_relaxed );
+    pStats->format = m_Format.load( std::memory_order_relaxed );
+    pStats->arrived = m_Arrived.load( std::memory_order_relaxed );
+    pStats->noInput = m_NoInput.load( std::memory_order_relaxed );
+    pStats->dropped = m_Dropped.load( std::memory_order_relaxed );
+    pStats->consumed = m_Consumed.load( std::memory_order_relaxed );
+    pStats->convertFormat = ( m_pScheduler != NULL ) ? m_ConvertFormat : 0;
+    pStats->convertFailures = m_ConvertFailures.load( std::memory_order_relaxed );
+    pStats->queued = (unsigned)m_Queue.Size();
+    pStats->framePool = m_FramePool && m_Switcher.GetPoolStats( &pStats->pool );
+
+    pStats->audio = ( m_pAudioRing != NULL );
+
+    if( m_pAudioRing != NULL )
+    {
+        m_pAudioRing->GetStats( &pStats->audioRing );
+    }
+
+    m_Sync.GetStats( &pStats->sync );
+    m_Switcher.GetStats( &pStats->switches );
+    pStats->ancillary = ( m_pAncillary != NULL );
+
+    if( m_pAncillary != NULL )
+    {
+        m_pAncillary->GetStats( &pStats->ancillaryQueue );
+    }
+
+    pStats->timecode = ( m_pTimecodes != NULL );
+
+    if( m_pTimecodes != NULL )
+    {
+        m_pTimecodes->GetStats( &pStats->timecodeLog );
+    }
+
+    pStats->recording = ( m_pRecorder != NULL );
+
+    if( m_pRecorder != NULL )
+    {
+        m_pRecorder->GetStats( &pStats->recorder );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only called with format detection enabled. Re-enables the input in the detected mode, in the way the SDK samples
+// do: in the configured pixel format for a YCbCr 4:2:2 signal, in one of the RGB kind for an RGB 4:4:4 signal and the
+// other way round. A change of colorspace alone needs no restart; the conversion follows it from the next frame on.
+// The plan of the new mode and format is made ready before the input is paused, so that between pausing and starting
+// again there are only the calls to the driver; a warm plan costs nothing. Without one the driver's buffers are used,
+// and frames are not converted. If the input cannot capture in the matching format, it stays in the one it had.
+HRESULT STDMETHODCALLTYPE CCaptureChannel::VideoInputFormatChanged( BMDVideoInputFormatChangedEvents events,
+                                                                    IDeckLinkDisplayMode* pMode,
+                                                                    BMDDetectedVideoInputFormatFlags detectedFlags )
+{
+    if( pMode == NULL )
+    {
+        return S_OK;
+    }
+
+    const BMDDisplayMode mode = pMode->GetDisplayMode();
+    const EColorspace colorspace = ColorspaceFromFlags( pMode->GetFlags() );
+    const BMDPixelFormat previous = m_Format.load( std::memory_order_relaxed );
+    BMDPixelFormat format = previous;
+
+    if( detectedFlags & bmdDetectedVideoInputRGB444 )
+    {
+        format = m_RgbFormat;
+    }
+    else if( detectedFlags & bmdDetectedVideoInputYCbCr422 )
+    {
+        format = m_YuvFormat;
+    }
+
+    if( mode == m_Mode.load( std::memory_order_relaxed ) && format == previous )
+    {
+        if( events & bmdVideoInputColorspaceChanged )
+        {
+            m_Switcher.SetColorspace( m_Switcher.Current(), colorspace );
+        }
+
+        return S_OK;
+    }
+
+    const SFormatPlan* pPlan = m_Switcher.BeginSwitch( mode, format );
+
+    m_pInput->PauseStreams();
+
+    if( m_FramePool )
+    {
+        m_pInput->SetVideoInputFrameMemoryAllocator( pPlan ? pPlan->pCapture : NULL );
+    }
+
+    if( m_pInput->EnableVideoInput( mode, format, m_Flags ) != S_OK && format != previous )
+    {
+        format = previous;
+        pPlan = m_Switcher.Prepare( mode, format, false );
+
+        if( m_FramePool )
+        {
+            m_pInput->SetVideoInputFrameMemoryAllocator( pPlan ? pPlan->pCapture : NULL );
+        }
+
+        m_pInput->EnableVideoInput( mode, format, m_Flags );
+    }
+
+    m_pInput->FlushStreams();
+    m_Sync.Restart();
+    m_Switcher.SetColorspace( pPlan, colorspace );
+    m_Switcher.EndSwitch(pPlan);
+    m_Mode.store(mode);
+    m_Format.store(format);
+
+    if( m_pTimecodes != NULL )
+    {
+        m_pTimecodes->SetMode(mode);
+    }
+
+    m_pInput->StartStreams();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CCaptureChannel::VideoInputFrameArrived( IDeckLinkVideoInputFrame* pFrame,
+                                                                   IDeckLinkAudioInputPacket* pAudio )
+{
+    m_Sync.Record( pFrame, pAudio );
+    m_Switcher.FrameArrived();
+
+    if( pAudio != NULL && m_pAudioRing != NULL )
+    {
+        m_pAudioRing->Write( pAudio, m_AudioType );
+    }
+
+    if( pFrame == NULL )
+    {
+        if( m_pRecorder != NULL )
+        {
+            m_pRecorder->Push( NULL, pAudio, m_Mode.load( std::memory_order_relaxed ) );
+        }
+
+        return S_OK;
+    }
+
+    const uint64_t frame = m_Arrived.load( std::memory_order_relaxed );
+
+    Increment(m_Arrived);
+
+    const bool input = !( pFrame->GetFlags() & bmdFrameHasNoInputSource );
+
+    if( !input )
+    {
+        Increment(m_NoInput);
+
+        if( m_pTimecodes != NULL )
+        {
+            m_pTimecodes->Missing();
+        }
+    }
+    else
+    {
+        if( m_pAncillary != NULL )
+        {
+            m_pAncillary->Scan( pFrame, frame );
+        }
+
+        if( m_pTimecodes != NULL )
+        {
+            m_pTimecodes->Append( pFrame, frame );
+        }
+    }
+
+    if( m_pRecorder != NULL )
+    {
+        m_pRecorder->Push( input ? pFrame : NULL, pAudio, m_Mode.load( std::memory_order_relaxed ) );
+    }
+
+    // only this thread pushes, so with room now the push below cannot fail
+    if( m_Queue.Size() == m_Queue.Capacity() )
+    {
+        Increment(m_Dropped);
+        return S_OK;
+    }
+
+    SCapturedFrame item;
+
+    item.pFrame = pFrame;
+    item.pConverted = NULL;
+    item.pAllocator = NULL;
+    pFrame->AddRef();
+
+    if( m_pScheduler != NULL )
+    {
+        Convert(&item);
+    }
+
+    m_Queue.TryPush(item);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if( m_Waiting.load( std::memory_order_relaxed ) )
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_WakeCond.notify_one();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CCaptureChannel::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkInputCallback ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkInputCallback*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CCaptureChannel::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CCaptureChannel::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+CCaptureEngine::CCaptureEngine( const SCaptureConfig& config, ICaptureConsumer* pConsumer )
+    : m_Config(config), m_pConsumer(pConsumer), m_pScheduler(NULL), m_Stopped(false)
+{
+    if( config.convertFormat != 0 )
+    {
+        m_pScheduler = new CConversionScheduler( config.convertThreads, config.numaNode );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CCaptureEngine::~CCaptureEngine()
+{
+    Stop();
+    delete m_pScheduler;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureEngine::Stop()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        m_Channels[i]->Stop();
+        m_Channels[i]->Release();
+    }
+
+    m_Channels.clear();
+    m_Stopped = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureEngine::GetStats( std::vector<SCaptureStats>* pStats )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    pStats->resize( m_Channels.size() );
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        m_Channels[i]->GetStats( &(*pStats)[i] );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CCaptureEngine::GetConversionStats( CConversionScheduler::SStats* pStats )
+{
+    if( m_pScheduler == NULL )
+    {
+        return false;
+    }
+
+    m_pScheduler->GetStats(pStats);
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CAudioRing* CCaptureEngine::AcquireAudioRing( int64_t persistentId )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        CAudioRing* pRing = m_Channels[i]->AudioRing();
+
+        if( m_Channels[i]->PersistentId() == persistentId && pRing != NULL )
+        {
+            pRing->AddRef();
+            return pRing;
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CAncillaryQueue* CCaptureEngine::AcquireAncillaryQueue( int64_t persistentId )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        CAncillaryQueue* pQueue = m_Channels[i]->AncillaryQueue();
+
+        if( m_Channels[i]->PersistentId() == persistentId && pQueue != NULL )
+        {
+            pQueue->AddRef();
+            return pQueue;
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CTimecodeLog* CCaptureEngine::AcquireTimecodeLog( int64_t persistentId )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        CTimecodeLog* pLog = m_Channels[i]->TimecodeLog();
+
+        if( m_Channels[i]->PersistentId() == persistentId && pLog != NULL )
+        {
+            pLog->AddRef();
+            return pLog;
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Decided from the capabilities read at arrival, without asking the driver again.
+static BMDDisplayMode ChooseMode( const SDeviceCaps& caps, const SCaptureConfig& config )
+{
+    if( !( caps.videoIOSupport & bmdDeviceSupportsCapture ) )
+    {
+        return (BMDDisplayMode)0;
+    }
+
+    if( config.mode != 0 )
+    {
+        return caps.Supports( kCapsInput, config.mode, config.format ) ? config.mode : (BMDDisplayMode)0;
+    }
+
+    return caps.FirstMode( kCapsInput, config.format );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureEngine::OnDeviceArrived( const SDeviceInfo& info )
+{
+    BMDDisplayMode mode = ChooseMode( info.caps, m_Config );
+
+    if( mode == 0 )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Stopped )
+    {
+        return;
+    }
+
+    CCaptureChannel* pChannel = new CCaptureChannel( info, m_pConsumer, m_Config, m_pScheduler );
+
+    if( !pChannel->Start( mode, m_Config.format ) )
+    {
+        pChannel->Release();
+        return;
+    }
+
+    m_Channels.push_back(pChannel);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureEngine::OnDeviceRemoved( const SDeviceInfo& info )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        if( m_Channels[i]->Device() == info.pDev )
+        {
+            m_Channels[i]->Stop();
+            m_Channels[i]->Release();
+            m_Channels.erase( m_Channels.begin() + i );
+            return;
+        }
+    }
+}
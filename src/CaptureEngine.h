@@ -0,0 +1,163 @@
+#ifndef CAPTURE_ENGINE_H
+#define CAPTURE_ENGINE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "Ancillary.h"
+#include "AudioRing.h"
+#include "CaptureRecorder.h"
+#include "ConversionScheduler.h"
+#include "DeckLinkPlatform.h"
+#include "DiscoveryCallback.h"
+#include "FormatSwitch.h"
+#include "FrameAllocator.h"
+#include "SyncTracker.h"
+#include "Timecode.h"
+
+class CCaptureChannel;
+
+//=====================================================================================================================
+// Downstream of the capture engine. Called on the consumer thread of the device's channel, one frame at a time.
+class ICaptureConsumer
+{
+public:
+    virtual ~ICaptureConsumer() {}
+
+    // pFrame is the driver's frame, valid for the duration of the call; AddRef() it to keep it longer. Holding on to
+    // frames holds on to the driver's capture buffers, of which there are only a few.
+    //
+    // pConverted is the frame converted to SCaptureConfig::convertFormat, NULL if no conversion is configured or it
+    // failed. It belongs to the channel and is valid for the duration of the call only.
+    virtual void OnFrame( const SDeviceInfo& device, IDeckLinkVideoInputFrame* pFrame,
+                          IDeckLinkVideoFrame* pConverted ) = 0;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SCaptureConfig
+{
+    BMDDisplayMode  mode;             // 0 = the first mode the input lists which supports the format natively
+    BMDPixelFormat  format;
+    unsigned        queueDepth;       // frames between the driver's callback and the consumer
+    bool            framePool;        // capture into a CFrameAllocator rather than the driver's buffers
+    int             numaNode;         // of the frame pool and the conversion threads, -1 = not bound
+    BMDPixelFormat  convertFormat;    // 0 = none; otherwise every frame is converted to it before the consumer sees it
+    unsigned        convertThreads;   // of the conversion scheduler, 0 = one per CPU of numaNode
+    unsigned        audioChannels;    // 0 = no audio; otherwise 2, 8 or 16 at 48 kHz, into each device's CAudioRing
+    BMDAudioSampleType  audioSampleType;
+    EAudioFormat    audioFormat;      // of the ring's planes
+    long            audioFrames;      // capacity of the ring in sample frames, 0 = one second
+    BMDDisplayMode  warmModes[CFormatSwitcher::kMaxPlans - 2];  // likely modes of a source switch, kept ready; 0 = none
+    unsigned        ancillaryPackets; // 0 = no VANC; otherwise the packets each device's CAncillaryQueue holds
+    BMDTimecodeFormat  timecodeFormat;  // 0 = no timecode; otherwise read from every frame into a CTimecodeLog
+    unsigned        timecodeRuns;     // runs each log keeps, 0 = 4096
+    const char*     recordDir;        // NULL = no recording; otherwise every device's frames and audio go to files here
+    unsigned        recordDepth;      // frames each recorder writes at a time, 0 = CCaptureRecorder::kDefaultDepth
+};
+
+struct SCaptureStats
+{
+    int64_t         persistentId;
+    char            displayName[64];
+    BMDDisplayMode  mode;
+    BMDPixelFormat  format;
+    uint64_t        arrived;          // frames delivered by the driver
+    uint64_t        noInput;          // ... of which flagged bmdFrameHasNoInputSource
+    uint64_t        dropped;          // ... of which released unseen because the consumer was behind
+    uint64_t        consumed;
+    BMDPixelFormat  convertFormat;    // 0 = not converting
+    uint64_t        convertFailures;  // frames handed on without pConverted
+    unsigned        queued;
+    bool            framePool;
+    CFrameAllocator::SStats  pool;    // if framePool
+    bool            audio;            // audio input enabled
+    CAudioRing::SStats  audioRing;    // if audio
+    SSyncStats      sync;
+    SFormatSwitchStats  switches;
+    bool            ancillary;        // VANC scanned
+    CAncillaryQueue::SStats  ancillaryQueue;  // if ancillary
+    bool            timecode;         // timecode logged
+    CTimecodeLog::SStats  timecodeLog;  // if timecode
+    bool            recording;        // a recorder configured
+    CCaptureRecorder::SStats  recorder;  // if recording
+};
+
+//=====================================================================================================================
+// Captures video from every device which arrives with an input that can do the configured mode and format.
+//
+// Frames are never copied: the driver's callback AddRef()s the frame and pushes the pointer into a per-device
+// single-producer single-consumer queue, and the device's consumer thread pops it, hands it to the consumer and
+// Release()s it, which returns the buffer to the driver. A full queue drops the frame in the callback, so a slow
+// consumer never delays the driver.
+//
+// With a convertFormat the callback also submits the frame to the engine's CConversionScheduler, shared by all
+// channels, into a buffer of the channel's own CFrameAllocator, and returns without waiting; the consumer thread waits
+// for the frame's future before handing it on. 4K frames are thus converted in a few milliseconds by the threads of
+// the card's NUMA node, while the driver's thread is never held up.
+//
+// With audioChannels the callback also deinterleaves each audio packet into the device's CAudioRing, before it even
+// looks at the video frame, so that audio arrives whether or not the frame is dropped. Meters, encoders and the like
+// each attach a reader to the ring and get the planar samples of every packet from the one copy.
+//
+// With ancillaryPackets the callback also scans the VANC lines of every frame with input for SMPTE 291 packets, which
+// go into the device's CAncillaryQueue whether or not the frame is dropped.
+//
+// With a timecodeFormat the callback also reads the timecode of every frame into the device's CTimecodeLog, as
+// BCD, whether or not the frame is dropped.
+//
+// With a recordDir the callback also hands every frame with input, and every audio packet, to the device's
+// CCaptureRecorder, whose thread writes them to disk from the capture buffers and indexes the frames by stream time
+// and timecode. The buffers it holds come on top of the frame pool's reserve; when it falls behind, it drops frames
+// from the recording, whether or not the consumer gets them.
+//
+// Every callback is also timed by the channel's CSyncTracker, for the jitter of the frames and the A/V offset.
+//
+// With format detection the channel follows the source from mode to mode. Frame pools and conversion parameters for
+// the current mode, the configured warmModes and the modes used last are kept ready by the channel's
+// CFormatSwitcher, so that a switch only restarts the input.
+//
+// Hook it into discovery with CDiscoveryCallback::AddListener(). Channels are set up and torn down on the
+// notification thread.
+class CCaptureEngine : public IDeviceListener
+{
+    SCaptureConfig                 m_Config;
+    ICaptureConsumer*              m_pConsumer;
+    CConversionScheduler*          m_pScheduler;       // NULL = no conversion
+
+    std::mutex                     m_Mutex;
+    std::vector<CCaptureChannel*>  m_Channels;
+    bool                           m_Stopped;
+
+    CCaptureEngine( const CCaptureEngine& );
+    CCaptureEngine& operator=( const CCaptureEngine& );
+
+public:
+    // pConsumer may be NULL, frames are then released as soon as they are dequeued.
+    CCaptureEngine( const SCaptureConfig& config, ICaptureConsumer* pConsumer );
+    ~CCaptureEngine();
+
+    // Stops all channels; devices arriving afterwards are ignored.
+    void Stop();
+
+    void GetStats( std::vector<SCaptureStats>* pStats );
+
+    // false if no conversion is configured
+    bool GetConversionStats( CConversionScheduler::SStats* pStats );
+
+    // The audio ring of the device being captured, AddRef'ed; NULL if there is none. The ring outlives the channel
+    // for as long as it is held, it then simply receives nothing more.
+    CAudioRing* AcquireAudioRing( int64_t persistentId );
+
+    // The same for the ancillary packets of the device; each queue has one consumer.
+    CAncillaryQueue* AcquireAncillaryQueue( int64_t persistentId );
+
+    // The same for the timecodes of the device.
+    CTimecodeLog* AcquireTimecodeLog( int64_t persistentId );
+
+    // overrides IDeviceListener
+    virtual void OnDeviceArrived( const SDeviceInfo& info );
+    virtual void OnDeviceRemoved( const SDeviceInfo& info );
+};
+
+#endif // CAPTURE_ENGINE_H
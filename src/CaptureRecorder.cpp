@@ -0,0 +1,816 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "CaptureRecorder.h"
+#include "Clock.h"
+#include "DisplayModes.h"
+#include "Timecode.h"
+#include "TimecodeIndex.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static const uint64_t kBlockSize  = 4096;
+static const unsigned kIndexHours = 48;
+static const uint32_t kIndexRuns  = 65536;
+
+#ifdef __linux__
+//=====================================================================================================================
+// The least of io_uring, over the raw system calls: a submission ring of writes, and a completion ring to reap them.
+// Used by the recorder's thread only.
+class CCaptureRecorder::CUring
+{
+    int                     m_Fd;
+    void*                   m_pSqMap;
+    size_t                  m_SqMapSize;
+    void*                   m_pCqMap;
+    size_t                  m_CqMapSize;
+    io_uring_sqe*           m_pSqes;
+    size_t                  m_SqesSize;
+
+    std::atomic<unsigned>*  m_pSqHead;
+    std::atomic<unsigned>*  m_pSqTail;
+    unsigned                m_SqMask;
+    unsigned                m_SqEntries;
+    unsigned*               m_pSqArray;
+    std::atomic<unsigned>*  m_pCqHead;
+    std::atomic<unsigned>*  m_pCqTail;
+    unsigned                m_CqMask;
+    io_uring_cqe*           m_pCqes;
+
+    unsigned                m_Tail;           // of the entries prepared
+    unsigned                m_Unsubmitted;
+
+    CUring( const CUring& );
+    CUring& operator=( const CUring& );
+
+public:
+    CUring()
+        : m_Fd(-1),
+          m_pSqMap(MAP_FAILED),
+          m_SqMapSize(0),
+          m_pCqMap(MAP_FAILED),
+          m_CqMapSize(0),
+          m_pSqes(NULL),
+          m_SqesSize(0),
+          m_Tail(0),
+          m_Unsubmitted(0)
+    {
+    }
+
+    ~CUring()
+    {
+        if( m_pSqes != NULL )
+        {
+            munmap( m_pSqes, m_SqesSize );
+        }
+
+        if( m_pCqMap != MAP_FAILED && m_pCqMap != m_pSqMap )
+        {
+            munmap( m_pCqMap, m_CqMapSize );
+        }
+
+        if( m_pSqMap != MAP_FAILED )
+        {
+            munmap( m_pSqMap, m_SqMapSize );
+        }
+
+        if( m_Fd >= 0 )
+        {
+            close( m_Fd );
+        }
+    }
+
+    // false if the kernel has no io_uring, or will not let us have one
+    bool Setup( unsigned entries )
+    {
+        io_uring_params params;
+        memset( &params, 0, sizeof(params) );
+
+        m_Fd = (int)syscall( __NR_io_uring_setup, entries, &params );
+
+        if( m_Fd < 0 )
+        {
+            return false;
+        }
+
+        m_SqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_CqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        if( params.features & IORING_FEAT_SINGLE_MMAP )
+        {
+            m_SqMapSize = m_CqMapSize = std::max( m_SqMapSize, m_CqMapSize );
+        }
+
+        m_pSqMap = mmap( NULL, m_SqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd,
+                         IORING_OFF_SQ_RING );
+
+        if( m_pSqMap == MAP_FAILED )
+        {
+            return false;
+        }
+
+        m_pCqMap = ( params.features & IORING_FEAT_SINGLE_MMAP ) ? m_pSqMap
+                 : mmap( NULL, m_CqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd,
+                         IORING_OFF_CQ_RING );
+
+        if( m_pCqMap == MAP_FAILED )
+        {
+            return false;
+        }
+
+        m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* pSqes = mmap( NULL, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd,
+                            IORING_OFF_SQES );
+
+        if( pSqes == MAP_FAILED )
+        {
+            return false;
+        }
+
+        uint8_t* pSq = (uint8_t*)m_pSqMap;
+        uint8_t* pCq = (uint8_t*)m_pCqMap;
+
+        m_pSqes = (io_uring_sqe*)pSqes;
+        m_pSqHead = (std::atomic<unsigned>*)( pSq + params.sq_off.head );
+        m_pSqTail = (std::atomic<unsigned>*)( pSq + params.sq_off.tail );
+        m_SqMask = *(unsigned*)( pSq + params.sq_off.ring_mask );
+        m_SqEntries = params.sq_entries;
+        m_pSqArray = (unsigned*)( pSq + params.sq_off.array );
+        m_pCqHead = (std::atomic<unsigned>*)( pCq + params.cq_off.head );
+        m_pCqTail = (std::atomic<unsigned>*)( pCq + params.cq_off.tail );
+        m_CqMask = *(unsigned*)( pCq + params.cq_off.ring_mask );
+        m_pCqes = (io_uring_cqe*)( pCq + params.cq_off.cqes );
+        m_Tail = m_pSqTail->load( std::memory_order_relaxed );
+        return true;
+    }
+
+    // A write, to be submitted with the next Enter(); false if the submission ring is full.
+    bool PrepareWrite( int fd, const void* pBytes, uint32_t size, uint64_t offset, uint64_t userData )
+    {
+        if( m_Tail - m_pSqHead->load( std::memory_order_acquire ) >= m_SqEntries )
+        {
+            return false;
+        }
+
+        const unsigned index = m_Tail & m_SqMask;
+        io_uring_sqe* pSqe = &m_pSqes[index];
+
+        memset( pSqe, 0, sizeof(*pSqe) );
+        pSqe->opcode = IORING_OP_WRITE;
+        pSqe->fd = fd;
+        pSqe->addr = (uint64_t)(uintptr_t)pBytes;
+        pSqe->len = size;
+        pSqe->off = offset;
+        pSqe->user_data = userData;
+        m_pSqArray[index] = index;
+
+        ++m_Tail;
+        ++m_Unsubmitted;
+        return true;
+    }
+
+    // Submits what is prepared, and waits for at least wait completions. false on an error of the kernel's.
+    bool Enter( unsigned wait )
+    {
+        m_pSqTail->store( m_Tail, std::memory_order_release );
+
+        for( ;; )
+        {
+            const int ret = (int)syscall( __NR_io_uring_enter, m_Fd, m_Unsubmitted, wait,
+                                          wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+
+            if( ret >= 0 )
+            {
+                m_Unsubmitted -= std::min( (unsigned)ret, m_Unsubmitted );
+                return true;
+            }
+
+            if( errno != EINTR )
+            {
+                return false;
+            }
+        }
+    }
+
+    // A completion, if there is one.
+    bool Reap( uint64_t* pUserData, int* pResult )
+    {
+        const unsigned head = m_pCqHead->load( std::memory_order_relaxed );
+
+        if( head == m_pCqTail->load( std::memory_order_acquire ) )
+        {
+            return false;
+        }
+
+        const io_uring_cqe& cqe = m_pCqes[head & m_CqMask];
+
+        *pUserData = cqe.user_data;
+        *pResult = cqe.res;
+        m_pCqHead->store( head + 1, std::memory_order_release );
+        return true;
+    }
+};
+#endif // __linux__
+
+//---------------------------------------------------------------------------------------------------------------------
+CCaptureRecorder::CCaptureRecorder( const char* dir, int64_t persistentId, unsigned depth,
+                                    BMDTimecodeFormat timecodeFormat )
+    : m_Dir(dir),
+      m_PersistentId(persistentId),
+      m_Depth( depth ? depth : (unsigned)kDefaultDepth ),
+      m_TimecodeFormat( timecodeFormat ? timecodeFormat : (BMDTimecodeFormat)bmdTimecodeRP188Any ),
+      m_Format(bmdFormat10BitYUV),
+      m_AudioFrameBytes(0),
+      m_Queue(m_Depth),
+      m_Waiting(false),
+      m_Stop(false),
+      m_Running(false),
+      m_pUring(NULL),
+      m_pPages(NULL),
+      m_Head(0),
+      m_Busy(0),
+      m_Take(0),
+      m_TakeMode((BMDDisplayMode)0),
+      m_TimeScale(0),
+      m_VideoFd(-1),
+      m_BufferedFd(-1),
+      m_AudioFd(-1),
+      m_VideoEnd(0),
+      m_AudioEnd(0),
+      m_pIndex(NULL),
+      m_Uring(false),
+      m_Direct(false),
+      m_Takes(0),
+      m_Frames(0),
+      m_AudioPackets(0),
+      m_Bytes(0),
+      m_Buffered(0),
+      m_Errors(0),
+      m_InFlight(0),
+      m_PeakInFlight(0),
+      m_Stalls(0),
+      m_Writes(0),
+      m_WriteNs(0),
+      m_MaxWriteNs(0),
+      m_Dropped(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CCaptureRecorder::~CCaptureRecorder()
+{
+    Stop();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureRecorder::Push( IDeckLinkVideoInputFrame* pFrame, IDeckLinkAudioInputPacket* pAudio,
+                             BMDDisplayMode mode )
+{
+    if( !m_Running.load( std::memory_order_relaxed ) || ( pFrame == NULL && pAudio == NULL ) )
+    {
+        return;
+    }
+
+    // only this thread pushes, so with room now the push below cannot fail
+    if( m_Queue.Size() == m_Queue.Capacity() )
+    {
+        Increment(m_Dropped);
+        return;
+    }
+
+    SItem item;
+
+    item.pFrame = pFrame;
+    item.pAudio = pAudio;
+    item.mode = mode;
+
+    if( pFrame != NULL )
+    {
+        pFrame->AddRef();
+    }
+
+    if( pAudio != NULL )
+    {
+        pAudio->AddRef();
+    }
+
+    m_Queue.TryPush(item);
+
+    // pairs with the fence in WriterMain(): either the thread sees the item, or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if( m_Waiting.load( std::memory_order_relaxed ) )
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_WakeCond.notify_one();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureRecorder::GetStats( SStats* pStats )
+{
+    pStats->running = m_Running.load( std::memory_order_relaxed );
+    pStats->uring = m_Uring.load( std::memory_order_relaxed );
+    pStats->direct = m_Direct.load( std::memory_order_relaxed );
+    pStats->takes = m_Takes.load( std::memory_order_relaxed );
+    pStats->frames = m_Frames.load( std::memory_order_relaxed );
+    pStats->audioPackets = m_AudioPackets.load( std::memory_order_relaxed );
+    pStats->bytes = m_Bytes.load( std::memory_order_relaxed );
+    pStats->buffered = m_Buffered.load( std::memory_order_relaxed );
+    pStats->dropped = m_Dropped.load( std::memory_order_relaxed );
+    pStats->errors = m_Errors.load( std::memory_order_relaxed );
+    pStats->inFlight = m_InFlight.load( std::memory_order_relaxed );
+    pStats->peakInFlight = m_PeakInFlight.load( std::memory_order_relaxed );
+    pStats->stalls = m_Stalls.load( std::memory_order_relaxed );
+    pStats->writes = m_Writes.load( std::memory_order_relaxed );
+    pStats->writeNs = m_WriteNs.load( std::memory_order_relaxed );
+    pStats->maxWriteNs = m_MaxWriteNs.load( std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureRecorder::Release( const SItem& item )
+{
+    if( item.pFrame != NULL )
+    {
+        item.pFrame->Release();
+    }
+
+    if( item.pAudio != NULL )
+    {
+        item.pAudio->Release();
+    }
+}
+
+#ifdef __linux__
+//---------------------------------------------------------------------------------------------------------------------
+bool CCaptureRecorder::Start( BMDPixelFormat format, unsigned audioChannels, BMDAudioSampleType audioType )
+{
+    if( m_Running.load() || access( m_Dir.c_str(), W_OK ) != 0 )
+    {
+        return false;
+    }
+
+    m_Format = format;
+    m_AudioFrameBytes = audioChannels * ( (uint32_t)audioType / 8 );
+
+    void* pPages = mmap( NULL, m_Depth * kBlockSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if( pPages == MAP_FAILED )
+    {
+        return false;
+    }
+
+    m_pPages = (uint8_t*)pPages;
+
+    // the tail of a frame, its whole blocks and its packet: 3 writes a slot at most
+    m_pUring = new CUring();
+
+    if( !m_pUring->Setup( m_Depth * 3 ) )
+    {
+        delete m_pUring;
+        m_pUring = NULL;
+    }
+
+    m_Uring.store( m_pUring != NULL );
+    m_Slots.resize(m_Depth);
+    m_Head = 0;
+    m_Busy = 0;
+    m_Stop.store(false);
+    m_Running.store(true);
+    m_Thread = std::thread( &CCaptureRecorder::WriterMain, this );
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureRecorder::Stop()
+{
+    if( !m_Running.load() )
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Stop.store(true);
+        m_WakeCond.notify_one();
+    }
+
+    m_Thread.join();
+    m_Running.store(false);
+
+    delete m_pUring;
+    m_pUring = NULL;
+    munmap( m_pPages, m_Depth * kBlockSize );
+    m_pPages = NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Fills the free slots from the queue, then waits: for a completion if a write is in flight, for the callback if not.
+// Once stopped, the queue and the writes are seen through before the take is closed.
+void CCaptureRecorder::WriterMain()
+{
+    InitCom();
+
+    for( ;; )
+    {
+        Reap(false);
+        Retire();
+
+        SItem item;
+        bool submitted = false;
+
+        while( m_Busy < m_Depth && m_Queue.TryPop(&item) )
+        {
+            Submit(item);
+            submitted = true;
+        }
+
+        if( m_Busy == m_Depth && m_Queue.Size() != 0 )
+        {
+            Increment(m_Stalls);
+            Reap(true);
+            continue;
+        }
+
+        if( submitted )
+        {
+            continue;
+        }
+
+        if( m_Busy != 0 )
+        {
+            Reap(true);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_WakeMutex);
+
+        if( m_Stop.load() && m_Queue.Size() == 0 )
+        {
+            break;
+        }
+
+        m_Waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if( m_Queue.Size() == 0 && !m_Stop.load() )
+        {
+            m_WakeCond.wait(lock);
+        }
+
+        m_Waiting.store(false);
+    }
+
+    CloseTake();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Opens the files of the next take; a file which cannot be opened is an error, and what would go to it is not
+// recorded until the next take.
+bool CCaptureRecorder::OpenTake( BMDDisplayMode mode )
+{
+    const SDisplayModeDesc* pDesc = FindDisplayMode(mode);
+    const char* format = PixelFormatName(m_Format);
+    char base[512];
+    char path[544];
+    char modeName[16];
+
+    snprintf( modeName, sizeof(modeName), "%08x", (unsigned)mode );
+    snprintf( base, sizeof(base), "%s/%016llx-%u-%s", m_Dir.c_str(), (unsigned long long)m_PersistentId, ++m_Take,
+              pDesc ? pDesc->name : modeName );
+
+    m_TakeMode = mode;
+    m_TimeScale = pDesc ? pDesc->timeScale : 90000;
+    m_VideoEnd = 0;
+    m_AudioEnd = 0;
+    m_Takes.store( m_Take, std::memory_order_relaxed );
+
+    snprintf( path, sizeof(path), "%s.%s", base, format ? format : "raw" );
+    m_VideoFd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644 );
+    m_Direct.store( m_VideoFd >= 0, std::memory_order_relaxed );
+
+    if( m_VideoFd >= 0 )
+    {
+        m_BufferedFd = open( path, O_WRONLY | O_CLOEXEC );
+    }
+    else if( errno == EINVAL )
+    {
+        // no O_DIRECT on this file system (tmpfs, some network ones)
+        m_VideoFd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+        m_BufferedFd = m_VideoFd;
+    }
+
+    if( m_AudioFrameBytes != 0 )
+    {
+        snprintf( path, sizeof(path), "%s.pcm", base );
+        m_AudioFd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+        Increment( m_Errors, m_AudioFd < 0 );
+    }
+
+    if( m_VideoFd < 0 || m_BufferedFd < 0 )
+    {
+        Increment(m_Errors);
+        return false;
+    }
+
+    const uint64_t frames = pDesc ? (uint64_t)pDesc->timeScale * 3600 * kIndexHours / pDesc->frameDuration
+                                  : (uint64_t)60 * 3600 * kIndexHours;
+
+    snprintf( path, sizeof(path), "%s.idx", base );
+    m_pIndex = new CTimecodeIndex();
+
+    if( !m_pIndex->Create( path, m_TimeScale, frames, kIndexRuns ) )
+    {
+        delete m_pIndex;
+        m_pIndex = NULL;
+        Increment(m_Errors);
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// With nothing in flight. The data is flushed, so that a take closed is a take on disk.
+void CCaptureRecorder::CloseTake()
+{
+    if( m_BufferedFd >= 0 && m_BufferedFd != m_VideoFd )
+    {
+        close(m_BufferedFd);
+    }
+
+    if( m_VideoFd >= 0 )
+    {
+        fdatasync(m_VideoFd);
+        close(m_VideoFd);
+    }
+
+    if( m_AudioFd >= 0 )
+    {
+        fdatasync(m_AudioFd);
+        close(m_AudioFd);
+    }
+
+    if( m_pIndex != NULL )
+    {
+        m_pIndex->Close();
+        delete m_pIndex;
+        m_pIndex = NULL;
+    }
+
+    m_VideoFd = -1;
+    m_BufferedFd = -1;
+    m_AudioFd = -1;
+    m_TakeMode = (BMDDisplayMode)0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Writes the item into the next slot, which is free. A new mode or pixel format waits for the writes of the last take
+// to complete.
+void CCaptureRecorder::Submit( const SItem& item )
+{
+    const BMDPixelFormat format = ( item.pFrame != NULL ) ? item.pFrame->GetPixelFormat() : m_Format;
+
+    if( item.mode != m_TakeMode || format != m_Format )
+    {
+        m_Format = format;
+
+        while( m_Busy != 0 )
+        {
+            Reap(true);
+            Retire();
+        }
+
+        CloseTake();
+        OpenTake(item.mode);
+    }
+
+    const unsigned slot = ( m_Head + m_Busy ) % m_Depth;
+    SSlot& s = m_Slots[slot];
+
+    s.item = item;
+    s.pending = 1;          // until all the writes are submitted, so that none retires the slot early
+    s.failed = false;
+    s.size = 0;
+    s.rate = 0;
+    s.bcd = 0;
+    s.bytes = 0;
+    s.submitNs = MonotonicNs();
+    ++m_Busy;
+
+    IDeckLinkVideoInputFrame* pFrame = m_VideoFd >= 0 ? item.pFrame : NULL;
+    void* pBytes = NULL;
+
+    if( pFrame != NULL && pFrame->GetBytes(&pBytes) == S_OK )
+    {
+        BMDTimeValue duration = 0;
+        IDeckLinkTimecode* pTimecode = NULL;
+
+        s.size = (uint32_t)( pFrame->GetRowBytes() * pFrame->GetHeight() );
+        s.offset = m_VideoEnd;
+        m_VideoEnd += ( s.size + kBlockSize - 1 ) / kBlockSize * kBlockSize;
+
+        if( pFrame->GetStreamTime( &s.streamTime, &duration, m_TimeScale ) != S_OK )
+        {
+            s.streamTime = -1;
+        }
+
+        if( pFrame->GetTimecode( m_TimecodeFormat, &pTimecode ) == S_OK && pTimecode != NULL )
+        {
+            s.bcd = pTimecode->GetBCD();
+            s.rate = TimecodeRate( m_TakeMode, pTimecode->GetFlags() );
+            pTimecode->Release();
+        }
+
+        if( m_Direct.load( std::memory_order_relaxed ) && ( (uintptr_t)pBytes & ( kBlockSize - 1 ) ) == 0 )
+        {
+            // the whole blocks from the capture buffer, the rest from the slot's page, padded with zeros
+            const uint32_t whole = (uint32_t)( s.size & ~( kBlockSize - 1 ) );
+            const uint32_t tail = s.size - whole;
+
+            if( whole != 0 )
+            {
+                Write( slot, m_VideoFd, pBytes, whole, s.offset );
+            }
+
+            if( tail != 0 )
+            {
+                uint8_t* pPage = m_pPages + slot * kBlockSize;
+
+                memcpy( pPage, (const uint8_t*)pBytes + whole, tail );
+                memset( pPage + tail, 0, kBlockSize - tail );
+                Write( slot, m_VideoFd, pPage, (uint32_t)kBlockSize, s.offset + whole );
+            }
+        }
+        else
+        {
+            Write( slot, m_BufferedFd, pBytes, s.size, s.offset );
+            Increment(m_Buffered);
+        }
+    }
+
+    void* pSamples = NULL;
+
+    if( item.pAudio != NULL && m_AudioFd >= 0 && item.pAudio->GetBytes(&pSamples) == S_OK )
+    {
+        const uint32_t size = (uint32_t)item.pAudio->GetSampleFrameCount() * m_AudioFrameBytes;
+
+        if( size != 0 )
+        {
+            Write( slot, m_AudioFd, pSamples, size, m_AudioEnd );
+            m_AudioEnd += size;
+        }
+    }
+
+    if( m_pUring != NULL && !m_pUring->Enter(0) )
+    {
+        // the writes stay in the ring, for the next Enter()
+        Increment(m_Errors);
+    }
+
+    Completed( slot, true );
+    m_InFlight.store( m_Busy, std::memory_order_relaxed );
+
+    if( m_Busy > m_PeakInFlight.load( std::memory_order_relaxed ) )
+    {
+        m_PeakInFlight.store( m_Busy, std::memory_order_relaxed );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// With io_uring the write is queued, to complete in Reap(); with pwrite() it is done here.
+void CCaptureRecorder::Write( unsigned slot, int fd, const void* pBytes, size_t size, uint64_t offset )
+{
+    SSlot& s = m_Slots[slot];
+
+    ++s.pending;
+    s.bytes += size;
+
+    // the slot and the size, to check the completion against
+    if( m_pUring != NULL &&
+        ( m_pUring->PrepareWrite( fd, pBytes, (uint32_t)size, offset, slot | (uint64_t)size << 32 ) ||
+          ( m_pUring->Enter(0) &&
+            m_pUring->PrepareWrite( fd, pBytes, (uint32_t)size, offset, slot | (uint64_t)size << 32 ) ) ) )
+    {
+        return;
+    }
+
+    size_t done = 0;
+
+    while( done < size )
+    {
+        const ssize_t n = pwrite( fd, (const uint8_t*)pBytes + done, size - done, (off_t)( offset + done ) );
+
+        if( n <= 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if( n <= 0 )
+        {
+            break;
+        }
+
+        done += (size_t)n;
+    }
+
+    Completed( slot, done == size );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureRecorder::Completed( unsigned slot, bool ok )
+{
+    SSlot& s = m_Slots[slot];
+
+    --s.pending;
+
+    if( !ok )
+    {
+        s.failed = true;
+        Increment(m_Errors);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The completions of the writes, waiting for one first if wait.
+void CCaptureRecorder::Reap( bool wait )
+{
+    if( m_pUring == NULL )
+    {
+        return;
+    }
+
+    if( wait && !m_pUring->Enter(1) )
+    {
+        Increment(m_Errors);
+    }
+
+    uint64_t userData;
+    int result;
+
+    while( m_pUring->Reap( &userData, &result ) )
+    {
+        Completed( (unsigned)( userData & 0xFFFFFFFF ), result == (int)( userData >> 32 ) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The slots whose writes are all done, oldest first: their frames go into the index in the order they arrived, and
+// back to the driver.
+void CCaptureRecorder::Retire()
+{
+    while( m_Busy != 0 && m_Slots[m_Head].pending == 0 )
+    {
+        SSlot& s = m_Slots[m_Head];
+        const uint64_t ns = MonotonicNs() - s.submitNs;
+
+        Increment(m_Writes);
+        Increment( m_WriteNs, ns );
+
+        if( ns > m_MaxWriteNs.load( std::memory_order_relaxed ) )
+        {
+            m_MaxWriteNs.store( ns, std::memory_order_relaxed );
+        }
+
+        if( !s.failed )
+        {
+            if( s.size != 0 )
+            {
+                if( m_pIndex != NULL )
+                {
+                    m_pIndex->Append( s.streamTime, s.offset, s.size, s.bcd, s.rate );
+                }
+
+                Increment(m_Frames);
+            }
+
+            Increment( m_AudioPackets, s.item.pAudio != NULL && m_AudioFd >= 0 );
+            Increment( m_Bytes, s.bytes );
+        }
+
+        Release(s.item);
+        m_Head = ( m_Head + 1 ) % m_Depth;
+        --m_Busy;
+    }
+
+    m_InFlight.store( m_Busy, std::memory_order_relaxed );
+}
+#else
+//---------------------------------------------------------------------------------------------------------------------
+bool CCaptureRecorder::Start( BMDPixelFormat format, unsigned audioChannels, BMDAudioSampleType audioType )
+{
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CCaptureRecorder::Stop()
+{
+}
+#endif // __linux__
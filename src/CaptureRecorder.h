@@ -0,0 +1,185 @@
+#ifndef CAPTURE_RECORDER_H
+#define CAPTURE_RECORDER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeckLinkPlatform.h"
+#include "SpscQueue.h"
+
+class CTimecodeIndex;
+
+//=====================================================================================================================
+// Records the frames and audio packets of one capture channel to disk, straight from the buffers they were captured
+// into.
+//
+// The channel's callback AddRef()s the frame and the packet and pushes them into a queue, as it does for its consumer;
+// the recorder's thread writes each with io_uring and releases it once the writes are done. Frames of the channel's
+// frame pool are page aligned, so the video file is opened with O_DIRECT and the writes go from the capture buffer to
+// the disk by DMA: no copy, and no page cache to fill and evict at over 1 GB/s for UHD 10-bit 50p. Each frame starts
+// on a 4 KB boundary of the file; the part of its last 4 KB block past the whole ones is copied to a padded page of
+// the slot, the only bytes that are copied. A frame not page aligned (the driver's own buffers) goes through the page
+// cache instead, and is counted. Audio packets, a few KB each, are written through the page cache.
+//
+// At most depth frames are being written at a time, and depth more wait in the queue: the capture buffers they hold
+// must be part of the frame pool's reserve. When the queue is full, the callback drops the frame and its audio from
+// the recording rather than wait, and counts it; the statistics tell how close the disk is to that, with the writes
+// in flight, the times a frame waited for a free slot, and the time the writes took.
+//
+// Each display mode and pixel format recorded is a take of three files, named after the device, the take and the mode:
+//
+//     <dir>/<persistent id>-<take>-<mode>.<pixel format>   the frames, each at a multiple of 4 KB
+//     <dir>/<persistent id>-<take>-<mode>.pcm               the audio, interleaved samples of the input as captured
+//     <dir>/<persistent id>-<take>-<mode>.idx               a CTimecodeIndex of the frames, stream time in the mode's
+//                                                           time scale
+//
+// Without io_uring (kernels before 5.6, or a seccomp filter), or on a file system without O_DIRECT, the thread writes
+// with pwrite() and through the page cache, one frame at a time. Linux only; elsewhere Start() fails.
+class CCaptureRecorder
+{
+public:
+    enum { kDefaultDepth = 8 };
+
+    struct SStats
+    {
+        bool      running;
+        bool      uring;              // io_uring rather than pwrite()
+        bool      direct;             // O_DIRECT on the video file
+        unsigned  takes;
+        uint64_t  frames;             // written and indexed
+        uint64_t  audioPackets;
+        uint64_t  bytes;              // written, video and audio
+        uint64_t  buffered;           // frames written through the page cache, their buffer not aligned
+        uint64_t  dropped;            // frames with their packets, or packets alone, not recorded: the writer behind
+        uint64_t  errors;             // failed or short writes, files not opened
+        unsigned  inFlight;           // frames being written
+        unsigned  peakInFlight;
+        uint64_t  stalls;             // times the next frame waited for a write to complete, all slots busy
+        uint64_t  writes;             // frames with their packets, and packets alone, written
+        uint64_t  writeNs;            // ... from submission to completion, summed
+        uint64_t  maxWriteNs;
+    };
+
+private:
+    class CUring;
+
+    // what the callback hands to the thread
+    struct SItem
+    {
+        IDeckLinkVideoInputFrame*   pFrame;       // AddRef'ed, NULL for a packet alone
+        IDeckLinkAudioInputPacket*  pAudio;       // AddRef'ed, NULL for a frame alone
+        BMDDisplayMode              mode;
+    };
+
+    // a frame and packet being written
+    struct SSlot
+    {
+        SItem            item;
+        unsigned         pending;     // writes not completed
+        bool             failed;
+        uint64_t         offset;      // of the frame in the video file
+        uint32_t         size;
+        BMDTimeValue     streamTime;
+        BMDTimecodeBCD   bcd;
+        uint8_t          rate;        // of bcd, 0 = none
+        uint64_t         bytes;
+        uint64_t         submitNs;
+    };
+
+    std::string                 m_Dir;
+    int64_t                     m_PersistentId;
+    unsigned                    m_Depth;
+    BMDTimecodeFormat           m_TimecodeFormat;
+    BMDPixelFormat              m_Format;             // of the take; the thread's once it runs
+    uint32_t                    m_AudioFrameBytes;    // per sample frame, 0 = no audio
+
+    CSpscQueue<SItem>           m_Queue;
+    std::thread                 m_Thread;
+    std::mutex                  m_WakeMutex;
+    std::condition_variable     m_WakeCond;
+    std::atomic<bool>           m_Waiting;
+    std::atomic<bool>           m_Stop;
+    std::atomic<bool>           m_Running;            // between Start() and Stop()
+
+    // the thread's
+    CUring*                     m_pUring;             // NULL = pwrite()
+    std::vector<SSlot>          m_Slots;              // a ring, m_Head the oldest in flight
+    uint8_t*                    m_pPages;             // a padded page per slot
+    unsigned                    m_Head;
+    unsigned                    m_Busy;               // slots in use
+    unsigned                    m_Take;
+    BMDDisplayMode              m_TakeMode;           // 0 = no take open
+    BMDTimeScale                m_TimeScale;
+    int                         m_VideoFd;
+    int                         m_BufferedFd;         // the same file without O_DIRECT, or m_VideoFd
+    int                         m_AudioFd;
+    uint64_t                    m_VideoEnd;
+    uint64_t                    m_AudioEnd;
+    CTimecodeIndex*             m_pIndex;
+
+    // written by the thread only
+    std::atomic<bool>           m_Uring;
+    std::atomic<bool>           m_Direct;
+    std::atomic<unsigned>       m_Takes;
+    std::atomic<uint64_t>       m_Frames;
+    std::atomic<uint64_t>       m_AudioPackets;
+    std::atomic<uint64_t>       m_Bytes;
+    std::atomic<uint64_t>       m_Buffered;
+    std::atomic<uint64_t>       m_Errors;
+    std::atomic<unsigned>       m_InFlight;
+    std::atomic<unsigned>       m_PeakInFlight;
+    std::atomic<uint64_t>       m_Stalls;
+    std::atomic<uint64_t>       m_Writes;
+    std::atomic<uint64_t>       m_WriteNs;
+    std::atomic<uint64_t>       m_MaxWriteNs;
+
+    // written by the callback only
+    std::atomic<uint64_t>       m_Dropped;
+
+    CCaptureRecorder( const CCaptureRecorder& );
+    CCaptureRecorder& operator=( const CCaptureRecorder& );
+
+    static void Increment( std::atomic<uint64_t>& counter, uint64_t n = 1 )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+    }
+
+    void WriterMain();
+    bool OpenTake( BMDDisplayMode mode );
+    void CloseTake();
+    void Submit( const SItem& item );
+    void Write( unsigned slot, int fd, const void* pBytes, size_t size, uint64_t offset );
+    void Completed( unsigned slot, bool ok );
+    void Reap( bool wait );
+    void Retire();
+    void Release( const SItem& item );
+
+public:
+    // dir: where the takes go. depth: frames being written at a time, 0 = kDefaultDepth. timecodeFormat: the timecode
+    // indexed, 0 = RP188 of any kind.
+    CCaptureRecorder( const char* dir, int64_t persistentId, unsigned depth, BMDTimecodeFormat timecodeFormat );
+    ~CCaptureRecorder();
+
+    // Captured frames it may hold at once, queued or being written.
+    unsigned MaxHeld() const  { return m_Depth + (unsigned)m_Queue.Capacity(); }
+
+    // Starts the thread; the first take is opened with the first frame. format: the one expected, a frame in another
+    // starts a new take. audioChannels 0 = no audio. false if the
+    // recorder cannot run here or the directory cannot be written to.
+    bool Start( BMDPixelFormat format, unsigned audioChannels, BMDAudioSampleType audioType );
+
+    // Writes out what is queued, then closes the take. The callback must not push any more.
+    void Stop();
+
+    // The callback. Either may be NULL; mode: the input's display mode, a new one starts a new take. Never blocks.
+    void Push( IDeckLinkVideoInputFrame* pFrame, IDeckLinkAudioInputPacket* pAudio, BMDDisplayMode mode );
+
+    void GetStats( SStats* pStats );
+};
+
+#endif // CAPTURE_RECORDER_H
@@ -0,0 +1,16 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <chrono>
+
+//---------------------------------------------------------------------------------------------------------------------
+// Nanoseconds on the monotonic clock (std::chrono::steady_clock), the one time stamps and latencies are taken on
+// throughout; only differences between two readings mean anything.
+inline uint64_t MonotonicNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                    std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+#endif // CLOCK_H
@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+#include "ConversionScheduler.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+static void Increment( std::atomic<uint64_t>& counter )
+{
+    counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+//=====================================================================================================================
+// Stripes [first, first + count) of the frame in a slot.
+struct CConversionScheduler::SRange
+{
+    unsigned  slot;
+    long      first;
+    long      count;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+struct CConversionScheduler::SFrame
+{
+    SConvertJob            job;
+    long                   stripeRows;
+    long                   stripes;
+    uint64_t               ticket;         // of the frame in the slot
+    std::atomic<long>      remaining;      // stripes not converted yet
+    std::atomic<uint64_t>  completed;      // ticket of the last frame finished in the slot, only ever grows
+    std::atomic<bool>      busy;
+
+    SFrame() : stripeRows(1), stripes(0), ticket(0), remaining(0), completed(0), busy(false)
+    {
+        memset( &job, 0, sizeof(job) );
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Ranges of splitting a frame in halves pile up to its log2(stripes) at most, so the deque cannot fill in practice;
+// when it does, the range is converted without splitting.
+struct CConversionScheduler::SWorker
+{
+    enum { kDequeSize = 512 };
+
+    std::thread            thread;
+    int                    cpu;            // pinned to, -1 = not pinned
+    std::mutex             mutex;          // of the deque
+    SRange                 ranges[kDequeSize];
+    unsigned               head;           // front
+    unsigned               count;
+
+    // written by the worker only
+    std::atomic<uint64_t>  stripes;
+    std::atomic<uint64_t>  steals;
+    char                   pad[64];
+
+    SWorker() : cpu(-1), head(0), count(0), stripes(0), steals(0)  {}
+};
+
+//=====================================================================================================================
+bool CConversionFuture::IsReady() const
+{
+    return m_pScheduler != NULL && m_pScheduler->IsReady( m_Slot, m_Ticket );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CConversionFuture::Wait() const
+{
+    if( m_pScheduler == NULL )
+    {
+        return false;
+    }
+
+    m_pScheduler->Wait( m_Slot, m_Ticket );
+    return true;
+}
+
+//=====================================================================================================================
+CConversionScheduler::CConversionScheduler( unsigned threads, int numaNode, ECpuIsa isa )
+    : m_NumaNode(numaNode), m_Isa(isa), m_pFrames(new SFrame[kMaxFrames]), m_Tickets(0), m_NextSlot(0),
+      m_Submitted(0), m_NextTake(0), m_Rejected(0), m_Queued(0), m_Sleeping(0), m_Quit(false), m_Waiting(0)
+{
+    static_assert( kMaxFrames <= 32, "a bit of m_Submitted per slot" );
+
+
+    std::vector<int> cpus;
+    GetCpus( numaNode, &cpus );
+
+    if( threads == 0 )
+    {
+        threads = cpus.empty() ? std::max( 1u, std::thread::hardware_concurrency() ) : (unsigned)cpus.size();
+    }
+
+    // all deques exist before the first worker may steal
+    for( unsigned i = 0; i < threads; ++i )
+    {
+        m_Workers.push_back( new SWorker );
+        m_Workers[i]->cpu = cpus.empty() ? -1 : cpus[ i % cpus.size() ];
+    }
+
+    for( unsigned i = 0; i < threads; ++i )
+    {
+        m_Workers[i]->thread = std::thread( &CConversionScheduler::WorkerMain, this, i );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CConversionScheduler::~CConversionScheduler()
+{
+    // each worker passes the wake on as it quits
+    m_Quit.store(true);
+    m_WorkReady.Set();
+
+    for( size_t i = 0; i < m_Workers.size(); ++i )
+    {
+        m_Workers[i]->thread.join();
+        delete m_Workers[i];
+    }
+
+    delete[] m_pFrames;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// CPUs of the node the process may run on; all those it may run on if numaNode < 0 or the node has none of them.
+void CConversionScheduler::GetCpus( int numaNode, std::vector<int>* pCpus )
+{
+    pCpus->clear();
+
+#if defined(_WIN32)
+    GROUP_AFFINITY node;
+
+    if( numaNode >= 0 && GetNumaNodeProcessorMaskEx( (USHORT)numaNode, &node ) )
+    {
+        for( int bit = 0; bit < 64; ++bit )
+        {
+            if( node.Mask & ( (KAFFINITY)1 << bit ) )
+            {
+                pCpus->push_back( node.Group * 64 + bit );
+            }
+        }
+    }
+
+    DWORD_PTR process = 0;
+    DWORD_PTR system = 0;
+
+    if( pCpus->empty() && GetProcessAffinityMask( GetCurrentProcess(), &process, &system ) )
+    {
+        for( int bit = 0; bit < 64; ++bit )
+        {
+            if( process & ( (DWORD_PTR)1 << bit ) )
+            {
+                pCpus->push_back(bit);
+            }
+        }
+    }
+#elif defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if( sched_getaffinity( 0, sizeof(allowed), &allowed ) != 0 )
+    {
+        return;
+    }
+
+    char path[64];
+    snprintf( path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numaNode );
+    FILE* pFile = ( numaNode >= 0 ) ? fopen( path, "r" ) : NULL;
+
+    if( pFile != NULL )
+    {
+        // e.g. "0-7,16-23"
+        char list[1024];
+
+        if( fgets( list, sizeof(list), pFile ) != NULL )
+        {
+            char* p = list;
+
+            while( *p >= '0' && *p <= '9' )
+            {
+                long first = strtol( p, &p, 10 );
+                long last = first;
+
+                if( *p == '-' )
+                {
+                    last = strtol( p + 1, &p, 10 );
+                }
+
+                for( long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu )
+                {
+                    if( CPU_ISSET( cpu, &allowed ) )
+                    {
+                        pCpus->push_back( (int)cpu );
+                    }
+                }
+
+                if( *p == ',' )
+                {
+                    ++p;
+                }
+            }
+        }
+
+        fclose(pFile);
+    }
+
+    if( !pCpus->empty() )
+    {
+        return;
+    }
+
+    for( int cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+    {
+        if( CPU_ISSET( cpu, &allowed ) )
+        {
+            pCpus->push_back(cpu);
+        }
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Of the calling thread; failure leaves it where the OS puts it.
+void CConversionScheduler::PinThread( int cpu )
+{
+    if( cpu < 0 )
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    GROUP_AFFINITY affinity;
+
+    memset( &affinity, 0, sizeof(affinity) );
+    affinity.Group = (WORD)( cpu / 64 );
+    affinity.Mask = (KAFFINITY)1 << ( cpu % 64 );
+    SetThreadGroupAffinity( GetCurrentThread(), &affinity, NULL );
+#elif defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET( cpu, &set );
+    sched_setaffinity( 0, sizeof(set), &set );
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CConversionScheduler::WorkerMain( unsigned index )
+{
+    PinThread( m_Workers[index]->cpu );
+
+    for( ;; )
+    {
+        SRange range;
+
+        if( Pop( index, &range ) )
+        {
+            // a wake does not add up with the one before it; if there is more, the next sleeper has to get it
+            if( m_Queued.load() != 0 && m_Sleeping.load() != 0 )
+            {
+                m_WorkReady.Set();
+            }
+
+            Run( index, range );
+            continue;
+        }
+
+        // pairs with Submit() and Push(): either they see m_Sleeping, or we see their range in m_Queued
+        m_Sleeping.fetch_add(1);
+
+        while( !m_Quit.load() && m_Queued.load() == 0 )
+        {
+            m_WorkReady.Wait();
+        }
+
+        m_Sleeping.fetch_sub(1);
+
+        if( m_Quit.load() && m_Queued.load() == 0 )
+        {
+            m_WorkReady.Set();
+            return;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Onto the back of pWorker's deque; false if it is full.
+bool CConversionScheduler::Push( SWorker* pWorker, const SRange& range )
+{
+    {
+        std::lock_guard<std::mutex> lock(pWorker->mutex);
+
+        if( pWorker->count == SWorker::kDequeSize )
+        {
+            return false;
+        }
+
+        pWorker->ranges[ ( pWorker->head + pWorker->count ) % SWorker::kDequeSize ] = range;
+        ++pWorker->count;
+    }
+
+    m_Queued.fetch_add(1);
+
+    if( m_Sleeping.load() != 0 )
+    {
+        m_WorkReady.Set();
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The whole of a frame from the inbox, the first one posted from m_NextTake on; false if it is empty.
+bool CConversionScheduler::Take( SRange* pRange )
+{
+    uint32_t submitted = m_Submitted.load( std::memory_order_acquire );
+
+    while( submitted != 0 )
+    {
+        const unsigned from = m_NextTake.load( std::memory_order_relaxed ) % kMaxFrames;
+        unsigned slot = from;
+
+        while( !( submitted & ( 1u << slot ) ) )
+        {
+            slot = ( slot + 1 ) % kMaxFrames;
+        }
+
+        if( m_Submitted.compare_exchange_weak( submitted, submitted & ~( 1u << slot ), std::memory_order_acquire ) )
+        {
+            m_NextTake.store( slot + 1, std::memory_order_relaxed );
+            m_Queued.fetch_sub(1);
+            pRange->slot = slot;
+            pRange->first = 0;
+            pRange->count = m_pFrames[slot].stripes;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// From the back of the worker's own deque, else a new frame from the inbox, else from the front of the others'
+// deques.
+bool CConversionScheduler::Pop( unsigned index, SRange* pRange )
+{
+    const unsigned workers = (unsigned)m_Workers.size();
+    SWorker* pWorker = m_Workers[index];
+
+    {
+        std::lock_guard<std::mutex> lock(pWorker->mutex);
+
+        if( pWorker->count != 0 )
+        {
+            *pRange = pWorker->ranges[ ( pWorker->head + pWorker->count - 1 ) % SWorker::kDequeSize ];
+            --pWorker->count;
+            m_Queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    if( Take(pRange) )
+    {
+        return true;
+    }
+
+    for( unsigned i = 1; i < workers; ++i )
+    {
+        SWorker* pVictim = m_Workers[ ( index + i ) % workers ];
+        std::lock_guard<std::mutex> lock(pVictim->mutex);
+
+        if( pVictim->count == 0 )
+        {
+            continue;
+        }
+
+        *pRange = pVictim->ranges[ pVictim->head ];
+        pVictim->head = ( pVictim->head + 1 ) % SWorker::kDequeSize;
+        --pVictim->count;
+        m_Queued.fetch_sub(1);
+        Increment( pWorker->steals );
+        return true;
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CConversionScheduler::Run( unsigned index, SRange range )
+{
+    SWorker* pWorker = m_Workers[index];
+    SFrame& frame = m_pFrames[range.slot];
+
+    // leave the upper halves to whoever is free, keep the first stripe
+    while( range.count > 1 )
+    {
+        const long half = range.count / 2;
+        const SRange upper = { range.slot, range.first + range.count - half, half };
+
+        if( !Push( pWorker, upper ) )
+        {
+            break;
+        }
+
+        range.count -= half;
+    }
+
+    const long firstRow = range.first * frame.stripeRows;
+    const long rows = std::min( range.count * frame.stripeRows, frame.job.height - firstRow );
+
+    ConvertRows( frame.job, firstRow, rows );
+    pWorker->stripes.store( pWorker->stripes.load( std::memory_order_relaxed ) + range.count,
+                            std::memory_order_relaxed );
+
+    if( frame.remaining.fetch_sub( range.count ) == range.count )
+    {
+        Complete(range.slot);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CConversionScheduler::Complete( unsigned slot )
+{
+    SFrame& frame = m_pFrames[slot];
+
+    // pairs with Wait(): either it sees the ticket, or we see it waiting
+    frame.completed.store( frame.ticket );
+    frame.busy.store(false);
+
+    if( m_Waiting.load() != 0 )
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Done.notify_all();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CConversionScheduler::IsReady( unsigned slot, uint64_t ticket ) const
+{
+    return m_pFrames[slot].completed.load() >= ticket;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CConversionScheduler::Wait( unsigned slot, uint64_t ticket )
+{
+    if( IsReady( slot, ticket ) )
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Waiting.fetch_add(1);
+
+    while( !IsReady( slot, ticket ) )
+    {
+        m_Done.wait(lock);
+    }
+
+    m_Waiting.fetch_sub(1);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CConversionFuture CConversionScheduler::Submit( const SConvertJob& job )
+{
+    CConversionFuture future;
+
+    if( m_Workers.empty() || !IsValidConvertJob(job) )
+    {
+        m_Rejected.fetch_add( 1, std::memory_order_relaxed );
+        return future;
+    }
+
+    const unsigned start = m_NextSlot.fetch_add( 1, std::memory_order_relaxed );
+
+    for( unsigned i = 0; i < kMaxFrames; ++i )
+    {
+        const unsigned slot = ( start + i ) % kMaxFrames;
+        SFrame& frame = m_pFrames[slot];
+        bool busy = false;
+
+        if( !frame.busy.compare_exchange_strong( busy, true ) )
+        {
+            continue;
+        }
+
+        frame.job = job;
+        frame.job.isa = m_Isa;
+        frame.stripeRows = std::max( 1L, (long)kStripeBytes / ( job.srcRowBytes + job.dstRowBytes ) );
+        frame.stripes = ( job.height + frame.stripeRows - 1 ) / frame.stripeRows;
+        frame.ticket = m_Tickets.fetch_add(1) + 1;
+        frame.remaining.store( frame.stripes );
+
+        // the whole frame to the first free worker; the others steal their share of it
+        m_Submitted.fetch_or( 1u << slot, std::memory_order_release );
+        m_Queued.fetch_add(1);
+
+        if( m_Sleeping.load() != 0 )
+        {
+            m_WorkReady.Set();
+        }
+
+        future.m_pScheduler = this;
+        future.m_Slot = slot;
+        future.m_Ticket = frame.ticket;
+        return future;
+    }
+
+    m_Rejected.fetch_add( 1, std::memory_order_relaxed );
+    return future;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CConversionFuture CConversionScheduler::Submit( IDeckLinkVideoFrame* pSrc, IDeckLinkVideoFrame* pDst,
+                                                EColorspace colorspace )
+{
+    SConvertJob job;
+
+    if( !MakeConvertJob( pSrc, pDst, colorspace, &job ) )
+    {
+        m_Rejected.fetch_add( 1, std::memory_order_relaxed );
+        return CConversionFuture();
+    }
+
+    return Submit(job);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CConversionScheduler::GetStats( SStats* pStats )
+{
+    pStats->threads = ThreadCount();
+    pStats->numaNode = m_NumaNode;
+    pStats->frames = m_Tickets.load( std::memory_order_relaxed );
+    pStats->rejected = m_Rejected.load( std::memory_order_relaxed );
+    pStats->stripes = 0;
+    pStats->steals = 0;
+
+    for( size_t i = 0; i < m_Workers.size(); ++i )
+    {
+        pStats->stripes += m_Workers[i]->stripes.load( std::memory_order_relaxed );
+        pStats->steals += m_Workers[i]->steals.load( std::memory_order_relaxed );
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef CONVERSION_SCHEDULER_H
+#define CONVERSION_SCHEDULER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "FrameConversion.h"
+#include "WakeEvent.h"
+
+class CConversionScheduler;
+
+//=====================================================================================================================
+// Completion of one frame submitted to a CConversionScheduler; a copyable value, invalid if the submission failed.
+// It must not outlive the scheduler.
+class CConversionFuture
+{
+    friend class CConversionScheduler;
+
+    CConversionScheduler*  m_pScheduler;
+    unsigned               m_Slot;
+    uint64_t               m_Ticket;
+
+public:
+    CConversionFuture() : m_pScheduler(NULL), m_Slot(0), m_Ticket(0)  {}
+
+    bool Valid() const  { return m_pScheduler != NULL; }
+
+    // Without blocking; false if not valid.
+    bool IsReady() const;
+
+    // Blocks until the frame is converted; false at once if not valid.
+    bool Wait() const;
+};
+
+//=====================================================================================================================
+// Converts frames asynchronously on a pool of worker threads, each pinned to one CPU of a NUMA node, so that a 4K
+// frame takes a few milliseconds of wall time and the thread submitting it none.
+//
+// A frame is cut into stripes of whole rows, as many as make kStripeBytes of source and destination together, so
+// that a stripe's rows stay in the converting core's L2. Submit() posts the frame to the inbox, a bit per slot, from
+// which the first free worker takes it as a single range of stripes. Every worker keeps a deque of ranges: it splits
+// the range it takes in halves, pushing the upper halves back, until one stripe is left to convert, and takes its
+// next range from the back, the most recent and smallest; an idle worker takes a new frame from the inbox, or else
+// steals from the front of the others' deques, the largest ranges still waiting. A frame thus spreads over as many
+// workers as are free without any of them going through a shared queue per stripe.
+//
+// Frames in flight live in kMaxFrames preallocated slots; Submit() neither allocates nor takes a lock: it claims a
+// slot and posts it with atomic operations, and wakes a sleeping worker through a CWakeEvent. It fails when all slots
+// are busy. The buffers of a frame must stay valid until its future is ready.
+class CConversionScheduler
+{
+public:
+    enum { kMaxFrames = 32 };
+    enum { kStripeBytes = 256 * 1024 };
+
+    struct SStats
+    {
+        unsigned  threads;
+        int       numaNode;           // as configured, -1 = not bound
+        uint64_t  frames;             // submitted
+        uint64_t  rejected;           // Submit() calls which found the job invalid or no free slot
+        uint64_t  stripes;            // converted
+        uint64_t  steals;             // ranges taken from another worker's deque
+    };
+
+private:
+    friend class CConversionFuture;
+
+    struct SFrame;
+    struct SWorker;
+    struct SRange;
+
+    int                       m_NumaNode;
+    ECpuIsa                   m_Isa;
+    SFrame*                   m_pFrames;          // kMaxFrames
+    std::vector<SWorker*>     m_Workers;
+
+    std::atomic<uint64_t>     m_Tickets;
+    std::atomic<unsigned>     m_NextSlot;
+    std::atomic<uint32_t>     m_Submitted;        // the inbox: a bit per slot not taken by a worker yet
+    std::atomic<unsigned>     m_NextTake;         // slot the inbox is searched from, to take frames in turn
+    std::atomic<uint64_t>     m_Rejected;
+
+    // idle workers sleep on m_WorkReady until m_Queued says the inbox or some deque has a range; waiters on m_Done
+    CWakeEvent                m_WorkReady;
+    std::atomic<long>         m_Queued;
+    std::atomic<unsigned>     m_Sleeping;
+    std::atomic<bool>         m_Quit;
+    std::mutex                m_Mutex;
+    std::condition_variable   m_Done;
+    std::atomic<unsigned>     m_Waiting;
+
+    CConversionScheduler( const CConversionScheduler& );
+    CConversionScheduler& operator=( const CConversionScheduler& );
+
+    static void GetCpus( int numaNode, std::vector<int>* pCpus );
+    static void PinThread( int cpu );
+
+    void WorkerMain( unsigned index );
+    bool Push( SWorker* pWorker, const SRange& range );
+    bool Take( SRange* pRange );
+    bool Pop( unsigned index, SRange* pRange );
+    void Run( unsigned index, SRange range );
+    void Complete( unsigned slot );
+
+    bool IsReady( unsigned slot, uint64_t ticket ) const;
+    void Wait( unsigned slot, uint64_t ticket );
+
+public:
+    // threads: workers, 0 = one per CPU of the node (of the process if numaNode < 0). isa: as in SConvertJob.
+    CConversionScheduler( unsigned threads, int numaNode, ECpuIsa isa = kIsaCount );
+
+    // Finishes the frames in flight first.
+    ~CConversionScheduler();
+
+    unsigned ThreadCount() const  { return (unsigned)m_Workers.size(); }
+
+    // job.isa is overridden by the scheduler's. Returns an invalid future if the job is not valid or all slots are
+    // busy; the frame is then not converted.
+    CConversionFuture Submit( const SConvertJob& job );
+    CConversionFuture Submit( IDeckLinkVideoFrame* pSrc, IDeckLinkVideoFrame* pDst, EColorspace colorspace );
+
+    void GetStats( SStats* pStats );
+};
+
+#endif // CONVERSION_SCHEDULER_H
@@ -0,0 +1,128 @@
+#include <stdint.h>
+
+#include "CpuFeatures.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef CPU_X86
+//---------------------------------------------------------------------------------------------------------------------
+static void Cpuid( unsigned leaf, unsigned sub, unsigned regs[4] )
+{
+#ifdef _MSC_VER
+    __cpuidex( (int*)regs, (int)leaf, (int)sub );
+#else
+    __cpuid_count( leaf, sub, regs[0], regs[1], regs[2], regs[3] );
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Register state the OS saves on context switches (XCR0).
+static uint64_t OsSavedState()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ __volatile__( "xgetbv" : "=a"(lo), "=d"(hi) : "c"(0) );
+    return ( (uint64_t)hi << 32 ) | lo;
+#endif
+}
+#endif // CPU_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+// A bit per ECpuIsa.
+static unsigned DetectIsas()
+{
+    unsigned isas = 1u << kIsaScalar;
+
+#ifdef CPU_X86
+    unsigned leaf0[4], leaf1[4], leaf7[4] = { 0, 0, 0, 0 };
+
+    Cpuid( 0, 0, leaf0 );
+    Cpuid( 1, 0, leaf1 );
+
+    if( leaf0[0] >= 7 )
+    {
+        Cpuid( 7, 0, leaf7 );
+    }
+
+    if( ( leaf1[2] & ( 1u << 9 ) ) && ( leaf1[2] & ( 1u << 19 ) ) )        // SSSE3, SSE4.1
+    {
+        isas |= 1u << kIsaSse41;
+    }
+
+    if( !( leaf1[2] & ( 1u << 27 ) ) || !( leaf1[2] & ( 1u << 28 ) ) )     // OSXSAVE, AVX
+    {
+        return isas;
+    }
+
+    const uint64_t state = OsSavedState();
+
+    if( ( state & 0x06 ) == 0x06 && ( leaf7[1] & ( 1u << 5 ) ) )            // XMM/YMM, AVX2
+    {
+        isas |= 1u << kIsaAvx2;
+    }
+
+    if( ( state & 0xE6 ) == 0xE6 && ( leaf7[1] & ( 1u << 16 ) ) && ( leaf7[1] & ( 1u << 30 ) ) )   // ZMM, F, BW
+    {
+        isas |= 1u << kIsaAvx512;
+    }
+#endif
+
+    return isas;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool HasCpuIsa( ECpuIsa isa )
+{
+    static const unsigned s_Isas = DetectIsas();
+
+    return isa >= 0 && isa < kIsaCount && ( s_Isas & ( 1u << isa ) );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool HasSse41()
+{
+    return HasCpuIsa(kIsaSse41);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool HasAvx2()
+{
+    return HasCpuIsa(kIsaAvx2);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool HasAvx512BW()
+{
+    return HasCpuIsa(kIsaAvx512);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ECpuIsa BestCpuIsa( ECpuIsa max )
+{
+    int isa = ( max < kIsaCount ) ? (int)max : kIsaCount - 1;
+
+    while( !HasCpuIsa( (ECpuIsa)isa ) )
+    {
+        --isa;
+    }
+
+    return (ECpuIsa)isa;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const char* CpuIsaName( ECpuIsa isa )
+{
+    static const char* const s_Names[kIsaCount] = { "scalar", "sse4.1", "avx2", "avx512" };
+
+    return ( isa >= 0 && isa < kIsaCount ) ? s_Names[isa] : "?";
+}
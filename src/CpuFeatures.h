@@ -0,0 +1,33 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+//=====================================================================================================================
+// Instruction sets the SIMD kernels of the tree are compiled for, into the same binary and chosen at run time; each
+// family has a kernel for some of them, always one in plain C. Functions taking an ECpuIsa use the highest kernels at
+// or below it which the CPU has, kIsaCount = the best there is, so that benchmarks can compare them.
+enum ECpuIsa
+{
+    kIsaScalar = 0,
+    kIsaSse41,          // with SSSE3
+    kIsaAvx2,
+    kIsaAvx512,         // F and BW
+
+    kIsaCount,
+};
+
+// Whether the CPU has the instructions and the OS saves their registers, from CPUID and XCR0, detected once. False
+// off x86.
+bool HasSse41();
+bool HasAvx2();
+bool HasAvx512BW();
+
+// The same by ECpuIsa; kIsaScalar is always there.
+bool HasCpuIsa( ECpuIsa isa );
+
+// The highest instruction set at or below max which the CPU has.
+ECpuIsa BestCpuIsa( ECpuIsa max = kIsaCount );
+
+// "scalar", "sse4.1", "avx2" or "avx512".
+const char* CpuIsaName( ECpuIsa isa );
+
+#endif // CPU_FEATURES_H
@@ -0,0 +1,158 @@
+#ifndef DECKLINK_PLATFORM_H
+#define DECKLINK_PLATFORM_H
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+#include <DeckLinkAPI.h>
+
+#ifdef _WIN32
+//=====================================================================================================================
+inline IDeckLinkDiscovery* CreateDiscoveryInst()
+{
+    LPVOID  p = NULL;
+    HRESULT  hr = CoCreateInstance(
+                                CLSID_CDeckLinkDiscovery,  NULL,  CLSCTX_ALL,
+                                IID_IDeckLinkDiscovery,  &p
+                                );
+
+    if ( FAILED(hr) )
+    {
+        throw std::runtime_error("creating IDeckLinkDiscovery failed");
+    }
+
+    assert( p != NULL );
+    return  static_cast<IDeckLinkDiscovery*>(p);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The API's own frame converter; NULL if the installed driver has none.
+inline IDeckLinkVideoConversion* CreateVideoConversionInst()
+{
+    LPVOID  p = NULL;
+    HRESULT  hr = CoCreateInstance(
+                                CLSID_CDeckLinkVideoConversion,  NULL,  CLSCTX_ALL,
+                                IID_IDeckLinkVideoConversion,  &p
+                                );
+
+    return SUCCEEDED(hr) ? static_cast<IDeckLinkVideoConversion*>(p) : NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+inline void InitCom()  { CoInitialize(NULL); } //  Initialize COM on this thread
+
+//---------------------------------------------------------------------------------------------------------------------
+typedef BSTR  DLString;
+
+inline DLString MakeDLString( const char* s )
+{
+    int len = MultiByteToWideChar( CP_UTF8, 0, s, -1, NULL, 0 );
+    BSTR str = SysAllocStringLen( NULL, len - 1 );
+    MultiByteToWideChar( CP_UTF8, 0, s, -1, str, len );
+    return str;
+}
+
+// Copies a string returned by the API into buf (UTF-8, truncated) and frees it.
+inline void TakeDLString( DLString s, char* buf, size_t size )
+{
+    if( WideCharToMultiByte( CP_UTF8, 0, s, -1, buf, (int)size, NULL, NULL ) == 0 )
+    {
+        buf[size - 1] = '\0';
+    }
+
+    SysFreeString(s);
+}
+
+#else
+//=====================================================================================================================
+#ifndef STDMETHODCALLTYPE
+#define STDMETHODCALLTYPE
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+inline bool IsEqualGUID( const REFIID& a, const REFIID& b )
+{
+    return memcmp( &a, &b, sizeof(REFIID) ) == 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+#ifdef __linux__
+// CreateDeckLinkDiscoveryInstance() and CreateVideoConversionInstance() with the library loaded and the factory looked
+// up by StartupProfile.cpp, timed for GetDispatchProfile(); DECKLINK_API_LAZY=1 opens the library with RTLD_LAZY and
+// looks up each factory on its first call only. NULL if either fails.
+IDeckLinkDiscovery* CreateProfiledDiscoveryInstance();
+IDeckLinkVideoConversion* CreateProfiledVideoConversionInstance();
+#endif
+
+inline IDeckLinkDiscovery* CreateDiscoveryInst()
+{
+#ifdef __linux__
+    IDeckLinkDiscovery* p = CreateProfiledDiscoveryInstance();
+#else
+    IDeckLinkDiscovery* p = CreateDeckLinkDiscoveryInstance();
+#endif
+
+    if( p == NULL )
+    {
+        throw std::runtime_error("creating IDeckLinkDiscovery failed");
+    }
+
+    return p;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The API's own frame converter; NULL if the installed driver has none.
+inline IDeckLinkVideoConversion* CreateVideoConversionInst()
+{
+#ifdef __linux__
+    return CreateProfiledVideoConversionInstance();
+#else
+    return CreateVideoConversionInstance();
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+inline void InitCom()  {}
+
+//---------------------------------------------------------------------------------------------------------------------
+#ifdef __APPLE__
+const REFIID IID_IUnknown = CFUUIDGetUUIDBytes(IUnknownUUID);
+
+typedef CFStringRef  DLString;
+
+inline DLString MakeDLString( const char* s )
+{
+    return CFStringCreateWithCString( kCFAllocatorDefault, s, kCFStringEncodingUTF8 );
+}
+
+inline void TakeDLString( DLString s, char* buf, size_t size )
+{
+    if( !CFStringGetCString( s, buf, size, kCFStringEncodingUTF8 ) )
+    {
+        buf[0] = '\0';
+    }
+
+    CFRelease(s);
+}
+
+#else
+typedef const char*  DLString;
+
+inline DLString MakeDLString( const char* s )
+{
+    return strdup(s);
+}
+
+inline void TakeDLString( DLString s, char* buf, size_t size )
+{
+    strncpy( buf, s, size - 1 );
+    buf[size - 1] = '\0';
+    free( (void*)s );
+}
+#endif
+
+#endif
+
+#endif // DECKLINK_PLATFORM_H
@@ -0,0 +1,175 @@
+#include "DeviceCaps.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+bool SDeviceCaps::Supports( ECapsDirection dir, BMDDisplayMode mode, BMDPixelFormat format,
+                            ECapsVariant variant, bool allowConversion ) const
+{
+    int formatIndex = PixelFormatIndex(format);
+
+    if( formatIndex < 0 )
+    {
+        return false;
+    }
+
+    return ( FormatMask( dir, mode, variant, allowConversion ) & ( 1u << formatIndex ) ) != 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+uint32_t SDeviceCaps::FormatMask( ECapsDirection dir, BMDDisplayMode mode,
+                                  ECapsVariant variant, bool allowConversion ) const
+{
+    int modeIndex = DisplayModeIndex(mode);
+
+    if( modeIndex < 0 )
+    {
+        return 0;
+    }
+
+    uint32_t bits = modes[dir][variant][modeIndex];
+    uint32_t mask = ( bits >> kNativeShift ) & kFormatMask;
+
+    if( allowConversion )
+    {
+        mask |= ( bits >> kConversionShift ) & kFormatMask;
+    }
+
+    return mask;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool SDeviceCaps::Listed( ECapsDirection dir, BMDDisplayMode mode ) const
+{
+    int modeIndex = DisplayModeIndex(mode);
+    return ( modeIndex >= 0 ) && ( modes[dir][kCapsDefault][modeIndex] & kListed ) != 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+BMDDisplayMode SDeviceCaps::FirstMode( ECapsDirection dir, BMDPixelFormat format ) const
+{
+    for( int i = 0; i < kDisplayModeCount; ++i )
+    {
+        if( Listed( dir, g_DisplayModes[i].mode ) && Supports( dir, g_DisplayModes[i].mode, format ) )
+        {
+            return g_DisplayModes[i].mode;
+        }
+    }
+
+    return (BMDDisplayMode)0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// TIO is IDeckLinkInput or IDeckLinkOutput, TFlags the matching BMDVideoInputFlags / BMDVideoOutputFlags.
+template< class TIO, class TFlags >
+static uint16_t QueryModeFormats( TIO* pIO, BMDDisplayMode mode, TFlags flags )
+{
+    uint16_t bits = 0;
+
+    for( int i = 0; i < kPixelFormatCount; ++i )
+    {
+        BMDDisplayModeSupport support = bmdDisplayModeNotSupported;
+
+        if( pIO->DoesSupportVideoMode( mode, g_PixelFormats[i], flags, &support, NULL ) != S_OK )
+        {
+            continue;
+        }
+
+        if( support == bmdDisplayModeSupported )
+        {
+            bits |= (uint16_t)( 1u << ( SDeviceCaps::kNativeShift + i ) );
+        }
+        else if( support == bmdDisplayModeSupportedWithConversion )
+        {
+            bits |= (uint16_t)( 1u << ( SDeviceCaps::kConversionShift + i ) );
+        }
+    }
+
+    return bits;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only the modes listed by the iterator are queried; the driver reports all others as unsupported anyway.
+template< class TIO, class TFlags >
+static void QueryDirection( TIO* pIO, TFlags flags3D, uint16_t (*pModes)[kDisplayModeCount] )
+{
+    IDeckLinkDisplayModeIterator* pIter = NULL;
+
+    if( pIO->GetDisplayModeIterator(&pIter) != S_OK )
+    {
+        return;
+    }
+
+    IDeckLinkDisplayMode* pMode = NULL;
+
+    while( pIter->Next(&pMode) == S_OK )
+    {
+        BMDDisplayMode mode = pMode->GetDisplayMode();
+        BMDDisplayModeFlags modeFlags = pMode->GetFlags();
+        pMode->Release();
+
+        int index = DisplayModeIndex(mode);
+
+        if( index < 0 )
+        {
+            continue;
+        }
+
+        pModes[kCapsDefault][index] = SDeviceCaps::kListed | QueryModeFormats( pIO, mode, (TFlags)0 );
+
+        if( modeFlags & bmdDisplayModeSupports3D )
+        {
+            pModes[kCapsDualStream3D][index] = SDeviceCaps::kListed | QueryModeFormats( pIO, mode, flags3D );
+        }
+    }
+
+    pIter->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool BuildDeviceCaps( IDeckLink* pDev, SDeviceCaps* pCaps )
+{
+    memset( pCaps, 0, sizeof(*pCaps) );
+
+    IDeckLinkAttributes* pAttr = NULL;
+    bool haveIOSupport = false;
+
+    if( pDev->QueryInterface( IID_IDeckLinkAttributes, (void**)&pAttr ) == S_OK )
+    {
+        int64_t value;
+
+        if( pAttr->GetInt( BMDDeckLinkVideoIOSupport, &value ) == S_OK )
+        {
+            pCaps->videoIOSupport = (uint32_t)value;
+            haveIOSupport = true;
+        }
+
+        pAttr->Release();
+    }
+
+    IDeckLinkInput* pInput = NULL;
+
+    if( pDev->QueryInterface( IID_IDeckLinkInput, (void**)&pInput ) == S_OK )
+    {
+        QueryDirection( pInput, (BMDVideoInputFlags)bmdVideoInputDualStream3D, pCaps->modes[kCapsInput] );
+        pInput->Release();
+
+        if( !haveIOSupport )
+        {
+            pCaps->videoIOSupport |= bmdDeviceSupportsCapture;
+        }
+    }
+
+    IDeckLinkOutput* pOutput = NULL;
+
+    if( pDev->QueryInterface( IID_IDeckLinkOutput, (void**)&pOutput ) == S_OK )
+    {
+        QueryDirection( pOutput, (BMDVideoOutputFlags)bmdVideoOutputDualStream3D, pCaps->modes[kCapsOutput] );
+        pOutput->Release();
+
+        if( !haveIOSupport )
+        {
+            pCaps->videoIOSupport |= bmdDeviceSupportsPlayback;
+        }
+    }
+
+    return pCaps->videoIOSupport != 0;
+}
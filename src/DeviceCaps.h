@@ -0,0 +1,67 @@
+#ifndef DEVICE_CAPS_H
+#define DEVICE_CAPS_H
+
+#include <stdint.h>
+
+#include "DisplayModes.h"
+
+//=====================================================================================================================
+enum ECapsDirection
+{
+    kCapsInput  = 0,
+    kCapsOutput = 1,
+
+    kCapsDirectionCount = 2,
+};
+
+enum ECapsVariant
+{
+    kCapsDefault      = 0,    // bmdVideoInputFlagDefault / bmdVideoOutputFlagDefault
+    kCapsDualStream3D = 1,    // bmdVideoInputDualStream3D / bmdVideoOutputDualStream3D
+
+    kCapsVariantCount = 2,
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// What a device can capture and play out, queried from the driver once when the device arrives.
+//
+// The answers of DoesSupportVideoMode() for every display mode x pixel format x flags combination are kept as a
+// bitset, one 16-bit word per direction, flag variant and mode (the order of g_DisplayModes):
+//
+//     bits 0..6    pixel formats supported natively (the order of g_PixelFormats)
+//     bits 7..13   pixel formats supported with conversion
+//     bit  14      mode listed by the display mode iterator
+//
+// so that negotiating a mode is a couple of table lookups instead of hundreds of driver calls.
+struct SDeviceCaps
+{
+    enum
+    {
+        kNativeShift     = 0,
+        kConversionShift = kPixelFormatCount,
+        kFormatMask      = ( 1 << kPixelFormatCount ) - 1,
+        kListed          = 1 << ( 2 * kPixelFormatCount ),
+    };
+
+    uint32_t           videoIOSupport;    // BMDVideoIOSupport
+    uint16_t           modes[kCapsDirectionCount][kCapsVariantCount][kDisplayModeCount];
+
+    // false for modes and formats unknown to this version of the API
+    bool Supports( ECapsDirection dir, BMDDisplayMode mode, BMDPixelFormat format,
+                   ECapsVariant variant = kCapsDefault, bool allowConversion = false ) const;
+
+    // Pixel formats usable with the mode, as a mask over g_PixelFormats.
+    uint32_t FormatMask( ECapsDirection dir, BMDDisplayMode mode,
+                         ECapsVariant variant = kCapsDefault, bool allowConversion = false ) const;
+
+    bool Listed( ECapsDirection dir, BMDDisplayMode mode ) const;
+
+    // The first listed mode which supports the format natively, in g_DisplayModes order; 0 if there is none.
+    BMDDisplayMode FirstMode( ECapsDirection dir, BMDPixelFormat format ) const;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Queries the driver. Returns false (with *pCaps empty) if the device has neither input nor output.
+bool BuildDeviceCaps( IDeckLink* pDev, SDeviceCaps* pCaps );
+
+#endif // DEVICE_CAPS_H
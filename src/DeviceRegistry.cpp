@@ -0,0 +1,486 @@
+#include <string.h>
+#include <limits>
+#include <new>
+
+#include "DeviceRegistry.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline size_t HashKey( uint64_t x )
+{
+    // murmur3 finaliser
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Preferred reader slot of the calling thread; kMaxReaders until first use.
+static thread_local unsigned   t_ReaderHint = CDeviceRegistry::kMaxReaders;
+static std::atomic<unsigned>   g_NextReaderHint(0);
+
+//=====================================================================================================================
+CDeviceRegistry::CDeviceRegistry()
+    : m_pTable( AllocTable(8) ), m_Epoch(1), m_HaveRetired(false)
+{
+    for( unsigned i = 0; i < kMaxReaders; ++i )
+    {
+        m_Readers[i].epoch.store( 0, std::memory_order_relaxed );
+    }
+
+    m_Retired.reserve(16);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CDeviceRegistry::~CDeviceRegistry()
+{
+    // no readers or writers may be active any more
+    for( size_t i = 0; i < m_Retired.size(); ++i )
+    {
+        if( m_Retired[i].pRelease != NULL )
+        {
+            m_Retired[i].pRelease->Release();
+        }
+
+        FreeTable( m_Retired[i].pTable );
+    }
+
+    for( size_t i = 0; i < m_Spare.size(); ++i )
+    {
+        FreeTable( m_Spare[i] );
+    }
+
+    STable* pTable = m_pTable.load();
+
+    for( size_t i = 0; i < pTable->count; ++i )
+    {
+        if( pTable->entries[i].pDev != NULL )
+        {
+            pTable->entries[i].pDev->Release();
+        }
+    }
+
+    FreeTable(pTable);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CDeviceRegistry::STable* CDeviceRegistry::AllocTable( size_t capacity )
+{
+    const size_t bytes = sizeof(STable) + capacity * sizeof(SDeviceInfo) + 4 * capacity * sizeof(uint32_t);
+    char* p = static_cast<char*>( ::operator new(bytes) );
+
+    STable* pTable = reinterpret_cast<STable*>(p);
+    pTable->count = 0;
+    pTable->present = 0;
+    pTable->capacity = capacity;
+    pTable->entries = reinterpret_cast<SDeviceInfo*>( p + sizeof(STable) );
+    pTable->byPointer = reinterpret_cast<uint32_t*>( pTable->entries + capacity );
+    pTable->byPersistentId = pTable->byPointer + 2 * capacity;
+
+    memset( pTable->byPointer, 0, 4 * capacity * sizeof(uint32_t) );
+    return pTable;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDeviceRegistry::FreeTable( STable* pTable )
+{
+    ::operator delete( pTable );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDeviceRegistry::IndexEntry( STable* pTable, size_t index )
+{
+    const size_t mask = 2 * pTable->capacity - 1;
+    const SDeviceInfo& info = pTable->entries[index];
+
+    size_t slot;
+
+    if( info.pDev != NULL )
+    {
+        slot = HashKey( (uintptr_t)info.pDev ) & mask;
+
+        while( pTable->byPointer[slot] != 0 )
+        {
+            slot = ( slot + 1 ) & mask;
+        }
+
+        pTable->byPointer[slot] = (uint32_t)index + 1;
+    }
+
+    if( info.hasPersistentId )
+    {
+        slot = HashKey( (uint64_t)info.persistentId ) & mask;
+
+        while( pTable->byPersistentId[slot] != 0 )
+        {
+            slot = ( slot + 1 ) & mask;
+        }
+
+        pTable->byPersistentId[slot] = (uint32_t)index + 1;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const SDeviceInfo* CDeviceRegistry::Lookup( const STable* pTable, const IDeckLink* pDev )
+{
+    const size_t mask = 2 * pTable->capacity - 1;
+
+    for( size_t slot = HashKey( (uintptr_t)pDev ) & mask; pTable->byPointer[slot] != 0; slot = ( slot + 1 ) & mask )
+    {
+        const SDeviceInfo* pInfo = &pTable->entries[ pTable->byPointer[slot] - 1 ];
+
+        if( pInfo->pDev == pDev )
+        {
+            return pInfo;
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const SDeviceInfo* CDeviceRegistry::Lookup( const STable* pTable, int64_t persistentId )
+{
+    const size_t mask = 2 * pTable->capacity - 1;
+
+    for( size_t slot = HashKey( (uint64_t)persistentId ) & mask; pTable->byPersistentId[slot] != 0;
+                                                                                        slot = ( slot + 1 ) & mask )
+    {
+        const SDeviceInfo* pInfo = &pTable->entries[ pTable->byPersistentId[slot] - 1 ];
+
+        if( pInfo->persistentId == persistentId )
+        {
+            return pInfo;
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CDeviceRegistry::STable* CDeviceRegistry::NewTable( size_t count )
+{
+    size_t capacity = 8;
+
+    while( capacity < count )
+    {
+        capacity <<= 1;
+    }
+
+    for( size_t i = 0; i < m_Spare.size(); ++i )
+    {
+        if( m_Spare[i]->capacity == capacity )
+        {
+            STable* pTable = m_Spare[i];
+            m_Spare[i] = m_Spare.back();
+            m_Spare.pop_back();
+
+            pTable->count = 0;
+            pTable->present = 0;
+            memset( pTable->byPointer, 0, 4 * capacity * sizeof(uint32_t) );
+            return pTable;
+        }
+    }
+
+    return AllocTable(capacity);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDeviceRegistry::Publish( STable* pTable, IDeckLink* pRelease )
+{
+    STable* pOld = m_pTable.exchange(pTable);
+    uint64_t epoch = m_Epoch.fetch_add(1) + 1;
+
+    SRetired retired = { pOld, epoch, pRelease };
+    m_Retired.push_back(retired);
+
+    Reclaim();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDeviceRegistry::Reclaim()
+{
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+
+    for( unsigned i = 0; i < kMaxReaders; ++i )
+    {
+        uint64_t epoch = m_Readers[i].epoch.load();
+
+        if( epoch != 0 && epoch < oldest )
+        {
+            oldest = epoch;
+        }
+    }
+
+    size_t kept = 0;
+
+    for( size_t i = 0; i < m_Retired.size(); ++i )
+    {
+        SRetired& retired = m_Retired[i];
+
+        if( retired.epoch > oldest )
+        {
+            m_Retired[kept++] = retired;
+            continue;
+        }
+
+        if( retired.pRelease != NULL )
+        {
+            retired.pRelease->Release();
+        }
+
+        if( m_Spare.size() < kMaxSpareTables )
+        {
+            m_Spare.push_back( retired.pTable );
+        }
+        else
+        {
+            FreeTable( retired.pTable );
+        }
+    }
+
+    m_Retired.resize(kept);
+    m_HaveRetired.store( kept != 0, std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+unsigned CDeviceRegistry::EnterRead( const STable** ppTable )
+{
+    unsigned slot = t_ReaderHint;
+
+    if( slot >= kMaxReaders )
+    {
+        slot = g_NextReaderHint.fetch_add( 1, std::memory_order_relaxed ) % kMaxReaders;
+    }
+
+    const uint64_t epoch = m_Epoch.load();
+
+    for(;;)
+    {
+        uint64_t expected = 0;
+
+        if( m_Readers[slot].epoch.compare_exchange_strong( expected, epoch ) )
+        {
+            break;
+        }
+
+        slot = ( slot + 1 ) % kMaxReaders;
+    }
+
+    t_ReaderHint = slot;
+    *ppTable = m_pTable.load();
+    return slot;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDeviceRegistry::LeaveRead( unsigned slot )
+{
+    m_Readers[slot].epoch.store( 0, std::memory_order_release );
+
+    // what a writer could not reclaim may have been waiting for this reader only, and would otherwise stay until the
+    // next hot-plug, which may never come. Never waits for a writer: one still in its Publish() may miss this reader
+    // leaving, and the next reader to leave retries.
+    if( m_HaveRetired.load( std::memory_order_relaxed ) && m_WriteMutex.try_lock() )
+    {
+        Reclaim();
+        m_WriteMutex.unlock();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CDeviceRegistry::Add( const SDeviceInfo& info, uint32_t* pGeneration, SDeviceInfo* pReplaced )
+{
+    std::lock_guard<std::mutex> lock(m_WriteMutex);
+
+    const STable* pCur = m_pTable.load( std::memory_order_relaxed );
+
+    if( info.pDev == NULL || Lookup( pCur, info.pDev ) != NULL )
+    {
+        return false;
+    }
+
+    // a known persistent ID re-uses its entry: the same physical port came back (or re-appeared under a new pointer)
+    const SDeviceInfo* pKnown = info.hasPersistentId ? Lookup( pCur, info.persistentId ) : NULL;
+    const size_t index = ( pKnown != NULL ) ? (size_t)( pKnown - pCur->entries ) : pCur->count;
+
+    STable* pTable = NewTable( pCur->count + 1 );
+    memcpy( pTable->entries, pCur->entries, pCur->count * sizeof(SDeviceInfo) );
+    pTable->count = pCur->count;
+    pTable->present = pCur->present;
+
+    IDeckLink* pRelease = NULL;
+    SDeviceInfo& entry = pTable->entries[index];
+
+    if( pKnown != NULL )
+    {
+        pRelease = pKnown->pDev;
+        entry = info;
+        entry.generation = pKnown->generation + 1;
+    }
+    else
+    {
+        entry = info;
+        entry.generation = 1;
+        ++pTable->count;
+    }
+
+    if( pRelease == NULL )
+    {
+        ++pTable->present;
+    }
+
+    for( size_t i = 0; i < pTable->count; ++i )
+    {
+        IndexEntry( pTable, i );
+    }
+
+    if( pGeneration != NULL )
+    {
+        *pGeneration = entry.generation;
+    }
+
+    if( pReplaced != NULL )
+    {
+        if( pRelease != NULL )
+        {
+            // outlives the registry's reference, for the caller to report the removal with
+            *pReplaced = *pKnown;
+            pRelease->AddRef();
+        }
+        else
+        {
+            pReplaced->pDev = NULL;
+        }
+    }
+
+    info.pDev->AddRef();
+    Publish( pTable, pRelease );
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CDeviceRegistry::Remove( IDeckLink* pDev, SDeviceInfo* pInfo )
+{
+    std::lock_guard<std::mutex> lock(m_WriteMutex);
+
+    const STable* pCur = m_pTable.load( std::memory_order_relaxed );
+    const SDeviceInfo* pFound = Lookup( pCur, pDev );
+
+    if( pFound == NULL )
+    {
+        return false;
+    }
+
+    if( pInfo != NULL )
+    {
+        *pInfo = *pFound;
+    }
+
+    STable* pTable = NewTable( pCur->count );
+    pTable->present = pCur->present - 1;
+
+    for( size_t i = 0; i < pCur->count; ++i )
+    {
+        const SDeviceInfo& entry = pCur->entries[i];
+
+        if( &entry != pFound )
+        {
+            pTable->entries[ pTable->count++ ] = entry;
+        }
+        else if( entry.hasPersistentId )
+        {
+            // keep the identity so that the port is recognised when it comes back
+            pTable->entries[ pTable->count ] = entry;
+            pTable->entries[ pTable->count++ ].pDev = NULL;
+        }
+    }
+
+    for( size_t i = 0; i < pTable->count; ++i )
+    {
+        IndexEntry( pTable, i );
+    }
+
+    Publish( pTable, pDev );
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CDeviceRegistry::FindByPointer( IDeckLink* pDev, SDeviceInfo* pInfo )
+{
+    const STable* pTable;
+    unsigned slot = EnterRead(&pTable);
+
+    const SDeviceInfo* pFound = ( pDev != NULL ) ? Lookup( pTable, pDev ) : NULL;
+
+    if( pFound != NULL )
+    {
+        *pInfo = *pFound;
+        pInfo->pDev->AddRef();
+    }
+
+    LeaveRead(slot);
+    return pFound != NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CDeviceRegistry::FindByPersistentId( int64_t persistentId, SDeviceInfo* pInfo )
+{
+    const STable* pTable;
+    unsigned slot = EnterRead(&pTable);
+
+    const SDeviceInfo* pFound = Lookup( pTable, persistentId );
+
+    if( pFound != NULL )
+    {
+        *pInfo = *pFound;
+
+        if( pInfo->pDev != NULL )
+        {
+            pInfo->pDev->AddRef();
+        }
+    }
+
+    LeaveRead(slot);
+    return pFound != NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDeviceRegistry::Snapshot( std::vector<SDeviceInfo>* pDevices, bool includeAbsent )
+{
+    const STable* pTable;
+    unsigned slot = EnterRead(&pTable);
+
+    for( size_t i = 0; i < pTable->count; ++i )
+    {
+        const SDeviceInfo& entry = pTable->entries[i];
+
+        if( entry.pDev != NULL )
+        {
+            entry.pDev->AddRef();
+        }
+        else if( !includeAbsent )
+        {
+            continue;
+        }
+
+        pDevices->push_back(entry);
+    }
+
+    LeaveRead(slot);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+size_t CDeviceRegistry::Count()
+{
+    const STable* pTable;
+    unsigned slot = EnterRead(&pTable);
+
+    size_t count = pTable->present;
+
+    LeaveRead(slot);
+    return count;
+}
@@ -0,0 +1,120 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "DeckLinkPlatform.h"
+#include "DeviceCaps.h"
+
+//=====================================================================================================================
+// Identity and capabilities of a device (port), read from the driver once when it arrives.
+struct SDeviceInfo
+{
+    IDeckLink*  pDev;                   // NULL while the device is absent
+    int64_t     persistentId;
+    bool        hasPersistentId;
+    int64_t     subDeviceIndex;         // -1 if not reported
+    int64_t     numberOfSubDevices;     // 0 if not reported
+    uint32_t    generation;             // number of arrivals seen for this persistent ID, set by the registry
+    char        modelName[64];
+    char        displayName[64];
+    SDeviceCaps caps;
+};
+
+//=====================================================================================================================
+// Set of present devices, looked up by IDeckLink pointer or by BMDDeckLinkPersistentID.
+//
+// Devices are identified by persistent ID rather than by pointer: when a device is removed its entry stays behind
+// (with pDev = NULL), and when a device with the same persistent ID arrives again the entry is re-used and its
+// generation bumped. A consumer bound to a port can thus rebind with a single FindByPersistentId(), and a pointer
+// re-used by the driver for a different card is never confused with the old one. Devices without a persistent ID
+// are forgotten on removal.
+//
+// The contents live in an immutable open-addressed table which is replaced as a whole on every change (copy on write).
+// Readers never lock: they announce the epoch they read in and use whatever table is current. A replaced table, and
+// the registry's reference on a removed device, are released once no reader can still be looking at them: by the next
+// writer, or by the next reader to leave the registry while the writers' mutex is free. Lookups are wait-free as long
+// as there are no more than kMaxReaders threads inside the registry at the same time.
+//
+// Writers are serialised with a mutex. Replaced tables are recycled, so steady-state hot-plug does not allocate.
+class CDeviceRegistry
+{
+public:
+    enum { kMaxReaders = 64, kMaxSpareTables = 16 };
+
+private:
+    struct STable
+    {
+        size_t        count;          // entries in use, including absent devices
+        size_t        present;
+        size_t        capacity;       // entries; the index arrays have twice as many slots
+        SDeviceInfo*  entries;
+        uint32_t*     byPointer;      // entry index + 1, 0 = empty slot
+        uint32_t*     byPersistentId;
+    };
+
+    struct SRetired
+    {
+        STable*     pTable;
+        uint64_t    epoch;            // safe to reclaim once no reader is in an earlier epoch
+        IDeckLink*  pRelease;         // device whose registry reference goes away with the table
+    };
+
+    struct alignas(64) SReaderSlot
+    {
+        std::atomic<uint64_t>  epoch; // 0 = free
+    };
+
+    std::atomic<STable*>   m_pTable;
+    std::atomic<uint64_t>  m_Epoch;
+    SReaderSlot            m_Readers[kMaxReaders];
+
+    std::mutex             m_WriteMutex;
+    std::vector<SRetired>  m_Retired;
+    std::atomic<bool>      m_HaveRetired;     // m_Retired is not empty, for the readers to look at without the mutex
+    std::vector<STable*>   m_Spare;
+
+    CDeviceRegistry( const CDeviceRegistry& );
+    CDeviceRegistry& operator=( const CDeviceRegistry& );
+
+    static STable* AllocTable( size_t capacity );
+    static void FreeTable( STable* pTable );
+    static void IndexEntry( STable* pTable, size_t index );
+    static const SDeviceInfo* Lookup( const STable* pTable, const IDeckLink* pDev );
+    static const SDeviceInfo* Lookup( const STable* pTable, int64_t persistentId );
+
+    STable* NewTable( size_t count );
+    void Publish( STable* pTable, IDeckLink* pRelease );
+    void Reclaim();
+
+    unsigned EnterRead( const STable** ppTable );
+    void LeaveRead( unsigned slot );
+
+public:
+    CDeviceRegistry();
+    ~CDeviceRegistry();
+
+    // Writers. Add takes a reference on the device, Remove drops it (deferred). Both return false if nothing changed.
+    // Add reports the generation assigned to the device, Remove the entry as it was (pInfo->pDev not AddRef'ed).
+    // A device whose persistent ID is still present under another pointer takes over its entry, and the other device
+    // is dropped as if removed: Add reports it in *pReplaced with pDev AddRef'ed, or pReplaced->pDev = NULL if none.
+    bool Add( const SDeviceInfo& info, uint32_t* pGeneration = NULL, SDeviceInfo* pReplaced = NULL );
+    bool Remove( IDeckLink* pDev, SDeviceInfo* pInfo = NULL );
+
+    // Readers. On success the device in *pInfo, if present, is AddRef'ed and must be released by the caller.
+    // FindByPersistentId() also finds absent devices (pInfo->pDev == NULL).
+    bool FindByPointer( IDeckLink* pDev, SDeviceInfo* pInfo );
+    bool FindByPersistentId( int64_t persistentId, SDeviceInfo* pInfo );
+
+    // Appends the known devices, present ones AddRef'ed.
+    void Snapshot( std::vector<SDeviceInfo>* pDevices, bool includeAbsent = false );
+
+    // Number of present devices.
+    size_t Count();
+};
+
+#endif // DEVICE_REGISTRY_H
@@ -0,0 +1,434 @@
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Clock.h"
+#include "DiscoveryBroker.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+static const size_t kBatchSize = 32 * 1024;
+
+//---------------------------------------------------------------------------------------------------------------------
+bool ReadBrokerSnapshot( const SBrokerSnapshot* pShared, std::vector<SBrokerDevice>* pDevices )
+{
+    if( pShared->magic != kBrokerMagic || pShared->version != kBrokerVersion ||
+        pShared->deviceSize != sizeof(SBrokerDevice) )
+    {
+        return false;
+    }
+
+    for( int attempt = 0; attempt < 1000; ++attempt )
+    {
+        uint64_t seq = pShared->seq.load( std::memory_order_acquire );
+
+        if( seq & 1 )
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        uint32_t count = pShared->count;
+
+        if( count > pShared->capacity )
+        {
+            continue;
+        }
+
+        pDevices->resize(count);
+        memcpy( pDevices->data(), pShared->devices, count * sizeof(SBrokerDevice) );
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+
+        if( pShared->seq.load( std::memory_order_relaxed ) == seq )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#ifdef __linux__
+//=====================================================================================================================
+CDiscoveryBroker::CDiscoveryBroker( CDeviceRegistry* pRegistry )
+    : m_pRegistry(pRegistry), m_ListenFd(-1), m_WakeFd(-1), m_ShmFd(-1), m_ShmReadFd(-1), m_pShared(NULL),
+      m_SharedSize(0), m_Batch(kBatchSize), m_BatchUsed(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CDiscoveryBroker::~CDiscoveryBroker()
+{
+    Stop();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::Start( const char* path, unsigned capacity )
+{
+    m_SharedSize = offsetof( SBrokerSnapshot, devices ) + capacity * sizeof(SBrokerDevice);
+    m_SharedSize = ( m_SharedSize + 4095 ) & ~(size_t)4095;
+
+    m_ShmFd = memfd_create( "decklink-discovery", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+
+    if( m_ShmFd < 0 || ftruncate( m_ShmFd, (off_t)m_SharedSize ) != 0 )
+    {
+        Close();
+        throw std::runtime_error("creating the shared snapshot failed");
+    }
+
+    // clients may rely on the size: nobody can change it any more
+    fcntl( m_ShmFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL );
+
+    void* p = mmap( NULL, m_SharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_ShmFd, 0 );
+
+    if( p == MAP_FAILED )
+    {
+        Close();
+        throw std::runtime_error("mapping the shared snapshot failed");
+    }
+
+    m_pShared = static_cast<SBrokerSnapshot*>(p);
+    m_pShared->magic = kBrokerMagic;
+    m_pShared->version = kBrokerVersion;
+    m_pShared->deviceSize = sizeof(SBrokerDevice);
+    m_pShared->capacity = capacity;
+    m_pShared->seq.store( 0, std::memory_order_relaxed );
+
+    // a read-only descriptor for the clients, so that they cannot map the snapshot writable
+    char procPath[64];
+    snprintf( procPath, sizeof(procPath), "/proc/self/fd/%d", m_ShmFd );
+    m_ShmReadFd = open( procPath, O_RDONLY | O_CLOEXEC );
+
+    if( m_ShmReadFd < 0 )
+    {
+        m_ShmReadFd = dup(m_ShmFd);
+    }
+
+    Publish();
+
+    sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+
+    if( strlen(path) >= sizeof(addr.sun_path) )
+    {
+        Close();
+        throw std::runtime_error("broker socket path too long");
+    }
+
+    strcpy( addr.sun_path, path );
+    unlink(path);
+
+    m_Path = path;
+    m_ListenFd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+    m_WakeFd = eventfd( 0, EFD_CLOEXEC );
+
+    if( m_ListenFd < 0 || m_WakeFd < 0 ||
+        bind( m_ListenFd, (const sockaddr*)&addr, sizeof(addr) ) != 0 || listen( m_ListenFd, 64 ) != 0 )
+    {
+        std::string msg = std::string("listening on ") + path + " failed: " + strerror(errno);
+        Close();
+        throw std::runtime_error(msg);
+    }
+
+    m_Thread = std::thread( &CDiscoveryBroker::AcceptMain, this );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::Stop()
+{
+    if( m_Thread.joinable() )
+    {
+        uint64_t one = 1;
+        ssize_t n = write( m_WakeFd, &one, sizeof(one) );
+        (void)n;
+        m_Thread.join();
+    }
+
+    Close();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_ClientsMutex);
+
+        for( size_t i = 0; i < m_Clients.size(); ++i )
+        {
+            close( m_Clients[i] );
+        }
+
+        m_Clients.clear();
+    }
+
+    if( m_ListenFd >= 0 )
+    {
+        close(m_ListenFd);
+        unlink( m_Path.c_str() );
+        m_ListenFd = -1;
+    }
+
+    if( m_WakeFd >= 0 )
+    {
+        close(m_WakeFd);
+        m_WakeFd = -1;
+    }
+
+    if( m_pShared != NULL )
+    {
+        munmap( m_pShared, m_SharedSize );
+        m_pShared = NULL;
+    }
+
+    if( m_ShmReadFd >= 0 )
+    {
+        close(m_ShmReadFd);
+        m_ShmReadFd = -1;
+    }
+
+    if( m_ShmFd >= 0 )
+    {
+        close(m_ShmFd);
+        m_ShmFd = -1;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+size_t CDiscoveryBroker::ClientCount()
+{
+    std::lock_guard<std::mutex> lock(m_ClientsMutex);
+    return m_Clients.size();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CDiscoveryBroker::SendHello( int fd )
+{
+    SBrokerHello hello;
+    hello.magic = kBrokerMagic;
+    hello.version = kBrokerVersion;
+    hello.snapshotSize = m_SharedSize;
+
+    iovec iov;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+
+    union
+    {
+        char     buf[ CMSG_SPACE(sizeof(int)) ];
+        cmsghdr  align;
+    } control;
+
+    memset( &control, 0, sizeof(control) );
+
+    msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+    pCmsg->cmsg_level = SOL_SOCKET;
+    pCmsg->cmsg_type = SCM_RIGHTS;
+    pCmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy( CMSG_DATA(pCmsg), &m_ShmReadFd, sizeof(int) );
+
+    return sendmsg( fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT ) == (ssize_t)sizeof(hello);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::AcceptMain()
+{
+    std::vector<pollfd> fds;
+    std::vector<int> gone;
+    char discard[256];
+
+    for(;;)
+    {
+        fds.clear();
+
+        pollfd pfd;
+        pfd.fd = m_WakeFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+
+        pfd.fd = m_ListenFd;
+        fds.push_back(pfd);
+
+        {
+            std::lock_guard<std::mutex> lock(m_ClientsMutex);
+
+            for( size_t i = 0; i < m_Clients.size(); ++i )
+            {
+                pfd.fd = m_Clients[i];
+                fds.push_back(pfd);
+            }
+        }
+
+        if( poll( fds.data(), fds.size(), -1 ) < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        if( fds[0].revents != 0 )
+        {
+            break;
+        }
+
+        // clients are not expected to send anything: readable means closed (or misbehaving)
+        gone.clear();
+
+        for( size_t i = 2; i < fds.size(); ++i )
+        {
+            if( fds[i].revents != 0 && recv( fds[i].fd, discard, sizeof(discard), MSG_DONTWAIT ) <= 0 )
+            {
+                gone.push_back( fds[i].fd );
+            }
+        }
+
+        if( !gone.empty() )
+        {
+            std::lock_guard<std::mutex> lock(m_ClientsMutex);
+
+            for( size_t i = 0; i < gone.size(); ++i )
+            {
+                std::vector<int>::iterator it = std::find( m_Clients.begin(), m_Clients.end(), gone[i] );
+
+                if( it != m_Clients.end() )
+                {
+                    close(*it);
+                    m_Clients.erase(it);
+                }
+            }
+        }
+
+        if( fds[1].revents & POLLIN )
+        {
+            int fd = accept4( m_ListenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK );
+
+            if( fd >= 0 )
+            {
+                // under the lock, so that no batch can go out between the hello and the registration
+                std::lock_guard<std::mutex> lock(m_ClientsMutex);
+
+                if( SendHello(fd) )
+                {
+                    m_Clients.push_back(fd);
+                }
+                else
+                {
+                    close(fd);
+                }
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::Publish()
+{
+    m_Devices.clear();
+    m_pRegistry->Snapshot( &m_Devices, true );
+
+    SBrokerSnapshot* pShared = m_pShared;
+    const uint64_t seq = pShared->seq.load( std::memory_order_relaxed );
+
+    pShared->seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    uint32_t count = 0;
+    uint32_t present = 0;
+
+    for( size_t i = 0; i < m_Devices.size(); ++i )
+    {
+        const SDeviceInfo& info = m_Devices[i];
+
+        if( count < pShared->capacity )
+        {
+            SBrokerDevice& dev = pShared->devices[count++];
+
+            dev.persistentId = info.persistentId;
+            dev.flags = ( info.pDev != NULL ? kBrokerDevicePresent : 0 ) |
+                        ( info.hasPersistentId ? kBrokerDevicePersistentId : 0 );
+            dev.generation = info.generation;
+            dev.subDeviceIndex = info.subDeviceIndex;
+            dev.numberOfSubDevices = info.numberOfSubDevices;
+            memcpy( dev.modelName, info.modelName, sizeof(dev.modelName) );
+            memcpy( dev.displayName, info.displayName, sizeof(dev.displayName) );
+            dev.caps = info.caps;
+
+            present += ( info.pDev != NULL ) ? 1 : 0;
+        }
+
+        if( info.pDev != NULL )
+        {
+            info.pDev->Release();
+        }
+    }
+
+    pShared->count = count;
+    pShared->present = present;
+    pShared->timeNs = MonotonicNs();
+
+    pShared->seq.store( seq + 2, std::memory_order_release );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::SendBatch()
+{
+    Publish();
+
+    std::lock_guard<std::mutex> lock(m_ClientsMutex);
+
+    for( size_t i = 0; i < m_Clients.size(); ++i )
+    {
+        // One datagram per batch. A client whose socket buffer is full has fallen behind and is disconnected; the
+        // accept thread then reaps it (it alone closes client sockets, so it never sees a descriptor re-used).
+        if( send( m_Clients[i], m_Batch.data(), m_BatchUsed, MSG_NOSIGNAL | MSG_DONTWAIT ) != (ssize_t)m_BatchUsed )
+        {
+            shutdown( m_Clients[i], SHUT_RDWR );
+        }
+    }
+
+    m_BatchUsed = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::OnEvent( const SEventRecord& rec )
+{
+    if( m_BatchUsed + kEventBinaryHeaderSize + sizeof(rec.modelName) > m_Batch.size() )
+    {
+        SendBatch();
+    }
+
+    m_BatchUsed += FormatEventBinary( rec, m_Batch.data() + m_BatchUsed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CDiscoveryBroker::OnBatchEnd()
+{
+    if( m_BatchUsed != 0 )
+    {
+        SendBatch();
+    }
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef DISCOVERY_BROKER_H
+#define DISCOVERY_BROKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeviceRegistry.h"
+#include "EventLog.h"
+
+//=====================================================================================================================
+// Protocol between the discovery broker and its clients (version 1).
+//
+// A client connects to the broker's Unix socket (SOCK_SEQPACKET). The first message it receives is an SBrokerHello
+// carrying, as SCM_RIGHTS, a read-only file descriptor of the shared snapshot, which the client maps (the size is in
+// the hello) and reads with ReadBrokerSnapshot(). Every following message is a batch of device events in the binary
+// format of the event log (see EventLog.h). The snapshot is updated before each batch is sent, so after receiving an
+// event the snapshot reflects at least that event. A client which does not keep up with the events is disconnected.
+enum
+{
+    kBrokerMagic   = 0x4B4C4344,    // 'DCLK'
+    kBrokerVersion = 1,
+};
+
+enum EBrokerDeviceFlags
+{
+    kBrokerDevicePresent      = 1 << 0,
+    kBrokerDevicePersistentId = 1 << 1,
+};
+
+struct SBrokerHello
+{
+    uint32_t  magic;
+    uint32_t  version;
+    uint64_t  snapshotSize;
+};
+
+struct SBrokerDevice
+{
+    int64_t      persistentId;
+    uint32_t     flags;                  // EBrokerDeviceFlags
+    uint32_t     generation;
+    int64_t      subDeviceIndex;
+    int64_t      numberOfSubDevices;
+    char         modelName[64];
+    char         displayName[64];
+    SDeviceCaps  caps;
+};
+
+// Beginning of the shared snapshot; devices[] has room for capacity entries.
+struct SBrokerSnapshot
+{
+    uint32_t               magic;
+    uint32_t               version;
+    uint32_t               deviceSize;   // sizeof(SBrokerDevice)
+    uint32_t               capacity;
+    std::atomic<uint64_t>  seq;          // odd while the broker is writing
+    uint64_t               timeNs;       // monotonic time of the last update
+    uint32_t               count;        // entries of devices[] in use, absent devices included
+    uint32_t               present;
+    SBrokerDevice          devices[1];
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Copies a consistent view of the snapshot. Returns false if the mapping is not a compatible snapshot or the broker
+// kept it busy for too long.
+bool ReadBrokerSnapshot( const SBrokerSnapshot* pShared, std::vector<SBrokerDevice>* pDevices );
+
+#ifdef __linux__
+//=====================================================================================================================
+// Serves the devices known to one discovery session to any number of local processes, so that they need neither
+// their own IDeckLinkDiscovery nor a driver enumeration to learn the current state.
+//
+// Events come in through IEventSink on the event log's drain thread; a second thread accepts and reaps clients.
+class CDiscoveryBroker : public IEventSink
+{
+    CDeviceRegistry*           m_pRegistry;
+    std::string                m_Path;
+    int                        m_ListenFd;
+    int                        m_WakeFd;       // eventfd, stops the accept thread
+    int                        m_ShmFd;
+    int                        m_ShmReadFd;    // read-only descriptor handed to clients
+    SBrokerSnapshot*           m_pShared;
+    size_t                     m_SharedSize;
+    std::thread                m_Thread;
+
+    std::mutex                 m_ClientsMutex;
+    std::vector<int>           m_Clients;
+
+    // used on the drain thread only
+    std::vector<SDeviceInfo>   m_Devices;
+    std::vector<char>          m_Batch;
+    size_t                     m_BatchUsed;
+
+    CDiscoveryBroker( const CDiscoveryBroker& );
+    CDiscoveryBroker& operator=( const CDiscoveryBroker& );
+
+    void AcceptMain();
+    bool SendHello( int fd );
+    void Publish();
+    void SendBatch();
+    void Close();
+
+public:
+    explicit CDiscoveryBroker( CDeviceRegistry* pRegistry );
+    ~CDiscoveryBroker();
+
+    // Creates the snapshot and starts listening on path (an existing socket file is replaced).
+    // Throws std::runtime_error.
+    void Start( const char* path, unsigned capacity = 256 );
+    void Stop();
+
+    size_t ClientCount();
+
+    // overrides IEventSink
+    virtual void OnEvent( const SEventRecord& rec );
+    virtual void OnBatchEnd();
+};
+#endif
+
+#endif // DISCOVERY_BROKER_H
@@ -0,0 +1,189 @@
+#include "DiscoveryCallback.h"
+#include "StartupProfile.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static SDeviceInfo QueryDeviceInfo( IDeckLink* pDev )
+{
+    SDeviceInfo info;
+    memset( &info, 0, sizeof(info) );
+
+    info.pDev = pDev;
+    info.subDeviceIndex = -1;
+
+    DLString name;
+
+    if( pDev->GetModelName(&name) == S_OK )
+    {
+        TakeDLString( name, info.modelName, sizeof(info.modelName) );
+    }
+
+    if( pDev->GetDisplayName(&name) == S_OK )
+    {
+        TakeDLString( name, info.displayName, sizeof(info.displayName) );
+    }
+
+    IDeckLinkAttributes* pAttr = NULL;
+
+    if( pDev->QueryInterface( IID_IDeckLinkAttributes, (void**)&pAttr ) == S_OK )
+    {
+        int64_t value;
+
+        info.hasPersistentId = ( pAttr->GetInt( BMDDeckLinkPersistentID, &info.persistentId ) == S_OK );
+
+        if( pAttr->GetInt( BMDDeckLinkSubDeviceIndex, &value ) == S_OK )
+        {
+            info.subDeviceIndex = value;
+        }
+
+        if( pAttr->GetInt( BMDDeckLinkNumberOfSubDevices, &value ) == S_OK )
+        {
+            info.numberOfSubDevices = value;
+        }
+
+        pAttr->Release();
+    }
+
+    BuildDeviceCaps( pDev, &info.caps );
+
+    return info;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void FillEventRecord( SEventRecord* pRec, uint32_t type, IDeckLink* pDev, const SDeviceInfo* pInfo )
+{
+    pRec->timeNs = 0;
+    pRec->type = type;
+    pRec->flags = 0;
+    pRec->device = (uintptr_t)pDev;
+    pRec->persistentId = 0;
+    pRec->subDeviceIndex = -1;
+    pRec->generation = 0;
+    pRec->modelName[0] = '\0';
+
+    if( pInfo != NULL )
+    {
+        pRec->flags |= pInfo->hasPersistentId ? kEventFlagPersistentId : 0;
+        pRec->persistentId = pInfo->persistentId;
+        pRec->subDeviceIndex = (int32_t)pInfo->subDeviceIndex;
+        pRec->generation = pInfo->generation;
+        strncpy( pRec->modelName, pInfo->modelName, sizeof(pRec->modelName) - 1 );
+        pRec->modelName[ sizeof(pRec->modelName) - 1 ] = '\0';
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CDiscoveryCallback::AddListener( IDeviceListener* pListener )
+{
+    if( m_ListenerCount >= kMaxListeners )
+    {
+        return false;
+    }
+
+    m_pListeners[m_ListenerCount++] = pListener;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CDiscoveryCallback::DeckLinkDeviceArrived( IDeckLink* pDev )
+{
+    StartupMark(kMarkFirstArrival);
+
+    SDeviceInfo info = QueryDeviceInfo(pDev);
+
+    // false for a pointer already registered: no reference was taken and no generation assigned, so the listeners
+    // must not bind to it (again)
+    SDeviceInfo replaced;
+    const bool added = m_Registry.Add( info, &info.generation, &replaced );
+
+    SEventRecord rec;
+
+    // the port re-appeared under a new pointer before the old one was removed: the old one is gone for the registry,
+    // and its removal by the API later will find it unknown, so the listeners are told now
+    if( added && replaced.pDev != NULL )
+    {
+        FillEventRecord( &rec, kEventDeviceRemoved, replaced.pDev, &replaced );
+        rec.flags |= kEventFlagKnownDevice | kEventFlagReplaced;
+        m_pLog->Post(rec);
+
+        for( int i = m_ListenerCount - 1; i >= 0; --i )
+        {
+            m_pListeners[i]->OnDeviceRemoved(replaced);
+        }
+
+        replaced.pDev->Release();
+    }
+
+    FillEventRecord( &rec, kEventDeviceArrived, pDev, &info );
+
+    if( !added )
+    {
+        rec.flags |= kEventFlagDuplicate;
+    }
+
+    m_pLog->Post(rec);
+
+    for( int i = 0; added && i < m_ListenerCount; ++i )
+    {
+        m_pListeners[i]->OnDeviceArrived(info);
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CDiscoveryCallback::DeckLinkDeviceRemoved( IDeckLink* pDev )
+{
+    SDeviceInfo info;
+    SEventRecord rec;
+
+    const bool known = m_Registry.Remove( pDev, &info );
+
+    if( known )
+    {
+        FillEventRecord( &rec, kEventDeviceRemoved, pDev, &info );
+        rec.flags |= kEventFlagKnownDevice;
+    }
+    else
+    {
+        FillEventRecord( &rec, kEventDeviceRemoved, pDev, NULL );
+    }
+
+    m_pLog->Post(rec);
+
+    for( int i = m_ListenerCount - 1; known && i >= 0; --i )
+    {
+        m_pListeners[i]->OnDeviceRemoved(info);
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CDiscoveryCallback::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkDeviceNotificationCallback ) )
+    {
+        *ppvObject = static_cast<IDeckLinkDeviceNotificationCallback*>(this);
+        return S_OK;
+    }
+
+    if( IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IUnknown*>(this);
+        return S_OK;
+    }
+
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CDiscoveryCallback::AddRef(void)
+{
+    return 2;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CDiscoveryCallback::Release(void)
+{
+    return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef DISCOVERY_CALLBACK_H
+#define DISCOVERY_CALLBACK_H
+
+#include "DeckLinkPlatform.h"
+#include "DeviceRegistry.h"
+#include "EventLog.h"
+
+//=====================================================================================================================
+// Told about devices coming and going, on the API's notification thread, after the registry has been updated.
+// Unlike the event log this is synchronous: the API waits while the listener sets up or tears down its use of the
+// device. Removal is only reported for devices whose arrival was.
+class IDeviceListener
+{
+public:
+    virtual ~IDeviceListener() {}
+
+    virtual void OnDeviceArrived( const SDeviceInfo& info ) = 0;
+    virtual void OnDeviceRemoved( const SDeviceInfo& info ) = 0;
+};
+
+//=====================================================================================================================
+class CDiscoveryCallback : public IDeckLinkDeviceNotificationCallback
+{
+    enum { kMaxListeners = 4 };
+
+    CDeviceRegistry   m_Registry;
+    CEventLog*        m_pLog;
+    IDeviceListener*  m_pListeners[kMaxListeners];
+    int               m_ListenerCount;
+
+public:
+    explicit CDiscoveryCallback( CEventLog* pLog ) : m_pLog(pLog), m_ListenerCount(0)  {}
+
+    // Present devices; safe to query from any thread.
+    CDeviceRegistry& Registry()  { return m_Registry; }
+
+    // Must be called before notifications are installed. Listeners are told about arrivals in the order they were
+    // added and about removals in the reverse order. Returns false if there are too many.
+    bool AddListener( IDeviceListener* pListener );
+
+    // overrides IDeckLinkDeviceNotificationCallback
+    virtual HRESULT STDMETHODCALLTYPE DeckLinkDeviceArrived( IDeckLink* pDev );
+
+    virtual HRESULT STDMETHODCALLTYPE DeckLinkDeviceRemoved( IDeckLink* pDev );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+#endif // DISCOVERY_CALLBACK_H
@@ -0,0 +1,200 @@
+#include <ctype.h>
+
+#include "DisplayModes.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+#define SD   bmdDisplayModeColorspaceRec601
+#define HD   bmdDisplayModeColorspaceRec709
+
+const SDisplayModeDesc g_DisplayModes[kDisplayModeCount] =
+{
+    { bmdModeNTSC,          "NTSC",            720,  486, 1001, 30000, bmdLowerFieldFirst,  SD },
+    { bmdModeNTSC2398,      "NTSC 23.98",      720,  486, 1001, 24000, bmdLowerFieldFirst,  SD },
+    { bmdModePAL,           "PAL",             720,  576, 1000, 25000, bmdUpperFieldFirst,  SD },
+    { bmdModeNTSCp,         "NTSC p",          720,  486, 1001, 60000, bmdProgressiveFrame, SD },
+    { bmdModePALp,          "PAL p",           720,  576, 1000, 50000, bmdProgressiveFrame, SD },
+
+    { bmdModeHD1080p2398,   "1080p23.98",     1920, 1080, 1001, 24000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080p24,     "1080p24",        1920, 1080, 1000, 24000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080p25,     "1080p25",        1920, 1080, 1000, 25000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080p2997,   "1080p29.97",     1920, 1080, 1001, 30000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080p30,     "1080p30",        1920, 1080, 1000, 30000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080i50,     "1080i50",        1920, 1080, 1000, 25000, bmdUpperFieldFirst,  HD },
+    { bmdModeHD1080i5994,   "1080i59.94",     1920, 1080, 1001, 30000, bmdUpperFieldFirst,  HD },
+    { bmdModeHD1080i6000,   "1080i60",        1920, 1080, 1000, 30000, bmdUpperFieldFirst,  HD },
+    { bmdModeHD1080p50,     "1080p50",        1920, 1080, 1000, 50000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080p5994,   "1080p59.94",     1920, 1080, 1001, 60000, bmdProgressiveFrame, HD },
+    { bmdModeHD1080p6000,   "1080p60",        1920, 1080, 1000, 60000, bmdProgressiveFrame, HD },
+
+    { bmdModeHD720p50,      "720p50",         1280,  720, 1000, 50000, bmdProgressiveFrame, HD },
+    { bmdModeHD720p5994,    "720p59.94",      1280,  720, 1001, 60000, bmdProgressiveFrame, HD },
+    { bmdModeHD720p60,      "720p60",         1280,  720, 1000, 60000, bmdProgressiveFrame, HD },
+
+    { bmdMode2k2398,        "2K 23.98",       2048, 1556, 1001, 24000, bmdProgressiveFrame, HD },
+    { bmdMode2k24,          "2K 24",          2048, 1556, 1000, 24000, bmdProgressiveFrame, HD },
+    { bmdMode2k25,          "2K 25",          2048, 1556, 1000, 25000, bmdProgressiveFrame, HD },
+
+    { bmdMode2kDCI2398,     "2K DCI 23.98",   2048, 1080, 1001, 24000, bmdProgressiveFrame, HD },
+    { bmdMode2kDCI24,       "2K DCI 24",      2048, 1080, 1000, 24000, bmdProgressiveFrame, HD },
+    { bmdMode2kDCI25,       "2K DCI 25",      2048, 1080, 1000, 25000, bmdProgressiveFrame, HD },
+
+    { bmdMode4K2160p2398,   "2160p23.98",     3840, 2160, 1001, 24000, bmdProgressiveFrame, HD },
+    { bmdMode4K2160p24,     "2160p24",        3840, 2160, 1000, 24000, bmdProgressiveFrame, HD },
+    { bmdMode4K2160p25,     "2160p25",        3840, 2160, 1000, 25000, bmdProgressiveFrame, HD },
+    { bmdMode4K2160p2997,   "2160p29.97",     3840, 2160, 1001, 30000, bmdProgressiveFrame, HD },
+    { bmdMode4K2160p30,     "2160p30",        3840, 2160, 1000, 30000, bmdProgressiveFrame, HD },
+
+    { bmdMode4kDCI2398,     "4K DCI 23.98",   4096, 2160, 1001, 24000, bmdProgressiveFrame, HD },
+    { bmdMode4kDCI24,       "4K DCI 24",      4096, 2160, 1000, 24000, bmdProgressiveFrame, HD },
+    { bmdMode4kDCI25,       "4K DCI 25",      4096, 2160, 1000, 25000, bmdProgressiveFrame, HD },
+};
+
+#undef SD
+#undef HD
+
+const BMDPixelFormat g_PixelFormats[kPixelFormatCount] =
+{
+    bmdFormat8BitYUV,
+    bmdFormat10BitYUV,
+    bmdFormat8BitARGB,
+    bmdFormat8BitBGRA,
+    bmdFormat10BitRGB,
+    bmdFormat10BitRGBXLE,
+    bmdFormat10BitRGBX,
+};
+
+static const char* const s_PixelFormatNames[kPixelFormatCount] =
+{
+    "2vuy",
+    "v210",
+    "ARGB",
+    "BGRA",
+    "r210",
+    "R10l",
+    "R10b",
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+int DisplayModeIndex( BMDDisplayMode mode )
+{
+    for( int i = 0; i < kDisplayModeCount; ++i )
+    {
+        if( g_DisplayModes[i].mode == mode )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int PixelFormatIndex( BMDPixelFormat format )
+{
+    for( int i = 0; i < kPixelFormatCount; ++i )
+    {
+        if( g_PixelFormats[i] == format )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const SDisplayModeDesc* FindDisplayMode( BMDDisplayMode mode )
+{
+    int index = DisplayModeIndex(mode);
+    return ( index >= 0 ) ? &g_DisplayModes[index] : NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+long RowBytesForPixelFormat( BMDPixelFormat format, long width )
+{
+    switch( format )
+    {
+    case bmdFormat8BitYUV:      return width * 2;
+    case bmdFormat10BitYUV:     return ( ( width + 47 ) / 48 ) * 128;
+    case bmdFormat8BitARGB:
+    case bmdFormat8BitBGRA:     return width * 4;
+    case bmdFormat10BitRGB:
+    case bmdFormat10BitRGBXLE:
+    case bmdFormat10BitRGBX:    return ( ( width + 63 ) / 64 ) * 256;
+    default:                    return 0;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool IsYuvPixelFormat( BMDPixelFormat format )
+{
+    return format == bmdFormat8BitYUV || format == bmdFormat10BitYUV;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const char* PixelFormatName( BMDPixelFormat format )
+{
+    int index = PixelFormatIndex(format);
+    return ( index >= 0 ) ? s_PixelFormatNames[index] : NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Equal ignoring case and spaces.
+static bool SameName( const char* a, const char* b )
+{
+    for( ;; )
+    {
+        while( *a == ' ' )
+        {
+            ++a;
+        }
+
+        while( *b == ' ' )
+        {
+            ++b;
+        }
+
+        if( tolower( (unsigned char)*a ) != tolower( (unsigned char)*b ) )
+        {
+            return false;
+        }
+
+        if( *a == '\0' )
+        {
+            return true;
+        }
+
+        ++a;
+        ++b;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool ParsePixelFormat( const char* name, BMDPixelFormat* pFormat )
+{
+    for( int i = 0; i < kPixelFormatCount; ++i )
+    {
+        if( SameName( name, s_PixelFormatNames[i] ) )
+        {
+            *pFormat = g_PixelFormats[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool ParseDisplayMode( const char* name, BMDDisplayMode* pMode )
+{
+    for( int i = 0; i < kDisplayModeCount; ++i )
+    {
+        if( SameName( name, g_DisplayModes[i].name ) )
+        {
+            *pMode = g_DisplayModes[i].mode;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,52 @@
+#ifndef DISPLAY_MODES_H
+#define DISPLAY_MODES_H
+
+#include "DeckLinkPlatform.h"
+
+//=====================================================================================================================
+// Static description of the display modes and pixel formats known to this version of the API, so that geometry and
+// timing can be looked up without asking the driver.
+struct SDisplayModeDesc
+{
+    BMDDisplayMode       mode;
+    const char*          name;
+    long                 width;
+    long                 height;
+    BMDTimeValue         frameDuration;
+    BMDTimeScale         timeScale;
+    BMDFieldDominance    fieldDominance;
+    BMDDisplayModeFlags  flags;          // colorspace
+};
+
+enum
+{
+    kDisplayModeCount = 33,
+    kPixelFormatCount = 7,
+};
+
+extern const SDisplayModeDesc  g_DisplayModes[kDisplayModeCount];
+extern const BMDPixelFormat    g_PixelFormats[kPixelFormatCount];
+
+//---------------------------------------------------------------------------------------------------------------------
+// Index into g_DisplayModes / g_PixelFormats, -1 if unknown.
+int DisplayModeIndex( BMDDisplayMode mode );
+int PixelFormatIndex( BMDPixelFormat format );
+
+// NULL if unknown.
+const SDisplayModeDesc* FindDisplayMode( BMDDisplayMode mode );
+
+// Row pitch the API uses for a frame of the given width, 0 if the format is unknown.
+long RowBytesForPixelFormat( BMDPixelFormat format, long width );
+
+// True for the YCbCr formats (2vuy, v210), false for the RGB ones.
+bool IsYuvPixelFormat( BMDPixelFormat format );
+
+// Four-character name of a pixel format ("2vuy", "v210", ...), NULL if unknown.
+const char* PixelFormatName( BMDPixelFormat format );
+
+// Look up a pixel format by its four-character name or a display mode by the name in g_DisplayModes ("1080i50",
+// "NTSC 23.98"), ignoring case and spaces. Return false if there is no match.
+bool ParsePixelFormat( const char* name, BMDPixelFormat* pFormat );
+bool ParseDisplayMode( const char* name, BMDDisplayMode* pMode );
+
+#endif // DISPLAY_MODES_H
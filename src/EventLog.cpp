@@ -0,0 +1,499 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "Clock.h"
+#include "EventLog.h"
+
+static const size_t kOutputBufSize = 64 * 1024;
+static const size_t kMaxFormattedSize = 512;    // upper bound of one formatted record
+
+//---------------------------------------------------------------------------------------------------------------------
+CEventLog::CEventLog( size_t capacity )
+    : m_Cells(NULL), m_Mask(0), m_EnqueuePos(0), m_DequeuePos(0), m_Dropped(0), m_Stop(false), m_ReportedDropped(0),
+      m_OutputFd(2), m_Format(kEventFormatText), m_Buf(NULL), m_Used(0), m_pSink(NULL)
+{
+    size_t size = 2;
+
+    while( size < capacity )
+    {
+        size <<= 1;
+    }
+
+    m_Cells = new SCell[size];
+    m_Mask = size - 1;
+    m_Buf = new char[kOutputBufSize];
+
+    for( size_t i = 0; i < size; ++i )
+    {
+        m_Cells[i].seq.store( i, std::memory_order_relaxed );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CEventLog::~CEventLog()
+{
+    Stop();
+    delete[] m_Cells;
+    delete[] m_Buf;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::SetOutput( int fd, EEventFormat format )
+{
+    m_OutputFd = fd;
+    m_Format = format;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::SetSink( IEventSink* pSink )
+{
+    m_pSink = pSink;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::Start()
+{
+    if( !m_Thread.joinable() )
+    {
+        m_Stop = false;
+        m_Thread = std::thread( &CEventLog::DrainMain, this );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::Stop()
+{
+    if( m_Thread.joinable() )
+    {
+        m_Stop = true;
+        m_Wake.Set();
+        m_Thread.join();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CEventLog::Post( const SEventRecord& rec )
+{
+    size_t pos = m_EnqueuePos.load( std::memory_order_relaxed );
+
+    for(;;)
+    {
+        SCell& cell = m_Cells[ pos & m_Mask ];
+        size_t seq = cell.seq.load( std::memory_order_acquire );
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if( diff == 0 )
+        {
+            if( m_EnqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+            {
+                cell.rec = rec;
+                cell.rec.timeNs = MonotonicNs();
+                cell.seq.store( pos + 1, std::memory_order_release );
+
+                // pairs with the fence in DrainMain(): either the drain thread sees the record before it sleeps, or
+                // we see it waiting at it; a thread still draining records before this one needs no wake
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if( m_DequeuePos.load( std::memory_order_relaxed ) == pos )
+                {
+                    m_Wake.Set();
+                }
+
+                return true;
+            }
+        }
+        else if( diff < 0 )
+        {
+            // the drain thread has not caught up; it may have looked at the count already
+            m_Dropped.fetch_add( 1, std::memory_order_relaxed );
+            m_Wake.Set();
+            return false;
+        }
+        else
+        {
+            pos = m_EnqueuePos.load( std::memory_order_relaxed );
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Appends s as a JSON string literal, truncated to fit size.
+static size_t AppendJsonString( char* p, size_t size, const char* s )
+{
+    size_t n = 0;
+    p[n++] = '"';
+
+    for( ; *s != '\0' && n + 8 < size; ++s )
+    {
+        unsigned char c = (unsigned char)*s;
+
+        if( c == '"' || c == '\\' )
+        {
+            p[n++] = '\\';
+            p[n++] = (char)c;
+        }
+        else if( c < 0x20 )
+        {
+            n += snprintf( p + n, size - n, "\\u%04x", c );
+        }
+        else
+        {
+            p[n++] = (char)c;
+        }
+    }
+
+    p[n++] = '"';
+    return n;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::Format( const SEventRecord& rec )
+{
+    char* p = m_Buf + m_Used;
+    const size_t size = kMaxFormattedSize;
+    size_t n = 0;
+
+    const char* name = ( rec.type == kEventDeviceArrived ) ? "arrived" :
+                       ( rec.type == kEventDeviceRemoved ) ? "removed" : "dropped";
+
+    switch( m_Format )
+    {
+    case kEventFormatText:
+        if( rec.type == kEventDropped )
+        {
+            n = snprintf( p, size, "CEventLog: %llu events dropped\n\n", (unsigned long long)rec.device );
+        }
+        else
+        {
+            const char* suffix = "";
+
+            if( rec.type == kEventDeviceRemoved )
+            {
+                suffix = ( rec.flags & kEventFlagReplaced )    ? " (replaced by a new pointer)" :
+                         ( rec.flags & kEventFlagKnownDevice ) ? " (added earlier)" : " (unknown pointer)";
+            }
+            else if( rec.flags & kEventFlagDuplicate )
+            {
+                suffix = " (already registered, ignored)";
+            }
+
+            n = snprintf( p, size, "CDiscoveryCallback::%s: IDeckLink pointer = 0x%08llx%s\n\n",
+                          rec.type == kEventDeviceArrived ? "DeckLinkDeviceArrived" : "DeckLinkDeviceRemoved",
+                          (unsigned long long)rec.device, suffix );
+        }
+        break;
+
+    case kEventFormatNdjson:
+        if( rec.type == kEventDropped )
+        {
+            n = snprintf( p, size, "{\"time_ns\":%llu,\"event\":\"dropped\",\"count\":%llu}\n",
+                          (unsigned long long)rec.timeNs, (unsigned long long)rec.device );
+            break;
+        }
+
+        n = snprintf( p, size, "{\"time_ns\":%llu,\"event\":\"%s\",\"device\":\"0x%llx\",\"known\":%s,",
+                      (unsigned long long)rec.timeNs, name, (unsigned long long)rec.device,
+                      ( rec.type == kEventDeviceArrived || ( rec.flags & kEventFlagKnownDevice ) ) ? "true" : "false" );
+
+        if( rec.flags & kEventFlagDuplicate )
+        {
+            n += snprintf( p + n, size - n, "\"duplicate\":true," );
+        }
+
+        if( rec.flags & kEventFlagReplaced )
+        {
+            n += snprintf( p + n, size - n, "\"replaced\":true," );
+        }
+
+        // as a string: 64-bit IDs do not survive JSON parsers which use doubles
+        if( rec.flags & kEventFlagPersistentId )
+        {
+            n += snprintf( p + n, size - n, "\"persistent_id\":\"0x%016llx\",",
+                           (unsigned long long)rec.persistentId );
+        }
+        else
+        {
+            n += snprintf( p + n, size - n, "\"persistent_id\":null," );
+        }
+
+        n += snprintf( p + n, size - n, "\"generation\":%u,\"sub_device\":%d,\"model\":",
+                       rec.generation, rec.subDeviceIndex );
+        n += AppendJsonString( p + n, size - n - 2, rec.modelName );
+        p[n++] = '}';
+        p[n++] = '\n';
+        break;
+
+    case kEventFormatBinary:
+        n = FormatEventBinary( rec, p );
+        break;
+    }
+
+    m_Used += n;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+size_t FormatEventBinary( const SEventRecord& rec, char* p )
+{
+    uint32_t modelLen = (uint32_t)strnlen( rec.modelName, sizeof(rec.modelName) );
+    uint32_t total = kEventBinaryHeaderSize + modelLen;
+    uint64_t timeNs = rec.timeNs;
+    uint64_t device = rec.device;
+    int64_t persistentId = ( rec.flags & kEventFlagPersistentId ) ? rec.persistentId : 0;
+
+    memcpy( p +  0, &total, 4 );
+    memcpy( p +  4, &rec.type, 4 );
+    memcpy( p +  8, &rec.flags, 4 );
+    memcpy( p + 12, &timeNs, 8 );
+    memcpy( p + 20, &device, 8 );
+    memcpy( p + 28, &persistentId, 8 );
+    memcpy( p + 36, &rec.subDeviceIndex, 4 );
+    memcpy( p + 40, &rec.generation, 4 );
+    memcpy( p + 44, &modelLen, 4 );
+    memcpy( p + kEventBinaryHeaderSize, rec.modelName, modelLen );
+
+    return total;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::Flush()
+{
+    size_t done = 0;
+
+    while( m_OutputFd >= 0 && done < m_Used )
+    {
+#ifdef _WIN32
+        int n = _write( m_OutputFd, m_Buf + done, (unsigned)( m_Used - done ) );
+#else
+        ssize_t n = write( m_OutputFd, m_Buf + done, m_Used - done );
+#endif
+
+        if( n > 0 )
+        {
+            done += (size_t)n;
+        }
+        else if( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        else
+        {
+            fprintf( stderr, "CEventLog: writing events failed (%s), output abandoned\n", strerror(errno) );
+            m_OutputFd = -1;
+        }
+    }
+
+    m_Used = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+size_t CEventLog::Drain()
+{
+    size_t count = 0;
+    size_t pos = m_DequeuePos.load( std::memory_order_relaxed );
+
+    for(;;)
+    {
+        SCell& cell = m_Cells[ pos & m_Mask ];
+
+        if( cell.seq.load( std::memory_order_acquire ) != pos + 1 )
+        {
+            break;
+        }
+
+        if( m_Used > kOutputBufSize - kMaxFormattedSize )
+        {
+            Flush();
+        }
+
+        Format( cell.rec );
+
+        if( m_pSink != NULL )
+        {
+            m_pSink->OnEvent( cell.rec );
+        }
+
+        cell.seq.store( pos + m_Mask + 1, std::memory_order_release );
+        m_DequeuePos.store( ++pos, std::memory_order_relaxed );
+        ++count;
+    }
+
+    uint64_t dropped = Dropped();
+
+    if( dropped != m_ReportedDropped )
+    {
+        SEventRecord rec;
+        memset( &rec, 0, sizeof(rec) );
+
+        rec.timeNs = MonotonicNs();
+        rec.type = kEventDropped;
+        rec.device = (uintptr_t)( dropped - m_ReportedDropped );
+        rec.subDeviceIndex = -1;
+
+        if( m_Used > kOutputBufSize - kMaxFormattedSize )
+        {
+            Flush();
+        }
+
+        Format(rec);
+        m_ReportedDropped = dropped;
+        ++count;
+
+        if( m_pSink != NULL )
+        {
+            m_pSink->OnEvent(rec);
+        }
+    }
+
+    if( m_Used != 0 )
+    {
+        Flush();
+    }
+
+    if( m_pSink != NULL && count != 0 )
+    {
+        m_pSink->OnBatchEnd();
+    }
+
+    return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CEventLog::DrainMain()
+{
+    while( !m_Stop.load( std::memory_order_acquire ) )
+    {
+        // events come in bursts: let the rest of one gather for a single write, and the posters find the thread
+        // awake, instead of waking it for every event
+        if( Drain() != 0 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+            continue;
+        }
+
+        // pairs with the fence in Post(); a wake which comes anyway only costs another pass
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        const size_t pos = m_DequeuePos.load( std::memory_order_relaxed );
+
+        if( m_Cells[ pos & m_Mask ].seq.load( std::memory_order_acquire ) != pos + 1 && !m_Stop.load() )
+        {
+            m_Wake.Wait();
+        }
+    }
+
+    Drain();
+}
+
+//=====================================================================================================================
+int OpenEventOutput( const char* spec )
+{
+    int fd = -1;
+
+    if( strcmp( spec, "-" ) == 0 )
+    {
+        fd = 1;
+    }
+    else if( strncmp( spec, "fd:", 3 ) == 0 )
+    {
+        char* end = NULL;
+        long n = strtol( spec + 3, &end, 10 );
+
+        if( end == spec + 3 || *end != '\0' || n < 0 )
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        fd = (int)n;
+    }
+    else if( strncmp( spec, "unix:", 5 ) == 0 )
+    {
+#ifdef _WIN32
+        errno = ENOTSUP;
+        return -1;
+#else
+        sockaddr_un addr;
+        memset( &addr, 0, sizeof(addr) );
+        addr.sun_family = AF_UNIX;
+
+        if( strlen( spec + 5 ) >= sizeof(addr.sun_path) )
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+
+        strcpy( addr.sun_path, spec + 5 );
+
+        fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+        if( fd < 0 )
+        {
+            return -1;
+        }
+
+        if( connect( fd, (const sockaddr*)&addr, sizeof(addr) ) != 0 )
+        {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+#endif
+    }
+    else
+    {
+#ifdef _WIN32
+        fd = _open( spec, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+        fd = open( spec, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+#endif
+
+        if( fd < 0 )
+        {
+            return -1;
+        }
+    }
+
+#ifndef _WIN32
+    signal( SIGPIPE, SIG_IGN );
+#endif
+
+    return fd;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool ParseEventFormat( const char* name, EEventFormat* pFormat )
+{
+    if( strcmp( name, "text" ) == 0 )
+    {
+        *pFormat = kEventFormatText;
+    }
+    else if( strcmp( name, "ndjson" ) == 0 )
+    {
+        *pFormat = kEventFormatNdjson;
+    }
+    else if( strcmp( name, "binary" ) == 0 )
+    {
+        *pFormat = kEventFormatBinary;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
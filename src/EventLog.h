@@ -0,0 +1,156 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#include "WakeEvent.h"
+
+//=====================================================================================================================
+enum EEventType
+{
+    kEventDeviceArrived = 1,
+    kEventDeviceRemoved = 2,
+    kEventDropped       = 3,    // written by the log itself when Post() found the queue full
+};
+
+enum EEventFlags
+{
+    kEventFlagKnownDevice  = 1 << 0,  // removal of a device which was reported as arrived earlier
+    kEventFlagPersistentId = 1 << 1,  // persistentId is valid
+    kEventFlagDuplicate    = 1 << 2,  // arrival of a device already registered, not passed on to the listeners
+    kEventFlagReplaced     = 1 << 3,  // removal implied by its persistent ID arriving under another pointer
+};
+
+enum EEventFormat
+{
+    kEventFormatText,       // for humans, the default
+    kEventFormatNdjson,     // one JSON object per line
+    kEventFormatBinary,     // length-prefixed records, see below
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SEventRecord
+{
+    uint64_t   timeNs;          // monotonic, set by Post()
+    uint32_t   type;            // EEventType
+    uint32_t   flags;           // EEventFlags
+    uintptr_t  device;          // IDeckLink pointer
+    int64_t    persistentId;
+    int32_t    subDeviceIndex;  // -1 if not reported
+    uint32_t   generation;      // 0 if not known
+    char       modelName[48];
+};
+
+// Binary format: every record is written in host byte order as
+//
+//     uint32  size             of the whole record, including this field and the model name
+//     uint32  type
+//     uint32  flags
+//     uint64  timeNs
+//     uint64  device           for kEventDropped the number of events lost
+//     int64   persistentId
+//     int32   subDeviceIndex
+//     uint32  generation
+//     uint32  modelNameLength
+//     char    modelName[modelNameLength]     not terminated
+//
+// so a reader can skip records (and fields appended in the future) by size alone.
+enum { kEventBinaryHeaderSize = 48 };
+
+//---------------------------------------------------------------------------------------------------------------------
+// Opens the destination of the event stream:
+//
+//     -             standard output
+//     fd:<n>        an inherited file descriptor
+//     unix:<path>   connects to a listening Unix stream socket (not on Windows)
+//     <path>        a file, appended to
+//
+// Returns -1 with errno set on failure. On POSIX, SIGPIPE is ignored from then on so that a consumer going away
+// shows up as a write error instead of killing the process.
+int OpenEventOutput( const char* spec );
+
+// "text", "ndjson" or "binary"
+bool ParseEventFormat( const char* name, EEventFormat* pFormat );
+
+// Writes rec in the binary format to p, which must have room for kEventBinaryHeaderSize + sizeof(rec.modelName).
+// Returns the size written.
+size_t FormatEventBinary( const SEventRecord& rec, char* p );
+
+//=====================================================================================================================
+// Second consumer of the events, called on the drain thread: OnEvent() for every record written out, then
+// OnBatchEnd() once per pass which wrote anything.
+class IEventSink
+{
+public:
+    virtual ~IEventSink() {}
+
+    virtual void OnEvent( const SEventRecord& rec ) = 0;
+    virtual void OnBatchEnd() = 0;
+};
+
+//=====================================================================================================================
+// Fixed-capacity event queue drained by a background thread.
+//
+// Post() may be called from any number of threads concurrently. It never allocates, locks or blocks: the record is
+// copied into a preallocated slot (bounded MPMC queue with per-slot sequence numbers). When the queue is full the
+// event is counted as dropped instead. The background thread formats the records and writes them out, everything
+// that has accumulated since its last pass with a single write(), so a slow terminal, pipe or consumer only delays
+// the log, not the caller. If writing fails the output is abandoned. After a pass which wrote anything the thread
+// naps for a millisecond, so that a burst goes out in few writes; after one which found nothing it sleeps on a
+// CWakeEvent until Post() sets it, which Post() does only when the queue was empty, so an idle log costs no wakeups.
+class CEventLog
+{
+    struct SCell
+    {
+        std::atomic<size_t>  seq;
+        SEventRecord         rec;
+    };
+
+    SCell*                 m_Cells;
+    size_t                 m_Mask;
+
+    alignas(64) std::atomic<size_t>    m_EnqueuePos;
+    alignas(64) std::atomic<size_t>    m_DequeuePos;    // written by the drain thread only
+    alignas(64) std::atomic<uint64_t>  m_Dropped;
+
+    std::thread            m_Thread;
+    CWakeEvent             m_Wake;
+    std::atomic<bool>      m_Stop;
+    uint64_t               m_ReportedDropped;
+
+    int                    m_OutputFd;
+    EEventFormat           m_Format;
+    char*                  m_Buf;
+    size_t                 m_Used;
+    IEventSink*            m_pSink;
+
+    CEventLog( const CEventLog& );
+    CEventLog& operator=( const CEventLog& );
+
+    void DrainMain();
+    size_t Drain();
+    void Format( const SEventRecord& rec );
+    void Flush();
+
+public:
+    // capacity is rounded up to a power of two
+    explicit CEventLog( size_t capacity = 4096 );
+    ~CEventLog();
+
+    // Where to write, standard error as text by default. Must be called before Start(); the descriptor is not closed.
+    void SetOutput( int fd, EEventFormat format );
+    void SetSink( IEventSink* pSink );     // also before Start()
+
+    void Start();
+    void Stop();    // writes out everything posted so far
+
+    // rec.timeNs is filled in
+    bool Post( const SEventRecord& rec );
+
+    uint64_t Dropped() const  { return m_Dropped.load( std::memory_order_relaxed ); }
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,308 @@
+#include <string.h>
+#include <algorithm>
+
+#include "Clock.h"
+#include "FormatSwitch.h"
+
+//=====================================================================================================================
+CFormatSwitcher::CFormatSwitcher( int numaNode, unsigned captureReserve, BMDPixelFormat convertFormat,
+                                  unsigned convertReserve )
+    : m_NumaNode(numaNode), m_CaptureReserve(captureReserve), m_ConvertFormat(convertFormat),
+      m_ConvertReserve(convertReserve), m_Uses(0), m_pCurrent(NULL), m_Pending(false), m_ChangeNs(0), m_RestartNs(0)
+{
+    memset( &m_Stats, 0, sizeof(m_Stats) );
+
+    for( int i = 0; i < kMaxPlans; ++i )
+    {
+        SFormatPlan* pPlan = &m_Plans[i];
+
+        memset( pPlan, 0, sizeof(*pPlan) );
+        pPlan->pConvert = ( convertFormat != 0 ) ? new CFrameAllocator( numaNode, convertReserve ) : NULL;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CFormatSwitcher::~CFormatSwitcher()
+{
+    Clear();
+
+    for( int i = 0; i < kMaxPlans; ++i )
+    {
+        if( m_Plans[i].pConvert != NULL )
+        {
+            m_Plans[i].pConvert->Release();
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+SFormatPlan* CFormatSwitcher::Find( BMDDisplayMode mode, BMDPixelFormat format )
+{
+    for( int i = 0; i < kMaxPlans; ++i )
+    {
+        if( m_Plans[i].mode == mode && m_Plans[i].format == format )
+        {
+            return &m_Plans[i];
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A free slot, or else the least recently used plan which is neither current nor pinned, cooled. NULL if there is
+// none.
+SFormatPlan* CFormatSwitcher::Evict()
+{
+    const SFormatPlan* pCurrent = Current();
+    SFormatPlan* pVictim = NULL;
+
+    for( int i = 0; i < kMaxPlans; ++i )
+    {
+        SFormatPlan* pPlan = &m_Plans[i];
+
+        if( pPlan->mode == 0 )
+        {
+            return pPlan;
+        }
+
+        if( pPlan != pCurrent && !pPlan->pinned && ( pVictim == NULL || pPlan->lastUsed < pVictim->lastUsed ) )
+        {
+            pVictim = pPlan;
+        }
+    }
+
+    if( pVictim != NULL )
+    {
+        Cool(pVictim);
+    }
+
+    return pVictim;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Commits the allocators of a free slot for the mode and pixel format: maps and faults in the slabs, which is what
+// takes the time.
+bool CFormatSwitcher::Warm( SFormatPlan* pPlan, BMDDisplayMode mode, BMDPixelFormat format )
+{
+    const SDisplayModeDesc* pDesc = FindDisplayMode(mode);
+    const long convertRowBytes = ( pDesc != NULL && m_ConvertFormat != 0 ) ?
+                                 RowBytesForPixelFormat( m_ConvertFormat, pDesc->width ) : 0;
+    CFrameAllocator* pCapture = NULL;
+
+    if( pDesc == NULL || ( m_ConvertFormat != 0 && convertRowBytes == 0 ) )
+    {
+        return false;
+    }
+
+    if( m_CaptureReserve != 0 )
+    {
+        pCapture = new CFrameAllocator( m_NumaNode, m_CaptureReserve );
+        pCapture->SetFormat( mode, format );
+
+        if( pCapture->Commit() != S_OK )
+        {
+            pCapture->Release();
+            return false;
+        }
+    }
+
+    if( pPlan->pConvert != NULL )
+    {
+        pPlan->pConvert->SetFormat( mode, m_ConvertFormat );
+
+        if( pPlan->pConvert->Commit() != S_OK )
+        {
+            if( pCapture != NULL )
+            {
+                pCapture->Decommit();
+                pCapture->Release();
+            }
+
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    pPlan->mode = mode;
+    pPlan->format = format;
+    pPlan->pDesc = pDesc;
+    pPlan->colorspace = ColorspaceFromFlags( pDesc->flags );
+    pPlan->frameNs = pDesc->frameDuration * 1000000000 / pDesc->timeScale;
+    pPlan->convertRowBytes = convertRowBytes;
+    pPlan->convertSize = (uint32_t)( convertRowBytes * pDesc->height );
+    pPlan->pCapture = pCapture;
+    pPlan->pinned = false;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Buffers still out go back to the retired slabs, which are unmapped once they all have.
+void CFormatSwitcher::Cool( SFormatPlan* pPlan )
+{
+    CFrameAllocator* pCapture;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        pCapture = pPlan->pCapture;
+        pPlan->pCapture = NULL;
+        pPlan->mode = (BMDDisplayMode)0;
+        pPlan->pinned = false;
+    }
+
+    if( pCapture != NULL )
+    {
+        pCapture->Decommit();
+        pCapture->Release();
+    }
+
+    if( pPlan->pConvert != NULL )
+    {
+        pPlan->pConvert->Decommit();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const SFormatPlan* CFormatSwitcher::Prepare( BMDDisplayMode mode, BMDPixelFormat format, bool pin )
+{
+    SFormatPlan* pPlan = Find( mode, format );
+
+    if( mode == 0 )
+    {
+        return NULL;
+    }
+
+    if( pPlan == NULL )
+    {
+        pPlan = Evict();
+
+        if( pPlan == NULL || !Warm( pPlan, mode, format ) )
+        {
+            return NULL;
+        }
+    }
+
+    pPlan->pinned = pPlan->pinned || pin;
+    pPlan->lastUsed = ++m_Uses;
+    return pPlan;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFormatSwitcher::Activate( const SFormatPlan* pPlan )
+{
+    m_pCurrent.store( pPlan, std::memory_order_release );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only the writer reads the colorspace, so the plan can be changed in place.
+void CFormatSwitcher::SetColorspace( const SFormatPlan* pPlan, EColorspace colorspace )
+{
+    if( pPlan == NULL || pPlan->colorspace == colorspace )
+    {
+        return;
+    }
+
+    const_cast<SFormatPlan*>(pPlan)->colorspace = colorspace;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    ++m_Stats.colorspaces;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const SFormatPlan* CFormatSwitcher::BeginSwitch( BMDDisplayMode mode, BMDPixelFormat format )
+{
+    const uint64_t start = MonotonicNs();
+    const bool warm = ( mode != 0 && Find( mode, format ) != NULL );
+    const SFormatPlan* pPlan = Prepare( mode, format, false );
+    const uint64_t prepared = MonotonicNs();
+
+    m_Pending = false;
+    m_ChangeNs = start;
+    m_RestartNs = prepared;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    ++m_Stats.switches;
+    m_Stats.warm += warm;
+    m_Stats.failures += ( pPlan == NULL );
+    m_Stats.lastPrepareNs = warm ? 0 : prepared - start;
+    return pPlan;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFormatSwitcher::EndSwitch( const SFormatPlan* pPlan )
+{
+    const uint64_t now = MonotonicNs();
+
+    Activate(pPlan);
+    m_Pending = true;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_Stats.lastRestartNs = now - m_RestartNs;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A frame normally follows the one before it by a period; the change came instead of a frame.
+void CFormatSwitcher::FirstFrame()
+{
+    const uint64_t outage = MonotonicNs() - m_ChangeNs;
+    const SFormatPlan* pPlan = Current();
+    const int64_t periods = ( pPlan != NULL ) ? ( (int64_t)outage + pPlan->frameNs / 2 ) / pPlan->frameNs : 0;
+
+    m_Pending = false;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_Stats.lostFrames += ( periods > 1 ) ? (uint64_t)( periods - 1 ) : 0;
+    m_Stats.lastOutageNs = outage;
+    m_Stats.maxOutageNs = std::max( m_Stats.maxOutageNs, outage );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFormatSwitcher::Clear()
+{
+    Activate(NULL);
+    m_Pending = false;
+
+    for( int i = 0; i < kMaxPlans; ++i )
+    {
+        if( m_Plans[i].mode != 0 )
+        {
+            Cool( &m_Plans[i] );
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFormatSwitcher::GetStats( SFormatSwitchStats* pStats ) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    *pStats = m_Stats;
+    pStats->plans = 0;
+
+    for( int i = 0; i < kMaxPlans; ++i )
+    {
+        pStats->plans += ( m_Plans[i].mode != 0 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CFormatSwitcher::GetPoolStats( CFrameAllocator::SStats* pStats ) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    const SFormatPlan* pPlan = m_pCurrent.load( std::memory_order_acquire );
+
+    if( pPlan == NULL || pPlan->pCapture == NULL )
+    {
+        return false;
+    }
+
+    pPlan->pCapture->GetStats(pStats);
+    return true;
+}
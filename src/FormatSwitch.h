@@ -0,0 +1,133 @@
+#ifndef FORMAT_SWITCH_H
+#define FORMAT_SWITCH_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "DeckLinkPlatform.h"
+#include "DisplayModes.h"
+#include "FrameAllocator.h"
+#include "FrameConversion.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+// What a channel needs to capture in one display mode and pixel format, worked out and allocated ahead of the first
+// frame.
+struct SFormatPlan
+{
+    BMDDisplayMode           mode;             // 0 = a free slot
+    BMDPixelFormat           format;           // captured in
+    const SDisplayModeDesc*  pDesc;
+    EColorspace              colorspace;       // of the signal, for the conversion; the mode's until one is detected
+    int64_t                  frameNs;          // duration of a frame
+    long                     convertRowBytes;  // 0 = not converting
+    uint32_t                 convertSize;
+    CFrameAllocator*         pCapture;         // committed for the mode; NULL = the driver's buffers
+    CFrameAllocator*         pConvert;         // committed for the mode; NULL = not converting
+    bool                     pinned;           // configured as a likely mode, kept warm
+    uint64_t                 lastUsed;
+};
+
+struct SFormatSwitchStats
+{
+    unsigned  plans;                  // warm, the current one included
+    uint64_t  switches;               // display mode or signal changes followed by a restart
+    uint64_t  warm;                   // ... of which to a warm plan
+    uint64_t  failures;               // ... of which to a mode no plan could be made for
+    uint64_t  colorspaces;            // colorspace changes followed without a restart
+    uint64_t  lostFrames;             // frame periods from each change to the first frame in the new mode, less one
+    uint64_t  lastPrepareNs;          // warming the plan of the last switch, 0 if it was warm
+    uint64_t  lastRestartNs;          // pausing, enabling, flushing and starting the input
+    uint64_t  lastOutageNs;           // the change to the first frame in the new mode
+    uint64_t  maxOutageNs;
+};
+
+//=====================================================================================================================
+// Display mode and signal changes of one capture channel.
+//
+// When the source switches, the driver calls VideoInputFormatChanged() and delivers nothing until the input is
+// re-enabled in the new mode; every millisecond spent in between is video lost. Mapping and faulting in a frame pool
+// for the new geometry alone takes longer than a frame at 1080p. So the switcher keeps up to kMaxPlans plans warm,
+// each with its allocators committed for its mode: the configured likely modes (pinned) and the modes used last. A
+// switch to a warm plan only swaps a pointer and restarts the input; a cold one is warmed on the spot, evicting the
+// least recently used plan which is neither current nor pinned. A plan is for a mode and a pixel format, since a
+// source switching between YCbCr 4:2:2 and RGB 4:4:4 is captured in a pixel format of the other kind.
+//
+// The plan's capture allocator is handed to the driver, which commits it again for its session; that is a no-op for
+// the slab that is already there. An evicted plan's capture allocator is released rather than reused, since the
+// driver's session may not have decommitted it yet. Convert allocators are only committed by the switcher and live as
+// long as it does, so that buffers still queued from before a switch can go back to them.
+//
+// One writer, the driver's callback thread (or the thread starting and stopping the channel, while the callback is
+// not installed); Current() is for the writer, GetStats() and GetPoolStats() for any thread.
+class CFormatSwitcher
+{
+public:
+    enum { kMaxPlans = 4 };
+
+private:
+    int                              m_NumaNode;
+    unsigned                         m_CaptureReserve;  // 0 = the driver's buffers
+    BMDPixelFormat                   m_ConvertFormat;   // 0 = not converting
+    unsigned                         m_ConvertReserve;
+
+    mutable std::mutex               m_Mutex;           // guards the plans' allocators and m_Stats against readers
+    SFormatPlan                      m_Plans[kMaxPlans];
+    uint64_t                         m_Uses;
+    std::atomic<const SFormatPlan*>  m_pCurrent;
+    SFormatSwitchStats               m_Stats;
+
+    // of the switch in progress
+    bool                             m_Pending;         // until the first frame in the new mode
+    uint64_t                         m_ChangeNs;
+    uint64_t                         m_RestartNs;
+
+    CFormatSwitcher( const CFormatSwitcher& );
+    CFormatSwitcher& operator=( const CFormatSwitcher& );
+
+    SFormatPlan* Find( BMDDisplayMode mode, BMDPixelFormat format );
+    SFormatPlan* Evict();
+    bool Warm( SFormatPlan* pPlan, BMDDisplayMode mode, BMDPixelFormat format );
+    void Cool( SFormatPlan* pPlan );
+    void FirstFrame();
+
+public:
+    // captureReserve and convertReserve as for CFrameAllocator; captureReserve 0 = capture into the driver's buffers,
+    // convertFormat 0 = no conversion
+    CFormatSwitcher( int numaNode, unsigned captureReserve, BMDPixelFormat convertFormat, unsigned convertReserve );
+    ~CFormatSwitcher();
+
+    // Writer. The warm plan for the mode and pixel format, warmed now if it was not; NULL if the mode is unknown or
+    // there is no memory for it. pin keeps it warm from now on.
+    const SFormatPlan* Prepare( BMDDisplayMode mode, BMDPixelFormat format, bool pin );
+
+    // Writer. The plan the input captures with; NULL = none.
+    const SFormatPlan* Current() const  { return m_pCurrent.load( std::memory_order_relaxed ); }
+    void Activate( const SFormatPlan* pPlan );
+
+    // Writer. The colorspace detected in the signal, which the conversion follows from the next frame on; no restart.
+    void SetColorspace( const SFormatPlan* pPlan, EColorspace colorspace );
+
+    // Writer. A switch to another mode or pixel format: BeginSwitch() as soon as the change is reported, returning the plan as
+    // Prepare() does; EndSwitch() once the input is enabled with it, just before its streams start again, which
+    // activates it. FrameArrived() for every frame; the first one ends the outage of the switch.
+    const SFormatPlan* BeginSwitch( BMDDisplayMode mode, BMDPixelFormat format );
+    void EndSwitch( const SFormatPlan* pPlan );
+
+    void FrameArrived()
+    {
+        if( m_Pending )
+        {
+            FirstFrame();
+        }
+    }
+
+    // Writer. Cools every plan; the switcher is then empty.
+    void Clear();
+
+    // Readers.
+    void GetStats( SFormatSwitchStats* pStats ) const;
+    bool GetPoolStats( CFrameAllocator::SStats* pStats ) const;     // of the current plan; false = none
+};
+
+#endif // FORMAT_SWITCH_H
@@ -0,0 +1,476 @@
+#include "FrameAllocator.h"
+#include "DisplayModes.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND     2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE  ( 1 << 1 )
+#endif
+#endif
+
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+static const size_t kPageSize = 4096;
+
+// in SSlab::state, above the count of buffers handed out
+static const uint32_t kSlabRetired = 0x80000000u;
+
+//---------------------------------------------------------------------------------------------------------------------
+static size_t RoundUp( size_t size, size_t unit )
+{
+    return ( size + unit - 1 ) / unit * unit;
+}
+
+//=====================================================================================================================
+struct CFrameAllocator::SSlab
+{
+    char*                    pBase;
+    size_t                   mapSize;
+    size_t                   stride;
+    unsigned                 count;
+    bool                     hugePages;
+
+    // free buffers: (tag << 32) | (index + 1) of the top, 0 = empty; pNext[i] = index + 1 of the one below i
+    std::atomic<uint64_t>    head;
+    std::atomic<uint32_t>*   pNext;
+
+    // buffers handed out, | kSlabRetired once the slab has been replaced: one word, so that the last ReleaseBuffer()
+    // and Retire() cannot both miss the slab becoming unused
+    std::atomic<uint32_t>    state;
+
+    bool Contains( const void* p ) const
+    {
+        return (const char*)p >= pBase && (const char*)p < pBase + (size_t)count * stride;
+    }
+
+    // Returns the index of a free buffer, or -1.
+    int Pop()
+    {
+        uint64_t top = head.load( std::memory_order_acquire );
+
+        for( ;; )
+        {
+            const uint32_t index1 = (uint32_t)top;
+
+            if( index1 == 0 )
+            {
+                return -1;
+            }
+
+            // may be stale if another thread pops first, the tag then fails the exchange
+            const uint64_t next = pNext[index1 - 1].load( std::memory_order_relaxed );
+            const uint64_t newTop = ( ( ( top >> 32 ) + 1 ) << 32 ) | next;
+
+            if( head.compare_exchange_weak( top, newTop, std::memory_order_acquire, std::memory_order_acquire ) )
+            {
+                return (int)( index1 - 1 );
+            }
+        }
+    }
+
+    void Push( unsigned index )
+    {
+        uint64_t top = head.load( std::memory_order_relaxed );
+        uint64_t newTop;
+
+        do
+        {
+            pNext[index].store( (uint32_t)top, std::memory_order_relaxed );
+            newTop = ( ( ( top >> 32 ) + 1 ) << 32 ) | ( index + 1 );
+        }
+        while( !head.compare_exchange_weak( top, newTop, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Maps count buffers of bufferSize bytes, on huge pages if possible, bound to numaNode (if >= 0) and faulted in.
+CFrameAllocator::SSlab* CFrameAllocator::MapSlab( size_t bufferSize, unsigned count, int numaNode )
+{
+    // buffers of a frame or more start on a huge page; smaller ones share them
+    const size_t stride = ( bufferSize >= kHugePageSize ) ? RoundUp( bufferSize, kHugePageSize )
+                                                          : RoundUp( bufferSize, kPageSize );
+    const size_t mapSize = RoundUp( stride * count, kHugePageSize );
+
+    void* p = NULL;
+    bool hugePages = false;
+
+#if defined(_WIN32)
+    // large pages need SeLockMemoryPrivilege, which few accounts have
+    const DWORD node = ( numaNode >= 0 ) ? (DWORD)numaNode : NUMA_NO_PREFERRED_NODE;
+
+    p = VirtualAllocExNuma( GetCurrentProcess(), NULL, mapSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                            PAGE_READWRITE, node );
+    hugePages = ( p != NULL );
+
+    if( p == NULL )
+    {
+        p = VirtualAllocExNuma( GetCurrentProcess(), NULL, mapSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node );
+    }
+
+    if( p == NULL )
+    {
+        return NULL;
+    }
+#else
+#ifdef MAP_HUGETLB
+    p = mmap( NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+    hugePages = ( p != MAP_FAILED );
+#else
+    p = MAP_FAILED;
+#endif
+
+    if( p == MAP_FAILED )
+    {
+        p = mmap( NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+        if( p == MAP_FAILED )
+        {
+            return NULL;
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise( p, mapSize, MADV_HUGEPAGE );
+#endif
+    }
+
+#ifdef __linux__
+    if( numaNode >= 0 && numaNode < 64 )
+    {
+        // before the first touch, so the pages are allocated there; failure (no NUMA support) is harmless
+        unsigned long mask = 1ul << numaNode;
+        syscall( SYS_mbind, p, mapSize, MPOL_BIND, &mask, sizeof(mask) * 8 + 1, MPOL_MF_MOVE );
+    }
+#endif
+#endif
+
+    for( size_t offset = 0; offset < mapSize; offset += kPageSize )
+    {
+        ( (volatile char*)p )[offset] = 0;
+    }
+
+    SSlab* pSlab = new SSlab();
+    pSlab->pBase = (char*)p;
+    pSlab->mapSize = mapSize;
+    pSlab->stride = stride;
+    pSlab->count = count;
+    pSlab->hugePages = hugePages;
+    pSlab->pNext = new std::atomic<uint32_t>[count];
+    pSlab->state.store(0);
+
+    // index 0 on top, so that a lightly used pool keeps touching the same buffers
+    for( unsigned i = 0; i < count; ++i )
+    {
+        pSlab->pNext[i].store( ( i + 1 < count ) ? i + 2 : 0 );
+    }
+
+    pSlab->head.store(1);
+    return pSlab;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFrameAllocator::UnmapSlab( SSlab* pSlab )
+{
+#ifdef _WIN32
+    VirtualFree( pSlab->pBase, 0, MEM_RELEASE );
+#else
+    munmap( pSlab->pBase, pSlab->mapSize );
+#endif
+
+    delete[] pSlab->pNext;
+    delete pSlab;
+}
+
+//=====================================================================================================================
+CFrameAllocator::CFrameAllocator( int numaNode, unsigned reserve )
+    : m_RefCount(1), m_NumaNode(numaNode), m_Reserve(reserve), m_Mode((BMDDisplayMode)0),
+      m_Format(bmdFormat10BitYUV), m_Commits(0), m_pCurrent(NULL), m_Failures(0), m_Releasing(0),
+      m_CollectPending(false)
+{
+    for( int i = 0; i < kMaxSlabs; ++i )
+    {
+        m_Slabs[i].store(NULL);
+    }
+
+    m_Unmapping.reserve(kMaxSlabs);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Reached only once the driver has released the allocator, and with it every buffer.
+CFrameAllocator::~CFrameAllocator()
+{
+    for( int i = 0; i < kMaxSlabs; ++i )
+    {
+        SSlab* pSlab = m_Slabs[i].load();
+
+        if( pSlab != NULL )
+        {
+            UnmapSlab(pSlab);
+        }
+    }
+
+    for( size_t i = 0; i < m_Unmapping.size(); ++i )
+    {
+        UnmapSlab( m_Unmapping[i] );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFrameAllocator::SetFormat( BMDDisplayMode mode, BMDPixelFormat format )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_Mode = mode;
+    m_Format = format;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFrameAllocator::GetStats( SStats* pStats )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    SSlab* pSlab = m_pCurrent.load();
+
+    pStats->buffers = pSlab ? pSlab->count : 0;
+    pStats->inUse = pSlab ? ( pSlab->state.load( std::memory_order_relaxed ) & ~kSlabRetired ) : 0;
+    pStats->bufferSize = pSlab ? pSlab->stride : 0;
+    pStats->hugePages = pSlab ? pSlab->hugePages : false;
+    pStats->numaNode = m_NumaNode;
+    pStats->failures = m_Failures.load( std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Called with m_Mutex held.
+void CFrameAllocator::Retire( SSlab* pSlab )
+{
+    // before the bit: a ReleaseBuffer() which sees the bit sees this too
+    m_CollectPending.store(true);
+    pSlab->state.fetch_or(kSlabRetired);
+
+    Collect();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Takes the retired slabs without buffers out of m_Slabs, and unmaps them unless a ReleaseBuffer() which may have
+// found them there is still running; those are unmapped by a later call. Called with m_Mutex held.
+void CFrameAllocator::Collect()
+{
+    bool retired = false;
+
+    for( int i = 0; i < kMaxSlabs; ++i )
+    {
+        SSlab* pSlab = m_Slabs[i].load();
+
+        if( pSlab == NULL )
+        {
+            continue;
+        }
+
+        const uint32_t state = pSlab->state.load();
+
+        if( state == kSlabRetired )
+        {
+            m_Slabs[i].store(NULL);
+            m_Unmapping.push_back(pSlab);
+        }
+        else if( state & kSlabRetired )
+        {
+            retired = true;
+        }
+    }
+
+    // a ReleaseBuffer() counted after this cannot find them any more
+    if( !m_Unmapping.empty() && m_Releasing.load() == 0 )
+    {
+        for( size_t i = 0; i < m_Unmapping.size(); ++i )
+        {
+            UnmapSlab( m_Unmapping[i] );
+        }
+
+        m_Unmapping.clear();
+    }
+
+    m_CollectPending.store( retired || !m_Unmapping.empty() );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameAllocator::AllocateBuffer( uint32_t bufferSize, void** allocatedBuffer )
+{
+    SSlab* pSlab = m_pCurrent.load( std::memory_order_acquire );
+    int index = -1;
+
+    if( pSlab != NULL && bufferSize <= pSlab->stride )
+    {
+        pSlab->state.fetch_add( 1, std::memory_order_relaxed );
+        index = pSlab->Pop();
+
+        if( index < 0 )
+        {
+            pSlab->state.fetch_sub( 1, std::memory_order_relaxed );
+        }
+    }
+
+    if( index < 0 )
+    {
+        m_Failures.fetch_add( 1, std::memory_order_relaxed );
+        *allocatedBuffer = NULL;
+        return E_OUTOFMEMORY;
+    }
+
+    *allocatedBuffer = pSlab->pBase + (size_t)index * pSlab->stride;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameAllocator::ReleaseBuffer( void* buffer )
+{
+    HRESULT result = E_INVALIDARG;
+
+    // while counted, Collect() unmaps none of the slabs this call may find in m_Slabs
+    m_Releasing.fetch_add(1);
+
+    for( int i = 0; i < kMaxSlabs; ++i )
+    {
+        SSlab* pSlab = m_Slabs[i].load();
+
+        if( pSlab != NULL && pSlab->Contains(buffer) )
+        {
+            pSlab->Push( (unsigned)( ( (char*)buffer - pSlab->pBase ) / pSlab->stride ) );
+            pSlab->state.fetch_sub(1);
+            result = S_OK;
+            break;
+        }
+    }
+
+    m_Releasing.fetch_sub(1);
+
+    // only while a replaced slab is mapped still; never waits for Commit() or Decommit(), which collect anyway
+    if( m_CollectPending.load() && m_Mutex.try_lock() )
+    {
+        Collect();
+        m_Mutex.unlock();
+    }
+
+    return result;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameAllocator::Commit(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    const SDisplayModeDesc* pMode = FindDisplayMode(m_Mode);
+    const long rowBytes = pMode ? RowBytesForPixelFormat( m_Format, pMode->width ) : 0;
+
+    if( rowBytes == 0 )
+    {
+        return E_FAIL;
+    }
+
+    const size_t bufferSize = (size_t)rowBytes * pMode->height;
+    const unsigned perTenth = (unsigned)( ( pMode->timeScale + pMode->frameDuration * 10 - 1 ) /
+                                          ( pMode->frameDuration * 10 ) );
+    const unsigned count = perTenth + m_Reserve;
+
+    // frees the slots of slabs retired earlier
+    Collect();
+
+    SSlab* pCurrent = m_pCurrent.load();
+
+    if( pCurrent != NULL && pCurrent->stride >= bufferSize && pCurrent->count >= count )
+    {
+        ++m_Commits;
+        return S_OK;
+    }
+
+    SSlab* pSlab = MapSlab( bufferSize, count, m_NumaNode );
+
+    if( pSlab == NULL )
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for( int i = 0; i < kMaxSlabs; ++i )
+    {
+        SSlab* pExpected = NULL;
+
+        if( m_Slabs[i].compare_exchange_strong( pExpected, pSlab ) )
+        {
+            m_pCurrent.store( pSlab, std::memory_order_release );
+
+            if( pCurrent != NULL )
+            {
+                Retire(pCurrent);
+            }
+
+            ++m_Commits;
+            return S_OK;
+        }
+    }
+
+    // too many old slabs still have buffers out
+    UnmapSlab(pSlab);
+    return E_OUTOFMEMORY;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameAllocator::Decommit(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Commits > 0 && --m_Commits == 0 )
+    {
+        SSlab* pSlab = m_pCurrent.exchange(NULL);
+
+        if( pSlab != NULL )
+        {
+            Retire(pSlab);
+        }
+    }
+    else
+    {
+        Collect();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameAllocator::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkMemoryAllocator ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkMemoryAllocator*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CFrameAllocator::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CFrameAllocator::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
@@ -0,0 +1,99 @@
+#ifndef FRAME_ALLOCATOR_H
+#define FRAME_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "DeckLinkPlatform.h"
+
+//=====================================================================================================================
+// Frame buffers for IDeckLinkInput::SetVideoInputFrameMemoryAllocator() and
+// IDeckLinkOutput::SetVideoOutputFrameMemoryAllocator(), carved out of one preallocated slab.
+//
+// Commit() sizes the slab from the display mode and pixel format last passed to SetFormat(): one buffer per frame the
+// pipeline can hold (100 ms of video plus the reserve), each big enough for a frame of that geometry. The slab is
+// mapped with 2 MB huge pages if the system has them reserved (transparent huge pages are requested otherwise),
+// bound to a NUMA node and faulted in up front, so neither the driver's DMA nor the consumer's first touch of a frame
+// takes a page fault, and a UHD frame costs a dozen TLB entries instead of thousands. AllocateBuffer() and
+// ReleaseBuffer() are a lock-free pop and push on a stack of free buffer indices, tagged against ABA; they never
+// allocate or enter the kernel, except for a ReleaseBuffer() which finds a replaced slab to unmap (see below).
+//
+// This version of the API does not tell which PCIe slot, hence which NUMA node, a device sits on, so the node is
+// configured; by default the pages land on the node of the thread calling Commit().
+//
+// A Commit() for a geometry the current slab cannot hold (a format change) maps a new slab. The old one is unmapped
+// once its last buffer has come back and no ReleaseBuffer() can still be looking at it: by the next ReleaseBuffer()
+// which finds the mutex free, or by the next Commit() or Decommit(). As with the driver's own allocator,
+// AllocateBuffer() must not race with Commit() or Decommit(); ReleaseBuffer() may be called at any time.
+class CFrameAllocator : public IDeckLinkMemoryAllocator
+{
+public:
+    enum { kMaxSlabs = 4 };
+
+    struct SStats
+    {
+        unsigned  buffers;            // in the current slab, 0 if not committed
+        unsigned  inUse;
+        size_t    bufferSize;
+        bool      hugePages;          // MAP_HUGETLB (or large pages on Windows) rather than transparent huge pages
+        int       numaNode;           // as configured, -1 = not bound
+        uint64_t  failures;           // AllocateBuffer() calls which found no free buffer
+    };
+
+private:
+    struct SSlab;
+
+    std::atomic<ULONG>     m_RefCount;
+    int                    m_NumaNode;
+    unsigned               m_Reserve;
+
+    std::mutex             m_Mutex;       // serialises SetFormat(), Commit(), Decommit() and Collect()
+    BMDDisplayMode         m_Mode;
+    BMDPixelFormat         m_Format;
+    unsigned               m_Commits;
+
+    std::atomic<SSlab*>    m_pCurrent;
+    std::atomic<SSlab*>    m_Slabs[kMaxSlabs];    // current and retired slabs, for ReleaseBuffer()
+    std::atomic<uint64_t>  m_Failures;
+
+    std::atomic<unsigned>  m_Releasing;           // ReleaseBuffer() calls which may be looking at m_Slabs
+    std::atomic<bool>      m_CollectPending;      // a retired slab is mapped still
+    std::vector<SSlab*>    m_Unmapping;           // out of m_Slabs, waiting for m_Releasing to drain; under m_Mutex
+
+    CFrameAllocator( const CFrameAllocator& );
+    CFrameAllocator& operator=( const CFrameAllocator& );
+
+    virtual ~CFrameAllocator();
+
+    static SSlab* MapSlab( size_t bufferSize, unsigned count, int numaNode );
+    static void UnmapSlab( SSlab* pSlab );
+    void Retire( SSlab* pSlab );
+    void Collect();
+
+public:
+    // reserve: buffers on top of 100 ms of video, for frames queued to or held by consumers
+    CFrameAllocator( int numaNode, unsigned reserve );
+
+    // Geometry of the frames for the next Commit().
+    void SetFormat( BMDDisplayMode mode, BMDPixelFormat format );
+
+    void GetStats( SStats* pStats );
+
+    // overrides IDeckLinkMemoryAllocator
+    virtual HRESULT STDMETHODCALLTYPE AllocateBuffer( uint32_t bufferSize, void** allocatedBuffer );
+    virtual HRESULT STDMETHODCALLTYPE ReleaseBuffer( void* buffer );
+
+    virtual HRESULT STDMETHODCALLTYPE Commit(void);
+    virtual HRESULT STDMETHODCALLTYPE Decommit(void);
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+#endif // FRAME_ALLOCATOR_H
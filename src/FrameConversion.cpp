@@ -0,0 +1,929 @@
+#include <string.h>
+#include <algorithm>
+
+#include "DisplayModes.h"
+#include "FrameConversion.h"
+#include "V210.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define CONVERT_TARGET(isa)
+#else
+#define CONVERT_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+// Pixels a row is converted at a time: a multiple of 48, so that v210 chunks start on a block and only the last
+// chunk of a row packs padding.
+static const long kChunk = 1536;
+
+//=====================================================================================================================
+// Fixed-point Q14 coefficients of one colorspace. Luma excursion is 876 codes, chroma 896, on both sides, so R, G, B
+// and Y share a scale. The chroma rows of toU/toV apply to the sum of a pair of pixels, hence carry half the weight.
+struct SMatrix
+{
+    int16_t  rv, gu, gv, bu;          // R, G, B from Y' = Y - 64, U' = Cb - 512, V' = Cr - 512; Y' has weight 1
+    int16_t  yr, yg, yb;              // Y - 64 from R' = R - 64, G', B'
+    int16_t  ur, ug, ub;              // Cb - 512 from the sums R'0 + R'1, ... of a pair
+    int16_t  vr, vg, vb;
+};
+
+static int16_t Q14( double x )
+{
+    return (int16_t)( x < 0.0 ? x * 16384.0 - 0.5 : x * 16384.0 + 0.5 );
+}
+
+static SMatrix MakeMatrix( double kr, double kb )
+{
+    const double kg = 1.0 - kr - kb;
+    const double toRgb = 876.0 / 896.0;
+    const double cb = 896.0 / 876.0 / ( 2.0 * ( 1.0 - kb ) ) / 2.0;
+    const double cr = 896.0 / 876.0 / ( 2.0 * ( 1.0 - kr ) ) / 2.0;
+    SMatrix m;
+
+    m.rv = Q14( toRgb * 2.0 * ( 1.0 - kr ) );
+    m.gu = Q14( -toRgb * 2.0 * ( 1.0 - kb ) * kb / kg );
+    m.gv = Q14( -toRgb * 2.0 * ( 1.0 - kr ) * kr / kg );
+    m.bu = Q14( toRgb * 2.0 * ( 1.0 - kb ) );
+    m.yr = Q14(kr);
+    m.yg = Q14(kg);
+    m.yb = Q14(kb);
+    m.ur = Q14( -cb * kr );
+    m.ug = Q14( -cb * kg );
+    m.ub = Q14( cb * ( 1.0 - kb ) );
+    m.vr = Q14( cr * ( 1.0 - kr ) );
+    m.vg = Q14( -cr * kg );
+    m.vb = Q14( -cr * kb );
+    return m;
+}
+
+static const SMatrix s_Matrices[] =
+{
+    MakeMatrix( 0.299, 0.114 ),           // kColorspaceRec601
+    MakeMatrix( 0.2126, 0.0722 ),         // kColorspaceRec709
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+EColorspace ColorspaceFromFlags( BMDDisplayModeFlags flags )
+{
+    return ( flags & bmdDisplayModeColorspaceRec709 ) ? kColorspaceRec709 : kColorspaceRec601;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+EColorspace ColorspaceForSize( long width, long height )
+{
+    for( int i = 0; i < kDisplayModeCount; ++i )
+    {
+        if( g_DisplayModes[i].width == width && g_DisplayModes[i].height == height )
+        {
+            return ColorspaceFromFlags( g_DisplayModes[i].flags );
+        }
+    }
+
+    return ( height > 576 ) ? kColorspaceRec709 : kColorspaceRec601;
+}
+
+//=====================================================================================================================
+// Row kernels. Unpacking writes three planes of n samples (R, G, B) or n, n / 2, n / 2 (Y, Cb, Cr); packing is the
+// reverse. n is even.
+typedef void (*FUnpackRow)( const uint8_t* pSrc, uint16_t* p0, uint16_t* p1, uint16_t* p2, long n );
+typedef void (*FPackRow)( const uint16_t* p0, const uint16_t* p1, const uint16_t* p2, uint8_t* pDst, long n );
+
+// YUV to RGB reads n / 2 + 1 chroma samples, the last one for interpolating the last pixel.
+typedef void (*FMatrixRow)( const uint16_t* pA, const uint16_t* pB, const uint16_t* pC, uint16_t* pX, uint16_t* pY,
+                            uint16_t* pZ, long n, const SMatrix& m );
+
+struct SConvertKernels
+{
+    FUnpackRow  unpack[kPixelFormatCount];    // NULL for v210, which has its own
+    FPackRow    pack[kPixelFormatCount];
+    FMatrixRow  yuvToRgb;
+    FMatrixRow  rgbToYuv;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline uint16_t Clip10( int x )
+{
+    return (uint16_t)( x < 4 ? 4 : ( x > 1019 ? 1019 : x ) );
+}
+
+// 8-bit full range to and from 10-bit 64..940, as the SIMD kernels do it with pmulhrsw
+static inline uint16_t FullTo10( unsigned v )
+{
+    return (uint16_t)( 64 + ( ( ( ( v << 4 ) * 7036 >> 14 ) + 1 ) >> 1 ) );
+}
+
+static inline uint8_t Full8From10( unsigned v )
+{
+    const int x = ( ( ( (int)v - 64 ) * 9539 >> 14 ) + 1 ) >> 1;
+    return (uint8_t)( x < 0 ? 0 : ( x > 255 ? 255 : x ) );
+}
+
+static inline uint8_t Narrow8( unsigned v )
+{
+    const unsigned x = ( v + 2 ) >> 2;
+    return (uint8_t)( x > 255 ? 255 : x );
+}
+
+static inline uint32_t LoadWord( const uint8_t* p, bool bigEndian )
+{
+    return bigEndian ? (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]
+                     : (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static inline void StoreWord( uint8_t* p, uint32_t w, bool bigEndian )
+{
+    for( int i = 0; i < 4; ++i )
+    {
+        p[ bigEndian ? 3 - i : i ] = (uint8_t)( w >> ( i * 8 ) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// 2vuy: Cb Y0 Cr Y1 per pair of pixels.
+static void Unpack2vuyC( const uint8_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long n )
+{
+    for( long x = 0; x < n; x += 2, pSrc += 4 )
+    {
+        pU[x / 2] = (uint16_t)( pSrc[0] << 2 );
+        pY[x] = (uint16_t)( pSrc[1] << 2 );
+        pV[x / 2] = (uint16_t)( pSrc[2] << 2 );
+        pY[x + 1] = (uint16_t)( pSrc[3] << 2 );
+    }
+}
+
+static void Pack2vuyC( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint8_t* pDst, long n )
+{
+    for( long x = 0; x < n; x += 2, pDst += 4 )
+    {
+        pDst[0] = Narrow8( pU[x / 2] );
+        pDst[1] = Narrow8( pY[x] );
+        pDst[2] = Narrow8( pV[x / 2] );
+        pDst[3] = Narrow8( pY[x + 1] );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// ARGB and BGRA, by the byte offsets of R, G and B; alpha is dropped, and opaque when packing.
+template< int kR, int kG, int kB, int kA >
+static void Unpack8BitRgbC( const uint8_t* pSrc, uint16_t* pR, uint16_t* pG, uint16_t* pB, long n )
+{
+    for( long x = 0; x < n; ++x, pSrc += 4 )
+    {
+        pR[x] = FullTo10( pSrc[kR] );
+        pG[x] = FullTo10( pSrc[kG] );
+        pB[x] = FullTo10( pSrc[kB] );
+    }
+}
+
+template< int kR, int kG, int kB, int kA >
+static void Pack8BitRgbC( const uint16_t* pR, const uint16_t* pG, const uint16_t* pB, uint8_t* pDst, long n )
+{
+    for( long x = 0; x < n; ++x, pDst += 4 )
+    {
+        pDst[kR] = Full8From10( pR[x] );
+        pDst[kG] = Full8From10( pG[x] );
+        pDst[kB] = Full8From10( pB[x] );
+        pDst[kA] = 255;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// r210: R << 20 | G << 10 | B, big-endian. R10l and R10b: R << 22 | G << 12 | B << 2, little- and big-endian.
+template< bool kBigEndian, int kShift >
+static void Unpack10BitRgbC( const uint8_t* pSrc, uint16_t* pR, uint16_t* pG, uint16_t* pB, long n )
+{
+    for( long x = 0; x < n; ++x, pSrc += 4 )
+    {
+        const uint32_t w = LoadWord( pSrc, kBigEndian );
+
+        pR[x] = ( w >> ( 20 + kShift ) ) & 0x3FF;
+        pG[x] = ( w >> ( 10 + kShift ) ) & 0x3FF;
+        pB[x] = ( w >> kShift ) & 0x3FF;
+    }
+}
+
+template< bool kBigEndian, int kShift >
+static void Pack10BitRgbC( const uint16_t* pR, const uint16_t* pG, const uint16_t* pB, uint8_t* pDst, long n )
+{
+    for( long x = 0; x < n; ++x, pDst += 4 )
+    {
+        const uint32_t w = (uint32_t)( pR[x] & 0x3FF ) << ( 20 + kShift ) |
+                           (uint32_t)( pG[x] & 0x3FF ) << ( 10 + kShift ) | (uint32_t)( pB[x] & 0x3FF ) << kShift;
+        StoreWord( pDst, w, kBigEndian );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void YuvToRgbC( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint16_t* pR, uint16_t* pG,
+                       uint16_t* pB, long n, const SMatrix& m )
+{
+    for( long x = 0; x < n; ++x )
+    {
+        const long c = x / 2;
+        const int y = pY[x] - 64;
+        const int u = ( ( x & 1 ) ? ( pU[c] + pU[c + 1] + 1 ) >> 1 : pU[c] ) - 512;
+        const int v = ( ( x & 1 ) ? ( pV[c] + pV[c + 1] + 1 ) >> 1 : pV[c] ) - 512;
+
+        pR[x] = Clip10( ( ( 16384 * y + m.rv * v + 8192 ) >> 14 ) + 64 );
+        pG[x] = Clip10( ( ( 16384 * y + m.gu * u + m.gv * v + 8192 ) >> 14 ) + 64 );
+        pB[x] = Clip10( ( ( 16384 * y + m.bu * u + 8192 ) >> 14 ) + 64 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void RgbToYuvC( const uint16_t* pR, const uint16_t* pG, const uint16_t* pB, uint16_t* pY, uint16_t* pU,
+                       uint16_t* pV, long n, const SMatrix& m )
+{
+    for( long x = 0; x < n; x += 2 )
+    {
+        const int r0 = pR[x] - 64, g0 = pG[x] - 64, b0 = pB[x] - 64;
+        const int r1 = pR[x + 1] - 64, g1 = pG[x + 1] - 64, b1 = pB[x + 1] - 64;
+        const int rs = r0 + r1, gs = g0 + g1, bs = b0 + b1;
+
+        pY[x] = Clip10( ( ( m.yr * r0 + m.yg * g0 + m.yb * b0 + 8192 ) >> 14 ) + 64 );
+        pY[x + 1] = Clip10( ( ( m.yr * r1 + m.yg * g1 + m.yb * b1 + 8192 ) >> 14 ) + 64 );
+        pU[x / 2] = Clip10( ( ( m.ur * rs + m.ug * gs + m.ub * bs + 8192 ) >> 14 ) + 512 );
+        pV[x / 2] = Clip10( ( ( m.vr * rs + m.vg * gs + m.vb * bs + 8192 ) >> 14 ) + 512 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static const SConvertKernels s_ScalarKernels =
+{
+    {
+        Unpack2vuyC, NULL, Unpack8BitRgbC<1, 2, 3, 0>, Unpack8BitRgbC<2, 1, 0, 3>,
+        Unpack10BitRgbC<true, 0>, Unpack10BitRgbC<false, 2>, Unpack10BitRgbC<true, 2>,
+    },
+    {
+        Pack2vuyC, NULL, Pack8BitRgbC<1, 2, 3, 0>, Pack8BitRgbC<2, 1, 0, 3>,
+        Pack10BitRgbC<true, 0>, Pack10BitRgbC<false, 2>, Pack10BitRgbC<true, 2>,
+    },
+    YuvToRgbC,
+    RgbToYuvC,
+};
+
+#ifdef CONVERT_X86
+//=====================================================================================================================
+// AVX2: 16 pixels (32 for 2vuy unpacking) per iteration; the rest of the row goes to the plain C kernel.
+
+// R, G, B bytes of four pixels to bytes 0-3, 4-7 and 8-11 of a lane
+static const int8_t s_GatherArgb[16] = { 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15, -1, -1, -1, -1 };
+static const int8_t s_GatherBgra[16] = { 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12, -1, -1, -1, -1 };
+static const int8_t s_SwapWords[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+
+// pair of 16-bit multipliers for pmaddwd, lo for the even lanes
+static inline int32_t Pair( int lo, int hi )
+{
+    return (int32_t)( (uint32_t)(uint16_t)hi << 16 | (uint16_t)lo );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template< bool kArgb >
+CONVERT_TARGET("avx2")
+static void Unpack8BitRgbAvx2( const uint8_t* pSrc, uint16_t* pR, uint16_t* pG, uint16_t* pB, long n )
+{
+    const __m256i gather = _mm256_broadcastsi128_si256(
+                                    _mm_loadu_si128( (const __m128i*)( kArgb ? s_GatherArgb : s_GatherBgra ) ) );
+    const __m256i planes = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+    const __m256i black = _mm256_set1_epi16(64);
+    const __m256i scale = _mm256_set1_epi16(7036);
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        // each: R of 8 pixels in bytes 0-7, G in 8-15, B in 16-23
+        const __m256i a = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8(
+                                    _mm256_loadu_si256( (const __m256i*)( pSrc + x * 4 ) ), gather ), planes );
+        const __m256i b = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8(
+                                    _mm256_loadu_si256( (const __m256i*)( pSrc + x * 4 + 32 ) ), gather ), planes );
+        const __m256i r = _mm256_cvtepu8_epi16( _mm_unpacklo_epi64( _mm256_castsi256_si128(a),
+                                                                    _mm256_castsi256_si128(b) ) );
+        const __m256i g = _mm256_cvtepu8_epi16( _mm_unpackhi_epi64( _mm256_castsi256_si128(a),
+                                                                    _mm256_castsi256_si128(b) ) );
+        const __m256i bl = _mm256_cvtepu8_epi16( _mm_unpacklo_epi64( _mm256_extracti128_si256( a, 1 ),
+                                                                     _mm256_extracti128_si256( b, 1 ) ) );
+
+        _mm256_storeu_si256( (__m256i*)( pR + x ),
+                             _mm256_add_epi16( black, _mm256_mulhrs_epi16( _mm256_slli_epi16( r, 4 ), scale ) ) );
+        _mm256_storeu_si256( (__m256i*)( pG + x ),
+                             _mm256_add_epi16( black, _mm256_mulhrs_epi16( _mm256_slli_epi16( g, 4 ), scale ) ) );
+        _mm256_storeu_si256( (__m256i*)( pB + x ),
+                             _mm256_add_epi16( black, _mm256_mulhrs_epi16( _mm256_slli_epi16( bl, 4 ), scale ) ) );
+    }
+
+    if( kArgb )
+    {
+        Unpack8BitRgbC<1, 2, 3, 0>( pSrc + x * 4, pR + x, pG + x, pB + x, n - x );
+    }
+    else
+    {
+        Unpack8BitRgbC<2, 1, 0, 3>( pSrc + x * 4, pR + x, pG + x, pB + x, n - x );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template< bool kArgb >
+CONVERT_TARGET("avx2")
+static void Pack8BitRgbAvx2( const uint16_t* pR, const uint16_t* pG, const uint16_t* pB, uint8_t* pDst, long n )
+{
+    const __m256i black = _mm256_set1_epi16(64);
+    const __m256i scale = _mm256_set1_epi16(9539);
+    const __m128i alpha = _mm_set1_epi8( (char)255 );
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        const __m256i r = _mm256_mulhrs_epi16( _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pR + x ) ),
+                                                                 black ), scale );
+        const __m256i g = _mm256_mulhrs_epi16( _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pG + x ) ),
+                                                                 black ), scale );
+        const __m256i b = _mm256_mulhrs_epi16( _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pB + x ) ),
+                                                                 black ), scale );
+        const __m128i r8 = _mm_packus_epi16( _mm256_castsi256_si128(r), _mm256_extracti128_si256( r, 1 ) );
+        const __m128i g8 = _mm_packus_epi16( _mm256_castsi256_si128(g), _mm256_extracti128_si256( g, 1 ) );
+        const __m128i b8 = _mm_packus_epi16( _mm256_castsi256_si128(b), _mm256_extracti128_si256( b, 1 ) );
+
+        // bytes 0, 1 and 2, 3 of each pixel
+        const __m128i lo0 = kArgb ? _mm_unpacklo_epi8( alpha, r8 ) : _mm_unpacklo_epi8( b8, g8 );
+        const __m128i hi0 = kArgb ? _mm_unpackhi_epi8( alpha, r8 ) : _mm_unpackhi_epi8( b8, g8 );
+        const __m128i lo1 = kArgb ? _mm_unpacklo_epi8( g8, b8 ) : _mm_unpacklo_epi8( r8, alpha );
+        const __m128i hi1 = kArgb ? _mm_unpackhi_epi8( g8, b8 ) : _mm_unpackhi_epi8( r8, alpha );
+        __m128i* pOut = (__m128i*)( pDst + x * 4 );
+
+        _mm_storeu_si128( pOut, _mm_unpacklo_epi16( lo0, lo1 ) );
+        _mm_storeu_si128( pOut + 1, _mm_unpackhi_epi16( lo0, lo1 ) );
+        _mm_storeu_si128( pOut + 2, _mm_unpacklo_epi16( hi0, hi1 ) );
+        _mm_storeu_si128( pOut + 3, _mm_unpackhi_epi16( hi0, hi1 ) );
+    }
+
+    if( kArgb )
+    {
+        Pack8BitRgbC<1, 2, 3, 0>( pR + x, pG + x, pB + x, pDst + x * 4, n - x );
+    }
+    else
+    {
+        Pack8BitRgbC<2, 1, 0, 3>( pR + x, pG + x, pB + x, pDst + x * 4, n - x );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template< bool kBigEndian, int kShift >
+CONVERT_TARGET("avx2")
+static void Unpack10BitRgbAvx2( const uint8_t* pSrc, uint16_t* pR, uint16_t* pG, uint16_t* pB, long n )
+{
+    const __m256i swap = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_SwapWords ) );
+    const __m256i mask = _mm256_set1_epi32(0x3FF);
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        __m256i a = _mm256_loadu_si256( (const __m256i*)( pSrc + x * 4 ) );
+        __m256i b = _mm256_loadu_si256( (const __m256i*)( pSrc + x * 4 + 32 ) );
+
+        if( kBigEndian )
+        {
+            a = _mm256_shuffle_epi8( a, swap );
+            b = _mm256_shuffle_epi8( b, swap );
+        }
+
+        // packusdw interleaves the lanes of a and b; 0xD8 puts the quarters back in order
+        const __m256i r = _mm256_packus_epi32( _mm256_and_si256( _mm256_srli_epi32( a, 20 + kShift ), mask ),
+                                               _mm256_and_si256( _mm256_srli_epi32( b, 20 + kShift ), mask ) );
+        const __m256i g = _mm256_packus_epi32( _mm256_and_si256( _mm256_srli_epi32( a, 10 + kShift ), mask ),
+                                               _mm256_and_si256( _mm256_srli_epi32( b, 10 + kShift ), mask ) );
+        const __m256i bl = _mm256_packus_epi32( _mm256_and_si256( _mm256_srli_epi32( a, kShift ), mask ),
+                                                _mm256_and_si256( _mm256_srli_epi32( b, kShift ), mask ) );
+
+        _mm256_storeu_si256( (__m256i*)( pR + x ), _mm256_permute4x64_epi64( r, 0xD8 ) );
+        _mm256_storeu_si256( (__m256i*)( pG + x ), _mm256_permute4x64_epi64( g, 0xD8 ) );
+        _mm256_storeu_si256( (__m256i*)( pB + x ), _mm256_permute4x64_epi64( bl, 0xD8 ) );
+    }
+
+    Unpack10BitRgbC<kBigEndian, kShift>( pSrc + x * 4, pR + x, pG + x, pB + x, n - x );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template< bool kBigEndian, int kShift >
+CONVERT_TARGET("avx2")
+static void Pack10BitRgbAvx2( const uint16_t* pR, const uint16_t* pG, const uint16_t* pB, uint8_t* pDst, long n )
+{
+    const __m256i swap = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_SwapWords ) );
+    const __m256i mask = _mm256_set1_epi16(0x3FF);
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        const __m256i r = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*)( pR + x ) ), mask );
+        const __m256i g = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*)( pG + x ) ), mask );
+        const __m256i b = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*)( pB + x ) ), mask );
+
+        for( int half = 0; half < 2; ++half )
+        {
+            const __m128i r8 = half ? _mm256_extracti128_si256( r, 1 ) : _mm256_castsi256_si128(r);
+            const __m128i g8 = half ? _mm256_extracti128_si256( g, 1 ) : _mm256_castsi256_si128(g);
+            const __m128i b8 = half ? _mm256_extracti128_si256( b, 1 ) : _mm256_castsi256_si128(b);
+            __m256i w = _mm256_or_si256( _mm256_or_si256(
+                                            _mm256_slli_epi32( _mm256_cvtepu16_epi32(r8), 20 + kShift ),
+                                            _mm256_slli_epi32( _mm256_cvtepu16_epi32(g8), 10 + kShift ) ),
+                                         _mm256_slli_epi32( _mm256_cvtepu16_epi32(b8), kShift ) );
+
+            if( kBigEndian )
+            {
+                w = _mm256_shuffle_epi8( w, swap );
+            }
+
+            _mm256_storeu_si256( (__m256i*)( pDst + x * 4 + half * 32 ), w );
+        }
+    }
+
+    Pack10BitRgbC<kBigEndian, kShift>( pR + x, pG + x, pB + x, pDst + x * 4, n - x );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CONVERT_TARGET("avx2")
+static void Unpack2vuyAvx2( const uint8_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long n )
+{
+    const __m256i low = _mm256_set1_epi16(0xFF);
+    const __m256i cb = _mm256_set1_epi32(0xFFFF);
+    long x = 0;
+
+    for( ; x + 32 <= n; x += 32 )
+    {
+        const __m256i a = _mm256_loadu_si256( (const __m256i*)( pSrc + x * 2 ) );
+        const __m256i b = _mm256_loadu_si256( (const __m256i*)( pSrc + x * 2 + 32 ) );
+        const __m256i ca = _mm256_and_si256( a, low );            // Cb Cr Cb Cr ...
+        const __m256i cbb = _mm256_and_si256( b, low );
+        const __m256i u = _mm256_packus_epi32( _mm256_and_si256( ca, cb ), _mm256_and_si256( cbb, cb ) );
+        const __m256i v = _mm256_packus_epi32( _mm256_srli_epi32( ca, 16 ), _mm256_srli_epi32( cbb, 16 ) );
+
+        _mm256_storeu_si256( (__m256i*)( pY + x ), _mm256_slli_epi16( _mm256_srli_epi16( a, 8 ), 2 ) );
+        _mm256_storeu_si256( (__m256i*)( pY + x + 16 ), _mm256_slli_epi16( _mm256_srli_epi16( b, 8 ), 2 ) );
+        _mm256_storeu_si256( (__m256i*)( pU + x / 2 ), _mm256_slli_epi16( _mm256_permute4x64_epi64( u, 0xD8 ), 2 ) );
+        _mm256_storeu_si256( (__m256i*)( pV + x / 2 ), _mm256_slli_epi16( _mm256_permute4x64_epi64( v, 0xD8 ), 2 ) );
+    }
+
+    Unpack2vuyC( pSrc + x * 2, pY + x, pU + x / 2, pV + x / 2, n - x );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CONVERT_TARGET("avx2")
+static void Pack2vuyAvx2( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint8_t* pDst, long n )
+{
+    const __m256i round = _mm256_set1_epi16(2);
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        const __m256i y = _mm256_srli_epi16( _mm256_add_epi16( _mm256_loadu_si256( (const __m256i*)( pY + x ) ),
+                                                               round ), 2 );
+        const __m128i u = _mm_srli_epi16( _mm_add_epi16( _mm_loadu_si128( (const __m128i*)( pU + x / 2 ) ),
+                                                         _mm256_castsi256_si128(round) ), 2 );
+        const __m128i v = _mm_srli_epi16( _mm_add_epi16( _mm_loadu_si128( (const __m128i*)( pV + x / 2 ) ),
+                                                         _mm256_castsi256_si128(round) ), 2 );
+        const __m128i y8 = _mm_packus_epi16( _mm256_castsi256_si128(y), _mm256_extracti128_si256( y, 1 ) );
+        const __m128i uv8 = _mm_packus_epi16( u, v );
+        const __m128i cbcr = _mm_unpacklo_epi8( uv8, _mm_srli_si128( uv8, 8 ) );
+
+        _mm_storeu_si128( (__m128i*)( pDst + x * 2 ), _mm_unpacklo_epi8( cbcr, y8 ) );
+        _mm_storeu_si128( (__m128i*)( pDst + x * 2 + 16 ), _mm_unpackhi_epi8( cbcr, y8 ) );
+    }
+
+    Pack2vuyC( pY + x, pU + x / 2, pV + x / 2, pDst + x * 2, n - x );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// pmaddwd on interleaved pairs gives the sums of two products in 32 bits; packssdw restores the pixel order the
+// unpacks changed.
+CONVERT_TARGET("avx2")
+static void YuvToRgbAvx2( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint16_t* pR, uint16_t* pG,
+                          uint16_t* pB, long n, const SMatrix& m )
+{
+    const __m256i black = _mm256_set1_epi16(64);
+    const __m256i zero = _mm256_set1_epi16(512);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi32(8192);
+    const __m256i lo = _mm256_set1_epi16(4);
+    const __m256i hi = _mm256_set1_epi16(1019);
+    const __m256i yv = _mm256_set1_epi32( Pair( 16384, m.rv ) );
+    const __m256i yuG = _mm256_set1_epi32( Pair( 16384, m.gu ) );
+    const __m256i v1G = _mm256_set1_epi32( Pair( m.gv, 8192 ) );
+    const __m256i yuB = _mm256_set1_epi32( Pair( 16384, m.bu ) );
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        const __m128i u0 = _mm_loadu_si128( (const __m128i*)( pU + x / 2 ) );
+        const __m128i u1 = _mm_avg_epu16( u0, _mm_loadu_si128( (const __m128i*)( pU + x / 2 + 1 ) ) );
+        const __m128i v0 = _mm_loadu_si128( (const __m128i*)( pV + x / 2 ) );
+        const __m128i v1 = _mm_avg_epu16( v0, _mm_loadu_si128( (const __m128i*)( pV + x / 2 + 1 ) ) );
+
+        const __m256i y = _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pY + x ) ), black );
+        const __m256i u = _mm256_sub_epi16( _mm256_inserti128_si256( _mm256_castsi128_si256(
+                                            _mm_unpacklo_epi16( u0, u1 ) ), _mm_unpackhi_epi16( u0, u1 ), 1 ), zero );
+        const __m256i v = _mm256_sub_epi16( _mm256_inserti128_si256( _mm256_castsi128_si256(
+                                            _mm_unpacklo_epi16( v0, v1 ) ), _mm_unpackhi_epi16( v0, v1 ), 1 ), zero );
+
+        const __m256i yvLo = _mm256_unpacklo_epi16( y, v ), yvHi = _mm256_unpackhi_epi16( y, v );
+        const __m256i yuLo = _mm256_unpacklo_epi16( y, u ), yuHi = _mm256_unpackhi_epi16( y, u );
+        const __m256i v1Lo = _mm256_unpacklo_epi16( v, one ), v1Hi = _mm256_unpackhi_epi16( v, one );
+
+        const __m256i r = _mm256_packs_epi32(
+                            _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( yvLo, yv ), round ), 14 ),
+                            _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( yvHi, yv ), round ), 14 ) );
+        const __m256i g = _mm256_packs_epi32(
+                            _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( yuLo, yuG ),
+                                                                 _mm256_madd_epi16( v1Lo, v1G ) ), 14 ),
+                            _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( yuHi, yuG ),
+                                                                 _mm256_madd_epi16( v1Hi, v1G ) ), 14 ) );
+        const __m256i b = _mm256_packs_epi32(
+                            _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( yuLo, yuB ), round ), 14 ),
+                            _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( yuHi, yuB ), round ), 14 ) );
+
+        _mm256_storeu_si256( (__m256i*)( pR + x ),
+                             _mm256_min_epi16( _mm256_max_epi16( _mm256_add_epi16( r, black ), lo ), hi ) );
+        _mm256_storeu_si256( (__m256i*)( pG + x ),
+                             _mm256_min_epi16( _mm256_max_epi16( _mm256_add_epi16( g, black ), lo ), hi ) );
+        _mm256_storeu_si256( (__m256i*)( pB + x ),
+                             _mm256_min_epi16( _mm256_max_epi16( _mm256_add_epi16( b, black ), lo ), hi ) );
+    }
+
+    YuvToRgbC( pY + x, pU + x / 2, pV + x / 2, pR + x, pG + x, pB + x, n - x, m );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CONVERT_TARGET("avx2")
+static void RgbToYuvAvx2( const uint16_t* pR, const uint16_t* pG, const uint16_t* pB, uint16_t* pY, uint16_t* pU,
+                          uint16_t* pV, long n, const SMatrix& m )
+{
+    const __m256i black = _mm256_set1_epi16(64);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi32(8192);
+    const __m256i lo = _mm256_set1_epi16(4);
+    const __m256i hi = _mm256_set1_epi16(1019);
+    const __m256i zero32 = _mm256_set1_epi32(512);
+    const __m256i lo32 = _mm256_set1_epi32(4);
+    const __m256i hi32 = _mm256_set1_epi32(1019);
+    const __m256i rgY = _mm256_set1_epi32( Pair( m.yr, m.yg ) );
+    const __m256i b1Y = _mm256_set1_epi32( Pair( m.yb, 8192 ) );
+    const __m256i ur = _mm256_set1_epi32(m.ur), ug = _mm256_set1_epi32(m.ug), ub = _mm256_set1_epi32(m.ub);
+    const __m256i vr = _mm256_set1_epi32(m.vr), vg = _mm256_set1_epi32(m.vg), vb = _mm256_set1_epi32(m.vb);
+    long x = 0;
+
+    for( ; x + 16 <= n; x += 16 )
+    {
+        const __m256i r = _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pR + x ) ), black );
+        const __m256i g = _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pG + x ) ), black );
+        const __m256i b = _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*)( pB + x ) ), black );
+
+        const __m256i y = _mm256_packs_epi32(
+                            _mm256_srai_epi32( _mm256_add_epi32(
+                                _mm256_madd_epi16( _mm256_unpacklo_epi16( r, g ), rgY ),
+                                _mm256_madd_epi16( _mm256_unpacklo_epi16( b, one ), b1Y ) ), 14 ),
+                            _mm256_srai_epi32( _mm256_add_epi32(
+                                _mm256_madd_epi16( _mm256_unpackhi_epi16( r, g ), rgY ),
+                                _mm256_madd_epi16( _mm256_unpackhi_epi16( b, one ), b1Y ) ), 14 ) );
+
+        // sums of the pairs, in order
+        const __m256i rs = _mm256_madd_epi16( r, one );
+        const __m256i gs = _mm256_madd_epi16( g, one );
+        const __m256i bs = _mm256_madd_epi16( b, one );
+
+        __m256i u = _mm256_add_epi32( _mm256_add_epi32( _mm256_mullo_epi32( rs, ur ), _mm256_mullo_epi32( gs, ug ) ),
+                                      _mm256_add_epi32( _mm256_mullo_epi32( bs, ub ), round ) );
+        __m256i v = _mm256_add_epi32( _mm256_add_epi32( _mm256_mullo_epi32( rs, vr ), _mm256_mullo_epi32( gs, vg ) ),
+                                      _mm256_add_epi32( _mm256_mullo_epi32( bs, vb ), round ) );
+
+        u = _mm256_min_epi32( _mm256_max_epi32( _mm256_add_epi32( _mm256_srai_epi32( u, 14 ), zero32 ), lo32 ), hi32 );
+        v = _mm256_min_epi32( _mm256_max_epi32( _mm256_add_epi32( _mm256_srai_epi32( v, 14 ), zero32 ), lo32 ), hi32 );
+
+        _mm256_storeu_si256( (__m256i*)( pY + x ),
+                             _mm256_min_epi16( _mm256_max_epi16( _mm256_add_epi16( y, black ), lo ), hi ) );
+        _mm_storeu_si128( (__m128i*)( pU + x / 2 ),
+                          _mm256_castsi256_si128( _mm256_permute4x64_epi64( _mm256_packus_epi32( u, u ), 0x08 ) ) );
+        _mm_storeu_si128( (__m128i*)( pV + x / 2 ),
+                          _mm256_castsi256_si128( _mm256_permute4x64_epi64( _mm256_packus_epi32( v, v ), 0x08 ) ) );
+    }
+
+    RgbToYuvC( pR + x, pG + x, pB + x, pY + x, pU + x / 2, pV + x / 2, n - x, m );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static const SConvertKernels s_Avx2Kernels =
+{
+    {
+        Unpack2vuyAvx2, NULL, Unpack8BitRgbAvx2<true>, Unpack8BitRgbAvx2<false>,
+        Unpack10BitRgbAvx2<true, 0>, Unpack10BitRgbAvx2<false, 2>, Unpack10BitRgbAvx2<true, 2>,
+    },
+    {
+        Pack2vuyAvx2, NULL, Pack8BitRgbAvx2<true>, Pack8BitRgbAvx2<false>,
+        Pack10BitRgbAvx2<true, 0>, Pack10BitRgbAvx2<false, 2>, Pack10BitRgbAvx2<true, 2>,
+    },
+    YuvToRgbAvx2,
+    RgbToYuvAvx2,
+};
+#endif // CONVERT_X86
+
+//=====================================================================================================================
+// Of pixel x, a multiple of 6, within a row.
+static long ByteOffset( BMDPixelFormat format, long x )
+{
+    switch( format )
+    {
+    case bmdFormat8BitYUV:      return x * 2;
+    case bmdFormat10BitYUV:     return x / 6 * 16;
+    default:                    return x * 4;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool IsValidConvertJob( const SConvertJob& job )
+{
+    return PixelFormatIndex( job.srcFormat ) >= 0 && PixelFormatIndex( job.dstFormat ) >= 0 &&
+           job.pSrc != NULL && job.pDst != NULL && job.width > 0 && job.width % 2 == 0 && job.height > 0 &&
+           job.srcRowBytes >= RowBytesForPixelFormat( job.srcFormat, job.width ) &&
+           job.dstRowBytes >= RowBytesForPixelFormat( job.dstFormat, job.width ) &&
+           ( job.colorspace == kColorspaceRec601 || job.colorspace == kColorspaceRec709 );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void ConvertRows( const SConvertJob& job, long firstRow, long rows )
+{
+    const int src = PixelFormatIndex( job.srcFormat );
+    const int dst = PixelFormatIndex( job.dstFormat );
+
+    if( src == dst )
+    {
+        const long rowBytes = RowBytesForPixelFormat( job.srcFormat, job.width );
+
+        for( long row = firstRow; row < firstRow + rows; ++row )
+        {
+            memcpy( (uint8_t*)job.pDst + row * job.dstRowBytes, (const uint8_t*)job.pSrc + row * job.srcRowBytes,
+                    rowBytes );
+        }
+
+        return;
+    }
+
+    // the highest kernels at or below job.isa which the CPU has
+    const ECpuIsa isa = BestCpuIsa( job.isa );
+    const SV210Kernels* pV210 = GetV210Kernels(isa);
+    const SConvertKernels* pKernels = &s_ScalarKernels;
+
+#ifdef CONVERT_X86
+    if( isa >= kIsaAvx2 )
+    {
+        pKernels = &s_Avx2Kernels;
+    }
+#endif
+
+    const SMatrix& matrix = s_Matrices[job.colorspace];
+    const bool toRgb = IsYuvPixelFormat( job.srcFormat ) && !IsYuvPixelFormat( job.dstFormat );
+    const bool toYuv = !IsYuvPixelFormat( job.srcFormat ) && IsYuvPixelFormat( job.dstFormat );
+
+    // a: as unpacked, b: after the matrix; Cb/Cr planes have one sample to spare for the interpolation
+    uint16_t a[3][kChunk + 8];
+    uint16_t b[3][kChunk + 8];
+    uint16_t (*pPacked)[kChunk + 8] = ( toRgb || toYuv ) ? b : a;
+
+    for( long row = firstRow; row < firstRow + rows; ++row )
+    {
+        const uint8_t* pSrcRow = (const uint8_t*)job.pSrc + row * job.srcRowBytes;
+        uint8_t* pDstRow = (uint8_t*)job.pDst + row * job.dstRowBytes;
+
+        for( long x = 0; x < job.width; x += kChunk )
+        {
+            const long n = std::min( kChunk, job.width - x );
+
+            // to RGB, the chroma of the next block too, for the last odd pixel
+            const long unpack = toRgb ? std::min( n + 6, job.width - x ) : n;
+
+            if( pKernels->unpack[src] != NULL )
+            {
+                pKernels->unpack[src]( pSrcRow + ByteOffset( job.srcFormat, x ), a[0], a[1], a[2], unpack );
+            }
+            else
+            {
+                pV210->unpackRow( (const uint32_t*)( pSrcRow + ByteOffset( job.srcFormat, x ) ), a[0], a[1], a[2],
+                                  unpack );
+            }
+
+            if( toRgb )
+            {
+                if( unpack == n )
+                {
+                    a[1][n / 2] = a[1][n / 2 - 1];
+                    a[2][n / 2] = a[2][n / 2 - 1];
+                }
+
+                pKernels->yuvToRgb( a[0], a[1], a[2], b[0], b[1], b[2], n, matrix );
+            }
+            else if( toYuv )
+            {
+                pKernels->rgbToYuv( a[0], a[1], a[2], b[0], b[1], b[2], n, matrix );
+            }
+
+            if( pKernels->pack[dst] != NULL )
+            {
+                pKernels->pack[dst]( pPacked[0], pPacked[1], pPacked[2], pDstRow + ByteOffset( job.dstFormat, x ), n );
+            }
+            else
+            {
+                pV210->packRow( pPacked[0], pPacked[1], pPacked[2],
+                                (uint32_t*)( pDstRow + ByteOffset( job.dstFormat, x ) ), n );
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool MakeConvertJob( IDeckLinkVideoFrame* pSrc, IDeckLinkVideoFrame* pDst, EColorspace colorspace, SConvertJob* pJob )
+{
+    void* pSrcBytes = NULL;
+
+    memset( pJob, 0, sizeof(*pJob) );
+
+    if( pSrc->GetWidth() != pDst->GetWidth() || pSrc->GetHeight() != pDst->GetHeight() ||
+        pSrc->GetBytes(&pSrcBytes) != S_OK || pDst->GetBytes(&pJob->pDst) != S_OK )
+    {
+        return false;
+    }
+
+    pJob->pSrc = pSrcBytes;
+    pJob->srcRowBytes = pSrc->GetRowBytes();
+    pJob->srcFormat = pSrc->GetPixelFormat();
+    pJob->dstRowBytes = pDst->GetRowBytes();
+    pJob->dstFormat = pDst->GetPixelFormat();
+    pJob->width = pSrc->GetWidth();
+    pJob->height = pSrc->GetHeight();
+    pJob->colorspace = colorspace;
+    pJob->isa = kIsaCount;
+    return true;
+}
+
+//=====================================================================================================================
+CFrameConverter::CFrameConverter( unsigned threads, ECpuIsa isa )
+    : m_RefCount(1), m_Isa(isa), m_pJob(NULL), m_Generation(0), m_Busy(0), m_Quit(false), m_NextBand(0)
+{
+    if( threads == 0 )
+    {
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    for( unsigned i = 1; i < threads; ++i )
+    {
+        m_Workers.push_back( std::thread( &CFrameConverter::WorkerMain, this ) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CFrameConverter::~CFrameConverter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Quit = true;
+    }
+
+    m_Wake.notify_all();
+
+    for( size_t i = 0; i < m_Workers.size(); ++i )
+    {
+        m_Workers[i].join();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFrameConverter::WorkerMain()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    for( ;; )
+    {
+        while( !m_Quit && m_Generation == seen )
+        {
+            m_Wake.wait(lock);
+        }
+
+        if( m_Quit )
+        {
+            return;
+        }
+
+        seen = m_Generation;
+        const SConvertJob job = *m_pJob;
+
+        lock.unlock();
+        RunBands(job);
+        lock.lock();
+
+        if( --m_Busy == 0 )
+        {
+            m_Done.notify_one();
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CFrameConverter::RunBands( const SConvertJob& job )
+{
+    const long bands = ( job.height + kBandRows - 1 ) / kBandRows;
+    long band;
+
+    while( ( band = m_NextBand.fetch_add( 1, std::memory_order_relaxed ) ) < bands )
+    {
+        ConvertRows( job, band * kBandRows, std::min( (long)kBandRows, job.height - band * kBandRows ) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CFrameConverter::Convert( const SConvertJob& job )
+{
+    if( !IsValidConvertJob(job) )
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> convertLock(m_ConvertMutex);
+    SConvertJob mine = job;
+
+    mine.isa = m_Isa;
+    m_NextBand.store( 0, std::memory_order_relaxed );
+
+    if( m_Workers.empty() )
+    {
+        RunBands(mine);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_pJob = &mine;
+        m_Busy = (unsigned)m_Workers.size();
+        ++m_Generation;
+    }
+
+    m_Wake.notify_all();
+    RunBands(mine);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    while( m_Busy != 0 )
+    {
+        m_Done.wait(lock);
+    }
+
+    m_pJob = NULL;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CFrameConverter::Convert( IDeckLinkVideoFrame* pSrc, IDeckLinkVideoFrame* pDst, EColorspace colorspace )
+{
+    SConvertJob job;
+
+    return MakeConvertJob( pSrc, pDst, colorspace, &job ) && Convert(job);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameConverter::ConvertFrame( IDeckLinkVideoFrame* srcFrame, IDeckLinkVideoFrame* dstFrame )
+{
+    const EColorspace colorspace = ColorspaceForSize( srcFrame->GetWidth(), srcFrame->GetHeight() );
+
+    return Convert( srcFrame, dstFrame, colorspace ) ? S_OK : E_INVALIDARG;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CFrameConverter::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkVideoConversion ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkVideoConversion*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CFrameConverter::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CFrameConverter::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
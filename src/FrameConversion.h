@@ -0,0 +1,116 @@
+#ifndef FRAME_CONVERSION_H
+#define FRAME_CONVERSION_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "DeckLinkPlatform.h"
+
+//=====================================================================================================================
+// Conversion between any two of the pixel formats in g_PixelFormats.
+//
+// A row goes through at most three stages, a chunk of pixels at a time in buffers that stay in L1/L2: unpacking into
+// planes of 10-bit samples at SMPTE levels (Y/Cb/Cr 4:2:2 for 2vuy and v210, R/G/B 4:4:4 for the RGB formats), the
+// Rec.601 or Rec.709 matrix if the two formats are on different sides, and packing. 8-bit ARGB/BGRA are full range
+// and scaled to 64..940 on the way in; the 10-bit RGB formats carry SMPTE levels as they are. 4:2:2 chroma is
+// co-sited with the even pixels: interpolated for the odd pixels going to RGB, averaged over each pair going back.
+// Results of the matrix are clipped to 4..1019, clear of the codes SDI reserves.
+//
+// The kernels of every stage exist in plain C and AVX2, with the same integer arithmetic, so they give identical
+// results; the v210 stages use the kernels of V210.h.
+enum EColorspace
+{
+    kColorspaceRec601,
+    kColorspaceRec709,
+};
+
+// Rec.709 if the flags of the display mode say so, Rec.601 otherwise.
+EColorspace ColorspaceFromFlags( BMDDisplayModeFlags flags );
+
+// Of the first display mode with that geometry; otherwise Rec.601 up to 576 lines and Rec.709 above.
+EColorspace ColorspaceForSize( long width, long height );
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SConvertJob
+{
+    const void*     pSrc;
+    long            srcRowBytes;
+    BMDPixelFormat  srcFormat;
+    void*           pDst;
+    long            dstRowBytes;
+    BMDPixelFormat  dstFormat;
+    long            width;
+    long            height;
+    EColorspace     colorspace;
+    ECpuIsa         isa;              // highest kernels to use; kIsaCount = the best the CPU has
+};
+
+// Formats known, buffers present, width even and rows long enough.
+bool IsValidConvertJob( const SConvertJob& job );
+
+// Converts rows [firstRow, firstRow + rows) of a valid job on the calling thread. Rows are independent, so any split
+// of a frame between threads gives the same result.
+void ConvertRows( const SConvertJob& job, long firstRow, long rows );
+
+// A job for the whole of pSrc into pDst, from their geometry and GetRowBytes(), at the best kernels; false if the
+// frames differ in size or have no buffer. Whether the job is valid is left to IsValidConvertJob().
+bool MakeConvertJob( IDeckLinkVideoFrame* pSrc, IDeckLinkVideoFrame* pDst, EColorspace colorspace, SConvertJob* pJob );
+
+//=====================================================================================================================
+// Converts whole frames, bands of rows being spread over worker threads and the caller, which returns when all are
+// done. One frame at a time: concurrent callers take turns.
+//
+// As an IDeckLinkVideoConversion it stands in for the API's converter; ConvertFrame() then takes the colorspace from
+// the frame's geometry (ColorspaceForSize()).
+class CFrameConverter : public IDeckLinkVideoConversion
+{
+    enum { kBandRows = 16 };
+
+    std::atomic<ULONG>        m_RefCount;
+    ECpuIsa                   m_Isa;
+
+    std::mutex                m_ConvertMutex;     // one frame at a time
+    std::mutex                m_Mutex;
+    std::condition_variable   m_Wake;
+    std::condition_variable   m_Done;
+    std::vector<std::thread>  m_Workers;
+    const SConvertJob*        m_pJob;
+    uint64_t                  m_Generation;       // of m_pJob, for the workers to tell a new frame
+    unsigned                  m_Busy;             // workers still on the current frame
+    bool                      m_Quit;
+    std::atomic<long>         m_NextBand;
+
+    CFrameConverter( const CFrameConverter& );
+    CFrameConverter& operator=( const CFrameConverter& );
+
+    virtual ~CFrameConverter();
+
+    void WorkerMain();
+    void RunBands( const SConvertJob& job );
+
+public:
+    // threads: converting a frame, including the caller; 0 = one per CPU. isa: as in SConvertJob.
+    CFrameConverter( unsigned threads, ECpuIsa isa = kIsaCount );
+
+    unsigned ThreadCount() const  { return (unsigned)m_Workers.size() + 1; }
+
+    // false if the job is not valid; job.isa is overridden by the converter's
+    bool Convert( const SConvertJob& job );
+    bool Convert( IDeckLinkVideoFrame* pSrc, IDeckLinkVideoFrame* pDst, EColorspace colorspace );
+
+    // overrides IDeckLinkVideoConversion
+    virtual HRESULT STDMETHODCALLTYPE ConvertFrame( IDeckLinkVideoFrame* srcFrame, IDeckLinkVideoFrame* dstFrame );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+#endif // FRAME_CONVERSION_H
@@ -0,0 +1,638 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+#include "DisplayModes.h"
+#include "PlayoutEngine.h"
+#include "SpscQueue.h"
+
+//=====================================================================================================================
+// Playout to one device: m_Thread schedules, the driver's completion callback returns frames to m_Free.
+class CPlayoutChannel : public IDeckLinkVideoOutputCallback
+{
+    enum { kSpareFrames = 3 };        // on screen, being completed, being filled
+    enum { kDecaySeconds = 10 };
+
+    std::atomic<ULONG>                        m_RefCount;
+    SDeviceInfo                               m_Info;         // m_Info.pDev AddRef'ed
+    IPlayoutSource*                           m_pSource;
+    SPlayoutConfig                            m_Config;
+    CFrameAllocator*                          m_pAllocator;   // NULL = the driver's memory
+    IDeckLinkOutput*                          m_pOutput;
+    CAudioPlayout*                            m_pAudio;       // NULL = video only
+    CAncillaryInserter*                       m_pInserter;    // NULL = no VANC
+    const SDisplayModeDesc*                   m_pMode;
+    long                                      m_RowBytes;
+    uint64_t                                  m_FramesPerSecond;
+
+    CSpscQueue<IDeckLinkMutableVideoFrame*>   m_Free;
+    std::thread                               m_Thread;
+    std::mutex                                m_WakeMutex;
+    std::condition_variable                   m_WakeCond;
+    std::atomic<bool>                         m_Stop;
+
+    // owned by the scheduler thread
+    std::vector<IDeckLinkMutableVideoFrame*>  m_Frames;       // every frame created, one reference each
+    IDeckLinkMutableVideoFrame*               m_pSpare;       // taken from the free list but not scheduled
+    BMDTimeValue                              m_NextTime;
+    uint64_t                                  m_NextFrame;
+    bool                                      m_Playing;
+    uint64_t                                  m_LastBad;      // late + dropped + underruns at the last adaptation
+    uint64_t                                  m_CleanSince;   // frames shown at the last adaptation
+    SAncillaryPacket                          m_Packets[CAncillaryInserter::kMaxSlots];
+
+    // written by the completion callback only
+    std::atomic<uint64_t>                     m_Completed;
+    std::atomic<uint64_t>                     m_Late;
+    std::atomic<uint64_t>                     m_Dropped;
+    std::atomic<uint64_t>                     m_Flushed;
+
+    // written by the scheduler thread only
+    std::atomic<uint64_t>                     m_Scheduled;
+    std::atomic<uint64_t>                     m_Underruns;
+    std::atomic<unsigned>                     m_Target;
+    std::atomic<unsigned>                     m_Buffered;
+    std::atomic<unsigned>                     m_FrameCount;
+
+    CPlayoutChannel( const CPlayoutChannel& );
+    CPlayoutChannel& operator=( const CPlayoutChannel& );
+
+    ~CPlayoutChannel();
+
+    void StartAudio();
+    void SchedulerMain();
+    void Adapt();
+    void Refill();
+    void InsertAncillary( IDeckLinkMutableVideoFrame* pFrame );
+    IDeckLinkMutableVideoFrame* FreeFrame();
+
+    static void Increment( std::atomic<uint64_t>& counter )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+
+public:
+    CPlayoutChannel( const SDeviceInfo& info, IPlayoutSource* pSource, const SPlayoutConfig& config );
+
+    IDeckLink* Device() const  { return m_Info.pDev; }
+
+    // Returns false if the output could not be enabled, the channel is then unusable.
+    bool Start( BMDDisplayMode mode );
+    void Stop();
+
+    void GetStats( SPlayoutStats* pStats );
+
+    // overrides IDeckLinkVideoOutputCallback
+    virtual HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted( IDeckLinkVideoFrame* pFrame,
+                                                               BMDOutputFrameCompletionResult result );
+    virtual HRESULT STDMETHODCALLTYPE ScheduledPlaybackHasStopped(void);
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CPlayoutChannel::CPlayoutChannel( const SDeviceInfo& info, IPlayoutSource* pSource, const SPlayoutConfig& config )
+    : m_RefCount(1), m_Info(info), m_pSource(pSource), m_Config(config), m_pAllocator(NULL), m_pOutput(NULL),
+      m_pAudio(NULL), m_pInserter(NULL), m_pMode(NULL), m_RowBytes(0), m_FramesPerSecond(1),
+      m_Free( config.maxBuffered + kSpareFrames ), m_Stop(false),
+      m_pSpare(NULL), m_NextTime(0), m_NextFrame(0), m_Playing(false), m_LastBad(0), m_CleanSince(0), m_Completed(0),
+      m_Late(0), m_Dropped(0), m_Flushed(0), m_Scheduled(0), m_Underruns(0), m_Target(config.minBuffered),
+      m_Buffered(0), m_FrameCount(0)
+{
+    m_Info.pDev->AddRef();
+    m_Frames.reserve( m_Config.maxBuffered + kSpareFrames );
+
+    if( config.framePool )
+    {
+        m_pAllocator = new CFrameAllocator( config.numaNode, config.maxBuffered + kSpareFrames );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CPlayoutChannel::~CPlayoutChannel()
+{
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->Release();
+    }
+
+    delete m_pInserter;
+    m_Info.pDev->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CPlayoutChannel::Start( BMDDisplayMode mode )
+{
+    m_pMode = FindDisplayMode(mode);
+
+    if( m_pMode == NULL || m_Info.pDev->QueryInterface( IID_IDeckLinkOutput, (void**)&m_pOutput ) != S_OK )
+    {
+        m_pOutput = NULL;
+        return false;
+    }
+
+    m_RowBytes = RowBytesForPixelFormat( m_Config.format, m_pMode->width );
+    m_FramesPerSecond = (uint64_t)( ( m_pMode->timeScale + m_pMode->frameDuration - 1 ) / m_pMode->frameDuration );
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->SetFormat( mode, m_Config.format );
+        m_pOutput->SetVideoOutputFrameMemoryAllocator(m_pAllocator);
+    }
+
+    if( m_Config.ancillarySlots != 0 )
+    {
+        m_pInserter = new CAncillaryInserter( m_Config.ancillary, m_Config.ancillarySlots );
+
+        if( m_pInserter->Prepare(mode) == 0 ||
+            m_pOutput->EnableVideoOutput( mode, bmdVideoOutputVANC ) != S_OK )
+        {
+            delete m_pInserter;
+            m_pInserter = NULL;
+        }
+    }
+
+    if( m_pInserter == NULL && m_pOutput->EnableVideoOutput( mode, bmdVideoOutputFlagDefault ) != S_OK )
+    {
+        m_pOutput->SetVideoOutputFrameMemoryAllocator(NULL);
+        m_pOutput->Release();
+        m_pOutput = NULL;
+        return false;
+    }
+
+    if( m_Config.audioChannels != 0 )
+    {
+        StartAudio();
+    }
+
+    m_pOutput->SetScheduledFrameCompletionCallback(this);
+    m_Thread = std::thread( &CPlayoutChannel::SchedulerMain, this );
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Audio is an extra: on failure the channel goes on with video only.
+void CPlayoutChannel::StartAudio()
+{
+    const uint64_t frameSamples = (uint64_t)bmdAudioSampleRate48kHz * m_pMode->frameDuration / m_pMode->timeScale;
+    const long buffered = ( m_Config.audioBuffered > 0 ) ? m_Config.audioBuffered
+                                                         : (long)( frameSamples * m_Config.minBuffered );
+    const long latency = ( m_Config.audioLatency > 0 ) ? m_Config.audioLatency : buffered + (long)frameSamples * 3;
+    CAudioRing* pRing = ( m_pSource != NULL ) ? m_pSource->AcquireAudioRing(m_Info) : NULL;
+
+    m_pAudio = new CAudioPlayout( m_pOutput, m_Config.audioChannels, m_Config.audioSampleType, buffered, latency,
+                                  pRing );
+
+    if( pRing != NULL )
+    {
+        pRing->Release();
+    }
+
+    if( !m_pAudio->Start() )
+    {
+        m_pAudio->Release();
+        m_pAudio = NULL;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The scheduler goes first, so nothing is scheduled while playback stops; the frames it had scheduled come back
+// flushed. Frames the driver still holds stay alive until it lets go of them.
+void CPlayoutChannel::Stop()
+{
+    if( m_Thread.joinable() )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_WakeMutex);
+            m_Stop.store(true);
+            m_WakeCond.notify_one();
+        }
+
+        m_Thread.join();
+    }
+
+    if( m_pOutput != NULL )
+    {
+        m_pOutput->StopScheduledPlayback( 0, NULL, 0 );
+
+        if( m_pAudio != NULL )
+        {
+            m_pAudio->Stop();
+            m_pAudio->Release();
+            m_pAudio = NULL;
+        }
+
+        m_pOutput->SetScheduledFrameCompletionCallback(NULL);
+        m_pOutput->DisableVideoOutput();
+        m_pOutput->SetVideoOutputFrameMemoryAllocator(NULL);
+        m_pOutput->Release();
+        m_pOutput = NULL;
+    }
+
+    IDeckLinkMutableVideoFrame* pFrame;
+
+    while( m_Free.TryPop(&pFrame) )
+    {
+    }
+
+    for( size_t i = 0; i < m_Frames.size(); ++i )
+    {
+        m_Frames[i]->Release();
+    }
+
+    m_Frames.clear();
+    m_pSpare = NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Woken by every completion, and at least twice per frame period.
+void CPlayoutChannel::SchedulerMain()
+{
+    InitCom();
+
+    const std::chrono::nanoseconds poll( m_pMode->frameDuration * 1000000000 / m_pMode->timeScale / 2 );
+    std::unique_lock<std::mutex> lock(m_WakeMutex);
+
+    while( !m_Stop.load() )
+    {
+        lock.unlock();
+        Adapt();
+        Refill();
+        lock.lock();
+
+        if( !m_Stop.load() )
+        {
+            m_WakeCond.wait_for( lock, poll );
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CPlayoutChannel::Adapt()
+{
+    const uint64_t bad = m_Late.load( std::memory_order_relaxed ) + m_Dropped.load( std::memory_order_relaxed ) +
+                         m_Underruns.load( std::memory_order_relaxed );
+    const uint64_t shown = m_Completed.load( std::memory_order_relaxed ) + m_Late.load( std::memory_order_relaxed );
+    unsigned target = m_Target.load( std::memory_order_relaxed );
+
+    if( bad != m_LastBad )
+    {
+        target = (unsigned)std::min<uint64_t>( m_Config.maxBuffered, target + ( bad - m_LastBad ) );
+        m_LastBad = bad;
+        m_CleanSince = shown;
+    }
+    else if( shown - m_CleanSince >= kDecaySeconds * m_FramesPerSecond )
+    {
+        target = std::max( m_Config.minBuffered, target - 1 );
+        m_CleanSince = shown;
+    }
+
+    m_Target.store( target, std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Tops the output up to the target; prerolls and starts playback the first time the target is reached, and the
+// audio has prerolled.
+void CPlayoutChannel::Refill()
+{
+    const BMDTimeValue duration = m_pMode->frameDuration;
+    const BMDTimeScale timeScale = m_pMode->timeScale;
+    uint32_t buffered = 0;
+
+    if( m_pOutput->GetBufferedVideoFrameCount(&buffered) != S_OK )
+    {
+        return;
+    }
+
+    BMDTimeValue streamTime;
+    double speed;
+
+    // scheduling into the past would only produce late frames: restart one frame ahead of the output
+    if( m_Playing && m_pOutput->GetScheduledStreamTime( timeScale, &streamTime, &speed ) == S_OK &&
+        m_NextTime <= streamTime )
+    {
+        m_NextTime = ( streamTime / duration + 1 ) * duration;
+        Increment(m_Underruns);
+    }
+
+    const unsigned target = m_Target.load( std::memory_order_relaxed );
+
+    while( buffered < target )
+    {
+        IDeckLinkMutableVideoFrame* pFrame = FreeFrame();
+
+        if( pFrame == NULL )
+        {
+            break;
+        }
+
+        if( m_pSource != NULL )
+        {
+            m_pSource->FillFrame( m_Info, pFrame, m_NextFrame );
+        }
+
+        if( m_pInserter != NULL )
+        {
+            InsertAncillary(pFrame);
+        }
+
+        if( m_pOutput->ScheduleVideoFrame( pFrame, m_NextTime, duration, timeScale ) != S_OK )
+        {
+            m_pSpare = pFrame;
+            break;
+        }
+
+        m_NextTime += duration;
+        ++m_NextFrame;
+        ++buffered;
+        Increment(m_Scheduled);
+    }
+
+    m_Buffered.store( buffered, std::memory_order_relaxed );
+
+    if( !m_Playing && buffered >= target && ( m_pAudio == NULL || m_pAudio->Prerolled() ) )
+    {
+        if( m_pAudio != NULL )
+        {
+            m_pAudio->EndPreroll();
+        }
+
+        m_Playing = ( m_pOutput->StartScheduledPlayback( 0, timeScale, 1.0 ) == S_OK );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Into the ancillary data the frame got when it was created; a frame without counts as a failure.
+void CPlayoutChannel::InsertAncillary( IDeckLinkMutableVideoFrame* pFrame )
+{
+    IDeckLinkVideoFrameAncillary* pAncillary = NULL;
+
+    for( unsigned i = 0; i < m_Config.ancillarySlots; ++i )
+    {
+        m_Packets[i].count = 0;
+    }
+
+    if( m_pSource != NULL )
+    {
+        m_pSource->FillAncillary( m_Info, m_NextFrame, m_Packets );
+    }
+
+    if( pFrame->GetAncillaryData(&pAncillary) != S_OK )
+    {
+        pAncillary = NULL;
+    }
+
+    m_pInserter->Insert( pAncillary, m_Packets );
+
+    if( pAncillary != NULL )
+    {
+        pAncillary->Release();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// NULL while all frames are in flight.
+IDeckLinkMutableVideoFrame* CPlayoutChannel::FreeFrame()
+{
+    IDeckLinkMutableVideoFrame* pFrame = m_pSpare;
+
+    if( pFrame != NULL )
+    {
+        m_pSpare = NULL;
+        return pFrame;
+    }
+
+    if( m_Free.TryPop(&pFrame) )
+    {
+        return pFrame;
+    }
+
+    if( m_Frames.size() >= m_Config.maxBuffered + kSpareFrames ||
+        m_pOutput->CreateVideoFrame( (int32_t)m_pMode->width, (int32_t)m_pMode->height, (int32_t)m_RowBytes,
+                                     m_Config.format, bmdFrameFlagDefault, &pFrame ) != S_OK )
+    {
+        return NULL;
+    }
+
+    IDeckLinkVideoFrameAncillary* pAncillary = NULL;
+
+    if( m_pInserter != NULL && m_pOutput->CreateAncillaryData( bmdFormat10BitYUV, &pAncillary ) == S_OK )
+    {
+        m_pInserter->Blank(pAncillary);
+        pFrame->SetAncillaryData(pAncillary);
+        pAncillary->Release();
+    }
+
+    m_Frames.push_back(pFrame);
+    m_FrameCount.store( (unsigned)m_Frames.size(), std::memory_order_relaxed );
+    return pFrame;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CPlayoutChannel::GetStats( SPlayoutStats* pStats )
+{
+    pStats->persistentId = m_Info.persistentId;
+    memcpy( pStats->displayName, m_Info.displayName, sizeof(pStats->displayName) );
+    pStats->mode = m_pMode->mode;
+    pStats->format = m_Config.format;
+    pStats->scheduled = m_Scheduled.load( std::memory_order_relaxed );
+    pStats->completed = m_Completed.load( std::memory_order_relaxed );
+    pStats->late = m_Late.load( std::memory_order_relaxed );
+    pStats->dropped = m_Dropped.load( std::memory_order_relaxed );
+    pStats->flushed = m_Flushed.load( std::memory_order_relaxed );
+    pStats->underruns = m_Underruns.load( std::memory_order_relaxed );
+    pStats->target = m_Target.load( std::memory_order_relaxed );
+    pStats->buffered = m_Buffered.load( std::memory_order_relaxed );
+    pStats->frames = m_FrameCount.load( std::memory_order_relaxed );
+    pStats->framePool = ( m_pAllocator != NULL );
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->GetStats( &pStats->pool );
+    }
+
+    pStats->audio = ( m_pAudio != NULL );
+
+    if( m_pAudio != NULL )
+    {
+        m_pAudio->GetStats( &pStats->audioStats );
+    }
+
+    pStats->ancillary = ( m_pInserter != NULL );
+
+    if( m_pInserter != NULL )
+    {
+        m_pInserter->GetStats( &pStats->ancillaryStats );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The free list never fills up: it can hold every frame the channel creates.
+HRESULT STDMETHODCALLTYPE CPlayoutChannel::ScheduledFrameCompleted( IDeckLinkVideoFrame* pFrame,
+                                                                    BMDOutputFrameCompletionResult result )
+{
+    switch( result )
+    {
+    case bmdOutputFrameCompleted:       Increment(m_Completed);  break;
+    case bmdOutputFrameDisplayedLate:   Increment(m_Late);       break;
+    case bmdOutputFrameDropped:         Increment(m_Dropped);    break;
+    default:                            Increment(m_Flushed);    break;
+    }
+
+    // one of ours, which were all scheduled as IDeckLinkMutableVideoFrame
+    m_Free.TryPush( static_cast<IDeckLinkMutableVideoFrame*>(pFrame) );
+
+    // without the mutex: a missed wake-up only delays the refill to the scheduler's next poll
+    m_WakeCond.notify_one();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CPlayoutChannel::ScheduledPlaybackHasStopped(void)
+{
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CPlayoutChannel::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkVideoOutputCallback ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkVideoOutputCallback*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CPlayoutChannel::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CPlayoutChannel::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+CPlayoutEngine::CPlayoutEngine( const SPlayoutConfig& config, IPlayoutSource* pSource )
+    : m_Config(config), m_pSource(pSource), m_Stopped(false)
+{
+    m_Config.minBuffered = std::max( m_Config.minBuffered, 2u );
+    m_Config.maxBuffered = std::max( m_Config.maxBuffered, m_Config.minBuffered );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CPlayoutEngine::~CPlayoutEngine()
+{
+    Stop();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CPlayoutEngine::Stop()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        m_Channels[i]->Stop();
+        m_Channels[i]->Release();
+    }
+
+    m_Channels.clear();
+    m_Stopped = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CPlayoutEngine::GetStats( std::vector<SPlayoutStats>* pStats )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    pStats->resize( m_Channels.size() );
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        m_Channels[i]->GetStats( &(*pStats)[i] );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Decided from the capabilities read at arrival, without asking the driver again.
+static BMDDisplayMode ChooseMode( const SDeviceCaps& caps, const SPlayoutConfig& config )
+{
+    if( !( caps.videoIOSupport & bmdDeviceSupportsPlayback ) )
+    {
+        return (BMDDisplayMode)0;
+    }
+
+    if( config.mode != 0 )
+    {
+        return caps.Supports( kCapsOutput, config.mode, config.format ) ? config.mode : (BMDDisplayMode)0;
+    }
+
+    return caps.FirstMode( kCapsOutput, config.format );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CPlayoutEngine::OnDeviceArrived( const SDeviceInfo& info )
+{
+    BMDDisplayMode mode = ChooseMode( info.caps, m_Config );
+
+    if( mode == 0 )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Stopped )
+    {
+        return;
+    }
+
+    CPlayoutChannel* pChannel = new CPlayoutChannel( info, m_pSource, m_Config );
+
+    if( !pChannel->Start(mode) )
+    {
+        pChannel->Release();
+        return;
+    }
+
+    m_Channels.push_back(pChannel);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CPlayoutEngine::OnDeviceRemoved( const SDeviceInfo& info )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for( size_t i = 0; i < m_Channels.size(); ++i )
+    {
+        if( m_Channels[i]->Device() == info.pDev )
+        {
+            m_Channels[i]->Stop();
+            m_Channels[i]->Release();
+            m_Channels.erase( m_Channels.begin() + i );
+            return;
+        }
+    }
+}
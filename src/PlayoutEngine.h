@@ -0,0 +1,126 @@
+#ifndef PLAYOUT_ENGINE_H
+#define PLAYOUT_ENGINE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "Ancillary.h"
+#include "AudioPlayout.h"
+#include "DeckLinkPlatform.h"
+#include "DiscoveryCallback.h"
+#include "FrameAllocator.h"
+
+class CPlayoutChannel;
+
+//=====================================================================================================================
+// Upstream of the playout engine. Called on the scheduler thread of the device's channel, one frame at a time.
+class IPlayoutSource
+{
+public:
+    virtual ~IPlayoutSource() {}
+
+    // Fills pFrame, of the channel's mode and pixel format, with frame frameNumber of the stream. Frames are
+    // recycled, so it still holds the picture it was last filled with. Time spent here eats into the buffered frames;
+    // a source slower than the frame rate makes frames late whatever the buffering.
+    virtual void FillFrame( const SDeviceInfo& device, IDeckLinkMutableVideoFrame* pFrame, uint64_t frameNumber ) = 0;
+
+    // The ring to play out on the device's audio output, AddRef'ed; NULL for silence. Called once, when the
+    // channel starts, on the notification thread.
+    virtual CAudioRing* AcquireAudioRing( const SDeviceInfo& device )  { return NULL; }
+
+    // The VANC packets of frame frameNumber, with SPlayoutConfig::ancillary: pPackets[i] for slot i, its count preset
+    // to 0 = no packet (see CAncillaryInserter::Insert()). Called on the scheduler thread after FillFrame().
+    virtual void FillAncillary( const SDeviceInfo& device, uint64_t frameNumber, SAncillaryPacket* pPackets )  {}
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SPlayoutConfig
+{
+    BMDDisplayMode  mode;             // 0 = the first mode the output lists which supports the format natively
+    BMDPixelFormat  format;
+    unsigned        minBuffered;      // bounds of the target for frames scheduled ahead of the output
+    unsigned        maxBuffered;
+    bool            framePool;        // frames in a CFrameAllocator rather than in the driver's memory
+    int             numaNode;         // of the frame pool, -1 = not bound
+    unsigned        audioChannels;    // 0 = no audio; else 2, 8 or 16
+    BMDAudioSampleType  audioSampleType;
+    long            audioBuffered;    // sample frames kept buffered by the output, 0 = minBuffered frames' worth
+    long            audioLatency;     // from source to output, 0 = audioBuffered plus 3 frames' worth
+    SAncillarySlot  ancillary[CAncillaryInserter::kMaxSlots];   // VANC packets inserted into every frame
+    unsigned        ancillarySlots;   // 0 = no VANC
+};
+
+struct SPlayoutStats
+{
+    int64_t         persistentId;
+    char            displayName[64];
+    BMDDisplayMode  mode;
+    BMDPixelFormat  format;
+    uint64_t        scheduled;
+    uint64_t        completed;        // displayed on time
+    uint64_t        late;             // bmdOutputFrameDisplayedLate
+    uint64_t        dropped;          // bmdOutputFrameDropped
+    uint64_t        flushed;          // still scheduled when playback stopped
+    uint64_t        underruns;        // times the output overtook the schedule, which then restarted ahead of it
+    unsigned        target;           // current target for the buffered frames
+    unsigned        buffered;         // as last seen by the scheduler
+    unsigned        frames;           // created so far
+    bool            framePool;
+    CFrameAllocator::SStats  pool;    // if framePool
+    bool            audio;
+    SAudioPlayoutStats  audioStats;   // if audio
+    bool            ancillary;
+    CAncillaryInserter::SStats  ancillaryStats;  // if ancillary
+};
+
+//=====================================================================================================================
+// Plays out on every device which arrives with an output that can do the configured mode and format.
+//
+// Each channel's scheduler thread keeps GetBufferedVideoFrameCount() at a target number of frames scheduled ahead of
+// the output. The target adapts to how the output copes: every late, dropped or missing frame raises it by one at
+// once, up to maxBuffered, and ten seconds without any lower it by one, down to minBuffered. Scheduling deeper only
+// costs latency, and only while it is needed.
+//
+// Frames are created with CreateVideoFrame() the first time the buffering needs them, at most maxBuffered + 3 per
+// channel. The completion callback pushes completed frames into a single-producer single-consumer free list, from
+// which the scheduler thread refills them; once the buffering has settled, playout allocates nothing.
+//
+// With audioChannels, each channel also plays out audio through a CAudioPlayout, from the source's ring for the
+// device; playback starts once both the frames and the audio have been prerolled. An output which cannot do the audio
+// plays out video only.
+//
+// With ancillarySlots, the output is enabled with VANC and a CAncillaryInserter writes the source's packets into
+// every frame. Each frame gets its ancillary data when it is created and keeps it, so that the objects are recycled
+// with the frames. An output or a mode without VANC plays out the frames without it.
+//
+// Hook it into discovery with CDiscoveryCallback::AddListener(). Channels are set up and torn down on the
+// notification thread.
+class CPlayoutEngine : public IDeviceListener
+{
+    SPlayoutConfig                 m_Config;
+    IPlayoutSource*                m_pSource;
+
+    std::mutex                     m_Mutex;
+    std::vector<CPlayoutChannel*>  m_Channels;
+    bool                           m_Stopped;
+
+    CPlayoutEngine( const CPlayoutEngine& );
+    CPlayoutEngine& operator=( const CPlayoutEngine& );
+
+public:
+    // pSource may be NULL, frames are then played out as they come from CreateVideoFrame().
+    CPlayoutEngine( const SPlayoutConfig& config, IPlayoutSource* pSource );
+    ~CPlayoutEngine();
+
+    // Stops all channels; devices arriving afterwards are ignored.
+    void Stop();
+
+    void GetStats( std::vector<SPlayoutStats>* pStats );
+
+    // overrides IDeviceListener
+    virtual void OnDeviceArrived( const SDeviceInfo& info );
+    virtual void OnDeviceRemoved( const SDeviceInfo& info );
+};
+
+#endif // PLAYOUT_ENGINE_H
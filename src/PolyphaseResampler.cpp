@@ -0,0 +1,274 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "PolyphaseResampler.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RESAMPLER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define RESAMPLER_TARGET(isa)
+#else
+#define RESAMPLER_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+static const long kHalf = CPolyphaseResampler::kTaps / 2;        // taps after the position; kHalf - 1 before it
+
+//=====================================================================================================================
+// Phase p is the filter for a position p / kPhases of a sample frame past an input sample; phase kPhases is phase 0
+// one sample frame on, so that every position lies between two phases. Each phase sums to 1.
+struct SResamplerTable
+{
+    float  coef[CPolyphaseResampler::kPhases + 1][CPolyphaseResampler::kTaps];
+
+    SResamplerTable()
+    {
+        const double kPi = 3.14159265358979323846;
+        const double cutoff = 20400.0 / 24000.0;
+        const double beta = 8.0;
+
+        for( int p = 0; p <= CPolyphaseResampler::kPhases; ++p )
+        {
+            double taps[CPolyphaseResampler::kTaps];
+            double sum = 0.0;
+
+            for( int k = 0; k < CPolyphaseResampler::kTaps; ++k )
+            {
+                // distance of the tap from the position, within ( -kHalf, kHalf ]
+                const double d = ( k - ( kHalf - 1 ) ) - (double)p / CPolyphaseResampler::kPhases;
+                const double x = cutoff * d;
+                const double sinc = ( x == 0.0 ) ? 1.0 : sin( kPi * x ) / ( kPi * x );
+                const double r = d / kHalf;
+
+                taps[k] = sinc * BesselI0( beta * sqrt( std::max( 0.0, 1.0 - r * r ) ) );
+                sum += taps[k];
+            }
+
+            for( int k = 0; k < CPolyphaseResampler::kTaps; ++k )
+            {
+                coef[p][k] = (float)( taps[k] / sum );
+            }
+        }
+    }
+
+    static double BesselI0( double x )
+    {
+        double sum = 1.0, term = 1.0;
+
+        for( int k = 1; term > 1e-12 * sum; ++k )
+        {
+            term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+            sum += term;
+        }
+
+        return sum;
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+static const SResamplerTable& ResamplerTable()
+{
+    static const SResamplerTable table;
+    return table;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Coefficients at a position: between the phases around its fractional part, the top 8 bits of which select the
+// phase and the other 24 the weight.
+static inline void BlendPhases( uint32_t frac, float* pCoef )
+{
+    const float (*pTable)[CPolyphaseResampler::kTaps] = ResamplerTable().coef;
+    const float* pLo = pTable[ frac >> 24 ];
+    const float* pHi = pTable[ ( frac >> 24 ) + 1 ];
+    const float weight = (float)( frac & 0xFFFFFF ) * ( 1.0f / 16777216.0f );
+
+    for( int k = 0; k < CPolyphaseResampler::kTaps; ++k )
+    {
+        pCoef[k] = pLo[k] + weight * ( pHi[k] - pLo[k] );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Output sample frames from pPos on while the taps stay before end; pBuffer holds sample frames from base on.
+static long ResampleC( const float* pBuffer, uint64_t base, uint64_t end, unsigned channels, uint64_t* pPos,
+                       uint64_t step, float* pDst, long frames )
+{
+    float coef[CPolyphaseResampler::kTaps];
+    uint64_t pos = *pPos;
+    long produced = 0;
+
+    for( ; produced < frames && ( pos >> 32 ) + kHalf < end; ++produced, pos += step )
+    {
+        const float* pIn = pBuffer + ( ( pos >> 32 ) - ( kHalf - 1 ) - base ) * channels;
+
+        BlendPhases( (uint32_t)pos, coef );
+
+        for( unsigned c = 0; c < channels; ++c )
+        {
+            float acc = 0.0f;
+
+            for( int k = 0; k < CPolyphaseResampler::kTaps; ++k )
+            {
+                acc += pIn[ k * channels + c ] * coef[k];
+            }
+
+            *pDst++ = acc;
+        }
+    }
+
+    *pPos = pos;
+    return produced;
+}
+
+#ifdef RESAMPLER_X86
+//---------------------------------------------------------------------------------------------------------------------
+// As ResampleC(), 8 channels per register; channels a multiple of 8. Multiplies and adds are kept apart, as they
+// are in plain C, so that nothing is fused and the sums round the same way.
+RESAMPLER_TARGET("avx2")
+static long ResampleAvx2( const float* pBuffer, uint64_t base, uint64_t end, unsigned channels, uint64_t* pPos,
+                          uint64_t step, float* pDst, long frames )
+{
+    float coef[CPolyphaseResampler::kTaps];
+    uint64_t pos = *pPos;
+    long produced = 0;
+
+    for( ; produced < frames && ( pos >> 32 ) + kHalf < end; ++produced, pos += step )
+    {
+        const float* pIn = pBuffer + ( ( pos >> 32 ) - ( kHalf - 1 ) - base ) * channels;
+
+        BlendPhases( (uint32_t)pos, coef );
+
+        for( unsigned c = 0; c < channels; c += 8 )
+        {
+            __m256 acc = _mm256_setzero_ps();
+
+            for( int k = 0; k < CPolyphaseResampler::kTaps; ++k )
+            {
+                const __m256 x = _mm256_loadu_ps( pIn + k * channels + c );
+                acc = _mm256_add_ps( acc, _mm256_mul_ps( x, _mm256_set1_ps( coef[k] ) ) );
+            }
+
+            _mm256_storeu_ps( pDst, acc );
+            pDst += 8;
+        }
+    }
+
+    *pPos = pos;
+    return produced;
+}
+#endif // RESAMPLER_X86
+
+//=====================================================================================================================
+CPolyphaseResampler::CPolyphaseResampler( unsigned channels, long capacity, ECpuIsa isa )
+    : m_Channels( std::max( channels, 1u ) ), m_Isa(isa), m_Capacity( std::max( capacity, (long)kTaps * 2 ) ),
+      m_Buffer( (size_t)m_Capacity * m_Channels ), m_Base(0), m_End(0), m_Pos(0)
+{
+    ResamplerTable();
+    Reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Positions count the kHalf - 1 frames of silence before the first input sample, which Position() leaves out.
+void CPolyphaseResampler::Reset()
+{
+    std::fill( m_Buffer.begin(), m_Buffer.begin() + ( kHalf - 1 ) * m_Channels, 0.0f );
+    m_Base = 0;
+    m_End = kHalf - 1;
+    m_Pos = (uint64_t)( kHalf - 1 ) << kFracBits;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Moves the frames still needed, from the first tap of the next output sample on, to the start of the buffer.
+void CPolyphaseResampler::Compact()
+{
+    const uint64_t first = std::min( ( m_Pos >> kFracBits ) - ( kHalf - 1 ), m_End );
+
+    if( first > m_Base )
+    {
+        memmove( m_Buffer.data(), m_Buffer.data() + ( first - m_Base ) * m_Channels,
+                 ( m_End - first ) * m_Channels * sizeof(float) );
+        m_Base = first;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+long CPolyphaseResampler::Write( const void* const* ppPlanes, unsigned channels, EAudioFormat format, long frames )
+{
+    if( m_End + frames - m_Base > (uint64_t)m_Capacity )
+    {
+        Compact();
+    }
+
+    frames = std::min( frames, m_Capacity - (long)( m_End - m_Base ) );
+
+    if( frames <= 0 )
+    {
+        return 0;
+    }
+
+    float* pOut = m_Buffer.data() + ( m_End - m_Base ) * m_Channels;
+
+    for( unsigned c = 0; c < m_Channels; ++c )
+    {
+        if( ppPlanes == NULL || c >= channels )
+        {
+            for( long f = 0; f < frames; ++f )
+            {
+                pOut[ f * m_Channels + c ] = 0.0f;
+            }
+        }
+        else if( format == kAudioInt32 )
+        {
+            const int32_t* pIn = (const int32_t*)ppPlanes[c];
+
+            for( long f = 0; f < frames; ++f )
+            {
+                pOut[ f * m_Channels + c ] = (float)pIn[f] * ( 1.0f / 2147483648.0f );
+            }
+        }
+        else
+        {
+            const float* pIn = (const float*)ppPlanes[c];
+
+            for( long f = 0; f < frames; ++f )
+            {
+                pOut[ f * m_Channels + c ] = pIn[f];
+            }
+        }
+    }
+
+    m_End += frames;
+    return frames;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+long CPolyphaseResampler::Skip( long frames )
+{
+    frames = std::max( 0L, std::min( frames, Available() ) );
+    m_Pos += (uint64_t)frames << kFracBits;
+    return frames;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+long CPolyphaseResampler::Read( float* pDst, long frames, uint64_t step )
+{
+    long (*pKernel)( const float*, uint64_t, uint64_t, unsigned, uint64_t*, uint64_t, float*, long ) = ResampleC;
+
+#ifdef RESAMPLER_X86
+    if( m_Channels % 8 == 0 && m_Isa >= kIsaAvx2 && HasAvx2() )
+    {
+        pKernel = ResampleAvx2;
+    }
+#endif
+
+    return pKernel( m_Buffer.data(), m_Base, m_End, m_Channels, &m_Pos, step, pDst, frames );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+long CPolyphaseResampler::Available() const
+{
+    const uint64_t next = m_Pos >> kFracBits;
+    return ( m_End > next ) ? (long)( m_End - next ) : 0;
+}
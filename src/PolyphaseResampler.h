@@ -0,0 +1,69 @@
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "AudioRing.h"
+
+//=====================================================================================================================
+// Resamples interleaved float audio by a ratio close to 1, which changes by the call: the drift correction between
+// two clocks which both run at 48 kHz, near enough.
+//
+// A 32-tap Kaiser-windowed sinc (20.4 kHz cut-off, about 80 dB of stop band) in kPhases phases; the coefficients of an
+// output sample are interpolated linearly between the two phases around its fractional position, so that the ratio
+// can be anything without the phases beating. The AVX2 kernel computes 8 channels at a time, each lane accumulating
+// the taps of one channel in the same order as the plain C kernel, so both give identical results; channel counts
+// which are not a multiple of 8 go through plain C.
+//
+// Input is appended from planar blocks, such as those of a CAudioRing, into a buffer of interleaved history; one
+// thread at a time.
+class CPolyphaseResampler
+{
+public:
+    enum { kTaps = 32 };
+    enum { kPhases = 256 };
+    enum { kFracBits = 32 };          // positions and steps are in input sample frames, in 32.32 fixed point
+
+private:
+    unsigned            m_Channels;
+    ECpuIsa             m_Isa;
+    long                m_Capacity;
+    std::vector<float>  m_Buffer;     // m_Capacity interleaved sample frames
+    uint64_t            m_Base;       // input sample frame of m_Buffer[0], counted from Reset()
+    uint64_t            m_End;        // ... just past the last one appended
+    uint64_t            m_Pos;        // of the next output sample, 32.32
+
+    CPolyphaseResampler( const CPolyphaseResampler& );
+    CPolyphaseResampler& operator=( const CPolyphaseResampler& );
+
+    void Compact();
+
+public:
+    // capacity: input sample frames buffered at most. isa: the highest kernels to use, as for DeinterleaveAudio().
+    CPolyphaseResampler( unsigned channels, long capacity, ECpuIsa isa = kIsaCount );
+
+    unsigned Channels() const  { return m_Channels; }
+
+    // Drops all input; the next output sample is then at the first input sample appended, and can be read once
+    // kTaps / 2 more have been.
+    void Reset();
+
+    // Appends frames of planes, which are in format: planes beyond the resampler's channels are ignored, missing
+    // ones are silent. NULL ppPlanes appends silence. Returns the frames taken, fewer when the buffer is full.
+    long Write( const void* const* ppPlanes, unsigned channels, EAudioFormat format, long frames );
+
+    // Drops up to frames input sample frames ahead of the read position; returns how many were dropped.
+    long Skip( long frames );
+
+    // Up to frames output sample frames into pDst, reading step / 2^32 input sample frames for each; fewer when the
+    // input runs out. Returns the frames written.
+    long Read( float* pDst, long frames, uint64_t step );
+
+    // Input sample frames, counted from Reset(), up to the position of the next output sample, 32.32; and those
+    // appended from the position's sample frame on.
+    uint64_t Position() const  { return m_Pos - ( (uint64_t)( kTaps / 2 - 1 ) << kFracBits ); }
+    long Available() const;
+};
+
+#endif // POLYPHASE_RESAMPLER_H
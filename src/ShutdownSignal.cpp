@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <stdexcept>
+
+#include "ShutdownSignal.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/signalfd.h>
+#endif
+
+#ifdef _WIN32
+//=====================================================================================================================
+HANDLE CShutdownSignal::s_hStop = NULL;
+HANDLE CShutdownSignal::s_hDump = NULL;
+
+//---------------------------------------------------------------------------------------------------------------------
+BOOL WINAPI CShutdownSignal::ConsoleHandler( DWORD ctrlType )
+{
+    switch( ctrlType )
+    {
+    case CTRL_BREAK_EVENT:
+        SetEvent(s_hDump);
+        return TRUE;
+
+    case CTRL_C_EVENT:
+    case CTRL_CLOSE_EVENT:
+    case CTRL_LOGOFF_EVENT:
+    case CTRL_SHUTDOWN_EVENT:
+        SetEvent(s_hStop);
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CShutdownSignal::CShutdownSignal()
+{
+    s_hStop = CreateEvent( NULL, TRUE, FALSE, NULL );
+    s_hDump = CreateEvent( NULL, FALSE, FALSE, NULL );
+
+    if( s_hStop == NULL || s_hDump == NULL || !SetConsoleCtrlHandler( ConsoleHandler, TRUE ) )
+    {
+        throw std::runtime_error("installing the console control handler failed");
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CShutdownSignal::~CShutdownSignal()
+{
+    SetConsoleCtrlHandler( ConsoleHandler, FALSE );
+    CloseHandle(s_hStop);
+    CloseHandle(s_hDump);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CShutdownSignal::ESignal CShutdownSignal::Wait()
+{
+    HANDLE handles[2] = { s_hStop, s_hDump };
+
+    DWORD res = WaitForMultipleObjects( 2, handles, FALSE, INFINITE );
+    return ( res == WAIT_OBJECT_0 + 1 ) ? kSignalDump : kSignalStop;
+}
+
+#else
+//=====================================================================================================================
+CShutdownSignal::CShutdownSignal()
+    : m_Fd(-1)
+{
+    sigemptyset(&m_Mask);
+    sigaddset( &m_Mask, SIGTERM );
+    sigaddset( &m_Mask, SIGINT );
+    sigaddset( &m_Mask, SIGUSR1 );
+
+    if( pthread_sigmask( SIG_BLOCK, &m_Mask, &m_OldMask ) != 0 )
+    {
+        throw std::runtime_error("blocking signals failed");
+    }
+
+#if defined(__linux__)
+    m_Fd = signalfd( -1, &m_Mask, SFD_CLOEXEC );
+
+    if( m_Fd < 0 )
+    {
+        pthread_sigmask( SIG_SETMASK, &m_OldMask, NULL );
+        throw std::runtime_error("signalfd failed");
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CShutdownSignal::~CShutdownSignal()
+{
+#if defined(__linux__)
+    close(m_Fd);
+#endif
+    pthread_sigmask( SIG_SETMASK, &m_OldMask, NULL );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CShutdownSignal::ESignal CShutdownSignal::Wait()
+{
+    int sig = 0;
+
+#if defined(__linux__)
+    signalfd_siginfo info;
+
+    for(;;)
+    {
+        ssize_t n = read( m_Fd, &info, sizeof(info) );
+
+        if( n == (ssize_t)sizeof(info) )
+        {
+            sig = (int)info.ssi_signo;
+            break;
+        }
+
+        if( n < 0 && errno != EINTR )
+        {
+            return kSignalStop;
+        }
+    }
+#else
+    if( sigwait( &m_Mask, &sig ) != 0 )
+    {
+        return kSignalStop;
+    }
+#endif
+
+    return ( sig == SIGUSR1 ) ? kSignalDump : kSignalStop;
+}
+
+#endif
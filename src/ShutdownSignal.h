@@ -0,0 +1,48 @@
+#ifndef SHUTDOWN_SIGNAL_H
+#define SHUTDOWN_SIGNAL_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#endif
+
+//=====================================================================================================================
+// Waits for the process to be asked to stop, for running without a console.
+//
+//     Linux     SIGTERM / SIGINT stop, SIGUSR1 dumps; received through a signalfd
+//     macOS     the same signals, received with sigwait()
+//     Windows   Ctrl+C / close / logoff / shutdown stop, Ctrl+Break dumps
+//
+// On POSIX the signals are blocked in the constructing thread and in every thread it creates afterwards, so the
+// object has to be constructed before any other thread is started (in particular before the DeckLink API is loaded).
+class CShutdownSignal
+{
+#ifdef _WIN32
+    static HANDLE  s_hStop;
+    static HANDLE  s_hDump;
+
+    static BOOL WINAPI ConsoleHandler( DWORD ctrlType );
+#else
+    sigset_t       m_Mask;
+    sigset_t       m_OldMask;
+    int            m_Fd;          // signalfd, Linux only
+#endif
+
+    CShutdownSignal( const CShutdownSignal& );
+    CShutdownSignal& operator=( const CShutdownSignal& );
+
+public:
+    enum ESignal
+    {
+        kSignalStop,
+        kSignalDump,
+    };
+
+    CShutdownSignal();      // throws std::runtime_error
+    ~CShutdownSignal();
+
+    ESignal Wait();
+};
+
+#endif // SHUTDOWN_SIGNAL_H
@@ -0,0 +1,98 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+//=====================================================================================================================
+// Bounded wait-free queue for exactly one producer thread and one consumer thread.
+//
+// The producer and consumer indices live on separate cache lines, and each side keeps a private copy of the other's
+// index which it refreshes only when the queue looks full (or empty), so in steady state a push or pop touches no
+// cache line owned by the other side except the slot itself.
+template< class T >
+class CSpscQueue
+{
+    // Padded rather than alignas(64), so that the queue can be a member of heap objects without C++17 aligned new.
+    std::vector<T>       m_Slots;
+    size_t               m_Mask;
+    char                 m_Pad0[64];
+
+    std::atomic<size_t>  m_Tail;          // next slot to write, owned by the producer
+    size_t               m_CachedHead;    // producer's view of m_Head
+    char                 m_Pad1[64];
+
+    std::atomic<size_t>  m_Head;          // next slot to read, owned by the consumer
+    size_t               m_CachedTail;    // consumer's view of m_Tail
+    char                 m_Pad2[64];
+
+    CSpscQueue( const CSpscQueue& );
+    CSpscQueue& operator=( const CSpscQueue& );
+
+public:
+    // capacity is rounded up to a power of two
+    explicit CSpscQueue( size_t capacity )
+        : m_Mask(0), m_Tail(0), m_CachedHead(0), m_Head(0), m_CachedTail(0)
+    {
+        size_t size = 2;
+
+        while( size < capacity )
+        {
+            size <<= 1;
+        }
+
+        m_Slots.resize(size);
+        m_Mask = size - 1;
+    }
+
+    size_t Capacity() const  { return m_Slots.size(); }
+
+    // producer
+    bool TryPush( const T& value )
+    {
+        const size_t tail = m_Tail.load( std::memory_order_relaxed );
+
+        if( tail - m_CachedHead == m_Slots.size() )
+        {
+            m_CachedHead = m_Head.load( std::memory_order_acquire );
+
+            if( tail - m_CachedHead == m_Slots.size() )
+            {
+                return false;
+            }
+        }
+
+        m_Slots[ tail & m_Mask ] = value;
+        m_Tail.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    // consumer
+    bool TryPop( T* pValue )
+    {
+        const size_t head = m_Head.load( std::memory_order_relaxed );
+
+        if( head == m_CachedTail )
+        {
+            m_CachedTail = m_Tail.load( std::memory_order_acquire );
+
+            if( head == m_CachedTail )
+            {
+                return false;
+            }
+        }
+
+        *pValue = m_Slots[ head & m_Mask ];
+        m_Head.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    // approximate when called while the other side is active
+    size_t Size() const
+    {
+        return m_Tail.load( std::memory_order_acquire ) - m_Head.load( std::memory_order_acquire );
+    }
+};
+
+#endif // SPSC_QUEUE_H
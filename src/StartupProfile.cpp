@@ -0,0 +1,255 @@
+#include <atomic>
+
+#ifdef __linux__
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+#include "Clock.h"
+#include "DeckLinkPlatform.h"
+#include "StartupProfile.h"
+
+static const uint64_t          g_ProcessStartNs = MonotonicNs();
+static std::atomic<uint64_t>   g_Marks[kMarkCount];
+
+//---------------------------------------------------------------------------------------------------------------------
+void StartupMark( EStartupMark mark )
+{
+    if( g_Marks[mark].load( std::memory_order_relaxed ) != 0 )
+    {
+        return;
+    }
+
+    uint64_t expected = 0;
+    g_Marks[mark].compare_exchange_strong( expected, MonotonicNs(), std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static double MarkMs( EStartupMark mark )
+{
+    return (double)( g_Marks[mark].load( std::memory_order_relaxed ) - g_ProcessStartNs ) / 1e6;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static bool Reached( EStartupMark mark )
+{
+    return g_Marks[mark].load( std::memory_order_relaxed ) != 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const char* ApiFactoryName( EApiFactory factory )
+{
+    static const char* const s_Names[kFactoryCount] = { "discovery", "video conversion", "iterator", "API information" };
+
+    return s_Names[factory];
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void PrintStartupProfile( FILE* pFile )
+{
+    fprintf( pFile, "Startup profile:                    took (ms)    done at (ms since start)\n" );
+
+    if( Reached(kMarkCreateBegin) && Reached(kMarkCreateEnd) )
+    {
+        fprintf( pFile, "    create discovery             %12.3f    %12.3f\n",
+                 MarkMs(kMarkCreateEnd) - MarkMs(kMarkCreateBegin), MarkMs(kMarkCreateEnd) );
+    }
+
+    SDispatchProfile dispatch;
+
+    if( GetDispatchProfile(&dispatch) )
+    {
+        fprintf( pFile, "        dlopen %-6s            %12.3f\n",
+                 dispatch.lazy ? "(lazy)" : "(now)", dispatch.dlopenNs / 1e6 );
+
+        for( int i = 0; i < kFactoryCount; ++i )
+        {
+            const SFactoryProfile& factory = dispatch.factories[i];
+
+            if( !factory.resolved )
+            {
+                fprintf( pFile, "        dlsym %-19s    not used\n", ApiFactoryName( (EApiFactory)i ) );
+            }
+            else
+            {
+                fprintf( pFile, "        dlsym %-19s%12.3f%s\n", ApiFactoryName( (EApiFactory)i ),
+                         factory.resolveNs / 1e6, factory.missing ? "    missing" : "" );
+            }
+        }
+    }
+
+    if( Reached(kMarkInstallBegin) && Reached(kMarkInstallEnd) )
+    {
+        fprintf( pFile, "    InstallDeviceNotifications   %12.3f    %12.3f\n",
+                 MarkMs(kMarkInstallEnd) - MarkMs(kMarkInstallBegin), MarkMs(kMarkInstallEnd) );
+    }
+
+    if( Reached(kMarkFirstArrival) && Reached(kMarkInstallBegin) )
+    {
+        fprintf( pFile, "    first arrival                %12.3f    %12.3f\n",
+                 MarkMs(kMarkFirstArrival) - MarkMs(kMarkInstallBegin), MarkMs(kMarkFirstArrival) );
+    }
+    else
+    {
+        fprintf( pFile, "    first arrival                    none yet\n" );
+    }
+
+    fprintf( pFile, "\n" );
+}
+
+#ifdef __linux__
+//=====================================================================================================================
+// The API factories, loaded and looked up here rather than by the SDK's DeckLinkAPIDispatch.cpp so that each step can
+// be timed. By default the library is opened with RTLD_NOW and every factory looked up at once, as the SDK does; with
+// DECKLINK_API_LAZY it is opened with RTLD_LAZY and a factory is only looked up the first time it is called, so a
+// process that never converts frames never resolves the converter. Each factory has its own once, so a late first use
+// from one thread does not wait behind another.
+static const char* const       g_FactorySymbols[kFactoryCount] =
+{
+    "CreateDeckLinkDiscoveryInstance_0001",
+    "CreateVideoConversionInstance_0001",
+    "CreateDeckLinkIteratorInstance_0002",
+    "CreateDeckLinkAPIInformationInstance_0001",
+};
+
+struct SFactory
+{
+    pthread_once_t     once;
+    void*              pFunc;
+    uint64_t           resolveNs;
+    std::atomic<bool>  resolved;    // publishes pFunc and resolveNs to GetDispatchProfile()
+};
+
+static pthread_once_t          g_LoadOnce = PTHREAD_ONCE_INIT;
+static void*                   g_pLibrary = NULL;
+static std::atomic<bool>       g_Loaded(false);
+static bool                    g_Lazy = false;
+static uint64_t                g_DlopenNs = 0;
+static SFactory                g_Factories[kFactoryCount];
+
+//---------------------------------------------------------------------------------------------------------------------
+static void ResolveFactory( EApiFactory factory )
+{
+    SFactory& f = g_Factories[factory];
+
+    if( g_pLibrary != NULL )
+    {
+        uint64_t start = MonotonicNs();
+        f.pFunc = dlsym( g_pLibrary, g_FactorySymbols[factory] );
+        f.resolveNs = MonotonicNs() - start;
+
+        if( f.pFunc == NULL )
+        {
+            fprintf( stderr, "%s\n", dlerror() );
+        }
+
+        f.resolved.store( true, std::memory_order_release );
+    }
+}
+
+// pthread_once() takes no argument, hence one function per factory
+template <EApiFactory F> static void ResolveFactoryOnce()
+{
+    ResolveFactory(F);
+}
+
+static void (* const g_ResolveOnce[kFactoryCount])() =
+{
+    ResolveFactoryOnce<kFactoryDiscovery>,
+    ResolveFactoryOnce<kFactoryVideoConversion>,
+    ResolveFactoryOnce<kFactoryIterator>,
+    ResolveFactoryOnce<kFactoryApiInformation>,
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+static void LoadApiLibrary()
+{
+    const char* lazyEnv = getenv("DECKLINK_API_LAZY");
+    g_Lazy = lazyEnv != NULL && strcmp( lazyEnv, "0" ) != 0;
+
+    for( int i = 0; i < kFactoryCount; ++i )
+    {
+        g_Factories[i].once = PTHREAD_ONCE_INIT;
+    }
+
+    uint64_t start = MonotonicNs();
+    g_pLibrary = dlopen( "libDeckLinkAPI.so", ( g_Lazy ? RTLD_LAZY : RTLD_NOW ) | RTLD_GLOBAL );
+    g_DlopenNs = MonotonicNs() - start;
+
+    if( g_pLibrary == NULL )
+    {
+        fprintf( stderr, "%s\n", dlerror() );
+        return;
+    }
+
+    if( !g_Lazy )
+    {
+        for( int i = 0; i < kFactoryCount; ++i )
+        {
+            pthread_once( &g_Factories[i].once, g_ResolveOnce[i] );
+        }
+    }
+
+    g_Loaded.store( true, std::memory_order_release );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void* Factory( EApiFactory factory )
+{
+    pthread_once( &g_LoadOnce, LoadApiLibrary );
+    pthread_once( &g_Factories[factory].once, g_ResolveOnce[factory] );
+
+    return g_Factories[factory].pFunc;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+IDeckLinkDiscovery* CreateProfiledDiscoveryInstance()
+{
+    typedef IDeckLinkDiscovery* (*CreateFunc)();
+    CreateFunc pCreate = (CreateFunc)Factory(kFactoryDiscovery);
+
+    return pCreate != NULL ? pCreate() : NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+IDeckLinkVideoConversion* CreateProfiledVideoConversionInstance()
+{
+    typedef IDeckLinkVideoConversion* (*CreateFunc)();
+    CreateFunc pCreate = (CreateFunc)Factory(kFactoryVideoConversion);
+
+    return pCreate != NULL ? pCreate() : NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool GetDispatchProfile( SDispatchProfile* pProfile )
+{
+    if( !g_Loaded.load( std::memory_order_acquire ) )
+    {
+        return false;
+    }
+
+    pProfile->loaded = true;
+    pProfile->lazy = g_Lazy;
+    pProfile->dlopenNs = g_DlopenNs;
+
+    for( int i = 0; i < kFactoryCount; ++i )
+    {
+        SFactoryProfile& profile = pProfile->factories[i];
+
+        profile.resolved = g_Factories[i].resolved.load( std::memory_order_acquire );
+        profile.missing = profile.resolved && g_Factories[i].pFunc == NULL;
+        profile.resolveNs = profile.resolved ? g_Factories[i].resolveNs : 0;
+    }
+
+    return true;
+}
+
+#else
+//---------------------------------------------------------------------------------------------------------------------
+bool GetDispatchProfile( SDispatchProfile* pProfile )
+{
+    return false;
+}
+#endif
@@ -0,0 +1,61 @@
+#ifndef STARTUP_PROFILE_H
+#define STARTUP_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//=====================================================================================================================
+// The API factories on Linux, looked up by StartupProfile.cpp instead of the SDK's DeckLinkAPIDispatch.cpp.
+enum EApiFactory
+{
+    kFactoryDiscovery,
+    kFactoryVideoConversion,
+    kFactoryIterator,           // not called by us, looked up only when the library is bound eagerly
+    kFactoryApiInformation,     // ditto
+
+    kFactoryCount
+};
+
+struct SFactoryProfile
+{
+    bool      resolved;           // looked up, found or not
+    bool      missing;
+    uint64_t  resolveNs;          // dlsym()
+};
+
+// Cost of loading the DeckLink API and of looking up each factory, as measured by CreateProfiledDiscoveryInstance()
+// and CreateProfiledVideoConversionInstance() (DeckLinkPlatform.h).
+struct SDispatchProfile
+{
+    bool             loaded;
+    bool             lazy;        // DECKLINK_API_LAZY: RTLD_LAZY, each factory looked up on its first use
+    uint64_t         dlopenNs;
+    SFactoryProfile  factories[kFactoryCount];
+};
+
+const char* ApiFactoryName( EApiFactory factory );
+
+// Returns false if the API has not been loaded (yet), or on platforms where we do not load it ourselves (Windows,
+// where COM loads the driver, and macOS).
+bool GetDispatchProfile( SDispatchProfile* pProfile );
+
+//---------------------------------------------------------------------------------------------------------------------
+// Points on the way from process start to the first device, recorded once each (later calls are ignored).
+// StartupMark() is lock-free and may be called from any thread, including API callbacks.
+enum EStartupMark
+{
+    kMarkCreateBegin,           // before IDeckLinkDiscovery is created (and the library loaded)
+    kMarkCreateEnd,
+    kMarkInstallBegin,          // InstallDeviceNotifications()
+    kMarkInstallEnd,
+    kMarkFirstArrival,          // first DeckLinkDeviceArrived()
+
+    kMarkCount
+};
+
+void StartupMark( EStartupMark mark );
+
+// Breakdown relative to process start (static initialisation), marks not reached yet are left out.
+void PrintStartupProfile( FILE* pFile );
+
+#endif // STARTUP_PROFILE_H
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <algorithm>
+
+#include "SyncTracker.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const BMDTimeScale kNanoseconds = 1000000000;
+
+//---------------------------------------------------------------------------------------------------------------------
+// Of a non-zero value.
+static inline int HighestBit( uint64_t value )
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse64( &bit, value );
+    return (int)bit;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+//=====================================================================================================================
+CSyncHistogram::CSyncHistogram()
+{
+    Clear();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Magnitudes below 2^(kSubBits + 1) have a bucket each; above, a power of two 2^e has the 2^kSubBits buckets of the
+// values which agree in their top kSubBits + 1 bits.
+int CSyncHistogram::BucketIndex( uint64_t magnitude )
+{
+    if( magnitude < ( 2u << kSubBits ) )
+    {
+        return (int)magnitude;
+    }
+
+    const int shift = HighestBit(magnitude) - kSubBits;
+
+    return std::min( ( shift << kSubBits ) + (int)( magnitude >> shift ), (int)kBuckets - 1 );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+uint64_t CSyncHistogram::BucketLow( int index )
+{
+    if( index < ( 2 << kSubBits ) )
+    {
+        return (uint64_t)index;
+    }
+
+    const int shift = ( index >> kSubBits ) - 1;
+
+    return (uint64_t)( index - ( shift << kSubBits ) ) << shift;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSyncHistogram::Record( int64_t valueNs )
+{
+    std::atomic<uint64_t>& bucket = ( valueNs < 0 ) ? m_Negative[ BucketIndex( 0 - (uint64_t)valueNs ) ]
+                                                    : m_Positive[ BucketIndex( (uint64_t)valueNs ) ];
+    const uint64_t count = m_Count.load( std::memory_order_relaxed );
+
+    bucket.store( bucket.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    m_Sum.store( m_Sum.load( std::memory_order_relaxed ) + valueNs, std::memory_order_relaxed );
+
+    if( count == 0 || valueNs < m_Min.load( std::memory_order_relaxed ) )
+    {
+        m_Min.store( valueNs, std::memory_order_relaxed );
+    }
+
+    if( count == 0 || valueNs > m_Max.load( std::memory_order_relaxed ) )
+    {
+        m_Max.store( valueNs, std::memory_order_relaxed );
+    }
+
+    // last, so that a reader never counts more values than the buckets hold
+    m_Count.store( count + 1, std::memory_order_release );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSyncHistogram::Clear()
+{
+    for( int i = 0; i < kBuckets; ++i )
+    {
+        m_Negative[i].store( 0, std::memory_order_relaxed );
+        m_Positive[i].store( 0, std::memory_order_relaxed );
+    }
+
+    m_Sum.store( 0, std::memory_order_relaxed );
+    m_Min.store( 0, std::memory_order_relaxed );
+    m_Max.store( 0, std::memory_order_relaxed );
+    m_Count.store( 0, std::memory_order_release );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Percentiles walk the buckets from the most negative value up and report the middle of the bucket they fall in,
+// clamped to the extremes seen.
+void CSyncHistogram::GetSummary( SSyncSummary* pSummary ) const
+{
+    const uint64_t count = m_Count.load( std::memory_order_acquire );
+
+    pSummary->count = count;
+    pSummary->minNs = m_Min.load( std::memory_order_relaxed );
+    pSummary->maxNs = m_Max.load( std::memory_order_relaxed );
+    pSummary->meanNs = count ? (double)m_Sum.load( std::memory_order_relaxed ) / (double)count : 0.0;
+
+    static const double kFractions[] = { 0.5, 0.99, 0.999 };
+    int64_t* const pResults[] = { &pSummary->p50Ns, &pSummary->p99Ns, &pSummary->p999Ns };
+    uint64_t seen = 0;
+    size_t next = 0;
+
+    for( int i = -kBuckets + 1; i < kBuckets && next < 3; ++i )
+    {
+        const int index = abs(i);
+        const uint64_t n = ( i < 0 ) ? m_Negative[index].load( std::memory_order_relaxed )
+                                     : m_Positive[index].load( std::memory_order_relaxed );
+        seen += n;
+
+        while( next < 3 && n != 0 && (double)seen >= kFractions[next] * (double)count )
+        {
+            const uint64_t low = BucketLow(index), high = BucketLow( index + 1 );
+            const int64_t middle = (int64_t)( low + ( high - low - 1 ) / 2 );
+            const int64_t value = ( i < 0 ) ? -middle : middle;
+
+            *pResults[next++] = std::min( std::max( value, pSummary->minNs ), pSummary->maxNs );
+        }
+    }
+
+    // only while the counts are still coming in
+    for( ; next < 3; ++next )
+    {
+        *pResults[next] = pSummary->maxNs;
+    }
+}
+
+//=====================================================================================================================
+CSyncTracker::CSyncTracker()
+    : m_HaveVideo(false), m_NextHardwareNs(0), m_LastDurationNs(0), m_HaveAudio(false), m_NextPacketNs(0),
+      m_Frames(0), m_MissedFrames(0), m_AudioPackets(0), m_AudioGaps(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSyncTracker::Record( IDeckLinkVideoInputFrame* pFrame, IDeckLinkAudioInputPacket* pAudio )
+{
+    SSyncSample sample;
+    BMDTimeValue time, duration;
+
+    sample.video = ( pFrame != NULL &&
+                     pFrame->GetHardwareReferenceTimestamp( kNanoseconds, &time, &duration ) == S_OK );
+
+    if( sample.video )
+    {
+        sample.hardwareNs = time;
+        sample.durationNs = duration;
+        sample.streamNs = ( pFrame->GetStreamTime( &time, &duration, kNanoseconds ) == S_OK ) ? time : 0;
+    }
+
+    sample.audio = ( pAudio != NULL && pAudio->GetPacketTime( &time, kNanoseconds ) == S_OK );
+
+    if( sample.audio )
+    {
+        sample.packetNs = time;
+        sample.audioFrames = pAudio->GetSampleFrameCount();
+    }
+
+    Record(sample);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSyncTracker::Record( const SSyncSample& sample )
+{
+    if( sample.video )
+    {
+        Increment(m_Frames);
+
+        if( m_HaveVideo && m_LastDurationNs > 0 )
+        {
+            // frames missed in between leave whole periods, which are not jitter
+            const int64_t late = sample.hardwareNs - m_NextHardwareNs;
+            const int64_t missed = ( late + m_LastDurationNs / 2 ) / m_LastDurationNs;
+
+            if( missed > 0 )
+            {
+                Increment( m_MissedFrames, (uint64_t)missed );
+            }
+
+            m_Jitter.Record( late - std::max<int64_t>( missed, 0 ) * m_LastDurationNs );
+        }
+
+        m_HaveVideo = true;
+        m_NextHardwareNs = sample.hardwareNs + sample.durationNs;
+        m_LastDurationNs = sample.durationNs;
+    }
+
+    if( sample.audio )
+    {
+        Increment(m_AudioPackets);
+
+        // packet times in ns are rounded; a gap is at least a sample frame
+        if( m_HaveAudio && llabs( sample.packetNs - m_NextPacketNs ) > kNanoseconds / bmdAudioSampleRate48kHz / 2 )
+        {
+            Increment(m_AudioGaps);
+        }
+
+        if( sample.video )
+        {
+            m_Offset.Record( sample.packetNs - sample.streamNs );
+        }
+
+        m_HaveAudio = true;
+        m_NextPacketNs = sample.packetNs + (int64_t)sample.audioFrames * kNanoseconds / bmdAudioSampleRate48kHz;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSyncTracker::Restart()
+{
+    m_HaveVideo = false;
+    m_HaveAudio = false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSyncTracker::GetStats( SSyncStats* pStats ) const
+{
+    pStats->frames = m_Frames.load( std::memory_order_relaxed );
+    pStats->missedFrames = m_MissedFrames.load( std::memory_order_relaxed );
+    pStats->audioPackets = m_AudioPackets.load( std::memory_order_relaxed );
+    pStats->audioGaps = m_AudioGaps.load( std::memory_order_relaxed );
+    m_Offset.GetSummary( &pStats->offset );
+    m_Jitter.GetSummary( &pStats->jitter );
+}
@@ -0,0 +1,132 @@
+#ifndef SYNC_TRACKER_H
+#define SYNC_TRACKER_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "DeckLinkPlatform.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SSyncSummary
+{
+    uint64_t   count;
+    int64_t    minNs;
+    int64_t    maxNs;
+    double     meanNs;
+    int64_t    p50Ns;             // percentiles to within a bucket, 1/64 of the value
+    int64_t    p99Ns;
+    int64_t    p999Ns;
+};
+
+//=====================================================================================================================
+// Histogram of signed nanosecond values in the manner of an HDR histogram: for each power of two of the magnitude
+// 64 buckets, so that every value is kept to within 1/64, from 0 up to 2^kMaxBits ns; larger ones count in the last
+// bucket. Recording is an index computation and a relaxed increment, with no locks and no allocation.
+//
+// One writer; readers on any thread see every count as of some recent point, though not all as of the same one.
+class CSyncHistogram
+{
+public:
+    enum { kSubBits = 6 };
+    enum { kMaxBits = 36 };       // about 69 s
+    enum { kBuckets = ( kMaxBits - kSubBits + 1 ) << kSubBits };
+
+private:
+    std::atomic<uint64_t>  m_Negative[kBuckets];  // by magnitude
+    std::atomic<uint64_t>  m_Positive[kBuckets];  // zero included
+    std::atomic<uint64_t>  m_Count;
+    std::atomic<int64_t>   m_Sum;
+    std::atomic<int64_t>   m_Min;
+    std::atomic<int64_t>   m_Max;
+
+    CSyncHistogram( const CSyncHistogram& );
+    CSyncHistogram& operator=( const CSyncHistogram& );
+
+public:
+    CSyncHistogram();
+
+    // Writer.
+    void Record( int64_t valueNs );
+    void Clear();
+
+    // Readers.
+    void GetSummary( SSyncSummary* pSummary ) const;
+
+    static int BucketIndex( uint64_t magnitude );
+    static uint64_t BucketLow( int index );
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// What one callback of the driver says about timing, in ns. Either half may be missing.
+struct SSyncSample
+{
+    bool          video;
+    int64_t       hardwareNs;     // IDeckLinkVideoInputFrame::GetHardwareReferenceTimestamp()
+    int64_t       durationNs;
+    int64_t       streamNs;       // IDeckLinkVideoInputFrame::GetStreamTime()
+    bool          audio;
+    int64_t       packetNs;       // IDeckLinkAudioInputPacket::GetPacketTime()
+    long          audioFrames;
+};
+
+struct SSyncStats
+{
+    uint64_t      frames;
+    uint64_t      missedFrames;   // frame periods without a frame, between two frames
+    uint64_t      audioPackets;
+    uint64_t      audioGaps;      // packets which do not start where the last one ended
+    SSyncSummary  offset;         // audio packet time less video stream time, of the frames with audio
+    SSyncSummary  jitter;         // hardware reference timestamp less the one expected from the last frame's
+};
+
+//=====================================================================================================================
+// A/V sync of one input, measured on the driver's callback thread.
+//
+// Per frame: the jitter of the hardware reference timestamp against the last frame's plus its duration, a whole
+// number of periods when frames were missed; and, with audio, the offset of the audio packet's time from the video
+// frame's stream time, both on the stream clock, so that a steady offset is the pipeline's and a drifting one means
+// audio and video are not clocked together. Each goes into a CSyncHistogram, which GetStats() summarizes while the
+// callback goes on recording.
+//
+// Record() costs a few virtual calls into the frame and the packet and two histogram increments, well under a
+// microsecond, so it stays on in production.
+class CSyncTracker
+{
+    // owned by the writer
+    bool                   m_HaveVideo;
+    int64_t                m_NextHardwareNs;  // expected of the next frame
+    int64_t                m_LastDurationNs;
+    bool                   m_HaveAudio;
+    int64_t                m_NextPacketNs;
+
+    // written by the writer only
+    std::atomic<uint64_t>  m_Frames;
+    std::atomic<uint64_t>  m_MissedFrames;
+    std::atomic<uint64_t>  m_AudioPackets;
+    std::atomic<uint64_t>  m_AudioGaps;
+    CSyncHistogram         m_Offset;
+    CSyncHistogram         m_Jitter;
+
+    CSyncTracker( const CSyncTracker& );
+    CSyncTracker& operator=( const CSyncTracker& );
+
+    static void Increment( std::atomic<uint64_t>& counter, uint64_t n = 1 )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+    }
+
+public:
+    CSyncTracker();
+
+    // Writer. Either may be NULL.
+    void Record( IDeckLinkVideoInputFrame* pFrame, IDeckLinkAudioInputPacket* pAudio );
+    void Record( const SSyncSample& sample );
+
+    // Writer. The stream starts over, as after a format change: the next frame and packet have no predecessor.
+    void Restart();
+
+    // Readers.
+    void GetStats( SSyncStats* pStats ) const;
+};
+
+#endif // SYNC_TRACKER_H
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "Clock.h"
+#include "DisplayModes.h"
+#include "Timecode.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TIMECODE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TIMECODE_TARGET(isa)
+#else
+#define TIMECODE_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+// 29.97 (and 30) frames a second count in 30, 59.94 in 60; 23.98 counts in 24 without dropping any.
+uint8_t TimecodeRate( BMDDisplayMode mode, BMDTimecodeFlags flags )
+{
+    const SDisplayModeDesc* pDesc = FindDisplayMode(mode);
+
+    if( pDesc == NULL || pDesc->frameDuration <= 0 )
+    {
+        return 0;
+    }
+
+    const unsigned fps = (unsigned)( ( pDesc->timeScale + pDesc->frameDuration / 2 ) / pDesc->frameDuration );
+
+    return (uint8_t)( std::min( fps, 0x7Fu ) | ( ( flags & bmdTimecodeIsDropFrame ) ? kTimecodeDropFrame : 0 ) );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Per minute the drop-frame timecode skips fps / 15 frame numbers, 2 at 30 and 4 at 60: fps * 4370 >> 16. The
+// minutes divisible by 10 skip none; minutes / 10 is minutes * 6554 >> 16 up to well beyond the 1440 of a day.
+uint32_t TimecodeToFrames( BMDTimecodeBCD bcd, uint8_t rate )
+{
+    const uint32_t tens = ( bcd >> 4 ) & 0x0F0F0F0F;
+    const uint32_t bin = bcd - ( tens << 3 ) + ( tens << 1 );
+    const uint32_t minutes = ( bin >> 24 ) * 60 + ( ( bin >> 16 ) & 0xFF );
+    const uint32_t seconds = minutes * 60 + ( ( bin >> 8 ) & 0xFF );
+    const uint32_t fps = rate & 0x7F;
+    const uint32_t dropped = ( rate >> 7 ) * ( ( fps * 4370 ) >> 16 ) * ( minutes - ( ( minutes * 6554 ) >> 16 ) );
+
+    return seconds * fps + ( bin & 0xFF ) - dropped;
+}
+
+#ifdef TIMECODE_X86
+//---------------------------------------------------------------------------------------------------------------------
+// TimecodeToFrames() on 8 lanes.
+TIMECODE_TARGET("avx2")
+static size_t ToFramesAvx2( const BMDTimecodeBCD* pBcd, const uint8_t* pRates, size_t count, uint32_t* pFrames )
+{
+    const __m256i kNibbles = _mm256_set1_epi32(0x0F0F0F0F);
+    const __m256i kByte = _mm256_set1_epi32(0xFF);
+    const __m256i kFps = _mm256_set1_epi32(0x7F);
+    const __m256i k60 = _mm256_set1_epi32(60);
+    const __m256i kPerMinute = _mm256_set1_epi32(4370);
+    const __m256i kTenth = _mm256_set1_epi32(6554);
+    size_t k = 0;
+
+    for( ; k + 8 <= count; k += 8 )
+    {
+        const __m256i bcd = _mm256_loadu_si256( (const __m256i*)( pBcd + k ) );
+        const __m256i rate = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( pRates + k ) ) );
+        const __m256i tens = _mm256_and_si256( _mm256_srli_epi32( bcd, 4 ), kNibbles );
+        const __m256i bin = _mm256_add_epi32( _mm256_sub_epi32( bcd, _mm256_slli_epi32( tens, 3 ) ),
+                                              _mm256_slli_epi32( tens, 1 ) );
+        const __m256i minutes = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_srli_epi32( bin, 24 ), k60 ),
+                                                  _mm256_and_si256( _mm256_srli_epi32( bin, 16 ), kByte ) );
+        const __m256i seconds = _mm256_add_epi32( _mm256_mullo_epi32( minutes, k60 ),
+                                                  _mm256_and_si256( _mm256_srli_epi32( bin, 8 ), kByte ) );
+        const __m256i fps = _mm256_and_si256( rate, kFps );
+        const __m256i perMinute = _mm256_mullo_epi32( _mm256_srli_epi32( rate, 7 ),
+                                                      _mm256_srli_epi32( _mm256_mullo_epi32( fps, kPerMinute ), 16 ) );
+        const __m256i dropping = _mm256_sub_epi32( minutes,
+                                                   _mm256_srli_epi32( _mm256_mullo_epi32( minutes, kTenth ), 16 ) );
+        const __m256i frames = _mm256_add_epi32( _mm256_mullo_epi32( seconds, fps ), _mm256_and_si256( bin, kByte ) );
+
+        _mm256_storeu_si256( (__m256i*)( pFrames + k ),
+                             _mm256_sub_epi32( frames, _mm256_mullo_epi32( perMinute, dropping ) ) );
+    }
+
+    return k;
+}
+#endif // TIMECODE_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+void TimecodesToFrames( const BMDTimecodeBCD* pBcd, const uint8_t* pRates, size_t count, uint32_t* pFrames,
+                        ECpuIsa isa )
+{
+    size_t done = 0;
+
+#ifdef TIMECODE_X86
+    if( isa >= kIsaAvx2 && HasAvx2() )
+    {
+        done = ToFramesAvx2( pBcd, pRates, count, pFrames );
+    }
+#endif
+
+    for( size_t k = done; k < count; ++k )
+    {
+        pFrames[k] = TimecodeToFrames( pBcd[k], pRates[k] );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline uint32_t ToBcd( uint32_t value )
+{
+    return ( value / 10 ) << 4 | value % 10;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Drop-frame: every 10 minutes hold 9 minutes of fps * 60 - drop frames and one of fps * 60; the frame numbers skipped
+// before the count are added back.
+BMDTimecodeBCD FramesToTimecode( uint32_t frames, uint8_t rate )
+{
+    const uint32_t fps = rate & 0x7F;
+    const uint32_t drop = ( rate & kTimecodeDropFrame ) ? fps / 15 : 0;
+
+    if( fps == 0 )
+    {
+        return 0;
+    }
+
+    frames %= TimecodeDayFrames(rate);
+
+    if( drop != 0 )
+    {
+        const uint32_t perTen = fps * 600 - drop * 9;
+        const uint32_t perMinute = fps * 60 - drop;
+        const uint32_t tens = frames / perTen;
+        const uint32_t rest = frames % perTen;
+
+        frames += drop * 9 * tens + ( ( rest > drop ) ? drop * ( ( rest - drop ) / perMinute ) : 0 );
+    }
+
+    const uint32_t seconds = frames / fps;
+
+    return ToBcd( seconds / 3600 ) << 24 | ToBcd( seconds / 60 % 60 ) << 16 | ToBcd( seconds % 60 ) << 8 |
+           ToBcd( frames % fps );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+uint32_t TimecodeDayFrames( uint8_t rate )
+{
+    const uint32_t fps = rate & 0x7F;
+    const uint32_t drop = ( rate & kTimecodeDropFrame ) ? fps / 15 : 0;
+
+    return fps * 86400 - drop * ( 1440 - 144 );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The digits of BCD print as hexadecimal.
+void FormatTimecode( BMDTimecodeBCD bcd, uint8_t rate, char* pBuffer )
+{
+    snprintf( pBuffer, 12, "%02x:%02x:%02x%c%02x", ( bcd >> 24 ) & 0xFF, ( bcd >> 16 ) & 0xFF, ( bcd >> 8 ) & 0xFF,
+              ( rate & kTimecodeDropFrame ) ? ';' : ':', bcd & 0xFF );
+}
+
+//=====================================================================================================================
+CTimecodeLog::CTimecodeLog( BMDTimecodeFormat format, unsigned capacity, ECpuIsa isa )
+    : m_RefCount(1), m_Format(format), m_Isa(isa), m_Capacity(1), m_ModeRate(0), m_Open(false), m_NextFrame(0),
+      m_NextCount(0), m_RunRate(0), m_RunFrames(0), m_Runs(0), m_Frames(0), m_Missing(0), m_Gaps(0), m_Skipped(0),
+      m_AppendNs(0), m_Last(0), m_LastRate(0)
+{
+    while( m_Capacity < capacity && m_Capacity < 0x80000000u )
+    {
+        m_Capacity <<= 1;
+    }
+
+    m_Mask = m_Capacity - 1;
+    m_pFirstFrame = new std::atomic<uint64_t>[m_Capacity];
+    m_pFrames = new std::atomic<uint64_t>[m_Capacity];
+    m_pFirstBcd = new std::atomic<uint32_t>[m_Capacity];
+    m_pFirstCount = new std::atomic<uint32_t>[m_Capacity];
+    m_pRate = new std::atomic<uint8_t>[m_Capacity];
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CTimecodeLog::~CTimecodeLog()
+{
+    delete[] m_pFirstFrame;
+    delete[] m_pFrames;
+    delete[] m_pFirstBcd;
+    delete[] m_pFirstCount;
+    delete[] m_pRate;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeLog::SetMode( BMDDisplayMode mode )
+{
+    m_ModeRate = TimecodeRate( mode, bmdTimecodeFlagDefault );
+    m_Open = false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The fence orders the row after the count which made its slot free, as far as a reader which copies part of the new
+// row is concerned: once it has read its copy, it is sure to see the count, and to drop the row.
+void CTimecodeLog::StartRun( uint64_t frame, BMDTimecodeBCD bcd, uint32_t count, uint8_t rate )
+{
+    const uint64_t run = m_Runs.load( std::memory_order_relaxed );
+    const uint32_t slot = (uint32_t)run & m_Mask;
+
+    std::atomic_thread_fence( std::memory_order_release );
+
+    m_pFirstFrame[slot].store( frame, std::memory_order_relaxed );
+    m_pFrames[slot].store( 1, std::memory_order_relaxed );
+    m_pFirstBcd[slot].store( bcd, std::memory_order_relaxed );
+    m_pFirstCount[slot].store( count, std::memory_order_relaxed );
+    m_pRate[slot].store( rate, std::memory_order_relaxed );
+    m_Runs.store( run + 1, std::memory_order_release );
+
+    m_Open = true;
+    m_RunRate = rate;
+    m_RunFrames = 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeLog::Append( IDeckLinkVideoInputFrame* pFrame, uint64_t frame )
+{
+    const uint64_t start = MonotonicNs();
+    IDeckLinkTimecode* pTimecode = NULL;
+
+    if( pFrame->GetTimecode( m_Format, &pTimecode ) != S_OK || pTimecode == NULL )
+    {
+        Missing();
+    }
+    else
+    {
+        const BMDTimecodeBCD bcd = pTimecode->GetBCD();
+        const BMDTimecodeFlags flags = pTimecode->GetFlags();
+
+        pTimecode->Release();
+        Append( frame, bcd, flags );
+    }
+
+    Increment( m_AppendNs, MonotonicNs() - start );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeLog::Append( uint64_t frame, BMDTimecodeBCD bcd, BMDTimecodeFlags flags )
+{
+    if( m_ModeRate == 0 )
+    {
+        Missing();
+        return;
+    }
+
+    const uint8_t rate = m_ModeRate | ( ( flags & bmdTimecodeIsDropFrame ) ? kTimecodeDropFrame : 0 );
+    const uint32_t count = TimecodeToFrames( bcd, rate );
+    const uint32_t day = TimecodeDayFrames(rate);
+
+    if( m_Open && frame == m_NextFrame && count == m_NextCount && rate == m_RunRate )
+    {
+        m_pFrames[ ( m_Runs.load( std::memory_order_relaxed ) - 1 ) & m_Mask ].store( ++m_RunFrames,
+                                                                                   std::memory_order_relaxed );
+    }
+    else
+    {
+        const uint32_t ahead = ( count + day - m_NextCount % day ) % day;
+
+        if( m_Open && rate == m_RunRate && ahead != 0 && ahead < day / 2 )
+        {
+            Increment(m_Gaps);
+            Increment( m_Skipped, ahead );
+        }
+
+        StartRun( frame, bcd, count, rate );
+    }
+
+    m_NextFrame = frame + 1;
+    m_NextCount = ( count + 1 ) % day;
+    m_Last.store( bcd, std::memory_order_relaxed );
+    m_LastRate.store( rate, std::memory_order_relaxed );
+    Increment(m_Frames);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeLog::Missing()
+{
+    Increment(m_Missing);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Copies the rows of runs first to end, then drops those the writer may have overwritten meanwhile: a slot is reused
+// for the run capacity later, which is being written once the count has reached it. Returns how many were dropped,
+// from the front.
+unsigned CTimecodeLog::ReadRows( uint64_t first, uint64_t end, SRun* pRuns ) const
+{
+    for( uint64_t run = first; run < end; ++run )
+    {
+        const uint32_t slot = (uint32_t)run & m_Mask;
+        SRun* pRun = &pRuns[ run - first ];
+
+        pRun->sequence = run;
+        pRun->firstFrame = m_pFirstFrame[slot].load( std::memory_order_relaxed );
+        pRun->frames = m_pFrames[slot].load( std::memory_order_relaxed );
+        pRun->firstBcd = m_pFirstBcd[slot].load( std::memory_order_relaxed );
+        pRun->firstCount = m_pFirstCount[slot].load( std::memory_order_relaxed );
+        pRun->rate = m_pRate[slot].load( std::memory_order_relaxed );
+    }
+
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    const uint64_t runs = m_Runs.load( std::memory_order_relaxed );
+    const uint64_t oldest = ( runs >= m_Capacity ) ? runs - m_Capacity + 1 : 0;
+
+    return (unsigned)( std::min( std::max( oldest, first ), end ) - first );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+unsigned CTimecodeLog::GetRuns( uint64_t first, SRun* pRuns, unsigned maxRuns, uint64_t* pNext )
+{
+    const uint64_t runs = m_Runs.load( std::memory_order_acquire );
+    const uint64_t start = std::max( first, ( runs >= m_Capacity ) ? runs - m_Capacity + 1 : 0 );
+    const uint64_t end = std::max( start, std::min( runs, start + maxRuns ) );
+    const unsigned dropped = ReadRows( start, end, pRuns );
+    const unsigned count = (unsigned)( end - start ) - dropped;
+
+    memmove( pRuns, pRuns + dropped, count * sizeof(SRun) );
+    *pNext = end;
+    return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Newest runs first, a block at a time: the target converted in the rate of each run in one batch, then a test of
+// its offset into the run.
+bool CTimecodeLog::Seek( BMDTimecodeBCD bcd, uint64_t* pFrame )
+{
+    enum { kBlock = 64 };
+
+    SRun rows[kBlock];
+    BMDTimecodeBCD targets[kBlock];
+    uint8_t rates[kBlock];
+    uint32_t counts[kBlock];
+    uint64_t end = m_Runs.load( std::memory_order_acquire );
+
+    for( int i = 0; i < kBlock; ++i )
+    {
+        targets[i] = bcd;
+    }
+
+    while( end != 0 )
+    {
+        const uint64_t start = ( end > kBlock ) ? end - kBlock : 0;
+        const unsigned n = (unsigned)( end - start );
+        const unsigned dropped = ReadRows( start, end, rows );
+
+        for( unsigned i = 0; i < n; ++i )
+        {
+            rates[i] = rows[i].rate;
+        }
+
+        TimecodesToFrames( targets, rates, n, counts, m_Isa );
+
+        for( unsigned i = n; i-- > dropped; )
+        {
+            const uint32_t day = TimecodeDayFrames( rows[i].rate );
+            const uint32_t offset = ( counts[i] + day - rows[i].firstCount ) % day;
+
+            if( counts[i] < day && offset < rows[i].frames )
+            {
+                *pFrame = rows[i].firstFrame + offset;
+                return true;
+            }
+        }
+
+        if( dropped != 0 )
+        {
+            break;
+        }
+
+        end = start;
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeLog::GetStats( SStats* pStats )
+{
+    pStats->capacity = m_Capacity;
+    pStats->frames = m_Frames.load( std::memory_order_relaxed );
+    pStats->missing = m_Missing.load( std::memory_order_relaxed );
+    pStats->runs = m_Runs.load( std::memory_order_relaxed );
+    pStats->gaps = m_Gaps.load( std::memory_order_relaxed );
+    pStats->skipped = m_Skipped.load( std::memory_order_relaxed );
+    pStats->appendNs = m_AppendNs.load( std::memory_order_relaxed );
+    pStats->last = m_Last.load( std::memory_order_relaxed );
+    pStats->lastRate = m_LastRate.load( std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG CTimecodeLog::AddRef()
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG CTimecodeLog::Release()
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
@@ -0,0 +1,164 @@
+#ifndef TIMECODE_H
+#define TIMECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "CpuFeatures.h"
+#include "DeckLinkPlatform.h"
+
+//=====================================================================================================================
+// SMPTE 12M timecodes as counts of frames, straight from IDeckLinkTimecode::GetBCD().
+//
+// GetString() formats a string the caller then has to parse, per frame; the BCD word 0xHHMMSSFF has the same
+// information in four bytes of two digits each. All four bytes are turned into binary at once, each as its value less
+// 6 times its tens digit, and the count is then a few multiplications and adds, with no branch: drop-frame timecode
+// (bmdTimecodeIsDropFrame, 29.97 and 59.94 frames per second) skips the first 2 (or 4) frame numbers of every minute
+// but every tenth, which is subtracted with a multiplication by the flag, and the division by 10 is a multiplication
+// and a shift. The batch form does 8 timecodes at a time with AVX2, each with its own rate, so that the timecodes of
+// many channels in different modes convert in one call; the kernels are chosen at run time with CpuFeatures.h and
+// give the same counts.
+//
+// A rate is the number of frames the timecode counts per second (24, 25, 30, 50 or 60, whatever the fraction of the
+// mode) in the low 7 bits, and kTimecodeDropFrame.
+enum
+{
+    kTimecodeDropFrame = 0x80,
+};
+
+// The rate of timecodes captured in the mode, with the flags of the timecode; 0 if the mode is unknown.
+uint8_t TimecodeRate( BMDDisplayMode mode, BMDTimecodeFlags flags );
+
+// Frames since 00:00:00:00. The BCD must be a valid timecode of the rate; anything else gives a meaningless count.
+uint32_t TimecodeToFrames( BMDTimecodeBCD bcd, uint8_t rate );
+
+// The same for count timecodes, pRates[i] the rate of pBcd[i]. isa: the highest kernels to use, kIsaCount = the
+// best the CPU has.
+void TimecodesToFrames( const BMDTimecodeBCD* pBcd, const uint8_t* pRates, size_t count, uint32_t* pFrames,
+                        ECpuIsa isa = kIsaCount );
+
+// The other way, modulo a day.
+BMDTimecodeBCD FramesToTimecode( uint32_t frames, uint8_t rate );
+
+// Frames in a day of the rate.
+uint32_t TimecodeDayFrames( uint8_t rate );
+
+// "hh:mm:ss:ff", ';' before the frames for drop-frame; buffer of at least 12 characters.
+void FormatTimecode( BMDTimecodeBCD bcd, uint8_t rate, char* pBuffer );
+
+//=====================================================================================================================
+// The timecodes of one device, read from every frame on the capture callback, as runs of consecutive frames.
+//
+// Consecutive frames normally carry consecutive timecodes, so the log keeps one row per run rather than one per frame:
+// the capture frame and timecode it starts with, its rate and its length. A frame whose timecode does not follow the
+// last one's, or which does not follow the last frame with a timecode, starts a new run: a gap when the timecode
+// jumps ahead by less than half a day (frames lost on the way to the card, or a source cut), a discontinuity
+// otherwise. A day of clean timecode is one row, seeking a timecode is a look at each run's range, and the gaps are
+// the starts of the runs.
+//
+// The rows are kept in columns, in a ring of a fixed number of runs, allocated once; the oldest runs are overwritten
+// once it is full. One writer, which never waits; readers on any thread copy the rows they want and drop any the
+// writer overwrote in the meantime.
+class CTimecodeLog
+{
+public:
+    struct SRun
+    {
+        uint64_t        sequence;     // runs the log started before this one
+        uint64_t        firstFrame;   // frames the input delivered before the run's first
+        uint64_t        frames;       // in the run, so far for the last one
+        BMDTimecodeBCD  firstBcd;
+        uint32_t        firstCount;   // TimecodeToFrames( firstBcd, rate )
+        uint8_t         rate;
+    };
+
+    struct SStats
+    {
+        uint32_t        capacity;     // runs kept
+        uint64_t        frames;       // with a timecode
+        uint64_t        missing;      // frames without one, input or not
+        uint64_t        runs;         // started
+        uint64_t        gaps;         // runs which started with a jump ahead
+        uint64_t        skipped;      // ... timecode frames jumped over in total
+        uint64_t        appendNs;     // spent in Append()
+        BMDTimecodeBCD  last;         // of the last frame with a timecode, valid if frames != 0
+        uint8_t         lastRate;
+    };
+
+private:
+    std::atomic<ULONG>               m_RefCount;
+    BMDTimecodeFormat                m_Format;
+    ECpuIsa                          m_Isa;
+    uint32_t                         m_Capacity;    // a power of two
+    uint32_t                         m_Mask;
+
+    // the columns of the ring
+    std::atomic<uint64_t>*           m_pFirstFrame;
+    std::atomic<uint64_t>*           m_pFrames;
+    std::atomic<uint32_t>*           m_pFirstBcd;
+    std::atomic<uint32_t>*           m_pFirstCount;
+    std::atomic<uint8_t>*            m_pRate;
+
+    // writer only
+    uint8_t                          m_ModeRate;    // of the current mode, without the flag
+    bool                             m_Open;        // a run is going on
+    uint64_t                         m_NextFrame;   // of the run going on
+    uint32_t                         m_NextCount;
+    uint8_t                          m_RunRate;
+    uint64_t                         m_RunFrames;
+
+    // written by the writer only
+    std::atomic<uint64_t>            m_Runs;        // released once the row of the new run is written
+    std::atomic<uint64_t>            m_Frames;
+    std::atomic<uint64_t>            m_Missing;
+    std::atomic<uint64_t>            m_Gaps;
+    std::atomic<uint64_t>            m_Skipped;
+    std::atomic<uint64_t>            m_AppendNs;
+    std::atomic<uint32_t>            m_Last;
+    std::atomic<uint8_t>             m_LastRate;
+
+    CTimecodeLog( const CTimecodeLog& );
+    CTimecodeLog& operator=( const CTimecodeLog& );
+
+    ~CTimecodeLog();
+
+    static void Increment( std::atomic<uint64_t>& counter, uint64_t n = 1 )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+    }
+
+    void StartRun( uint64_t frame, BMDTimecodeBCD bcd, uint32_t count, uint8_t rate );
+    unsigned ReadRows( uint64_t first, uint64_t end, SRun* pRuns ) const;
+
+public:
+    // format: the timecode to read from each frame. capacity: runs kept, rounded up to a power of two. isa: as for
+    // TimecodesToFrames(), for Seek().
+    CTimecodeLog( BMDTimecodeFormat format, unsigned capacity, ECpuIsa isa = kIsaCount );
+
+    BMDTimecodeFormat Format() const  { return m_Format; }
+
+    // Writer. The display mode of the frames from now on; a change ends the run going on.
+    void SetMode( BMDDisplayMode mode );
+
+    // Writer. frame: the number of frames before this one. The first form reads the timecode of the log's format, a
+    // frame without one counts as missing.
+    void Append( IDeckLinkVideoInputFrame* pFrame, uint64_t frame );
+    void Append( uint64_t frame, BMDTimecodeBCD bcd, BMDTimecodeFlags flags );
+    void Missing();
+
+    // Readers. The runs from sequence first on, oldest first, at most maxRuns; *pNext is the sequence to ask for next.
+    // Runs already overwritten are skipped, and the first run returned tells how many.
+    unsigned GetRuns( uint64_t first, SRun* pRuns, unsigned maxRuns, uint64_t* pNext );
+
+    // Readers. The capture frame of the last frame logged with the timecode, read in the rate of each run; false if
+    // no run kept has it.
+    bool Seek( BMDTimecodeBCD bcd, uint64_t* pFrame );
+
+    void GetStats( SStats* pStats );
+
+    ULONG AddRef();
+    ULONG Release();
+};
+
+#endif // TIMECODE_H
@@ -0,0 +1,474 @@
+#include <string.h>
+#include <algorithm>
+
+#include "TimecodeIndex.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const uint64_t kPageSize  = 4096;
+static const uint64_t kGrowBytes = 4 * 1024 * 1024;
+
+//---------------------------------------------------------------------------------------------------------------------
+static uint64_t RoundUp( uint64_t n, uint64_t step )
+{
+    return ( n + step - 1 ) / step * step;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CTimecodeIndex::CTimecodeIndex()
+    : m_Fd(-1), m_Writable(false), m_pMap(NULL), m_MapSize(0), m_pHeader(NULL), m_pSegments(NULL), m_pRuns(NULL),
+      m_pEntries(NULL), m_MaxEntries(0), m_FileSize(0), m_Entries(0), m_Runs(0), m_Segments(0), m_HaveTime(false),
+      m_LastTime(0), m_Open(false), m_NextCount(0), m_Rate(0), m_SegmentEnd(0), m_Rejected(0), m_Untimed(0),
+      m_RunsFull(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CTimecodeIndex::~CTimecodeIndex()
+{
+    Close();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Map( size_t size, bool writable )
+{
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* p = mmap( NULL, size, prot, MAP_SHARED, m_Fd, 0 );
+
+    if( p == MAP_FAILED )
+    {
+        return false;
+    }
+
+    m_pMap = (uint8_t*)p;
+    m_MapSize = size;
+    m_pHeader = (STimecodeIndexHeader*)m_pMap;
+    m_pSegments = (uint64_t*)( m_pMap + m_pHeader->segmentsOffset );
+    m_pRuns = (STimecodeIndexRun*)( m_pMap + m_pHeader->runsOffset );
+    m_pEntries = (STimecodeIndexEntry*)( m_pMap + m_pHeader->entriesOffset );
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Create( const char* path, BMDTimeScale timeScale, uint64_t maxEntries, uint32_t maxRuns )
+{
+    Close();
+
+    if( timeScale <= 0 || maxEntries == 0 || maxRuns == 0 )
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    // the tables are reserved in full, but their pages only take space on disk once written
+    STimecodeIndexHeader header;
+    memset( (void*)&header, 0, sizeof(header) );
+    header.magic = kTimecodeIndexMagic;
+    header.version = kTimecodeIndexVersion;
+    header.entrySize = sizeof(STimecodeIndexEntry);
+    header.runSize = sizeof(STimecodeIndexRun);
+    header.timeScale = timeScale;
+    header.runCapacity = maxRuns;
+    header.segmentsOffset = kPageSize;
+    header.runsOffset = RoundUp( header.segmentsOffset + (uint64_t)maxRuns * sizeof(uint64_t), kPageSize );
+    header.entriesOffset = RoundUp( header.runsOffset + (uint64_t)maxRuns * sizeof(STimecodeIndexRun), kPageSize );
+
+    m_Fd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+    if( m_Fd < 0 )
+    {
+        return false;
+    }
+
+    m_FileSize = header.entriesOffset;
+
+    if( ftruncate( m_Fd, (off_t)m_FileSize ) != 0 ||
+        pwrite( m_Fd, &header, sizeof(header), 0 ) != (ssize_t)sizeof(header) ||
+        !Map( (size_t)( header.entriesOffset + maxEntries * sizeof(STimecodeIndexEntry) ), true ) )
+    {
+        int error = errno;
+        close( m_Fd );
+        m_Fd = -1;
+        unlink( path );
+        errno = error;
+        return false;
+    }
+
+    m_Writable = true;
+    m_MaxEntries = maxEntries;
+    m_Entries = 0;
+    m_Runs = 0;
+    m_Segments = 0;
+    m_HaveTime = false;
+    m_Open = false;
+    m_Rejected.store( 0, std::memory_order_relaxed );
+    m_Untimed.store( 0, std::memory_order_relaxed );
+    m_RunsFull.store( 0, std::memory_order_relaxed );
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Open( const char* path )
+{
+    Close();
+
+    m_Fd = open( path, O_RDONLY | O_CLOEXEC );
+
+    if( m_Fd < 0 )
+    {
+        return false;
+    }
+
+    STimecodeIndexHeader header;
+    struct stat st;
+
+    bool valid = fstat( m_Fd, &st ) == 0 &&
+                 pread( m_Fd, &header, sizeof(header), 0 ) == (ssize_t)sizeof(header) &&
+                 header.magic == kTimecodeIndexMagic && header.version == kTimecodeIndexVersion &&
+                 header.entrySize == sizeof(STimecodeIndexEntry) && header.runSize == sizeof(STimecodeIndexRun) &&
+                 header.segmentsOffset >= sizeof(header) &&
+                 header.runsOffset >= header.segmentsOffset + header.runCapacity * sizeof(uint64_t) &&
+                 header.entriesOffset >= header.runsOffset + header.runCapacity * sizeof(STimecodeIndexRun) &&
+                 (uint64_t)st.st_size >= header.entriesOffset;
+
+    if( !valid || !Map( (size_t)st.st_size, false ) )
+    {
+        int error = valid ? errno : EINVAL;
+        close( m_Fd );
+        m_Fd = -1;
+        errno = error;
+        return false;
+    }
+
+    m_Writable = false;
+    m_MaxEntries = ( m_MapSize - header.entriesOffset ) / sizeof(STimecodeIndexEntry);
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Refresh()
+{
+    if( m_pHeader == NULL || m_Writable )
+    {
+        return m_pHeader != NULL;
+    }
+
+    struct stat st;
+
+    if( fstat( m_Fd, &st ) != 0 || (uint64_t)st.st_size < m_pHeader->entriesOffset )
+    {
+        return false;
+    }
+
+    if( (size_t)st.st_size <= m_MapSize )
+    {
+        return true;
+    }
+
+    uint64_t entriesOffset = m_pHeader->entriesOffset;
+    munmap( m_pMap, m_MapSize );
+    m_pHeader = NULL;
+
+    if( !Map( (size_t)st.st_size, false ) )
+    {
+        m_pMap = NULL;
+        m_MapSize = 0;
+        return false;
+    }
+
+    m_MaxEntries = ( m_MapSize - entriesOffset ) / sizeof(STimecodeIndexEntry);
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeIndex::Close()
+{
+    if( m_pHeader != NULL && m_Writable )
+    {
+        uint64_t used = m_pHeader->entriesOffset + m_Entries * sizeof(STimecodeIndexEntry);
+        m_pHeader->complete.store( 1, std::memory_order_release );
+        msync( m_pMap, (size_t)std::min( RoundUp( used, kPageSize ), (uint64_t)m_MapSize ), MS_SYNC );
+        munmap( m_pMap, m_MapSize );
+
+        if( ftruncate( m_Fd, (off_t)used ) != 0 )
+        {
+            // the file keeps its spare tail; readers go by the header's counts anyway
+        }
+    }
+    else if( m_pMap != NULL )
+    {
+        munmap( m_pMap, m_MapSize );
+    }
+
+    if( m_Fd >= 0 )
+    {
+        close( m_Fd );
+    }
+
+    m_Fd = -1;
+    m_pMap = NULL;
+    m_MapSize = 0;
+    m_pHeader = NULL;
+    m_pSegments = NULL;
+    m_pRuns = NULL;
+    m_pEntries = NULL;
+    m_MaxEntries = 0;
+    m_Writable = false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Complete() const
+{
+    return m_pHeader != NULL && m_pHeader->complete.load( std::memory_order_acquire ) != 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Grow( uint64_t entries )
+{
+    uint64_t size = RoundUp( m_pHeader->entriesOffset + entries * sizeof(STimecodeIndexEntry), kGrowBytes );
+    size = std::min( size, (uint64_t)m_MapSize );
+
+    if( ftruncate( m_Fd, (off_t)size ) != 0 )
+    {
+        return false;
+    }
+
+    m_FileSize = size;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeIndex::StartRun( uint32_t count, uint8_t rate )
+{
+    // a run which does not go on above the last one, in its rate, starts a segment; a segment's runs are thus sorted
+    bool segment = m_Runs == 0 || rate != m_Rate || count < m_SegmentEnd;
+
+    STimecodeIndexRun& run = m_pRuns[m_Runs];
+    run.firstEntry = m_Entries;
+    run.entries.store( 1, std::memory_order_relaxed );
+    run.firstCount = count;
+    run.rate = rate;
+    memset( run.reserved, 0, sizeof(run.reserved) );
+
+    // the run before the segment that refers to it: readers load the segments before the runs
+    ++m_Runs;
+    m_pHeader->runs.store( m_Runs, std::memory_order_release );
+
+    if( segment )
+    {
+        m_pSegments[m_Segments] = m_Runs - 1;
+        ++m_Segments;
+        m_pHeader->segments.store( m_Segments, std::memory_order_release );
+    }
+
+    m_Open = true;
+    m_Rate = rate;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::Append( BMDTimeValue streamTime, uint64_t offset, uint32_t size, BMDTimecodeBCD bcd,
+                             uint8_t rate )
+{
+    if( m_pHeader == NULL || !m_Writable )
+    {
+        return false;
+    }
+
+    if( m_Entries >= m_MaxEntries || ( m_HaveTime && streamTime <= m_LastTime ) ||
+        ( m_pHeader->entriesOffset + ( m_Entries + 1 ) * sizeof(STimecodeIndexEntry) > m_FileSize &&
+          !Grow( m_Entries + 1 ) ) )
+    {
+        Increment( m_Rejected );
+        return false;
+    }
+
+    uint32_t count = rate != 0 ? TimecodeToFrames( bcd, rate ) : 0;
+
+    if( rate != 0 && count >= TimecodeDayFrames( rate ) )
+    {
+        rate = 0;
+    }
+
+    STimecodeIndexEntry& entry = m_pEntries[m_Entries];
+    entry.streamTime = streamTime;
+    entry.offset = offset;
+    entry.size = size;
+    entry.bcd = rate != 0 ? bcd : (BMDTimecodeBCD)kTimecodeIndexNone;
+
+    if( rate == 0 )
+    {
+        m_Open = false;
+        Increment( m_Untimed );
+    }
+    else if( m_Open && rate == m_Rate && count == m_NextCount )
+    {
+        STimecodeIndexRun& run = m_pRuns[m_Runs - 1];
+        run.entries.store( run.entries.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+    else if( m_Runs < m_pHeader->runCapacity )
+    {
+        StartRun( count, rate );
+    }
+    else
+    {
+        m_Open = false;
+        Increment( m_RunsFull );
+    }
+
+    if( m_Open )
+    {
+        m_NextCount = count + 1;
+        m_SegmentEnd = m_NextCount;
+    }
+
+    m_HaveTime = true;
+    m_LastTime = streamTime;
+
+    // the entry, and the run it extends, before the count that covers them
+    ++m_Entries;
+    m_pHeader->entries.store( m_Entries, std::memory_order_release );
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+uint64_t CTimecodeIndex::Entries() const
+{
+    if( m_pHeader == NULL )
+    {
+        return 0;
+    }
+
+    return std::min( m_pHeader->entries.load( std::memory_order_acquire ), m_MaxEntries );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::GetEntry( uint64_t index, STimecodeIndexEntry* pEntry ) const
+{
+    if( index >= Entries() )
+    {
+        return false;
+    }
+
+    *pEntry = m_pEntries[index];
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::SeekStreamTime( BMDTimeValue streamTime, uint64_t* pIndex ) const
+{
+    uint64_t entries = Entries();
+
+    if( entries == 0 || m_pEntries[0].streamTime > streamTime )
+    {
+        return false;
+    }
+
+    // entries[lo] is at or before the time, entries[hi] after it or past the end
+    uint64_t lo = 0;
+    uint64_t hi = entries;
+
+    while( hi - lo > 1 )
+    {
+        uint64_t mid = lo + ( hi - lo ) / 2;
+
+        if( m_pEntries[mid].streamTime <= streamTime )
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    *pIndex = lo;
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CTimecodeIndex::SeekTimecode( BMDTimecodeBCD bcd, uint64_t* pIndex ) const
+{
+    if( m_pHeader == NULL )
+    {
+        return false;
+    }
+
+    uint64_t capacity = m_pHeader->runCapacity;
+    uint64_t segments = std::min( m_pHeader->segments.load( std::memory_order_acquire ), capacity );
+    uint64_t runs = std::min( m_pHeader->runs.load( std::memory_order_acquire ), capacity );
+    uint64_t entries = Entries();
+
+    for( uint64_t s = 0; s < segments; ++s )
+    {
+        uint64_t begin = m_pSegments[s];
+        uint64_t end = s + 1 < segments ? m_pSegments[s + 1] : runs;
+
+        if( begin >= end || end > runs )
+        {
+            continue;
+        }
+
+        uint8_t rate = m_pRuns[begin].rate;
+        uint32_t count = TimecodeToFrames( bcd, rate );
+
+        if( count >= TimecodeDayFrames( rate ) || count < m_pRuns[begin].firstCount )
+        {
+            continue;
+        }
+
+        // runs[lo] starts at or before the timecode, runs[hi] after it or past the segment
+        uint64_t lo = begin;
+        uint64_t hi = end;
+
+        while( hi - lo > 1 )
+        {
+            uint64_t mid = lo + ( hi - lo ) / 2;
+
+            if( m_pRuns[mid].firstCount <= count )
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        const STimecodeIndexRun& run = m_pRuns[lo];
+        uint64_t length = std::min( run.entries.load( std::memory_order_relaxed ),
+                                    run.firstEntry < entries ? entries - run.firstEntry : 0 );
+
+        if( count - run.firstCount < length )
+        {
+            *pIndex = run.firstEntry + ( count - run.firstCount );
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CTimecodeIndex::GetStats( SStats* pStats ) const
+{
+    memset( pStats, 0, sizeof(*pStats) );
+
+    if( m_pHeader == NULL )
+    {
+        return;
+    }
+
+    pStats->segments = m_pHeader->segments.load( std::memory_order_acquire );
+    pStats->runs = m_pHeader->runs.load( std::memory_order_acquire );
+    pStats->entries = Entries();
+    pStats->rejected = m_Rejected.load( std::memory_order_relaxed );
+    pStats->untimed = m_Untimed.load( std::memory_order_relaxed );
+    pStats->runsFull = m_RunsFull.load( std::memory_order_relaxed );
+    pStats->bytes = m_pHeader->entriesOffset + pStats->entries * sizeof(STimecodeIndexEntry);
+}
+#endif // _WIN32
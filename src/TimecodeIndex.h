@@ -0,0 +1,176 @@
+#ifndef TIMECODE_INDEX_H
+#define TIMECODE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "DeckLinkPlatform.h"
+#include "Timecode.h"
+
+//=====================================================================================================================
+// Index file of a recording (version 1): where each frame of the essence file is, by stream time and by timecode.
+//
+// The file is a header page, a segment table, a run table and an entry table, all little-endian, all written in place
+// through a shared mapping and only ever appended to:
+//
+//     entries   one STimecodeIndexEntry per frame, in the order recorded: its stream time, which only increases, and
+//               its offset and size in the essence file, and its timecode
+//     runs      one STimecodeIndexRun per stretch of frames with consecutive timecodes of one rate within a day, so
+//               that the frame of a timecode within a run is its first entry plus the timecode's distance from the
+//               run's first
+//     segments  the first run of each stretch of runs whose timecodes only increase, in one rate, so that their
+//               ranges are sorted and do not overlap: a new segment starts where the timecode jumps back (midnight, a
+//               source cut) or the rate changes
+//
+// A seek by stream time is a binary search of the entries; a seek by timecode is a binary search of the runs of each
+// segment. A day of timecode recorded without a jump back is one segment, so both take some 25 probes of the mapping
+// on a 24 hour recording at 60 frames a second, with no scan of the essence or of the index.
+//
+// The counts in the header are published after what they count, so a reader, in this process or another, always sees
+// a consistent index of the frames recorded so far.
+enum
+{
+    kTimecodeIndexMagic   = 0x58435442,   // 'BTCX'
+    kTimecodeIndexVersion = 1,
+    kTimecodeIndexNone    = 0xFFFFFFFF,   // STimecodeIndexEntry::bcd of a frame without timecode
+};
+
+struct STimecodeIndexEntry
+{
+    int64_t         streamTime;           // in the index's time scale
+    uint64_t        offset;               // of the frame in the essence file
+    uint32_t        size;                 // bytes there
+    BMDTimecodeBCD  bcd;                  // kTimecodeIndexNone = none
+};
+
+struct STimecodeIndexRun
+{
+    uint64_t               firstEntry;
+    std::atomic<uint64_t>  entries;       // grows while the run is the last one
+    uint32_t               firstCount;    // TimecodeToFrames() of the first entry's timecode
+    uint8_t                rate;
+    uint8_t                reserved[3];
+};
+
+struct STimecodeIndexHeader
+{
+    uint32_t               magic;
+    uint32_t               version;
+    uint32_t               entrySize;     // sizeof(STimecodeIndexEntry)
+    uint32_t               runSize;       // sizeof(STimecodeIndexRun)
+    int64_t                timeScale;     // of the stream times
+    uint64_t               runCapacity;   // slots in the segment and run tables
+    uint64_t               segmentsOffset;    // of the tables in the file
+    uint64_t               runsOffset;
+    uint64_t               entriesOffset;
+    std::atomic<uint64_t>  entries;       // each published after the entries, runs and segments it counts
+    std::atomic<uint64_t>  runs;
+    std::atomic<uint64_t>  segments;
+    std::atomic<uint32_t>  complete;      // 1 once the writer has closed it
+};
+
+#ifndef _WIN32
+//=====================================================================================================================
+// Writes or reads an index file.
+//
+// The writer maps the file for the most entries it may take and grows it by ftruncate() in steps of a few MB as the
+// entries come, so that appending a frame is a few stores into the mapping and now and then a system call; Close()
+// cuts the file down to the entries written. One thread writes; the Seek functions may be called on any thread
+// meanwhile. A reader opens the file read-only and maps what there is; Refresh() maps what has been added since.
+class CTimecodeIndex
+{
+public:
+    struct SStats
+    {
+        uint64_t  entries;
+        uint64_t  runs;
+        uint64_t  segments;
+        uint64_t  rejected;           // frames not indexed: the index full, or a stream time going back
+        uint64_t  untimed;            // frames indexed without timecode
+        uint64_t  runsFull;           // ... with one, but no room left to start its run: not found by timecode
+        uint64_t  bytes;              // of the file in use
+    };
+
+private:
+    int                         m_Fd;
+    bool                        m_Writable;
+    uint8_t*                    m_pMap;
+    size_t                      m_MapSize;        // mapped; the file may be smaller while writing
+    STimecodeIndexHeader*       m_pHeader;
+    uint64_t*                   m_pSegments;
+    STimecodeIndexRun*          m_pRuns;
+    STimecodeIndexEntry*        m_pEntries;
+    uint64_t                    m_MaxEntries;
+
+    // writer only
+    uint64_t                    m_FileSize;
+    uint64_t                    m_Entries;
+    uint64_t                    m_Runs;
+    uint64_t                    m_Segments;
+    bool                        m_HaveTime;
+    int64_t                     m_LastTime;
+    bool                        m_Open;           // the last run goes on with the next timecode
+    uint32_t                    m_NextCount;
+    uint8_t                     m_Rate;
+    uint32_t                    m_SegmentEnd;     // timecode after the last run of the current segment
+
+    // written by the writer only
+    std::atomic<uint64_t>       m_Rejected;
+    std::atomic<uint64_t>       m_Untimed;
+    std::atomic<uint64_t>       m_RunsFull;
+
+    CTimecodeIndex( const CTimecodeIndex& );
+    CTimecodeIndex& operator=( const CTimecodeIndex& );
+
+    static void Increment( std::atomic<uint64_t>& counter )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+
+    bool Map( size_t size, bool writable );
+    bool Grow( uint64_t entries );
+    void StartRun( uint32_t count, uint8_t rate );
+
+public:
+    CTimecodeIndex();
+    ~CTimecodeIndex();
+
+    // Creates (or replaces) the file for at most maxEntries frames and maxRuns runs, stream times in timeScale.
+    // false if the file cannot be created or mapped; errno tells why.
+    bool Create( const char* path, BMDTimeScale timeScale, uint64_t maxEntries, uint32_t maxRuns );
+
+    // Opens an index for reading, complete or still being written. false if it cannot be read or is not an index
+    // of this version.
+    bool Open( const char* path );
+
+    // Reader of an opened file. Maps what the writer has added since; false if the file went away.
+    bool Refresh();
+
+    // The writer marks the index complete and cuts the file to its entries; either way the file is closed.
+    void Close();
+
+    bool IsOpen() const  { return m_pHeader != NULL; }
+    BMDTimeScale TimeScale() const  { return m_pHeader ? m_pHeader->timeScale : 0; }
+    bool Complete() const;
+
+    // Writer. streamTime: in the index's time scale, after the last frame's. rate: TimecodeRate() of the frame's
+    // timecode, 0 = the frame has none. false if the frame could not be indexed.
+    bool Append( BMDTimeValue streamTime, uint64_t offset, uint32_t size, BMDTimecodeBCD bcd, uint8_t rate );
+
+    // Readers. Frames indexed so far, and one of them; false if index is out of range.
+    uint64_t Entries() const;
+    bool GetEntry( uint64_t index, STimecodeIndexEntry* pEntry ) const;
+
+    // Readers. The last frame whose stream time is at or before streamTime, i.e. the one showing at that time; false
+    // if streamTime is before the first frame.
+    bool SeekStreamTime( BMDTimeValue streamTime, uint64_t* pIndex ) const;
+
+    // Readers. The first frame recorded with the timecode, read in the rate of each segment; false if there is none.
+    bool SeekTimecode( BMDTimecodeBCD bcd, uint64_t* pIndex ) const;
+
+    void GetStats( SStats* pStats ) const;
+};
+#endif // _WIN32
+
+#endif // TIMECODE_INDEX_H
@@ -0,0 +1,698 @@
+#include <string.h>
+
+#include "DisplayModes.h"
+#include "V210.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define V210_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define V210_TARGET(isa)
+#else
+#define V210_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define V210_SSE2
+#include <emmintrin.h>
+#endif
+
+//=====================================================================================================================
+// Plain C, also used for the pixels after the last whole block the SIMD kernels can write.
+static inline void UnpackBlock( const uint32_t* p, uint16_t* y, uint16_t* u, uint16_t* v )
+{
+    const uint32_t w0 = p[0], w1 = p[1], w2 = p[2], w3 = p[3];
+
+    u[0] = w0 & 0x3FF;  y[0] = ( w0 >> 10 ) & 0x3FF;  v[0] = ( w0 >> 20 ) & 0x3FF;
+    y[1] = w1 & 0x3FF;  u[1] = ( w1 >> 10 ) & 0x3FF;  y[2] = ( w1 >> 20 ) & 0x3FF;
+    v[1] = w2 & 0x3FF;  y[3] = ( w2 >> 10 ) & 0x3FF;  u[2] = ( w2 >> 20 ) & 0x3FF;
+    y[4] = w3 & 0x3FF;  v[2] = ( w3 >> 10 ) & 0x3FF;  y[5] = ( w3 >> 20 ) & 0x3FF;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline uint32_t PackWord( unsigned a, unsigned b, unsigned c )
+{
+    return ( a & 0x3FF ) | ( b & 0x3FF ) << 10 | ( c & 0x3FF ) << 20;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static inline void PackBlock( const uint16_t* y, const uint16_t* u, const uint16_t* v, uint32_t* p )
+{
+    p[0] = PackWord( u[0], y[0], v[0] );
+    p[1] = PackWord( y[1], u[1], y[2] );
+    p[2] = PackWord( v[1], y[3], u[2] );
+    p[3] = PackWord( y[4], v[2], y[5] );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Pixels [from, width) of a row; from is a multiple of 6.
+static void UnpackTail( const uint32_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long from, long width )
+{
+    long x = from;
+
+    for( ; x + 6 <= width; x += 6 )
+    {
+        UnpackBlock( pSrc + x / 6 * 4, pY + x, pU + x / 2, pV + x / 2 );
+    }
+
+    if( x < width )
+    {
+        uint16_t y[6], u[3], v[3];
+        const long n = width - x;
+
+        UnpackBlock( pSrc + x / 6 * 4, y, u, v );
+        memcpy( pY + x, y, n * sizeof(uint16_t) );
+        memcpy( pU + x / 2, u, ( n + 1 ) / 2 * sizeof(uint16_t) );
+        memcpy( pV + x / 2, v, ( n + 1 ) / 2 * sizeof(uint16_t) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Zeroes the row after the last block up to the end of its 48-pixel group.
+static void ZeroPadding( uint32_t* pDst, long width )
+{
+    const long from = ( width + 5 ) / 6 * 4;
+    const long to = ( width + 47 ) / 48 * 32;
+
+    if( to > from )
+    {
+        memset( pDst + from, 0, ( to - from ) * sizeof(uint32_t) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PackTail( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint32_t* pDst, long from,
+                      long width )
+{
+    long x = from;
+
+    for( ; x + 6 <= width; x += 6 )
+    {
+        PackBlock( pY + x, pU + x / 2, pV + x / 2, pDst + x / 6 * 4 );
+    }
+
+    if( x < width )
+    {
+        uint16_t y[6] = { 0 }, u[3] = { 0 }, v[3] = { 0 };
+        const long n = width - x;
+
+        memcpy( y, pY + x, n * sizeof(uint16_t) );
+        memcpy( u, pU + x / 2, ( n + 1 ) / 2 * sizeof(uint16_t) );
+        memcpy( v, pV + x / 2, ( n + 1 ) / 2 * sizeof(uint16_t) );
+        PackBlock( y, u, v, pDst + x / 6 * 4 );
+    }
+
+    ZeroPadding( pDst, width );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void UnpackRowScalar( const uint32_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long width )
+{
+    UnpackTail( pSrc, pY, pU, pV, 0, width );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PackRowScalar( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint32_t* pDst, long width )
+{
+    PackTail( pY, pU, pV, pDst, 0, width );
+}
+
+#ifdef V210_X86
+//=====================================================================================================================
+// SSE4.1 and AVX2 work on one block per 128-bit lane. The three 10-bit fields of every word are masked out into
+// v0, v1 and v2; t = v0 | v1 << 16 then holds, as 16-bit lanes, Cb0 Y0 Y1 Cb2 Cr2 Y3 Y4 Cr4, and v2 holds Cr0 - Y2 -
+// Cb4 - Y5 -. Two byte shuffles of each give the Y samples and the Cb/Cr samples in order.
+static const int8_t s_ShufTY[16]   = { 2, 3, 4, 5, -1, -1, 10, 11, 12, 13, -1, -1, -1, -1, -1, -1 };
+static const int8_t s_ShufV2Y[16]  = { -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1 };
+static const int8_t s_ShufTUV[16]  = { 0, 1, 6, 7, -1, -1, -1, -1, -1, -1, 8, 9, 14, 15, -1, -1 };
+static const int8_t s_ShufV2UV[16] = { -1, -1, -1, -1, 8, 9, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1 };
+
+// Packing goes the other way: from Y0..Y7 and Cb0..Cb3 Cr0..Cr3 as 16-bit lanes, each shuffle puts one sample into
+// the low half of each word of v0 (Cb0 Y1 Cr2 Y4), v1 (Y0 Cb2 Y3 Cr4) or v2 (Cr0 Y2 Cb4 Y5).
+static const int8_t s_Shuf0Y[16]  = { -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, 8, 9, -1, -1 };
+static const int8_t s_Shuf0UV[16] = { 0, 1, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1 };
+static const int8_t s_Shuf1Y[16]  = { 0, 1, -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, -1, -1 };
+static const int8_t s_Shuf1UV[16] = { -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, 12, 13, -1, -1 };
+static const int8_t s_Shuf2Y[16]  = { -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1 };
+static const int8_t s_Shuf2UV[16] = { 8, 9, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1 };
+
+//---------------------------------------------------------------------------------------------------------------------
+// Each block's Y is stored as 8 samples and its Cb and Cr as 4, the excess being overwritten by the next block.
+V210_TARGET("sse4.1")
+static void UnpackRowSse41( const uint32_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long width )
+{
+    const __m128i mask = _mm_set1_epi32(0x3FF);
+    const __m128i shufTY = _mm_loadu_si128( (const __m128i*)s_ShufTY );
+    const __m128i shufV2Y = _mm_loadu_si128( (const __m128i*)s_ShufV2Y );
+    const __m128i shufTUV = _mm_loadu_si128( (const __m128i*)s_ShufTUV );
+    const __m128i shufV2UV = _mm_loadu_si128( (const __m128i*)s_ShufV2UV );
+    long x = 0;
+
+    for( ; x + 8 <= width; x += 6 )
+    {
+        const __m128i w = _mm_loadu_si128( (const __m128i*)( pSrc + x / 6 * 4 ) );
+        const __m128i v0 = _mm_and_si128( w, mask );
+        const __m128i v1 = _mm_and_si128( _mm_srli_epi32( w, 10 ), mask );
+        const __m128i v2 = _mm_and_si128( _mm_srli_epi32( w, 20 ), mask );
+        const __m128i t = _mm_or_si128( v0, _mm_slli_epi32( v1, 16 ) );
+        const __m128i y = _mm_or_si128( _mm_shuffle_epi8( t, shufTY ), _mm_shuffle_epi8( v2, shufV2Y ) );
+        const __m128i uv = _mm_or_si128( _mm_shuffle_epi8( t, shufTUV ), _mm_shuffle_epi8( v2, shufV2UV ) );
+
+        _mm_storeu_si128( (__m128i*)( pY + x ), y );
+        _mm_storel_epi64( (__m128i*)( pU + x / 2 ), uv );
+        _mm_storel_epi64( (__m128i*)( pV + x / 2 ), _mm_srli_si128( uv, 8 ) );
+    }
+
+    UnpackTail( pSrc, pY, pU, pV, x, width );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+V210_TARGET("sse4.1")
+static void PackRowSse41( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint32_t* pDst, long width )
+{
+    const __m128i mask = _mm_set1_epi16(0x3FF);
+    const __m128i shuf0Y = _mm_loadu_si128( (const __m128i*)s_Shuf0Y );
+    const __m128i shuf0UV = _mm_loadu_si128( (const __m128i*)s_Shuf0UV );
+    const __m128i shuf1Y = _mm_loadu_si128( (const __m128i*)s_Shuf1Y );
+    const __m128i shuf1UV = _mm_loadu_si128( (const __m128i*)s_Shuf1UV );
+    const __m128i shuf2Y = _mm_loadu_si128( (const __m128i*)s_Shuf2Y );
+    const __m128i shuf2UV = _mm_loadu_si128( (const __m128i*)s_Shuf2UV );
+    long x = 0;
+
+    for( ; x + 8 <= width; x += 6 )
+    {
+        const __m128i y = _mm_and_si128( _mm_loadu_si128( (const __m128i*)( pY + x ) ), mask );
+        const __m128i uv = _mm_and_si128( _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)( pU + x / 2 ) ),
+                                                              _mm_loadl_epi64( (const __m128i*)( pV + x / 2 ) ) ),
+                                          mask );
+        const __m128i v0 = _mm_or_si128( _mm_shuffle_epi8( y, shuf0Y ), _mm_shuffle_epi8( uv, shuf0UV ) );
+        const __m128i v1 = _mm_or_si128( _mm_shuffle_epi8( y, shuf1Y ), _mm_shuffle_epi8( uv, shuf1UV ) );
+        const __m128i v2 = _mm_or_si128( _mm_shuffle_epi8( y, shuf2Y ), _mm_shuffle_epi8( uv, shuf2UV ) );
+        const __m128i w = _mm_or_si128( _mm_or_si128( v0, _mm_slli_epi32( v1, 10 ) ), _mm_slli_epi32( v2, 20 ) );
+
+        _mm_storeu_si128( (__m128i*)( pDst + x / 6 * 4 ), w );
+    }
+
+    PackTail( pY, pU, pV, pDst, x, width );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Two blocks at a time, one per lane. The Y halves are joined with a cross-lane permute; Cb and Cr, three samples a
+// lane, are stored per lane.
+V210_TARGET("avx2")
+static void UnpackRowAvx2( const uint32_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long width )
+{
+    const __m256i mask = _mm256_set1_epi32(0x3FF);
+    const __m256i shufTY = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_ShufTY ) );
+    const __m256i shufV2Y = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_ShufV2Y ) );
+    const __m256i shufTUV = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_ShufTUV ) );
+    const __m256i shufV2UV = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_ShufV2UV ) );
+    const __m256i joinY = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 7, 7 );
+    long x = 0;
+
+    for( ; x + 16 <= width; x += 12 )
+    {
+        const __m256i w = _mm256_loadu_si256( (const __m256i*)( pSrc + x / 6 * 4 ) );
+        const __m256i v0 = _mm256_and_si256( w, mask );
+        const __m256i v1 = _mm256_and_si256( _mm256_srli_epi32( w, 10 ), mask );
+        const __m256i v2 = _mm256_and_si256( _mm256_srli_epi32( w, 20 ), mask );
+        const __m256i t = _mm256_or_si256( v0, _mm256_slli_epi32( v1, 16 ) );
+        const __m256i y = _mm256_or_si256( _mm256_shuffle_epi8( t, shufTY ), _mm256_shuffle_epi8( v2, shufV2Y ) );
+        const __m256i uv = _mm256_or_si256( _mm256_shuffle_epi8( t, shufTUV ), _mm256_shuffle_epi8( v2, shufV2UV ) );
+        const __m128i uvA = _mm256_castsi256_si128(uv);
+        const __m128i uvB = _mm256_extracti128_si256( uv, 1 );
+
+        _mm256_storeu_si256( (__m256i*)( pY + x ), _mm256_permutevar8x32_epi32( y, joinY ) );
+        _mm_storel_epi64( (__m128i*)( pU + x / 2 ), uvA );
+        _mm_storel_epi64( (__m128i*)( pU + x / 2 + 3 ), uvB );
+        _mm_storel_epi64( (__m128i*)( pV + x / 2 ), _mm_srli_si128( uvA, 8 ) );
+        _mm_storel_epi64( (__m128i*)( pV + x / 2 + 3 ), _mm_srli_si128( uvB, 8 ) );
+    }
+
+    UnpackTail( pSrc, pY, pU, pV, x, width );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+V210_TARGET("avx2")
+static void PackRowAvx2( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint32_t* pDst, long width )
+{
+    const __m256i mask = _mm256_set1_epi16(0x3FF);
+    const __m256i shuf0Y = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_Shuf0Y ) );
+    const __m256i shuf0UV = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_Shuf0UV ) );
+    const __m256i shuf1Y = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_Shuf1Y ) );
+    const __m256i shuf1UV = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_Shuf1UV ) );
+    const __m256i shuf2Y = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_Shuf2Y ) );
+    const __m256i shuf2UV = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)s_Shuf2UV ) );
+    long x = 0;
+
+    for( ; x + 16 <= width; x += 12 )
+    {
+        const __m128i uvA = _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)( pU + x / 2 ) ),
+                                                _mm_loadl_epi64( (const __m128i*)( pV + x / 2 ) ) );
+        const __m128i uvB = _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)( pU + x / 2 + 3 ) ),
+                                                _mm_loadl_epi64( (const __m128i*)( pV + x / 2 + 3 ) ) );
+        const __m256i y = _mm256_and_si256( _mm256_inserti128_si256(
+                                                _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)( pY + x ) ) ),
+                                                _mm_loadu_si128( (const __m128i*)( pY + x + 6 ) ), 1 ), mask );
+        const __m256i uv = _mm256_and_si256( _mm256_inserti128_si256( _mm256_castsi128_si256(uvA), uvB, 1 ), mask );
+        const __m256i v0 = _mm256_or_si256( _mm256_shuffle_epi8( y, shuf0Y ), _mm256_shuffle_epi8( uv, shuf0UV ) );
+        const __m256i v1 = _mm256_or_si256( _mm256_shuffle_epi8( y, shuf1Y ), _mm256_shuffle_epi8( uv, shuf1UV ) );
+        const __m256i v2 = _mm256_or_si256( _mm256_shuffle_epi8( y, shuf2Y ), _mm256_shuffle_epi8( uv, shuf2UV ) );
+        const __m256i w = _mm256_or_si256( _mm256_or_si256( v0, _mm256_slli_epi32( v1, 10 ) ),
+                                           _mm256_slli_epi32( v2, 20 ) );
+
+        _mm256_storeu_si256( (__m256i*)( pDst + x / 6 * 4 ), w );
+    }
+
+    PackTail( pY, pU, pV, pDst, x, width );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// AVX-512 does four blocks (24 pixels) at a time with two-source 16-bit permutes, which can gather across the whole
+// register, and masked loads and stores, which also take care of the end of the row.
+//
+// Unpack: sources are t (0..31) and v2 (32..63) as above, block b in lanes 8b..8b+7.
+static const uint16_t s_UnpackIdxY[32] =
+{
+    1, 2, 34, 5, 6, 38,   9, 10, 42, 13, 14, 46,   17, 18, 50, 21, 22, 54,   25, 26, 58, 29, 30, 62,
+};
+static const uint16_t s_UnpackIdxU[32] = { 0, 3, 36,   8, 11, 44,   16, 19, 52,   24, 27, 60 };
+static const uint16_t s_UnpackIdxV[32] = { 32, 4, 7,   40, 12, 15,   48, 20, 23,   56, 28, 31 };
+
+// Pack: sources are Y0..Y23 (0..31) and Cb0..Cb11, Cr0..Cr11 (32..43, 48..59); one sample in the even lane of each
+// word of v0, v1 and v2, the odd lanes are zeroed.
+static const uint16_t s_PackIdx0[32] =
+{
+    32, 0, 1, 0, 49, 0, 4, 0,    35, 0, 7, 0, 52, 0, 10, 0,
+    38, 0, 13, 0, 55, 0, 16, 0,    41, 0, 19, 0, 58, 0, 22, 0,
+};
+static const uint16_t s_PackIdx1[32] =
+{
+    0, 0, 33, 0, 3, 0, 50, 0,    6, 0, 36, 0, 9, 0, 53, 0,
+    12, 0, 39, 0, 15, 0, 56, 0,    18, 0, 42, 0, 21, 0, 59, 0,
+};
+static const uint16_t s_PackIdx2[32] =
+{
+    48, 0, 2, 0, 34, 0, 5, 0,    51, 0, 8, 0, 37, 0, 11, 0,
+    54, 0, 14, 0, 40, 0, 17, 0,    57, 0, 20, 0, 43, 0, 23, 0,
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// GCC 12's AVX-512 headers trip -Wmaybe-uninitialized on their own _mm512_undefined_epi32().
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+V210_TARGET("avx512f,avx512bw")
+static void UnpackRowAvx512( const uint32_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long width )
+{
+    const __m512i mask = _mm512_set1_epi32(0x3FF);
+    const __m512i idxY = _mm512_loadu_si512( s_UnpackIdxY );
+    const __m512i idxU = _mm512_loadu_si512( s_UnpackIdxU );
+    const __m512i idxV = _mm512_loadu_si512( s_UnpackIdxV );
+
+    for( long x = 0; x < width; x += 24 )
+    {
+        const long n = ( width - x < 24 ) ? width - x : 24;
+        const long chroma = ( n + 1 ) / 2;
+        const __mmask16 words = (__mmask16)( ( 1u << ( ( n + 5 ) / 6 * 4 ) ) - 1 );
+
+        const __m512i w = _mm512_maskz_loadu_epi32( words, pSrc + x / 6 * 4 );
+        const __m512i v0 = _mm512_and_si512( w, mask );
+        const __m512i v1 = _mm512_and_si512( _mm512_srli_epi32( w, 10 ), mask );
+        const __m512i v2 = _mm512_and_si512( _mm512_srli_epi32( w, 20 ), mask );
+        const __m512i t = _mm512_or_si512( v0, _mm512_slli_epi32( v1, 16 ) );
+
+        _mm512_mask_storeu_epi16( pY + x, (__mmask32)( ( 1ull << n ) - 1 ), _mm512_permutex2var_epi16( t, idxY, v2 ) );
+        _mm512_mask_storeu_epi16( pU + x / 2, (__mmask32)( ( 1ull << chroma ) - 1 ),
+                                  _mm512_permutex2var_epi16( t, idxU, v2 ) );
+        _mm512_mask_storeu_epi16( pV + x / 2, (__mmask32)( ( 1ull << chroma ) - 1 ),
+                                  _mm512_permutex2var_epi16( t, idxV, v2 ) );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+V210_TARGET("avx512f,avx512bw")
+static void PackRowAvx512( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint32_t* pDst, long width )
+{
+    const __m512i mask = _mm512_set1_epi16(0x3FF);
+    const __m512i idx0 = _mm512_loadu_si512( s_PackIdx0 );
+    const __m512i idx1 = _mm512_loadu_si512( s_PackIdx1 );
+    const __m512i idx2 = _mm512_loadu_si512( s_PackIdx2 );
+    const __mmask32 even = 0x55555555;
+
+    for( long x = 0; x < width; x += 24 )
+    {
+        const long n = ( width - x < 24 ) ? width - x : 24;
+        const __mmask32 chroma = (__mmask32)( ( 1ull << ( ( n + 1 ) / 2 ) ) - 1 );
+        const __mmask16 words = (__mmask16)( ( 1u << ( ( n + 5 ) / 6 * 4 ) ) - 1 );
+
+        const __m512i y = _mm512_and_si512( _mm512_maskz_loadu_epi16( (__mmask32)( ( 1ull << n ) - 1 ), pY + x ),
+                                            mask );
+        const __m512i u = _mm512_maskz_loadu_epi16( chroma, pU + x / 2 );
+        const __m512i v = _mm512_maskz_loadu_epi16( chroma, pV + x / 2 );
+        const __m512i uv = _mm512_and_si512( _mm512_inserti64x4( u, _mm512_castsi512_si256(v), 1 ), mask );
+
+        const __m512i v0 = _mm512_maskz_permutex2var_epi16( even, y, idx0, uv );
+        const __m512i v1 = _mm512_maskz_permutex2var_epi16( even, y, idx1, uv );
+        const __m512i v2 = _mm512_maskz_permutex2var_epi16( even, y, idx2, uv );
+        const __m512i w = _mm512_or_si512( _mm512_or_si512( v0, _mm512_slli_epi32( v1, 10 ) ),
+                                           _mm512_slli_epi32( v2, 20 ) );
+
+        _mm512_mask_storeu_epi32( pDst + x / 6 * 4, words, w );
+    }
+
+    ZeroPadding( pDst, width );
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // V210_X86
+
+//---------------------------------------------------------------------------------------------------------------------
+#ifdef V210_X86
+static const SV210Kernels s_Kernels[kIsaCount] =
+{
+    { kIsaScalar, "scalar",  UnpackRowScalar, PackRowScalar },
+    { kIsaSse41,  "sse4.1",  UnpackRowSse41,  PackRowSse41  },
+    { kIsaAvx2,   "avx2",    UnpackRowAvx2,   PackRowAvx2   },
+    { kIsaAvx512, "avx512",  UnpackRowAvx512, PackRowAvx512 },
+};
+#else
+static const SV210Kernels s_Kernels[kIsaCount] =
+{
+    { kIsaScalar, "scalar",  UnpackRowScalar, PackRowScalar },
+};
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+const SV210Kernels* GetV210Kernels( ECpuIsa isa )
+{
+    return HasCpuIsa(isa) ? &s_Kernels[isa] : NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const SV210Kernels* GetV210Kernels()
+{
+    static const SV210Kernels* s_pBest = GetV210Kernels( BestCpuIsa() );
+
+    return s_pBest;
+}
+
+//=====================================================================================================================
+// Sample conversions between the kernels' rows and the 8-bit and P010 layouts. They run on rows still in L1, so
+// SSE2, which every x86-64 CPU has, is enough.
+static void Narrow10To8( const uint16_t* pSrc, uint8_t* pDst, long n )
+{
+    long i = 0;
+
+#ifdef V210_SSE2
+    const __m128i round = _mm_set1_epi16(2);
+
+    for( ; i + 16 <= n; i += 16 )
+    {
+        const __m128i a = _mm_srli_epi16( _mm_add_epi16( _mm_loadu_si128( (const __m128i*)( pSrc + i ) ), round ), 2 );
+        const __m128i b = _mm_srli_epi16( _mm_add_epi16( _mm_loadu_si128( (const __m128i*)( pSrc + i + 8 ) ), round ),
+                                          2 );
+        _mm_storeu_si128( (__m128i*)( pDst + i ), _mm_packus_epi16( a, b ) );
+    }
+#endif
+
+    for( ; i < n; ++i )
+    {
+        const unsigned s = ( pSrc[i] + 2u ) >> 2;
+        pDst[i] = (uint8_t)( s > 255 ? 255 : s );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void Widen8To10( const uint8_t* pSrc, uint16_t* pDst, long n )
+{
+    long i = 0;
+
+#ifdef V210_SSE2
+    const __m128i zero = _mm_setzero_si128();
+
+    for( ; i + 16 <= n; i += 16 )
+    {
+        const __m128i s = _mm_loadu_si128( (const __m128i*)( pSrc + i ) );
+        _mm_storeu_si128( (__m128i*)( pDst + i ), _mm_slli_epi16( _mm_unpacklo_epi8( s, zero ), 2 ) );
+        _mm_storeu_si128( (__m128i*)( pDst + i + 8 ), _mm_slli_epi16( _mm_unpackhi_epi8( s, zero ), 2 ) );
+    }
+#endif
+
+    for( ; i < n; ++i )
+    {
+        pDst[i] = (uint16_t)( pSrc[i] << 2 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// left: to the high bits of P010, otherwise back
+static void ShiftSamples( const uint16_t* pSrc, uint16_t* pDst, long n, bool left )
+{
+    long i = 0;
+
+#ifdef V210_SSE2
+    for( ; i + 8 <= n; i += 8 )
+    {
+        const __m128i s = _mm_loadu_si128( (const __m128i*)( pSrc + i ) );
+        _mm_storeu_si128( (__m128i*)( pDst + i ), left ? _mm_slli_epi16( s, 6 ) : _mm_srli_epi16( s, 6 ) );
+    }
+#endif
+
+    for( ; i < n; ++i )
+    {
+        pDst[i] = left ? (uint16_t)( pSrc[i] << 6 ) : (uint16_t)( pSrc[i] >> 6 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// P010 chroma from two rows: Cb/Cr pairs of the rounded averages, in the high bits.
+static void AverageInterleave( const uint16_t* pU0, const uint16_t* pV0, const uint16_t* pU1, const uint16_t* pV1,
+                               uint16_t* pDst, long n )
+{
+    long i = 0;
+
+#ifdef V210_SSE2
+    for( ; i + 8 <= n; i += 8 )
+    {
+        const __m128i u = _mm_avg_epu16( _mm_loadu_si128( (const __m128i*)( pU0 + i ) ),
+                                         _mm_loadu_si128( (const __m128i*)( pU1 + i ) ) );
+        const __m128i v = _mm_avg_epu16( _mm_loadu_si128( (const __m128i*)( pV0 + i ) ),
+                                         _mm_loadu_si128( (const __m128i*)( pV1 + i ) ) );
+        _mm_storeu_si128( (__m128i*)( pDst + 2 * i ), _mm_slli_epi16( _mm_unpacklo_epi16( u, v ), 6 ) );
+        _mm_storeu_si128( (__m128i*)( pDst + 2 * i + 8 ), _mm_slli_epi16( _mm_unpackhi_epi16( u, v ), 6 ) );
+    }
+#endif
+
+    for( ; i < n; ++i )
+    {
+        pDst[2 * i] = (uint16_t)( ( ( pU0[i] + pU1[i] + 1 ) >> 1 ) << 6 );
+        pDst[2 * i + 1] = (uint16_t)( ( ( pV0[i] + pV1[i] + 1 ) >> 1 ) << 6 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void Deinterleave( const uint16_t* pSrc, uint16_t* pU, uint16_t* pV, long n )
+{
+    long i = 0;
+
+#ifdef V210_SSE2
+    const __m128i low = _mm_set1_epi32(0xFFFF);
+
+    for( ; i + 8 <= n; i += 8 )
+    {
+        const __m128i a = _mm_srli_epi16( _mm_loadu_si128( (const __m128i*)( pSrc + 2 * i ) ), 6 );
+        const __m128i b = _mm_srli_epi16( _mm_loadu_si128( (const __m128i*)( pSrc + 2 * i + 8 ) ), 6 );
+
+        // 10-bit values, so the signed saturation of packs never applies
+        _mm_storeu_si128( (__m128i*)( pU + i ), _mm_packs_epi32( _mm_and_si128( a, low ), _mm_and_si128( b, low ) ) );
+        _mm_storeu_si128( (__m128i*)( pV + i ), _mm_packs_epi32( _mm_srli_epi32( a, 16 ), _mm_srli_epi32( b, 16 ) ) );
+    }
+#endif
+
+    for( ; i < n; ++i )
+    {
+        pU[i] = (uint16_t)( pSrc[2 * i] >> 6 );
+        pV[i] = (uint16_t)( pSrc[2 * i + 1] >> 6 );
+    }
+}
+
+//=====================================================================================================================
+// The 8-bit and P010 layouts go through rows of kChunk pixels on the stack; a multiple of 48, so that only the last
+// chunk of a row has padding.
+static const long kChunk = 3072;
+
+template< class T >
+static inline T* Row( void* pBase, ptrdiff_t stride, long row )
+{
+    return (T*)( (uint8_t*)pBase + stride * row );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool UnpackV210( const void* pSrc, long srcRowBytes, long width, long height, EPlanarFormat format,
+                 const SPlanarImage& dst, const SV210Kernels* pKernels )
+{
+    if( pKernels == NULL )
+    {
+        pKernels = GetV210Kernels();
+    }
+
+    if( pSrc == NULL || width <= 0 || height <= 0 ||
+        srcRowBytes < RowBytesForPixelFormat( bmdFormat10BitYUV, width ) )
+    {
+        return false;
+    }
+
+    uint16_t y[kChunk], u0[kChunk / 2], v0[kChunk / 2], u1[kChunk / 2], v1[kChunk / 2];
+
+    for( long row = 0; row < height; ++row )
+    {
+        const uint32_t* pRow = Row<const uint32_t>( (void*)pSrc, srcRowBytes, row );
+
+        switch( format )
+        {
+        case kPlanarI422P10:
+            pKernels->unpackRow( pRow, Row<uint16_t>( dst.pPlane[0], dst.stride[0], row ),
+                                 Row<uint16_t>( dst.pPlane[1], dst.stride[1], row ),
+                                 Row<uint16_t>( dst.pPlane[2], dst.stride[2], row ), width );
+            break;
+
+        case kPlanarI422P8:
+            for( long x = 0; x < width; x += kChunk )
+            {
+                const long n = ( width - x < kChunk ) ? width - x : kChunk;
+
+                pKernels->unpackRow( pRow + x / 6 * 4, y, u0, v0, n );
+                Narrow10To8( y, Row<uint8_t>( dst.pPlane[0], dst.stride[0], row ) + x, n );
+                Narrow10To8( u0, Row<uint8_t>( dst.pPlane[1], dst.stride[1], row ) + x / 2, ( n + 1 ) / 2 );
+                Narrow10To8( v0, Row<uint8_t>( dst.pPlane[2], dst.stride[2], row ) + x / 2, ( n + 1 ) / 2 );
+            }
+            break;
+
+        case kPlanarP010:
+            {
+                // rows in pairs; a last odd row has its chroma to itself
+                const uint32_t* pNext = ( row + 1 < height ) ? Row<const uint32_t>( (void*)pSrc, srcRowBytes, row + 1 )
+                                                             : NULL;
+
+                for( long x = 0; x < width; x += kChunk )
+                {
+                    const long n = ( width - x < kChunk ) ? width - x : kChunk;
+
+                    pKernels->unpackRow( pRow + x / 6 * 4, y, u0, v0, n );
+                    ShiftSamples( y, Row<uint16_t>( dst.pPlane[0], dst.stride[0], row ) + x, n, true );
+
+                    if( pNext != NULL )
+                    {
+                        pKernels->unpackRow( pNext + x / 6 * 4, y, u1, v1, n );
+                        ShiftSamples( y, Row<uint16_t>( dst.pPlane[0], dst.stride[0], row + 1 ) + x, n, true );
+                    }
+
+                    AverageInterleave( u0, v0, pNext ? u1 : u0, pNext ? v1 : v0,
+                                       Row<uint16_t>( dst.pPlane[1], dst.stride[1], row / 2 ) + x, ( n + 1 ) / 2 );
+                }
+
+                ++row;
+            }
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool PackV210( const SPlanarImage& src, EPlanarFormat format, long width, long height, void* pDst, long dstRowBytes,
+               const SV210Kernels* pKernels )
+{
+    if( pKernels == NULL )
+    {
+        pKernels = GetV210Kernels();
+    }
+
+    if( pDst == NULL || width <= 0 || height <= 0 ||
+        dstRowBytes < RowBytesForPixelFormat( bmdFormat10BitYUV, width ) )
+    {
+        return false;
+    }
+
+    uint16_t y[kChunk], u[kChunk / 2], v[kChunk / 2];
+
+    for( long row = 0; row < height; ++row )
+    {
+        uint32_t* pRow = Row<uint32_t>( pDst, dstRowBytes, row );
+
+        switch( format )
+        {
+        case kPlanarI422P10:
+            pKernels->packRow( Row<uint16_t>( src.pPlane[0], src.stride[0], row ),
+                               Row<uint16_t>( src.pPlane[1], src.stride[1], row ),
+                               Row<uint16_t>( src.pPlane[2], src.stride[2], row ), pRow, width );
+            break;
+
+        case kPlanarI422P8:
+            for( long x = 0; x < width; x += kChunk )
+            {
+                const long n = ( width - x < kChunk ) ? width - x : kChunk;
+
+                Widen8To10( Row<uint8_t>( src.pPlane[0], src.stride[0], row ) + x, y, n );
+                Widen8To10( Row<uint8_t>( src.pPlane[1], src.stride[1], row ) + x / 2, u, ( n + 1 ) / 2 );
+                Widen8To10( Row<uint8_t>( src.pPlane[2], src.stride[2], row ) + x / 2, v, ( n + 1 ) / 2 );
+                pKernels->packRow( y, u, v, pRow + x / 6 * 4, n );
+            }
+            break;
+
+        case kPlanarP010:
+            for( long x = 0; x < width; x += kChunk )
+            {
+                const long n = ( width - x < kChunk ) ? width - x : kChunk;
+
+                ShiftSamples( Row<uint16_t>( src.pPlane[0], src.stride[0], row ) + x, y, n, false );
+                Deinterleave( Row<uint16_t>( src.pPlane[1], src.stride[1], row / 2 ) + x, u, v, ( n + 1 ) / 2 );
+                pKernels->packRow( y, u, v, pRow + x / 6 * 4, n );
+            }
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool UnpackV210Frame( IDeckLinkVideoFrame* pFrame, EPlanarFormat format, const SPlanarImage& dst )
+{
+    void* pBytes = NULL;
+
+    if( pFrame->GetPixelFormat() != bmdFormat10BitYUV || pFrame->GetBytes(&pBytes) != S_OK )
+    {
+        return false;
+    }
+
+    return UnpackV210( pBytes, pFrame->GetRowBytes(), pFrame->GetWidth(), pFrame->GetHeight(), format, dst );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool PackV210Frame( const SPlanarImage& src, EPlanarFormat format, IDeckLinkVideoFrame* pFrame )
+{
+    void* pBytes = NULL;
+
+    if( pFrame->GetPixelFormat() != bmdFormat10BitYUV || pFrame->GetBytes(&pBytes) != S_OK )
+    {
+        return false;
+    }
+
+    return PackV210( src, format, pFrame->GetWidth(), pFrame->GetHeight(), pBytes, pFrame->GetRowBytes() );
+}
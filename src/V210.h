@@ -0,0 +1,65 @@
+#ifndef V210_H
+#define V210_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CpuFeatures.h"
+#include "DeckLinkPlatform.h"
+
+//=====================================================================================================================
+// bmdFormat10BitYUV (v210) to and from the planar layouts encoders take.
+//
+// A v210 row is a sequence of 16-byte blocks of six pixels: four little-endian 32-bit words holding three 10-bit
+// samples each, Cb0 Y0 Cr0 / Y1 Cb2 Y2 / Cr2 Y3 Cb4 / Y4 Cr4 Y5 from the low bits up. Rows are padded to 48 pixels
+// (128 bytes) and may be further apart; the stride always comes from the caller or GetRowBytes().
+//
+// The row kernels exist for SSE4.1, AVX2 and AVX-512 (F + BW) besides plain C, compiled into the same binary and
+// chosen at run time by CpuFeatures.h; no compiler flags are needed. Within a row they write whole blocks,
+// overlapping the next block's output, and finish the last few pixels separately, so they never write past the row's
+// width.
+
+struct SV210Kernels
+{
+    ECpuIsa   isa;
+    const char*  name;
+
+    // width pixels; pY holds width samples, pU and pV (width + 1) / 2 each, 10 bits in the low bits
+    void (*unpackRow)( const uint32_t* pSrc, uint16_t* pY, uint16_t* pU, uint16_t* pV, long width );
+
+    // samples above 10 bits are ignored; the row is zeroed after the last pixel up to the end of its 48-pixel group
+    void (*packRow)( const uint16_t* pY, const uint16_t* pU, const uint16_t* pV, uint32_t* pDst, long width );
+};
+
+// Best kernels the CPU and OS support.
+const SV210Kernels* GetV210Kernels();
+
+// NULL if the CPU or OS does not support isa.
+const SV210Kernels* GetV210Kernels( ECpuIsa isa );
+
+//---------------------------------------------------------------------------------------------------------------------
+enum EPlanarFormat
+{
+    kPlanarI422P10,      // Y, Cb, Cr planes of uint16_t, 10 bits in the low bits (yuv422p10le)
+    kPlanarI422P8,       // Y, Cb, Cr planes of uint8_t, rounded (yuv422p)
+    kPlanarP010,         // 4:2:0: Y plane and interleaved Cb/Cr plane of uint16_t, 10 bits in the high bits;
+                         // chroma of each pair of rows is averaged on unpack, and repeated on pack
+};
+
+struct SPlanarImage
+{
+    void*      pPlane[3];     // unused planes are ignored
+    ptrdiff_t  stride[3];     // bytes
+};
+
+// pKernels NULL = GetV210Kernels(). Return false for sizes or formats they cannot handle.
+bool UnpackV210( const void* pSrc, long srcRowBytes, long width, long height, EPlanarFormat format,
+                 const SPlanarImage& dst, const SV210Kernels* pKernels = NULL );
+bool PackV210( const SPlanarImage& src, EPlanarFormat format, long width, long height, void* pDst, long dstRowBytes,
+               const SV210Kernels* pKernels = NULL );
+
+// The same on a frame's buffer, with its geometry and GetRowBytes(); false unless it is bmdFormat10BitYUV.
+bool UnpackV210Frame( IDeckLinkVideoFrame* pFrame, EPlanarFormat format, const SPlanarImage& dst );
+bool PackV210Frame( const SPlanarImage& src, EPlanarFormat format, IDeckLinkVideoFrame* pFrame );
+
+#endif // V210_H
@@ -0,0 +1,76 @@
+#include <stdexcept>
+
+#include "WakeEvent.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+//=====================================================================================================================
+// The sleeper counts itself before it looks at the state, and Set() changes the state before it looks at the count:
+// either Set() sees the sleeper, or the sleeper sees the state set.
+CWakeEvent::CWakeEvent()
+    : m_State(0), m_Sleepers(0)
+{
+#if defined(_WIN32)
+    m_hEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+
+    if( m_hEvent == NULL )
+    {
+        throw std::runtime_error("creating the wake event failed");
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CWakeEvent::~CWakeEvent()
+{
+#if defined(_WIN32)
+    CloseHandle(m_hEvent);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CWakeEvent::Set()
+{
+    if( m_State.exchange(1) != 0 || m_Sleepers.load() == 0 )
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    SetEvent(m_hEvent);
+#elif defined(__linux__)
+    syscall( SYS_futex, reinterpret_cast<int*>(&m_State), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0 );
+#else
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Cond.notify_one();
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CWakeEvent::Wait()
+{
+#if !defined(_WIN32) && !defined(__linux__)
+    std::unique_lock<std::mutex> lock(m_Mutex);
+#endif
+
+    m_Sleepers.fetch_add(1);
+
+    while( m_State.exchange(0) == 0 )
+    {
+#if defined(_WIN32)
+        // an event left signalled by an earlier Set() only costs another round
+        WaitForSingleObject( m_hEvent, INFINITE );
+#elif defined(__linux__)
+        // returns at once if the state is no longer 0
+        syscall( SYS_futex, reinterpret_cast<int*>(&m_State), FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0 );
+#else
+        m_Cond.wait(lock);
+#endif
+    }
+
+    m_Sleepers.fetch_sub(1);
+}
@@ -0,0 +1,47 @@
+#ifndef WAKE_EVENT_H
+#define WAKE_EVENT_H
+
+#include <atomic>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif !defined(__linux__)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+//=====================================================================================================================
+// An auto-reset event for threads which sleep until another one has work for them, set without taking a lock.
+//
+//     Linux     a futex on the state word
+//     Windows   an auto-reset event object
+//     macOS     a mutex and a condition variable; Set() takes the mutex when a thread sleeps
+//
+// Set() wakes one sleeping thread, or lets the next Wait() return at once if none sleeps; Set() calls before a Wait()
+// do not add up. Set() only enters the kernel when a thread sleeps, so producers can call it after every item; the
+// sleeper has to check for work again after waking, as with a condition variable.
+class CWakeEvent
+{
+    std::atomic<int>         m_State;        // 1 = set
+    std::atomic<unsigned>    m_Sleepers;     // in Wait()
+#if defined(_WIN32)
+    HANDLE                   m_hEvent;
+#elif !defined(__linux__)
+    std::mutex               m_Mutex;
+    std::condition_variable  m_Cond;
+#endif
+
+    CWakeEvent( const CWakeEvent& );
+    CWakeEvent& operator=( const CWakeEvent& );
+
+public:
+    CWakeEvent();       // throws std::runtime_error
+    ~CWakeEvent();
+
+    void Set();
+
+    // Returns once the event is set, resetting it.
+    void Wait();
+};
+
+#endif // WAKE_EVENT_H
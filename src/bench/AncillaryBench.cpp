@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../Ancillary.h"
+#include "../DisplayModes.h"
+#include "Bench.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintAncillaryUsage()
+{
+    fprintf( stderr,
+        "Usage: vanc [--mode <name>] [--frames N]\n"
+        "\n"
+        "Scanning the VANC lines of a frame for SMPTE 291 packets: unpacking every sample and matching the flag in\n"
+        "each stream, as a byte-by-byte parser would, then ScanAncillaryLine() with each kernel the CPU supports. The\n"
+        "lines are blank but for a few packets, one of them with a bad checksum; every scan must find the same ones.\n"
+        "Then inserting a caption, an AFD and an SCTE-104 packet per frame: blanking the lines and writing each\n"
+        "packet sample by sample, then CAncillaryInserter with each kernel; every frame is scanned back.\n"
+        "Defaults: 1080i59.94, 2000 frames.\n" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static unsigned Parity( unsigned byte )
+{
+    byte ^= byte >> 4;
+    byte ^= byte >> 2;
+    byte ^= byte >> 1;
+    return byte & 1;
+}
+
+//=====================================================================================================================
+// VANC lines of one frame in v210, blank (Cb Cr 200, Y 040).
+struct SBenchVanc
+{
+    long                               width;
+    long                               rowBytes;
+    bool                               multiplexed;
+    std::vector<uint16_t>              lines;
+    std::vector<std::vector<uint32_t>> buffers;
+
+    SBenchVanc( const SDisplayModeDesc* pMode )
+        : width(pMode->width), rowBytes( RowBytesForPixelFormat( bmdFormat10BitYUV, pMode->width ) ),
+          multiplexed( pMode->height <= 576 )
+    {
+        uint16_t numbers[CAncillaryQueue::kMaxLines];
+
+        lines.assign( numbers, numbers + AncillaryLines( pMode->mode, numbers, CAncillaryQueue::kMaxLines ) );
+        buffers.resize( lines.size() );
+
+        for( size_t i = 0; i < lines.size(); ++i )
+        {
+            buffers[i].assign( rowBytes / 4, 0 );
+            Blank(i);
+        }
+    }
+
+    void Blank( size_t line )
+    {
+        for( size_t s = 0; s < (size_t)width * 2; ++s )
+        {
+            Set( line, s, ( s & 1 ) ? 0x040 : 0x200 );
+        }
+    }
+
+    void Set( size_t line, size_t s, unsigned value )
+    {
+        uint32_t& word = buffers[line][s / 3];
+        word = ( word & ~( 0x3FFu << ( s % 3 * 10 ) ) ) | ( value << ( s % 3 * 10 ) );
+    }
+
+    // At sample first of the multiplexed stream (odd = luma in HD); returns the sample after the checksum.
+    size_t Write( size_t line, size_t first, uint8_t did, uint8_t sdid, const uint8_t* pData, unsigned count,
+                  bool corrupt )
+    {
+        const size_t step = multiplexed ? 1 : 2;
+        size_t s = first;
+        unsigned sum = 0;
+
+        Set( line, s, 0x000 );
+        Set( line, s += step, 0x3FF );
+        Set( line, s += step, 0x3FF );
+
+        for( unsigned k = 0; k < 3 + count; ++k )
+        {
+            const unsigned byte = ( k == 0 ) ? did : ( k == 1 ) ? sdid : ( k == 2 ) ? count : pData[k - 3];
+            const unsigned parity = Parity(byte);
+            const unsigned word = byte | parity << 8 | ( parity ^ 1 ) << 9;
+
+            sum += word & 0x1FF;
+            Set( line, s += step, word );
+        }
+
+        sum = ( sum + corrupt ) & 0x1FF;
+        Set( line, s += step, sum | ( ( ~sum >> 8 ) & 1 ) << 9 );
+        return s + step;
+    }
+};
+
+//=====================================================================================================================
+// Ancillary data of an output frame, over the lines of an SBenchVanc. Lives on the stack.
+class CBenchAncillary : public IDeckLinkVideoFrameAncillary
+{
+    SBenchVanc*     m_pVanc;
+    BMDDisplayMode  m_Mode;
+
+public:
+    CBenchAncillary( SBenchVanc* pVanc, BMDDisplayMode mode ) : m_pVanc(pVanc), m_Mode(mode)  {}
+    virtual ~CBenchAncillary()  {}
+
+    // overrides IDeckLinkVideoFrameAncillary
+    virtual HRESULT STDMETHODCALLTYPE GetBufferForVerticalBlankingLine( uint32_t lineNumber, void** buffer )
+    {
+        for( size_t i = 0; i < m_pVanc->lines.size(); ++i )
+        {
+            if( m_pVanc->lines[i] == lineNumber )
+            {
+                *buffer = m_pVanc->buffers[i].data();
+                return S_OK;
+            }
+        }
+
+        *buffer = NULL;
+        return E_INVALIDARG;
+    }
+
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return bmdFormat10BitYUV; }
+    virtual BMDDisplayMode STDMETHODCALLTYPE GetDisplayMode(void)  { return m_Mode; }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Every sample unpacked, then the flag matched in each stream and the packet decoded from the unpacked samples.
+static unsigned ScanNaive( const uint32_t* pWords, long width, bool multiplexed, std::vector<uint16_t>* pSamples,
+                           SAncillaryPacket* pPackets, unsigned maxPackets, unsigned* pErrors )
+{
+    const size_t samples = (size_t)width * 2;
+    const size_t step = multiplexed ? 1 : 2;
+    std::vector<uint16_t>& y = *pSamples;
+    unsigned count = 0, errors = 0;
+
+    y.resize(samples);
+
+    for( size_t s = 0; s < samples; ++s )
+    {
+        y[s] = (uint16_t)( ( pWords[s / 3] >> ( s % 3 * 10 ) ) & 0x3FF );
+    }
+
+    for( size_t s = 0; s + 5 * step < samples && count < maxPackets; ++s )
+    {
+        if( y[s] != 0 || y[s + step] != 0x3FF || y[s + 2 * step] != 0x3FF )
+        {
+            continue;
+        }
+
+        const unsigned n = y[s + 5 * step] & 0xFF;
+        unsigned sum = 0;
+
+        if( s + ( 6 + n ) * step >= samples )
+        {
+            ++errors;
+            continue;
+        }
+
+        bool ok = true;
+
+        for( unsigned k = 3; k < 6; ++k )
+        {
+            const unsigned word = y[s + k * step];
+            ok = ok && ( ( word >> 8 ) & 1 ) == Parity( word & 0xFF ) && ( ( word >> 9 ) & 1 ) != Parity( word & 0xFF );
+        }
+
+        for( unsigned k = 3; k < 6 + n; ++k )
+        {
+            sum += y[s + k * step] & 0x1FF;
+
+            if( k >= 6 )
+            {
+                pPackets[count].data[k - 6] = (uint8_t)y[s + k * step];
+            }
+        }
+
+        if( !ok || ( sum & 0x1FF ) != ( y[s + ( 6 + n ) * step] & 0x1FF ) )
+        {
+            ++errors;
+            continue;
+        }
+
+        pPackets[count].did = (uint8_t)y[s + 3 * step];
+        pPackets[count].sdid = (uint8_t)y[s + 4 * step];
+        pPackets[count].count = (uint8_t)n;
+        ++count;
+    }
+
+    *pErrors = errors;
+    return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static bool SamePackets( const std::vector<SAncillaryPacket>& a, const std::vector<SAncillaryPacket>& b )
+{
+    if( a.size() != b.size() )
+    {
+        return false;
+    }
+
+    for( size_t i = 0; i < a.size(); ++i )
+    {
+        if( a[i].did != b[i].did || a[i].sdid != b[i].sdid || a[i].count != b[i].count ||
+            memcmp( a[i].data, b[i].data, a[i].count ) != 0 )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static int BenchScan( const SDisplayModeDesc* pMode, unsigned frames )
+{
+    SBenchVanc vanc(pMode);
+
+    // a caption distribution packet, AFD, an SCTE-104 message in the other stream and a caption packet with a bad
+    // checksum, on the first lines
+    const uint8_t cdp[] = { 0x96, 0x69, 11, 0x4F, 0x43, 0x12, 0x34, 0x74, 0x12, 0x34, 0 };
+    const uint8_t afd[] = { 0x44, 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t scte[40];
+
+    for( unsigned k = 0; k < sizeof(scte); ++k )
+    {
+        scte[k] = (uint8_t)( k * 37 );
+    }
+
+    const size_t luma = vanc.multiplexed ? 0 : 1;
+
+    vanc.Write( 0, vanc.Write( 0, luma, 0x61, 0x01, cdp, sizeof(cdp), false ), 0x41, 0x05, afd, sizeof(afd), false );
+    vanc.Write( 1, vanc.multiplexed ? 100 : 0, 0x41, 0x07, scte, sizeof(scte), false );
+    vanc.Write( 2, luma, 0x61, 0x01, cdp, sizeof(cdp), true );
+
+    const double frameNs = 1e9 * pMode->frameDuration / pMode->timeScale;
+
+    PrintLatencyHeader();
+
+    std::vector<SAncillaryPacket> reference;
+    std::vector<uint16_t> samples;
+    SAncillaryPacket packets[CAncillaryQueue::kMaxPacketsPerLine];
+    int failures = 0;
+
+    for( int isa = -1; isa < kIsaCount; ++isa )
+    {
+        if( isa >= 0 && !HasCpuIsa( (ECpuIsa)isa ) )
+        {
+            continue;
+        }
+
+        std::vector<SAncillaryPacket> found;
+        std::vector<uint64_t> frameNsList;
+        unsigned errors = 0;
+
+        for( unsigned f = 0; f < frames; ++f )
+        {
+            const uint64_t t0 = BenchNowNs();
+
+            for( size_t i = 0; i < vanc.lines.size(); ++i )
+            {
+                unsigned bad = 0;
+                const unsigned count = ( isa < 0 ) ?
+                    ScanNaive( vanc.buffers[i].data(), vanc.width, vanc.multiplexed, &samples, packets,
+                               CAncillaryQueue::kMaxPacketsPerLine, &bad ) :
+                    ScanAncillaryLine( vanc.buffers[i].data(), vanc.width, vanc.multiplexed, packets,
+                                       CAncillaryQueue::kMaxPacketsPerLine, &bad, (ECpuIsa)isa );
+
+                errors += bad;
+
+                if( f == 0 )
+                {
+                    found.insert( found.end(), packets, packets + count );
+                }
+            }
+
+            frameNsList.push_back( BenchNowNs() - t0 );
+        }
+
+        const SLatencyStats stats = ComputeLatencyStats(frameNsList);
+        char name[64];
+
+        snprintf( name, sizeof(name), "%s scan", ( isa < 0 ) ? "unpacked" : CpuIsaName( (ECpuIsa)isa ) );
+        PrintLatencyRow( name, stats, -1.0 );
+        printf( "    %u packets, %u bad, median %.3f%% of a frame\n", (unsigned)found.size(), errors / frames,
+                100.0 * stats.p50Ns / frameNs );
+
+        if( isa < 0 )
+        {
+            reference = found;
+        }
+
+        if( found.size() != 3 || errors != frames || !SamePackets( found, reference ) )
+        {
+            fprintf( stderr, "vanc: %s found other packets than expected\n", name );
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The packets of frame f: a caption distribution packet with f as its sequence counter and a varying number of
+// caption bytes, AFD, and an SCTE-104 message of varying content.
+static void FillBenchPackets( const SAncillarySlot* pSlots, unsigned f, SAncillaryPacket* pPackets )
+{
+    for( int i = 0; i < 3; ++i )
+    {
+        SAncillaryPacket& packet = pPackets[i];
+
+        packet.did = pSlots[i].did;
+        packet.sdid = pSlots[i].sdid;
+        packet.count = (uint8_t)( ( i == 1 ) ? 8 : pSlots[i].maxCount - f % 16 );
+
+        for( unsigned k = 0; k < packet.count; ++k )
+        {
+            packet.data[k] = (uint8_t)( ( f * 131 + k * 37 + i ) >> ( k & 3 ) );
+        }
+    }
+
+    pPackets[0].data[5] = (uint8_t)( f >> 8 );
+    pPackets[0].data[6] = (uint8_t)f;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Each frame is scanned back outside of the timing.
+static int BenchInsert( const SDisplayModeDesc* pMode, unsigned frames )
+{
+    const bool sd = ( pMode->height <= 576 );
+    const SAncillarySlot slots[3] =
+    {
+        { 0, (uint8_t)( sd ? kAncillaryMultiplexed : kAncillaryLuma ),   0x61, 0x01, 120 },
+        { 0, (uint8_t)( sd ? kAncillaryMultiplexed : kAncillaryLuma ),   0x41, 0x05, 8 },
+        { 2, (uint8_t)( sd ? kAncillaryMultiplexed : kAncillaryChroma ), 0x41, 0x07, 200 },
+    };
+    const double frameNs = 1e9 * pMode->frameDuration / pMode->timeScale;
+    SBenchVanc vanc(pMode);
+    CBenchAncillary ancillary( &vanc, pMode->mode );
+    SAncillaryPacket packets[3], found[CAncillaryQueue::kMaxPacketsPerLine];
+    int failures = 0;
+
+    printf( "\n" );
+    PrintLatencyHeader();
+
+    for( int isa = -1; isa < kIsaCount; ++isa )
+    {
+        CAncillaryInserter inserter( slots, 3, ( isa < 0 ) ? kIsaScalar : (ECpuIsa)isa );
+
+        if( ( isa >= 0 && !HasCpuIsa( (ECpuIsa)isa ) ) || inserter.Prepare( pMode->mode ) != 3 )
+        {
+            continue;
+        }
+
+        std::vector<uint64_t> frameNsList;
+        unsigned mismatches = 0;
+
+        for( unsigned f = 0; f < frames; ++f )
+        {
+            FillBenchPackets( slots, f, packets );
+
+            const uint64_t t0 = BenchNowNs();
+
+            if( isa < 0 )
+            {
+                vanc.Blank(0);
+                vanc.Blank(2);
+
+                const size_t next = vanc.Write( 0, sd ? 0 : 1, slots[0].did, slots[0].sdid, packets[0].data,
+                                                packets[0].count, false );
+
+                vanc.Write( 0, next, slots[1].did, slots[1].sdid, packets[1].data, packets[1].count, false );
+                vanc.Write( 2, 0, slots[2].did, slots[2].sdid, packets[2].data, packets[2].count, false );
+            }
+            else
+            {
+                inserter.Insert( &ancillary, packets );
+            }
+
+            frameNsList.push_back( BenchNowNs() - t0 );
+
+            // the caption and AFD packets on the first line, SCTE-104 on the third
+            unsigned errors = 0, errors2 = 0;
+            unsigned count = ScanAncillaryLine( vanc.buffers[0].data(), vanc.width, vanc.multiplexed, found, 16,
+                                                &errors );
+            count += ScanAncillaryLine( vanc.buffers[2].data(), vanc.width, vanc.multiplexed, found + count,
+                                        16 - count, &errors2 );
+
+            for( unsigned i = 0; i < count && count == 3; ++i )
+            {
+                if( found[i].did != packets[i].did || found[i].sdid != packets[i].sdid ||
+                    found[i].count != packets[i].count || memcmp( found[i].data, packets[i].data, found[i].count ) )
+                {
+                    count = 0;
+                }
+            }
+
+            mismatches += ( count != 3 || errors != 0 || errors2 != 0 );
+        }
+
+        const SLatencyStats stats = ComputeLatencyStats(frameNsList);
+        char name[64];
+
+        snprintf( name, sizeof(name), "%s insert", ( isa < 0 ) ? "rewritten" : CpuIsaName( (ECpuIsa)isa ) );
+        PrintLatencyRow( name, stats, -1.0 );
+        printf( "    median %.4f%% of a frame\n", 100.0 * stats.p50Ns / frameNs );
+
+        if( mismatches != 0 )
+        {
+            fprintf( stderr, "vanc: %s: %u frames scanned back other packets than inserted\n", name, mismatches );
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunAncillaryBench( int argc, char** argv )
+{
+    BMDDisplayMode mode = bmdModeHD1080i5994;
+    unsigned frames = 2000;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--mode" ) == 0 && ParseDisplayMode( argv[i + 1], &mode ) )  ++i;
+        else if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )  frames = (unsigned)atoi( argv[++i] );
+        else
+        {
+            PrintAncillaryUsage();
+            return 1;
+        }
+    }
+
+    const SDisplayModeDesc* pMode = FindDisplayMode(mode);
+
+    if( frames == 0 || pMode == NULL )
+    {
+        PrintAncillaryUsage();
+        return 1;
+    }
+
+    uint16_t lines[CAncillaryQueue::kMaxLines];
+
+    if( AncillaryLines( mode, lines, CAncillaryQueue::kMaxLines ) < 4 )
+    {
+        fprintf( stderr, "vanc: %s has no VANC lines known\n", pMode->name );
+        return 1;
+    }
+
+    printf( "vanc: %s, %u lines of %ld samples, %u frames per kernel, best %s; a frame lasts %.0f us\n\n",
+            pMode->name, AncillaryLines( mode, lines, CAncillaryQueue::kMaxLines ), pMode->width * 2, frames,
+            CpuIsaName( HasAvx2() ? kIsaAvx2 : kIsaScalar ), 1e6 * pMode->frameDuration / pMode->timeScale );
+
+    const int failures = BenchScan( pMode, frames ) + BenchInsert( pMode, frames );
+
+    return failures ? 1 : 0;
+}
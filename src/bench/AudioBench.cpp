@@ -0,0 +1,439 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../AudioRing.h"
+#include "../PolyphaseResampler.h"
+#include "Bench.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintAudioUsage()
+{
+    fprintf( stderr,
+        "Usage: audio [--frames N] [--packets N] [--readers N]\n"
+        "\n"
+        "Deinterleaving of 16- and 32-bit packets into planar float and int32, for 2, 8, 16 and 32 channels, with\n"
+        "each kernel the CPU supports; every result is checked against the plain C kernel. Then a CAudioRing of 16\n"
+        "channels fed one packet per video frame, read by as many readers, each checking every sample it sees; the\n"
+        "writer lets the readers catch up between packets, as the frame rate would. Last the polyphase resampler:\n"
+        "each kernel on the same noise, checked against the plain C kernel, and a 1 kHz sine resampled by 1.0001,\n"
+        "checked for its signal to noise ratio.\n"
+        "Defaults: packets of 1602 sample frames (29.97 Hz video), 2000 packets, 2 readers.\n" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sample c of sample frame n of the ring's stream, as the simulator makes them.
+static int32_t AudioSample( uint64_t n, unsigned c )
+{
+    return (int32_t)(uint32_t)( ( n << 8 | c ) * 2654435761u );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static int RunDeinterleave( long frames, unsigned packets )
+{
+    static const unsigned channelCounts[] = { 2, 8, 16, 32 };
+    static const BMDAudioSampleType types[] = { bmdAudioSampleType16bitInteger, bmdAudioSampleType32bitInteger };
+    static const EAudioFormat formats[] = { kAudioFloat32, kAudioInt32 };
+
+    std::mt19937 rng(17);
+    int failures = 0;
+
+    PrintLatencyHeader();
+
+    for( size_t ci = 0; ci < sizeof(channelCounts) / sizeof(channelCounts[0]); ++ci )
+    {
+        const unsigned channels = channelCounts[ci];
+
+        for( size_t ti = 0; ti < sizeof(types) / sizeof(types[0]); ++ti )
+        {
+            const BMDAudioSampleType type = types[ti];
+            std::vector<uint8_t> source( (size_t)frames * channels * ( type / 8 ) );
+
+            for( size_t i = 0; i < source.size(); ++i )
+            {
+                source[i] = (uint8_t)rng();
+            }
+
+            for( size_t fi = 0; fi < sizeof(formats) / sizeof(formats[0]); ++fi )
+            {
+                const EAudioFormat format = formats[fi];
+                std::vector<uint32_t> reference( (size_t)frames * channels ), planes( (size_t)frames * channels );
+                std::vector<void*> pReference( channels ), pPlanes( channels );
+
+                for( unsigned c = 0; c < channels; ++c )
+                {
+                    pReference[c] = &reference[ (size_t)c * frames ];
+                    pPlanes[c] = &planes[ (size_t)c * frames ];
+                }
+
+                DeinterleaveAudio( source.data(), type, channels, frames, format, pReference.data(), kIsaScalar );
+
+                for( int isa = 0; isa < kIsaCount; ++isa )
+                {
+                    // the audio kernels are plain C and AVX2
+                    if( !HasCpuIsa( (ECpuIsa)isa ) || ( isa != kIsaScalar && isa != kIsaAvx2 ) )
+                    {
+                        continue;
+                    }
+
+                    std::vector<uint64_t> ns;
+                    std::fill( planes.begin(), planes.end(), 0 );
+
+                    for( unsigned i = 0; i < packets; ++i )
+                    {
+                        const uint64_t t0 = BenchNowNs();
+                        DeinterleaveAudio( source.data(), type, channels, frames, format, pPlanes.data(),
+                                           (ECpuIsa)isa );
+                        ns.push_back( BenchNowNs() - t0 );
+                    }
+
+                    char name[64];
+
+                    snprintf( name, sizeof(name), "%s %uch s%d>%s", CpuIsaName( (ECpuIsa)isa ), channels, (int)type,
+                              ( format == kAudioFloat32 ) ? "f32" : "s32" );
+                    PrintLatencyRow( name, ComputeLatencyStats(ns), -1.0 );
+
+                    if( planes != reference )
+                    {
+                        fprintf( stderr, "audio: %s differs from scalar\n", name );
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static int RunRing( long frames, unsigned packets, unsigned readerCount )
+{
+    const unsigned channels = 16;
+    CAudioRing* pRing = new CAudioRing( channels, kAudioInt32, (long)bmdAudioSampleRate48kHz );
+    std::vector<int> readers;
+
+    for( unsigned i = 0; i < readerCount; ++i )
+    {
+        const int reader = pRing->AddReader();
+
+        if( reader < 0 )
+        {
+            break;
+        }
+
+        readers.push_back(reader);
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<unsigned> errors(0);
+    std::atomic<uint64_t> blocksRead[CAudioRing::kMaxReaders];
+    std::vector<std::thread> threads;
+
+    for( size_t r = 0; r < readers.size(); ++r )
+    {
+        blocksRead[r].store(0);
+    }
+
+    for( size_t r = 0; r < readers.size(); ++r )
+    {
+        threads.push_back( std::thread( [&, r]()
+        {
+            const int reader = readers[r];
+            CAudioRing::SBlock block;
+
+            for( ;; )
+            {
+                if( !pRing->Peek( reader, &block ) )
+                {
+                    if( done.load() && !pRing->Peek( reader, &block ) )
+                    {
+                        break;
+                    }
+
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                for( unsigned c = 0; c < block.channels; ++c )
+                {
+                    const int32_t* p = (const int32_t*)block.pPlane[c];
+
+                    for( long f = 0; f < block.frames; ++f )
+                    {
+                        if( p[f] != AudioSample( block.packetTime + f, c ) )
+                        {
+                            ++errors;
+                            break;
+                        }
+                    }
+                }
+
+                pRing->Advance(reader);
+                ++blocksRead[r];
+            }
+        } ) );
+    }
+
+    std::vector<int32_t> packet( (size_t)frames * channels );
+    std::vector<uint64_t> writeNs;
+    uint64_t accepted = 0;
+
+    for( unsigned i = 0; i < packets; ++i )
+    {
+        const uint64_t first = (uint64_t)i * frames;
+
+        for( size_t r = 0; r < readers.size(); ++r )
+        {
+            while( accepted - blocksRead[r].load() > 4 )
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        for( long f = 0; f < frames; ++f )
+        {
+            for( unsigned c = 0; c < channels; ++c )
+            {
+                packet[ (size_t)f * channels + c ] = AudioSample( first + f, c );
+            }
+        }
+
+        const uint64_t t0 = BenchNowNs();
+
+        if( pRing->Write( packet.data(), bmdAudioSampleType32bitInteger, channels, frames, (BMDTimeValue)first,
+                          BenchNowNs() ) )
+        {
+            ++accepted;
+        }
+
+        writeNs.push_back( BenchNowNs() - t0 );
+    }
+
+    done.store(true);
+
+    for( size_t r = 0; r < threads.size(); ++r )
+    {
+        threads[r].join();
+    }
+
+    CAudioRing::SStats stats;
+    pRing->GetStats(&stats);
+
+    for( size_t r = 0; r < readers.size(); ++r )
+    {
+        pRing->RemoveReader( readers[r] );
+    }
+
+    pRing->Release();
+
+    printf( "\nring: %u channels s32, %ld frames, %u readers\n\n", stats.channels, stats.capacity, stats.readers );
+    PrintLatencyHeader();
+    PrintLatencyRow( "write (deinterleave+publish)", ComputeLatencyStats(writeNs), -1.0 );
+    printf( "\n%llu of %u packets written, %llu overruns", (unsigned long long)accepted, packets,
+            (unsigned long long)stats.overruns );
+
+    int failures = 0;
+
+    for( size_t r = 0; r < readers.size(); ++r )
+    {
+        printf( ", reader %u read %llu", (unsigned)r, (unsigned long long)blocksRead[r].load() );
+
+        if( blocksRead[r] != accepted )
+        {
+            ++failures;
+        }
+    }
+
+    printf( "\n" );
+
+    if( errors.load() != 0 )
+    {
+        fprintf( stderr, "audio: readers saw %u wrong planes\n", errors.load() );
+        ++failures;
+    }
+
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// All resamplers get the same input, with a ratio just below 1 so that none of them runs dry.
+static int RunResampler( long frames, unsigned packets )
+{
+    static const unsigned channelCounts[] = { 2, 8, 16 };
+    const uint64_t step = (uint64_t)( 0.9999 * 4294967296.0 );
+
+    std::mt19937 rng(18);
+    std::uniform_real_distribution<float> noise( -1.0f, 1.0f );
+    int failures = 0;
+
+    printf( "\nresampler: %d taps, %d phases, ratio 0.9999\n\n", (int)CPolyphaseResampler::kTaps,
+            (int)CPolyphaseResampler::kPhases );
+    PrintLatencyHeader();
+
+    for( size_t ci = 0; ci < sizeof(channelCounts) / sizeof(channelCounts[0]); ++ci )
+    {
+        const unsigned channels = channelCounts[ci];
+        std::vector<ECpuIsa> isas;
+        std::vector<CPolyphaseResampler*> resamplers;
+
+        for( int isa = 0; isa < kIsaCount; ++isa )
+        {
+            // the resampling kernels are plain C and AVX2
+            if( HasCpuIsa( (ECpuIsa)isa ) && ( isa == kIsaScalar || isa == kIsaAvx2 ) )
+            {
+                isas.push_back( (ECpuIsa)isa );
+                resamplers.push_back( new CPolyphaseResampler( channels, frames * 4, (ECpuIsa)isa ) );
+            }
+        }
+
+        std::vector<float> input( (size_t)frames * channels ), reference( (size_t)frames * channels ),
+                           output( (size_t)frames * channels );
+        std::vector<const void*> pPlanes( channels );
+        std::vector< std::vector<uint64_t> > ns( isas.size() );
+        unsigned mismatches = 0;
+        long expected = 0;
+
+        for( unsigned c = 0; c < channels; ++c )
+        {
+            pPlanes[c] = &input[ (size_t)c * frames ];
+        }
+
+        for( unsigned i = 0; i < packets; ++i )
+        {
+            for( size_t n = 0; n < input.size(); ++n )
+            {
+                input[n] = noise(rng);
+            }
+
+            for( size_t r = 0; r < resamplers.size(); ++r )
+            {
+                resamplers[r]->Write( pPlanes.data(), channels, kAudioFloat32, frames );
+
+                const uint64_t t0 = BenchNowNs();
+                const long produced = resamplers[r]->Read( ( r == 0 ) ? reference.data() : output.data(), frames,
+                                                           step );
+                ns[r].push_back( BenchNowNs() - t0 );
+
+                // the first packet comes short by the taps after the position
+                if( r == 0 )
+                {
+                    expected = produced;
+                }
+                else if( produced != expected ||
+                         !std::equal( output.begin(), output.begin() + produced * channels, reference.begin() ) )
+                {
+                    ++mismatches;
+                }
+            }
+        }
+
+        for( size_t r = 0; r < resamplers.size(); ++r )
+        {
+            char name[64];
+
+            snprintf( name, sizeof(name), "resample %s %uch", CpuIsaName( isas[r] ), channels );
+            PrintLatencyRow( name, ComputeLatencyStats( ns[r] ), -1.0 );
+            delete resamplers[r];
+        }
+
+        if( mismatches != 0 )
+        {
+            fprintf( stderr, "audio: resampling %u channels differs from scalar in %u packets\n", channels,
+                     mismatches );
+            ++failures;
+        }
+    }
+
+    // a sine through the best kernel, against the sine at the positions it was resampled to
+    const double kPi = 3.14159265358979323846;
+    const double ratio = 1.0001;
+    const long length = (long)bmdAudioSampleRate48kHz;
+    const unsigned channels = 8;
+    std::vector<float> sine( (size_t)length * 2 ), output( (size_t)length * channels );
+    const void* pPlanes[channels];
+    CPolyphaseResampler resampler( channels, length * 2 );
+
+    for( long n = 0; n < length * 2; ++n )
+    {
+        sine[n] = (float)( 0.5 * sin( 2.0 * kPi * 1000.0 * n / bmdAudioSampleRate48kHz ) );
+    }
+
+    for( unsigned c = 0; c < channels; ++c )
+    {
+        pPlanes[c] = sine.data();
+    }
+
+    resampler.Write( pPlanes, channels, kAudioFloat32, length * 2 );
+
+    const uint64_t sineStep = (uint64_t)llround( ratio * 4294967296.0 );
+    const long produced = resampler.Read( output.data(), length, sineStep );
+    double signal = 0.0, error = 0.0;
+
+    // past the silence before the first input sample
+    for( long k = CPolyphaseResampler::kTaps; k < produced; ++k )
+    {
+        const double position = (double)( (uint64_t)k * sineStep ) / 4294967296.0;
+        const double expected = 0.5 * sin( 2.0 * kPi * 1000.0 * position / bmdAudioSampleRate48kHz );
+
+        for( unsigned c = 0; c < channels; ++c )
+        {
+            const double e = output[ (size_t)k * channels + c ] - expected;
+            signal += expected * expected;
+            error += e * e;
+        }
+    }
+
+    const double snr = 10.0 * log10( signal / std::max( error, 1e-30 ) );
+
+    printf( "\n1 kHz sine resampled by %.4f: %ld frames, SNR %.1f dB\n", ratio, produced, snr );
+
+    if( produced != length || snr < 70.0 )
+    {
+        fprintf( stderr, "audio: resampled sine too noisy\n" );
+        ++failures;
+    }
+
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunAudioBench( int argc, char** argv )
+{
+    long frames = 1602;
+    unsigned packets = 2000;
+    unsigned readers = 2;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )  frames = atol( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--packets" ) == 0 )  packets = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--readers" ) == 0 )  readers = (unsigned)atoi( argv[++i] );
+        else
+        {
+            PrintAudioUsage();
+            return 1;
+        }
+    }
+
+    if( frames <= 0 || frames > (long)bmdAudioSampleRate48kHz / 2 || packets == 0 ||
+        readers > CAudioRing::kMaxReaders )
+    {
+        PrintAudioUsage();
+        return 1;
+    }
+
+    printf( "audio: packets of %ld sample frames, %u per kernel, best %s\n\n", frames, packets,
+            CpuIsaName( HasAvx2() ? kIsaAvx2 : kIsaScalar ) );
+
+    int failures = RunDeinterleave( frames, packets );
+    failures += RunRing( frames, packets, readers );
+    failures += RunResampler( frames, packets );
+    return failures ? 1 : 0;
+}
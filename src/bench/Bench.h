@@ -0,0 +1,93 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "../DeckLinkPlatform.h"
+
+//=====================================================================================================================
+struct SLatencyStats
+{
+    uint64_t  count;
+    double    meanNs;
+    uint64_t  p50Ns;
+    uint64_t  p99Ns;
+    uint64_t  p999Ns;
+    uint64_t  maxNs;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Monotonic time in nanoseconds.
+uint64_t BenchNowNs();
+
+// Number of operator new calls made by the process so far.
+uint64_t BenchAllocCount();
+
+// Sorts the samples in place.
+SLatencyStats ComputeLatencyStats( std::vector<uint64_t>& samplesNs );
+
+void PrintLatencyHeader();
+// allocsPerOp < 0 means not measured
+void PrintLatencyRow( const char* name, const SLatencyStats& stats, double allocsPerOp );
+
+//=====================================================================================================================
+// Frame around a caller's buffer, for converters and the *Frame() helpers. Lives on the stack.
+class CBenchFrame : public IDeckLinkVideoFrame
+{
+    void*           m_pBytes;
+    long            m_Width;
+    long            m_Height;
+    long            m_RowBytes;
+    BMDPixelFormat  m_Format;
+
+public:
+    CBenchFrame( void* pBytes, long width, long height, long rowBytes, BMDPixelFormat format )
+        : m_pBytes(pBytes), m_Width(width), m_Height(height), m_RowBytes(rowBytes), m_Format(format)  {}
+    virtual ~CBenchFrame()  {}
+
+    // overrides IDeckLinkVideoFrame
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return m_Width; }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return m_Height; }
+    virtual long STDMETHODCALLTYPE GetRowBytes(void)  { return m_RowBytes; }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return m_Format; }
+    virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void)  { return bmdFrameFlagDefault; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer )  { *buffer = m_pBytes; return S_OK; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode )
+    {
+        *timecode = NULL;
+        return S_FALSE;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary )
+    {
+        *ancillary = NULL;
+        return S_FALSE;
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Benchmark suites. argv[0] is the suite name.
+int RunDiscoveryBench( int argc, char** argv );
+int RunRegistryBench( int argc, char** argv );
+int RunFrameBench( int argc, char** argv );
+int RunV210Bench( int argc, char** argv );
+int RunConvertBench( int argc, char** argv );
+int RunAudioBench( int argc, char** argv );
+int RunSyncBench( int argc, char** argv );
+int RunAncillaryBench( int argc, char** argv );
+int RunTimecodeBench( int argc, char** argv );
+int RunRecordBench( int argc, char** argv );
+
+#endif // BENCH_H
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "Bench.h"
+#include "Clock.h"
+
+//=====================================================================================================================
+// Allocation counting. Every operator new flavour funnels through these two.
+static std::atomic<uint64_t>  g_AllocCount(0);
+
+void* operator new( size_t size )
+{
+    g_AllocCount.fetch_add( 1, std::memory_order_relaxed );
+
+    void* p = malloc( size ? size : 1 );
+
+    if( p == NULL )
+    {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void* operator new[]( size_t size )
+{
+    return operator new(size);
+}
+
+void operator delete( void* p ) noexcept
+{
+    free(p);
+}
+
+void operator delete[]( void* p ) noexcept
+{
+    free(p);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+uint64_t BenchAllocCount()
+{
+    return g_AllocCount.load( std::memory_order_relaxed );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+uint64_t BenchNowNs()
+{
+    return MonotonicNs();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+SLatencyStats ComputeLatencyStats( std::vector<uint64_t>& samplesNs )
+{
+    SLatencyStats stats = { 0, 0.0, 0, 0, 0, 0 };
+
+    if( samplesNs.empty() )
+    {
+        return stats;
+    }
+
+    std::sort( samplesNs.begin(), samplesNs.end() );
+
+    double sum = 0.0;
+
+    for( size_t i = 0; i < samplesNs.size(); ++i )
+    {
+        sum += (double)samplesNs[i];
+    }
+
+    const size_t n = samplesNs.size();
+
+    stats.count = n;
+    stats.meanNs = sum / n;
+    stats.p50Ns = samplesNs[ n * 500 / 1000 ];
+    stats.p99Ns = samplesNs[ n * 990 / 1000 ];
+    stats.p999Ns = samplesNs[ n * 999 / 1000 ];
+    stats.maxNs = samplesNs[ n - 1 ];
+
+    return stats;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void PrintLatencyHeader()
+{
+    printf( "%-24s %10s %10s %10s %10s %10s %10s %12s\n",
+                            "", "count", "mean ns", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "allocs/op" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void PrintLatencyRow( const char* name, const SLatencyStats& stats, double allocsPerOp )
+{
+    printf( "%-24s %10llu %10.0f %10llu %10llu %10llu %10llu", name,
+                    (unsigned long long)stats.count, stats.meanNs, (unsigned long long)stats.p50Ns,
+                    (unsigned long long)stats.p99Ns, (unsigned long long)stats.p999Ns,
+                    (unsigned long long)stats.maxNs );
+
+    if( allocsPerOp < 0.0 )
+    {
+        printf( " %12s\n", "-" );
+    }
+    else
+    {
+        printf( " %12.2f\n", allocsPerOp );
+    }
+}
+
+//=====================================================================================================================
+struct SBenchSuite
+{
+    const char*  name;
+    int          (*run)( int argc, char** argv );
+    const char*  description;
+};
+
+static const SBenchSuite  g_Suites[] =
+{
+    { "discovery", RunDiscoveryBench, "CDiscoveryCallback arrival/removal latency and throughput" },
+    { "registry",  RunRegistryBench,  "CDeviceRegistry lookups under concurrent hot-plug" },
+    { "frames",    RunFrameBench,     "frame buffer allocation (CFrameAllocator) and hand-off (CSpscQueue)" },
+    { "v210",      RunV210Bench,      "v210 to and from planar YUV per row kernel, against the API's converter" },
+    { "convert",   RunConvertBench,   "conversion between every pair of pixel formats (CFrameConverter)" },
+    { "audio",     RunAudioBench,     "audio deinterleaving per kernel, and CAudioRing with concurrent readers" },
+    { "sync",      RunSyncBench,      "CSyncTracker cost per frame and histogram accuracy, with a concurrent reader" },
+    { "vanc",      RunAncillaryBench, "VANC packet scanning per kernel, against unpacking every sample" },
+    { "timecode",  RunTimecodeBench,  "timecodes from GetBCD() per kernel vs GetString(); index seeks" },
+    { "record",    RunRecordBench,    "recording frames with CCaptureRecorder (io_uring, O_DIRECT) against pwrite()" },
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+    const char* suite = ( argc > 1 ) ? argv[1] : "discovery";
+
+    for( size_t i = 0; i < sizeof(g_Suites) / sizeof(g_Suites[0]); ++i )
+    {
+        if( strcmp( suite, g_Suites[i].name ) == 0 )
+        {
+            return g_Suites[i].run( argc > 1 ? argc - 1 : 1, argc > 1 ? argv + 1 : argv );
+        }
+    }
+
+    fprintf( stderr, "Usage: %s <suite> [options]\n\nSuites:\n", argv[0] );
+
+    for( size_t i = 0; i < sizeof(g_Suites) / sizeof(g_Suites[0]); ++i )
+    {
+        fprintf( stderr, "    %-12s %s\n", g_Suites[i].name, g_Suites[i].description );
+    }
+
+    return 1;
+}
@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../DiscoveryCallback.h"
+#include "Bench.h"
+
+//=====================================================================================================================
+// Synthetic device handed to the callback. Behaves like a driver object as far as reference counting goes.
+class CBenchDeckLink : public IDeckLink, public IDeckLinkAttributes
+{
+    std::atomic<ULONG>  m_RefCount;
+    unsigned            m_Index;
+
+public:
+    explicit CBenchDeckLink( unsigned index ) : m_RefCount(1), m_Index(index)  {}
+
+    // overrides IDeckLink
+    virtual HRESULT STDMETHODCALLTYPE GetModelName( DLString* modelName )
+    {
+        *modelName = MakeDLString("DeckLink Bench");
+        return S_OK;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetDisplayName( DLString* displayName )
+    {
+        char name[64];
+        snprintf( name, sizeof(name), "DeckLink Bench (%u)", m_Index + 1 );
+        *displayName = MakeDLString(name);
+        return S_OK;
+    }
+
+    // overrides IDeckLinkAttributes
+    virtual HRESULT STDMETHODCALLTYPE GetFlag( BMDDeckLinkAttributeID cfgID, bool* value )  { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE GetFloat( BMDDeckLinkAttributeID cfgID, double* value )  { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE GetString( BMDDeckLinkAttributeID cfgID, DLString* value )  { return E_NOTIMPL; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetInt( BMDDeckLinkAttributeID cfgID, int64_t* value )
+    {
+        // four sub-devices per card
+        switch( cfgID )
+        {
+        case BMDDeckLinkPersistentID:        *value = m_Index;      return S_OK;
+        case BMDDeckLinkSubDeviceIndex:      *value = m_Index % 4;  return S_OK;
+        case BMDDeckLinkNumberOfSubDevices:  *value = 4;            return S_OK;
+        default:                             return E_NOTIMPL;
+        }
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        if( IsEqualGUID( riid, IID_IDeckLink ) || IsEqualGUID( riid, IID_IUnknown ) )
+        {
+            *ppvObject = static_cast<IDeckLink*>(this);
+            AddRef();
+            return S_OK;
+        }
+
+        if( IsEqualGUID( riid, IID_IDeckLinkAttributes ) )
+        {
+            *ppvObject = static_cast<IDeckLinkAttributes*>(this);
+            AddRef();
+            return S_OK;
+        }
+
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)
+    {
+        return ++m_RefCount;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ULONG refs = --m_RefCount;
+
+        if( refs == 0 )
+        {
+            delete this;
+        }
+
+        return refs;
+    }
+};
+
+//=====================================================================================================================
+static void PrintUsage()
+{
+    fprintf( stderr,
+        "Usage: discovery [--devices N] [--rounds N] [--warmup N] [--format text|ndjson|binary]\n"
+        "\n"
+        "Each round reports every device as arrived, then every device as removed.\n"
+        "The event log is drained to stderr by a background thread; redirect it to measure a pipe, file or /dev/null.\n" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunDiscoveryBench( int argc, char** argv )
+{
+    unsigned devices = 64;
+    unsigned rounds = 1000;
+    unsigned warmup = 10;
+    EEventFormat format = kEventFormatText;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--devices" ) == 0 )      devices = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--rounds" ) == 0 )  rounds = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--warmup" ) == 0 )  warmup = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--format" ) == 0 && ParseEventFormat( argv[i + 1], &format ) )  ++i;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if( devices == 0 || rounds == 0 )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    CEventLog log;
+    CDiscoveryCallback callback(&log);
+    log.SetOutput( 2, format );
+    log.Start();
+    std::vector<CBenchDeckLink*> devs;
+
+    for( unsigned i = 0; i < devices; ++i )
+    {
+        devs.push_back( new CBenchDeckLink(i) );
+    }
+
+    std::vector<uint64_t> arrivedNs;
+    std::vector<uint64_t> removedNs;
+    arrivedNs.reserve( (size_t)devices * rounds );
+    removedNs.reserve( (size_t)devices * rounds );
+
+    uint64_t arrivedAllocs = 0;
+    uint64_t removedAllocs = 0;
+    uint64_t wallNs = 0;
+
+    for( unsigned round = 0; round < warmup + rounds; ++round )
+    {
+        const bool measure = ( round >= warmup );
+        const uint64_t roundStart = BenchNowNs();
+
+        uint64_t allocs = BenchAllocCount();
+
+        for( unsigned i = 0; i < devices; ++i )
+        {
+            uint64_t t0 = BenchNowNs();
+            callback.DeckLinkDeviceArrived( devs[i] );
+            uint64_t t1 = BenchNowNs();
+
+            if( measure )
+            {
+                arrivedNs.push_back( t1 - t0 );
+            }
+        }
+
+        if( measure )
+        {
+            arrivedAllocs += BenchAllocCount() - allocs;
+        }
+
+        allocs = BenchAllocCount();
+
+        for( unsigned i = 0; i < devices; ++i )
+        {
+            uint64_t t0 = BenchNowNs();
+            callback.DeckLinkDeviceRemoved( devs[i] );
+            uint64_t t1 = BenchNowNs();
+
+            if( measure )
+            {
+                removedNs.push_back( t1 - t0 );
+            }
+        }
+
+        if( measure )
+        {
+            removedAllocs += BenchAllocCount() - allocs;
+            wallNs += BenchNowNs() - roundStart;
+        }
+    }
+
+    log.Stop();
+
+    for( unsigned i = 0; i < devices; ++i )
+    {
+        devs[i]->Release();
+    }
+
+    // latency vectors were reserved up front, so the counts above only include allocations made by the callback
+    const double events = 2.0 * devices * rounds;
+
+    printf( "discovery: %u devices, %u rounds, %.0f events\n\n", devices, rounds, events );
+    PrintLatencyHeader();
+    PrintLatencyRow( "DeckLinkDeviceArrived", ComputeLatencyStats(arrivedNs), (double)arrivedAllocs / arrivedNs.size() );
+    PrintLatencyRow( "DeckLinkDeviceRemoved", ComputeLatencyStats(removedNs), (double)removedAllocs / removedNs.size() );
+    printf( "\nthroughput: %.0f events/sec\n", events * 1e9 / (double)wallNs );
+    printf( "event log:  %llu events dropped\n", (unsigned long long)log.Dropped() );
+
+    return 0;
+}
+
+//=====================================================================================================================
+static SDeviceInfo BenchDeviceInfo( IDeckLink* pDev, unsigned index )
+{
+    SDeviceInfo info;
+    memset( &info, 0, sizeof(info) );
+
+    info.pDev = pDev;
+    info.persistentId = index;
+    info.hasPersistentId = true;
+    info.subDeviceIndex = index % 4;
+    info.numberOfSubDevices = 4;
+    return info;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintRegistryUsage()
+{
+    fprintf( stderr,
+        "Usage: registry [--devices N] [--readers N] [--lookups N]\n"
+        "\n"
+        "Reader threads resolve devices by persistent ID while one writer keeps removing and re-adding devices.\n" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunRegistryBench( int argc, char** argv )
+{
+    unsigned devices = 64;
+    unsigned readers = 4;
+    unsigned lookups = 1000000;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--devices" ) == 0 )       devices = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--readers" ) == 0 )  readers = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--lookups" ) == 0 )  lookups = (unsigned)atoi( argv[++i] );
+        else
+        {
+            PrintRegistryUsage();
+            return 1;
+        }
+    }
+
+    if( devices == 0 || readers == 0 || lookups == 0 )
+    {
+        PrintRegistryUsage();
+        return 1;
+    }
+
+    CDeviceRegistry registry;
+    std::vector<CBenchDeckLink*> devs;
+
+    for( unsigned i = 0; i < devices; ++i )
+    {
+        devs.push_back( new CBenchDeckLink(i) );
+
+        SDeviceInfo info = BenchDeviceInfo( devs[i], i );
+        registry.Add(info);
+    }
+
+    std::atomic<unsigned> running(readers);
+    std::vector< std::vector<uint64_t> > lookupNs(readers);
+    std::vector<uint64_t> writeNs;
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> hits(0);
+
+    const uint64_t start = BenchNowNs();
+
+    for( unsigned r = 0; r < readers; ++r )
+    {
+        lookupNs[r].reserve(lookups);
+
+        threads.push_back( std::thread( [&, r]()
+        {
+            uint32_t x = 2463534242u + r;
+            uint64_t hit = 0;
+
+            for( unsigned i = 0; i < lookups; ++i )
+            {
+                x ^= x << 13;  x ^= x >> 17;  x ^= x << 5;
+
+                SDeviceInfo info;
+                uint64_t t0 = BenchNowNs();
+                bool ok = registry.FindByPersistentId( x % devices, &info );
+                uint64_t t1 = BenchNowNs();
+
+                // absent (mid re-plug) devices are found too, without a device pointer
+                if( ok && info.pDev != NULL )
+                {
+                    info.pDev->Release();
+                    ++hit;
+                }
+
+                lookupNs[r].push_back( t1 - t0 );
+            }
+
+            hits += hit;
+            --running;
+        } ) );
+    }
+
+    // writer: churn until all readers are done
+    for( unsigned i = 0; running != 0; i = ( i + 1 ) % devices )
+    {
+        SDeviceInfo info = BenchDeviceInfo( devs[i], i );
+
+        uint64_t t0 = BenchNowNs();
+        registry.Remove( devs[i] );
+        registry.Add(info);
+        writeNs.push_back( BenchNowNs() - t0 );
+    }
+
+    for( size_t i = 0; i < threads.size(); ++i )
+    {
+        threads[i].join();
+    }
+
+    const uint64_t wallNs = BenchNowNs() - start;
+
+    std::vector<uint64_t> allLookups;
+    allLookups.reserve( (size_t)readers * lookups );
+
+    for( unsigned r = 0; r < readers; ++r )
+    {
+        allLookups.insert( allLookups.end(), lookupNs[r].begin(), lookupNs[r].end() );
+    }
+
+    const double total = (double)readers * lookups;
+
+    printf( "registry: %u devices, %u readers, %.0f lookups, %llu remove+add cycles\n\n", devices, readers, total,
+                                                                            (unsigned long long)writeNs.size() );
+    PrintLatencyHeader();
+    PrintLatencyRow( "FindByPersistentId", ComputeLatencyStats(allLookups), -1.0 );
+    PrintLatencyRow( "Remove+Add", ComputeLatencyStats(writeNs), -1.0 );
+    printf( "\nthroughput: %.0f lookups/sec, %.1f%% hits\n", total * 1e9 / (double)wallNs, 100.0 * hits.load() / total );
+
+    for( unsigned i = 0; i < devices; ++i )
+    {
+        registry.Remove( devs[i] );
+        devs[i]->Release();
+    }
+
+    return 0;
+}
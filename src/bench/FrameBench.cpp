@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "../DisplayModes.h"
+#include "../FrameAllocator.h"
+#include "../SpscQueue.h"
+#include "Bench.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintFrameUsage()
+{
+    fprintf( stderr,
+        "Usage: frames [--mode <name>] [--format <fourcc>] [--frames N] [--numa-node N]\n"
+        "\n"
+        "Cost of getting a frame buffer, having it written (one store per 4 KB page, like DMA) and giving it back:\n"
+        "malloc/free against CFrameAllocator. Then the hand-off of frame pointers between two threads (CSpscQueue).\n"
+        "Defaults: 2160p25, v210, 500 frames.\n" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void TouchPages( void* p, size_t size )
+{
+    for( size_t offset = 0; offset < size; offset += 4096 )
+    {
+        ( (volatile char*)p )[offset] = 1;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunFrameBench( int argc, char** argv )
+{
+    BMDDisplayMode mode = bmdMode4K2160p25;
+    BMDPixelFormat format = bmdFormat10BitYUV;
+    unsigned frames = 500;
+    int numaNode = -1;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--mode" ) == 0 && ParseDisplayMode( argv[i + 1], &mode ) )        ++i;
+        else if( i + 1 < argc && strcmp( argv[i], "--format" ) == 0 && ParsePixelFormat( argv[i + 1], &format ) ) ++i;
+        else if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )     frames = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--numa-node" ) == 0 )  numaNode = atoi( argv[++i] );
+        else
+        {
+            PrintFrameUsage();
+            return 1;
+        }
+    }
+
+    const SDisplayModeDesc* pMode = FindDisplayMode(mode);
+
+    if( frames == 0 || pMode == NULL )
+    {
+        PrintFrameUsage();
+        return 1;
+    }
+
+    const size_t frameSize = (size_t)RowBytesForPixelFormat( format, pMode->width ) * pMode->height;
+    std::vector<uint64_t> mallocNs, poolNs, popPushNs;
+
+    for( unsigned i = 0; i < frames; ++i )
+    {
+        uint64_t t0 = BenchNowNs();
+        void* p = malloc(frameSize);
+        TouchPages( p, frameSize );
+        free(p);
+        mallocNs.push_back( BenchNowNs() - t0 );
+    }
+
+    CFrameAllocator* pAllocator = new CFrameAllocator( numaNode, 4 );
+    pAllocator->SetFormat( mode, format );
+
+    uint64_t t0 = BenchNowNs();
+
+    if( pAllocator->Commit() != S_OK )
+    {
+        fprintf( stderr, "frames: Commit() failed\n" );
+        pAllocator->Release();
+        return 1;
+    }
+
+    const uint64_t commitNs = BenchNowNs() - t0;
+
+    for( unsigned i = 0; i < frames; ++i )
+    {
+        void* p;
+
+        t0 = BenchNowNs();
+        pAllocator->AllocateBuffer( (uint32_t)frameSize, &p );
+        TouchPages( p, frameSize );
+        pAllocator->ReleaseBuffer(p);
+        poolNs.push_back( BenchNowNs() - t0 );
+
+        t0 = BenchNowNs();
+        pAllocator->AllocateBuffer( (uint32_t)frameSize, &p );
+        pAllocator->ReleaseBuffer(p);
+        popPushNs.push_back( BenchNowNs() - t0 );
+    }
+
+    CFrameAllocator::SStats stats;
+    pAllocator->GetStats(&stats);
+
+    pAllocator->Decommit();
+    pAllocator->Release();
+
+    printf( "frames: %s %s, %.1f MB per frame; pool of %u x %.1f MB on %s pages, committed in %.1f ms\n\n",
+            pMode->name, PixelFormatName(format), frameSize / 1048576.0, stats.buffers, stats.bufferSize / 1048576.0,
+            stats.hugePages ? "huge" : "normal", commitNs / 1e6 );
+    PrintLatencyHeader();
+    PrintLatencyRow( "malloc+write+free", ComputeLatencyStats(mallocNs), -1.0 );
+    PrintLatencyRow( "pool alloc+write+release", ComputeLatencyStats(poolNs), -1.0 );
+    PrintLatencyRow( "pool alloc+release", ComputeLatencyStats(popPushNs), -1.0 );
+
+    // hand-off: the pointers only, as the capture engine passes frames
+    const unsigned handoffs = 1000000;
+    CSpscQueue<void*> queue(8);
+
+    t0 = BenchNowNs();
+
+    std::thread consumer( [&]()
+    {
+        void* p;
+
+        for( unsigned i = 0; i < handoffs; )
+        {
+            if( queue.TryPop(&p) )
+            {
+                ++i;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    } );
+
+    for( unsigned i = 0; i < handoffs; )
+    {
+        if( queue.TryPush( (void*)(uintptr_t)( i + 1 ) ) )
+        {
+            ++i;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    consumer.join();
+
+    printf( "\nspsc hand-off: %.1f ns per frame pointer (%u, depth %u)\n",
+            (double)( BenchNowNs() - t0 ) / handoffs, handoffs, (unsigned)queue.Capacity() );
+    return 0;
+}
@@ -0,0 +1,411 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../CaptureRecorder.h"
+#include "../DisplayModes.h"
+#include "../TimecodeIndex.h"
+#include "Bench.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintRecordUsage()
+{
+    fprintf( stderr,
+        "Usage: record [--dir DIR] [--frames N] [--depth N] [--hd] [--format FMT]\n"
+        "\n"
+        "Recording 2160p30 frames with 16 channels of 32-bit audio from a pool of page aligned capture buffers,\n"
+        "as fast as the disk takes them: first with pwrite() through the page cache from one thread, as most\n"
+        "recorders do, then with CCaptureRecorder. The producer only hands on a frame when the pool has a free\n"
+        "buffer, as the driver does, and the pool is no bigger than the recorder's queue, so that the recorder\n"
+        "drops nothing and its rate is the disk's. Both rates include flushing the files. The recording is then\n"
+        "read back through its index and checked.\n"
+        "Defaults: the current directory, 200 frames, depth 8, v210; --hd records 1080p50 instead. 2vuy frames do\n"
+        "not fill their last 4 KB block, which the recorder then pads.\n" );
+}
+
+//=====================================================================================================================
+// The pool: page aligned buffers, each frame of the bench holding one. A frame released goes back to it.
+class CBenchPool
+{
+    uint8_t*                  m_pBytes;
+    size_t                    m_Stride;
+    std::mutex                m_Mutex;
+    std::condition_variable   m_Cond;
+    std::vector<unsigned>     m_Free;
+    unsigned                  m_Count;
+
+public:
+    CBenchPool( size_t bufferSize, unsigned count )
+        : m_pBytes(NULL), m_Stride( ( bufferSize + 4095 ) / 4096 * 4096 ), m_Count(count)
+    {
+        void* p = mmap( NULL, m_Stride * count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                        -1, 0 );
+        m_pBytes = ( p == MAP_FAILED ) ? NULL : (uint8_t*)p;
+
+        for( unsigned i = 0; i < count; ++i )
+        {
+            m_Free.push_back( count - 1 - i );
+        }
+    }
+
+    ~CBenchPool()
+    {
+        if( m_pBytes != NULL )
+        {
+            munmap( m_pBytes, m_Stride * m_Count );
+        }
+    }
+
+    bool Valid() const  { return m_pBytes != NULL; }
+    uint8_t* Buffer( unsigned index ) const  { return m_pBytes + index * m_Stride; }
+
+    unsigned Take()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+
+        while( m_Free.empty() )
+        {
+            m_Cond.wait(lock);
+        }
+
+        const unsigned index = m_Free.back();
+        m_Free.pop_back();
+        return index;
+    }
+
+    void Give( unsigned index )
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Free.push_back(index);
+        m_Cond.notify_one();
+    }
+};
+
+//=====================================================================================================================
+// A captured frame in a buffer of the pool, with its audio packet; back to the pool on the last Release().
+class CRecordFrame : public IDeckLinkVideoInputFrame
+{
+    CBenchPool*          m_pPool;
+    unsigned             m_Index;
+    uint64_t             m_Frame;
+    const SDisplayModeDesc*  m_pDesc;
+    BMDPixelFormat       m_Format;
+    long                 m_RowBytes;
+    std::atomic<ULONG>   m_RefCount;
+
+public:
+    CRecordFrame( CBenchPool* pPool, unsigned index, uint64_t frame, const SDisplayModeDesc* pDesc,
+                  BMDPixelFormat format, long rowBytes )
+        : m_pPool(pPool), m_Index(index), m_Frame(frame), m_pDesc(pDesc), m_Format(format), m_RowBytes(rowBytes),
+          m_RefCount(1)  {}
+    virtual ~CRecordFrame()  {}
+
+    // overrides IDeckLinkVideoInputFrame
+    virtual HRESULT STDMETHODCALLTYPE GetStreamTime( BMDTimeValue* frameTime, BMDTimeValue* frameDuration,
+                                                     BMDTimeScale timeScale )
+    {
+        *frameTime = (BMDTimeValue)m_Frame * m_pDesc->frameDuration * timeScale / m_pDesc->timeScale;
+        *frameDuration = m_pDesc->frameDuration * timeScale / m_pDesc->timeScale;
+        return S_OK;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetHardwareReferenceTimestamp( BMDTimeScale timeScale, BMDTimeValue* frameTime,
+                                                                     BMDTimeValue* frameDuration )
+    {
+        return GetStreamTime( frameTime, frameDuration, timeScale );
+    }
+
+    // overrides IDeckLinkVideoFrame
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return m_pDesc->width; }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return m_pDesc->height; }
+    virtual long STDMETHODCALLTYPE GetRowBytes(void)  { return m_RowBytes; }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return m_Format; }
+    virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void)  { return bmdFrameFlagDefault; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer )  { *buffer = m_pPool->Buffer(m_Index); return S_OK; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode )
+    {
+        *timecode = NULL;
+        return S_FALSE;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary )
+    {
+        *ancillary = NULL;
+        return S_FALSE;
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return ++m_RefCount; }
+
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ULONG refs = --m_RefCount;
+
+        if( refs == 0 )
+        {
+            m_pPool->Give(m_Index);
+            delete this;
+        }
+
+        return refs;
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// 20 ms of 16 channels of 32-bit samples, the same for every frame; the bench holds it throughout.
+class CRecordPacket : public IDeckLinkAudioInputPacket
+{
+    std::vector<int32_t>  m_Samples;
+
+public:
+    CRecordPacket() : m_Samples( 960 * 16, 0x01020304 )  {}
+    virtual ~CRecordPacket()  {}
+
+    // overrides IDeckLinkAudioInputPacket
+    virtual long STDMETHODCALLTYPE GetSampleFrameCount(void)  { return 960; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer )  { *buffer = &m_Samples[0]; return S_OK; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetPacketTime( BMDTimeValue* packetTime, BMDTimeScale timeScale )
+    {
+        *packetTime = 0;
+        return S_OK;
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Frame n's buffer starts with n, so that reading back tells whether each frame landed where the index says.
+static void MarkFrame( uint8_t* pBytes, uint64_t frame, size_t size )
+{
+    memcpy( pBytes, &frame, sizeof(frame) );
+    memcpy( pBytes + size - sizeof(frame), &frame, sizeof(frame) );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintRate( const char* name, uint64_t bytes, uint64_t frames, uint64_t ns )
+{
+    printf( "%-40s %8.0f MB/s %8.1f frames/s\n", name, bytes / 1048576.0 / ( ns / 1e9 ), frames / ( ns / 1e9 ) );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The usual way: one thread, pwrite() of each frame and packet at the end of its file.
+static int BenchBuffered( const std::string& dir, size_t size, unsigned frames )
+{
+    const std::string video = dir + "/record-bench-buffered.video";
+    const std::string audio = dir + "/record-bench-buffered.pcm";
+    CBenchPool pool( size, 4 );
+    CRecordPacket packet;
+    void* pSamples = NULL;
+    const int videoFd = open( video.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    const int audioFd = open( audio.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    const size_t audioSize = 960 * 16 * 4;
+    int failures = 0;
+
+    packet.GetBytes(&pSamples);
+
+    if( !pool.Valid() || videoFd < 0 || audioFd < 0 )
+    {
+        fprintf( stderr, "record: opening %s failed: %s\n", video.c_str(), strerror(errno) );
+        return 1;
+    }
+
+    const uint64_t t0 = BenchNowNs();
+
+    for( unsigned i = 0; i < frames; ++i )
+    {
+        uint8_t* pBytes = pool.Buffer( i % 4 );
+
+        MarkFrame( pBytes, i, size );
+        failures += pwrite( videoFd, pBytes, size, (off_t)i * size ) != (ssize_t)size;
+        failures += pwrite( audioFd, pSamples, audioSize, (off_t)i * audioSize ) != (ssize_t)audioSize;
+    }
+
+    fdatasync(videoFd);
+    fdatasync(audioFd);
+    PrintRate( "pwrite(), page cache", (uint64_t)frames * ( size + audioSize ), frames, BenchNowNs() - t0 );
+
+    close(videoFd);
+    close(audioFd);
+    unlink( video.c_str() );
+    unlink( audio.c_str() );
+    return failures ? 1 : 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Through a recorder, fed from a pool of just the buffers it may hold; then read back by the index.
+static int BenchRecorder( const std::string& dir, const SDisplayModeDesc* pDesc, BMDPixelFormat format, size_t size,
+                          long rowBytes, unsigned frames, unsigned depth )
+{
+    const int64_t id = 0x0000BE4C4000000FLL;
+    CCaptureRecorder* pRecorder = new CCaptureRecorder( dir.c_str(), id, depth, 0 );
+    // as many buffers as its queue holds, so that the queue is never full when a buffer is free
+    CBenchPool pool( size, pRecorder->MaxHeld() - depth );
+    CRecordPacket packet;
+    CCaptureRecorder::SStats stats;
+    int failures = 0;
+
+    if( !pool.Valid() || !pRecorder->Start( format, 16, bmdAudioSampleType32bitInteger ) )
+    {
+        fprintf( stderr, "record: starting the recorder in %s failed\n", dir.c_str() );
+        delete pRecorder;
+        return 1;
+    }
+
+    const uint64_t t0 = BenchNowNs();
+
+    for( unsigned i = 0; i < frames; ++i )
+    {
+        const unsigned index = pool.Take();
+        CRecordFrame* pFrame = new CRecordFrame( &pool, index, i, pDesc, format, rowBytes );
+
+        MarkFrame( pool.Buffer(index), i, size );
+        pRecorder->Push( pFrame, &packet, pDesc->mode );
+        pFrame->Release();
+    }
+
+    pRecorder->Stop();
+    const uint64_t ns = BenchNowNs() - t0;
+
+    pRecorder->GetStats(&stats);
+    delete pRecorder;
+
+    char name[64];
+
+    snprintf( name, sizeof(name), "CCaptureRecorder, %s%s", stats.uring ? "io_uring" : "pwrite()",
+              stats.direct ? " + O_DIRECT" : "" );
+    PrintRate( name, stats.bytes, stats.frames, ns );
+    printf( "    dropped=%llu buffered=%llu errors=%llu, in flight peak %u of %u, stalls=%llu, "
+            "write mean=%.2fms max=%.2fms\n",
+            (unsigned long long)stats.dropped, (unsigned long long)stats.buffered, (unsigned long long)stats.errors,
+            stats.peakInFlight, depth, (unsigned long long)stats.stalls,
+            stats.writes ? stats.writeNs / 1e6 / stats.writes : 0.0, stats.maxWriteNs / 1e6 );
+
+    failures += ( stats.frames != frames || stats.audioPackets != frames || stats.dropped != 0 || stats.errors != 0 );
+
+    // every frame where the index says, marked with its number
+    char base[512];
+    snprintf( base, sizeof(base), "%s/%016llx-1-%s", dir.c_str(), (unsigned long long)id, pDesc->name );
+
+    const std::string video = std::string(base) + "." + PixelFormatName(format);
+    const std::string audio = std::string(base) + ".pcm";
+    const std::string path = std::string(base) + ".idx";
+    const int fd = open( video.c_str(), O_RDONLY | O_CLOEXEC );
+    CTimecodeIndex index;
+    unsigned mismatches = 0;
+
+    if( fd < 0 || !index.Open( path.c_str() ) || index.Entries() != frames )
+    {
+        fprintf( stderr, "record: the take %s is not there, or not indexed\n", base );
+        failures += 1;
+    }
+    else
+    {
+        for( unsigned i = 0; i < frames; ++i )
+        {
+            uint64_t found = 0;
+            STimecodeIndexEntry entry;
+            uint64_t marks[2] = { ~0ull, ~0ull };
+
+            if( !index.SeekStreamTime( (BMDTimeValue)i * pDesc->frameDuration, &found ) ||
+                !index.GetEntry( found, &entry ) || entry.size != size ||
+                pread( fd, &marks[0], 8, (off_t)entry.offset ) != 8 ||
+                pread( fd, &marks[1], 8, (off_t)( entry.offset + size - 8 ) ) != 8 ||
+                marks[0] != i || marks[1] != i )
+            {
+                ++mismatches;
+            }
+        }
+
+        printf( "    read back through the index: %u of %u frames wrong\n", mismatches, frames );
+        failures += ( mismatches != 0 );
+    }
+
+    if( fd >= 0 )
+    {
+        close(fd);
+    }
+
+    index.Close();
+    unlink( video.c_str() );
+    unlink( audio.c_str() );
+    unlink( path.c_str() );
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunRecordBench( int argc, char** argv )
+{
+    std::string dir = ".";
+    unsigned frames = 200;
+    unsigned depth = CCaptureRecorder::kDefaultDepth;
+    BMDDisplayMode mode = bmdMode4K2160p30;
+    BMDPixelFormat format = bmdFormat10BitYUV;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--dir" ) == 0 )  dir = argv[++i];
+        else if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )  frames = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--depth" ) == 0 )  depth = (unsigned)atoi( argv[++i] );
+        else if( strcmp( argv[i], "--hd" ) == 0 )  mode = bmdModeHD1080p50;
+        else if( i + 1 < argc && strcmp( argv[i], "--format" ) == 0 && ParsePixelFormat( argv[i + 1], &format ) )  ++i;
+        else
+        {
+            PrintRecordUsage();
+            return 1;
+        }
+    }
+
+    const SDisplayModeDesc* pDesc = FindDisplayMode(mode);
+
+    if( frames == 0 || depth == 0 || pDesc == NULL )
+    {
+        PrintRecordUsage();
+        return 1;
+    }
+
+    const long rowBytes = RowBytesForPixelFormat( format, pDesc->width );
+    const size_t size = (size_t)rowBytes * pDesc->height;
+
+    printf( "record: %u frames of %s %s, %.1f MB each, and 16 channels of audio, to %s\n\n", frames, pDesc->name,
+            PixelFormatName(format), size / 1048576.0, dir.c_str() );
+
+    int failures = BenchBuffered( dir, size, frames );
+
+    failures += BenchRecorder( dir, pDesc, format, size, rowBytes, frames, depth );
+    return failures ? 1 : 0;
+}
+#else
+//---------------------------------------------------------------------------------------------------------------------
+int RunRecordBench( int argc, char** argv )
+{
+    fprintf( stderr, "record: CCaptureRecorder runs on Linux only\n" );
+    return 1;
+}
+#endif // __linux__
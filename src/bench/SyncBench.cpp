@@ -0,0 +1,299 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../SyncTracker.h"
+#include "Bench.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintSyncUsage()
+{
+    fprintf( stderr,
+        "Usage: sync [--frames N] [--jitter US] [--missed N]\n"
+        "\n"
+        "CSyncTracker fed a 1080p29.97 stream with audio, one frame and packet at a time, while another thread\n"
+        "reads its statistics: the cost of Record() from the times and from the frame and packet interfaces, and of\n"
+        "GetStats(). The jitter is normal with the given standard deviation, every Nth frame is missed, and the\n"
+        "audio runs at 48 kHz against the video's 30000/1001 Hz with a fixed offset. The histogram's percentiles,\n"
+        "missed frames and audio gaps are checked against the stream.\n"
+        "Defaults: 200000 frames, 50 us of jitter, every 1000th frame missed.\n" );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static const int64_t kFrameNum = 1001;
+static const int64_t kFrameDen = 30000;
+static const int64_t kOffsetNs = 1500000;
+
+// Times of frame k of the stream, and of its audio packet.
+static void StreamSample( uint64_t k, double noiseNs, SSyncSample* pSample )
+{
+    const int64_t samples = (int64_t)( k * bmdAudioSampleRate48kHz * kFrameNum / kFrameDen );
+    const int64_t next = (int64_t)( ( k + 1 ) * bmdAudioSampleRate48kHz * kFrameNum / kFrameDen );
+
+    pSample->video = true;
+    pSample->streamNs = (int64_t)( k * 1000000000 * kFrameNum / kFrameDen );
+    pSample->hardwareNs = pSample->streamNs + (int64_t)llround(noiseNs);
+    pSample->durationNs = 1000000000 * kFrameNum / kFrameDen;
+    pSample->audio = true;
+    pSample->packetNs = samples * 1000000000 / bmdAudioSampleRate48kHz + kOffsetNs;
+    pSample->audioFrames = (long)( next - samples );
+}
+
+//=====================================================================================================================
+// A frame and a packet which return the times of an SSyncSample, for Record() through the interfaces.
+class CBenchInputFrame : public IDeckLinkVideoInputFrame
+{
+    const SSyncSample*  m_pSample;
+
+public:
+    explicit CBenchInputFrame( const SSyncSample* pSample ) : m_pSample(pSample)  {}
+    virtual ~CBenchInputFrame()  {}
+
+    // overrides IDeckLinkVideoInputFrame
+    virtual HRESULT STDMETHODCALLTYPE GetStreamTime( BMDTimeValue* frameTime, BMDTimeValue* frameDuration,
+                                                     BMDTimeScale timeScale )
+    {
+        *frameTime = m_pSample->streamNs * ( timeScale / 1000000000 );
+        *frameDuration = m_pSample->durationNs * ( timeScale / 1000000000 );
+        return S_OK;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetHardwareReferenceTimestamp( BMDTimeScale timeScale, BMDTimeValue* frameTime,
+                                                                     BMDTimeValue* frameDuration )
+    {
+        *frameTime = m_pSample->hardwareNs * ( timeScale / 1000000000 );
+        *frameDuration = m_pSample->durationNs * ( timeScale / 1000000000 );
+        return S_OK;
+    }
+
+    // overrides IDeckLinkVideoFrame
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return 1920; }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return 1080; }
+    virtual long STDMETHODCALLTYPE GetRowBytes(void)  { return 5120; }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return bmdFormat10BitYUV; }
+    virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void)  { return bmdFrameFlagDefault; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer )  { *buffer = NULL; return E_FAIL; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode )
+    {
+        *timecode = NULL;
+        return S_FALSE;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary )
+    {
+        *ancillary = NULL;
+        return S_FALSE;
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+class CBenchAudioPacket : public IDeckLinkAudioInputPacket
+{
+    const SSyncSample*  m_pSample;
+
+public:
+    explicit CBenchAudioPacket( const SSyncSample* pSample ) : m_pSample(pSample)  {}
+    virtual ~CBenchAudioPacket()  {}
+
+    // overrides IDeckLinkAudioInputPacket
+    virtual long STDMETHODCALLTYPE GetSampleFrameCount(void)  { return m_pSample->audioFrames; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer )  { *buffer = NULL; return E_FAIL; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetPacketTime( BMDTimeValue* packetTime, BMDTimeScale timeScale )
+    {
+        *packetTime = m_pSample->packetNs * ( timeScale / 1000000000 );
+        return S_OK;
+    }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Within the bucket the value falls in, 1/64 of it, either way.
+static bool CloseEnough( int64_t measured, int64_t exact )
+{
+    return llabs( measured - exact ) <= llabs(exact) / 32 + 1;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// One stream through a tracker: through the interfaces or not. Returns the failures.
+static int RunTracker( bool interfaces, uint64_t frames, double jitterUs, unsigned missedEvery )
+{
+    std::mt19937_64 rng(19);
+    std::normal_distribution<double> noise( 0.0, jitterUs * 1000.0 );
+    CSyncTracker* pTracker = new CSyncTracker();
+    std::atomic<bool> done(false);
+    std::vector<uint64_t> recordNs, readNs;
+    std::vector<int64_t> jitters;
+    uint64_t missed = 0;
+
+    recordNs.reserve(frames);
+    readNs.reserve( 1 << 16 );
+    jitters.reserve(frames);
+
+    std::thread reader( [&]()
+    {
+        SSyncStats stats;
+
+        while( !done.load() )
+        {
+            const uint64_t t0 = BenchNowNs();
+            pTracker->GetStats(&stats);
+
+            if( readNs.size() < readNs.capacity() )
+            {
+                readNs.push_back( BenchNowNs() - t0 );
+            }
+
+            std::this_thread::yield();
+        }
+    } );
+
+    SSyncSample sample;
+    CBenchInputFrame frame(&sample);
+    CBenchAudioPacket packet(&sample);
+    double last = 0.0;
+    bool haveLast = false;
+
+    for( uint64_t k = 0; k < frames; ++k )
+    {
+        const double n = noise(rng);
+
+        // the audio of a missed frame is missed too, and counts as a gap; both only once another frame follows
+        if( missedEvery != 0 && k % missedEvery == missedEvery - 1 )
+        {
+            missed += ( k + 1 < frames );
+            continue;
+        }
+
+        StreamSample( k, n, &sample );
+
+        if( haveLast )
+        {
+            jitters.push_back( llround(n) - llround(last) );
+        }
+
+        last = n;
+        haveLast = true;
+
+        const uint64_t t0 = BenchNowNs();
+
+        if( interfaces )
+        {
+            pTracker->Record( &frame, &packet );
+        }
+        else
+        {
+            pTracker->Record(sample);
+        }
+
+        recordNs.push_back( BenchNowNs() - t0 );
+    }
+
+    done.store(true);
+    reader.join();
+
+    SSyncStats stats;
+    pTracker->GetStats(&stats);
+    delete pTracker;
+
+    const SLatencyStats record = ComputeLatencyStats(recordNs);
+
+    PrintLatencyRow( interfaces ? "Record(frame, packet)" : "Record(sample)", record, -1.0 );
+    PrintLatencyRow( "GetStats (other thread)", ComputeLatencyStats(readNs), -1.0 );
+
+    std::sort( jitters.begin(), jitters.end() );
+
+    const int64_t p50 = jitters[ (size_t)( jitters.size() * 0.5 ) ];
+    const int64_t p99 = jitters[ (size_t)( jitters.size() * 0.99 ) ];
+    const int64_t p999 = jitters[ (size_t)( jitters.size() * 0.999 ) ];
+    int failures = 0;
+
+    printf( "    jitter p50/p99/p99.9 %lld/%lld/%lld ns, exact %lld/%lld/%lld; offset mean %.0f ns, "
+            "%llu missed, %llu audio gaps\n",
+            (long long)stats.jitter.p50Ns, (long long)stats.jitter.p99Ns, (long long)stats.jitter.p999Ns,
+            (long long)p50, (long long)p99, (long long)p999, stats.offset.meanNs,
+            (unsigned long long)stats.missedFrames, (unsigned long long)stats.audioGaps );
+
+    if( stats.jitter.count != jitters.size() || !CloseEnough( stats.jitter.p50Ns, p50 ) ||
+        !CloseEnough( stats.jitter.p99Ns, p99 ) || !CloseEnough( stats.jitter.p999Ns, p999 ) )
+    {
+        fprintf( stderr, "sync: jitter percentiles off\n" );
+        ++failures;
+    }
+
+    // half a sample frame around the offset, the audio's share of the frame boundary
+    if( stats.missedFrames != missed || stats.audioGaps != missed ||
+        fabs( stats.offset.meanNs - kOffsetNs ) > 1e9 / bmdAudioSampleRate48kHz )
+    {
+        fprintf( stderr, "sync: missed frames, audio gaps or offset off\n" );
+        ++failures;
+    }
+
+    if( record.meanNs >= 1000.0 )
+    {
+        fprintf( stderr, "sync: Record() takes %.0f ns\n", record.meanNs );
+        ++failures;
+    }
+
+    return failures;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunSyncBench( int argc, char** argv )
+{
+    uint64_t frames = 200000;
+    double jitterUs = 50.0;
+    unsigned missedEvery = 1000;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )  frames = strtoull( argv[++i], NULL, 0 );
+        else if( i + 1 < argc && strcmp( argv[i], "--jitter" ) == 0 )  jitterUs = atof( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--missed" ) == 0 )  missedEvery = (unsigned)atoi( argv[++i] );
+        else
+        {
+            PrintSyncUsage();
+            return 1;
+        }
+    }
+
+    if( frames < 1000 || jitterUs < 0.0 || missedEvery == 1 )
+    {
+        PrintSyncUsage();
+        return 1;
+    }
+
+    printf( "sync: %llu frames of 1080p29.97 with audio, %.1f us jitter, every %u frames one missed (0 = none)\n\n",
+            (unsigned long long)frames, jitterUs, missedEvery );
+    PrintLatencyHeader();
+
+    int failures = RunTracker( false, frames, jitterUs, missedEvery );
+    failures += RunTracker( true, frames, jitterUs, missedEvery );
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,497 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../Timecode.h"
+#include "../TimecodeIndex.h"
+#include "Bench.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintTimecodeUsage()
+{
+    fprintf( stderr,
+        "Usage: timecode [--channels N] [--frames N] [--runs N] [--index-hours N] [--index FILE]\n"
+        "\n"
+        "Turning the timecode of every channel's frame into a count of frames, channels in a mix of modes with and\n"
+        "without drop-frame: GetString() parsed with sscanf(), as most code does, then GetBCD() with\n"
+        "TimecodeToFrames() per channel, then GetBCD() into a column converted by TimecodesToFrames() with each\n"
+        "kernel the CPU supports, then CTimecodeLog::Append(). Every method must give the same counts. Then seeking\n"
+        "a CTimecodeLog holding the given number of runs. Then writing a CTimecodeIndex of a 59.94 recording of the\n"
+        "given length to FILE, crossing midnight, with cuts and stretches without timecode, and seeking it by\n"
+        "stream time and by timecode, while written and once reopened; FILE is removed afterwards.\n"
+        "Defaults: 32 channels, 2000 frames, 4096 runs, 24 hours (0 = no index), timecode-bench.idx.\n" );
+}
+
+//=====================================================================================================================
+// Timecode of one channel's frame. GetString() formats it on each call, as the driver has to. Lives on the stack.
+class CBenchTimecode : public IDeckLinkTimecode
+{
+    BMDTimecodeBCD  m_Bcd;
+    uint8_t         m_Rate;
+    char            m_String[16];
+
+public:
+    CBenchTimecode() : m_Bcd(0), m_Rate(0)  {}
+    virtual ~CBenchTimecode()  {}
+
+    void Set( BMDTimecodeBCD bcd, uint8_t rate )  { m_Bcd = bcd; m_Rate = rate; }
+
+    // overrides IDeckLinkTimecode
+    virtual BMDTimecodeBCD STDMETHODCALLTYPE GetBCD(void)  { return m_Bcd; }
+
+    virtual HRESULT STDMETHODCALLTYPE GetComponents( uint8_t* hours, uint8_t* minutes, uint8_t* seconds,
+                                                     uint8_t* frames )
+    {
+        return E_NOTIMPL;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetString( const char** timecode )
+    {
+        FormatTimecode( m_Bcd, m_Rate, m_String );
+        *timecode = m_String;
+        return S_OK;
+    }
+
+    virtual BMDTimecodeFlags STDMETHODCALLTYPE GetFlags(void)
+    {
+        return ( m_Rate & kTimecodeDropFrame ) ? bmdTimecodeIsDropFrame : bmdTimecodeFlagDefault;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetTimecodeUserBits( BMDTimecodeUserBits* userBits )  { return E_NOTIMPL; }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObject )
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void)  { return 2; }
+    virtual ULONG STDMETHODCALLTYPE Release(void)  { return 1; }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// The usual way: parse the string, then count with divisions and a branch.
+static uint32_t ParseTimecode( const char* pString, unsigned fps, bool dropFrame )
+{
+    unsigned hours, minutes, seconds, frames;
+    char separator;
+
+    if( sscanf( pString, "%u:%u:%u%c%u", &hours, &minutes, &seconds, &separator, &frames ) != 5 )
+    {
+        return ~0u;
+    }
+
+    const unsigned total = hours * 60 + minutes;
+    uint32_t count = ( total * 60 + seconds ) * fps + frames;
+
+    if( dropFrame )
+    {
+        count -= fps / 15 * ( total - total / 10 );
+    }
+
+    return count;
+}
+
+//=====================================================================================================================
+// Channels in the modes of a mixed plant, each starting at its own time of day.
+struct SBenchChannels
+{
+    std::vector<CBenchTimecode>  timecodes;
+    std::vector<uint8_t>         rates;
+    std::vector<uint32_t>        start;
+
+    explicit SBenchChannels( unsigned channels )
+        : timecodes(channels), rates(channels), start(channels)
+    {
+        static const uint8_t kRates[] = { 25, 30 | kTimecodeDropFrame, 50, 60 | kTimecodeDropFrame, 24, 30, 60 };
+
+        for( unsigned c = 0; c < channels; ++c )
+        {
+            rates[c] = kRates[ c % ( sizeof(kRates) / sizeof(kRates[0]) ) ];
+            start[c] = (uint32_t)( ( c * 2654435761u ) % TimecodeDayFrames( rates[c] ) );
+        }
+    }
+
+    uint32_t Expected( unsigned c, unsigned f ) const
+    {
+        return ( start[c] + f ) % TimecodeDayFrames( rates[c] );
+    }
+
+    void SetFrame( unsigned f )
+    {
+        for( unsigned c = 0; c < timecodes.size(); ++c )
+        {
+            timecodes[c].Set( FramesToTimecode( Expected( c, f ), rates[c] ), rates[c] );
+        }
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// method: 0 = parsed string, 1 = TimecodeToFrames() per channel, 2 = a batch with the kernels of isa, 3 = the logs.
+static int BenchConvert( unsigned channels, unsigned frames, int method, ECpuIsa isa, const char* name )
+{
+    SBenchChannels bench(channels);
+    std::vector<IDeckLinkTimecode*> objects( channels );
+    std::vector<BMDTimecodeBCD> bcd( channels );
+    std::vector<uint8_t> rates( channels );
+    std::vector<uint32_t> counts( channels );
+    std::vector<CTimecodeLog*> logs;
+    std::vector<uint64_t> tickNs;
+    unsigned mismatches = 0;
+
+    for( unsigned c = 0; c < channels; ++c )
+    {
+        objects[c] = &bench.timecodes[c];
+
+        if( method == 3 )
+        {
+            logs.push_back( new CTimecodeLog( bmdTimecodeRP188Any, 64 ) );
+            logs[c]->SetMode( ( bench.rates[c] & 0x7F ) == 25 ? bmdModeHD1080i50 :
+                              ( bench.rates[c] & 0x7F ) == 30 ? bmdModeHD1080i5994 :
+                              ( bench.rates[c] & 0x7F ) == 50 ? bmdModeHD1080p50 :
+                              ( bench.rates[c] & 0x7F ) == 60 ? bmdModeHD1080p5994 : bmdModeHD1080p24 );
+        }
+    }
+
+    tickNs.reserve(frames);
+
+    const uint64_t allocs = BenchAllocCount();
+
+    for( unsigned f = 0; f < frames; ++f )
+    {
+        bench.SetFrame(f);
+
+        const uint64_t t0 = BenchNowNs();
+
+        for( unsigned c = 0; c < channels; ++c )
+        {
+            IDeckLinkTimecode* pTimecode = objects[c];
+
+            if( method == 0 )
+            {
+                const char* pString = NULL;
+
+                pTimecode->GetString(&pString);
+                counts[c] = ParseTimecode( pString, bench.rates[c] & 0x7F,
+                                           ( pTimecode->GetFlags() & bmdTimecodeIsDropFrame ) != 0 );
+            }
+            else if( method == 1 )
+            {
+                const BMDTimecodeBCD value = pTimecode->GetBCD();
+
+                counts[c] = TimecodeToFrames( value, ( bench.rates[c] & 0x7F ) |
+                                              ( ( pTimecode->GetFlags() & bmdTimecodeIsDropFrame ) ?
+                                                kTimecodeDropFrame : 0 ) );
+            }
+            else if( method == 2 )
+            {
+                bcd[c] = pTimecode->GetBCD();
+                rates[c] = (uint8_t)( ( bench.rates[c] & 0x7F ) |
+                                      ( ( pTimecode->GetFlags() & bmdTimecodeIsDropFrame ) ? kTimecodeDropFrame : 0 ) );
+            }
+            else
+            {
+                logs[c]->Append( f, pTimecode->GetBCD(), pTimecode->GetFlags() );
+            }
+        }
+
+        if( method == 2 )
+        {
+            TimecodesToFrames( bcd.data(), rates.data(), channels, counts.data(), isa );
+        }
+
+        tickNs.push_back( BenchNowNs() - t0 );
+
+        for( unsigned c = 0; c < channels && method != 3; ++c )
+        {
+            mismatches += ( counts[c] != bench.Expected( c, f ) );
+        }
+    }
+
+    const double allocsPerTick = (double)( BenchAllocCount() - allocs ) / frames;
+
+    // one run each, the timecode of every frame in it
+    for( size_t c = 0; c < logs.size(); ++c )
+    {
+        CTimecodeLog::SStats stats;
+        uint64_t frame;
+
+        logs[c]->GetStats(&stats);
+        mismatches += ( stats.runs != 1 || stats.frames != frames );
+        mismatches += ( !logs[c]->Seek( FramesToTimecode( bench.Expected( (unsigned)c, frames / 2 ),
+                                                          bench.rates[c] ), &frame ) || frame != frames / 2 );
+        logs[c]->Release();
+    }
+
+    PrintLatencyRow( name, ComputeLatencyStats(tickNs), allocsPerTick );
+
+    if( mismatches != 0 )
+    {
+        fprintf( stderr, "timecode: %s: %u counts differ from the timecodes\n", name, mismatches );
+        return 1;
+    }
+
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A log of 59.94 drop-frame filled to capacity with runs of 50 frames, a gap of a few frames between each two; each
+// seek is to the timecode of a random frame of a run still kept.
+static int BenchSeek( unsigned runs, unsigned seeks )
+{
+    const uint8_t rate = 60 | kTimecodeDropFrame;
+    CTimecodeLog* pLog = new CTimecodeLog( bmdTimecodeRP188Any, runs );
+    CTimecodeLog::SStats stats;
+    std::vector<uint32_t> counts;
+    std::vector<uint64_t> seekNs;
+    uint32_t count = 1000;
+    unsigned mismatches = 0;
+
+    pLog->SetMode(bmdModeHD1080p5994);
+    pLog->GetStats(&stats);
+    counts.reserve( (size_t)stats.capacity * 50 );
+
+    for( uint64_t frame = 0; frame < (uint64_t)stats.capacity * 50; ++frame )
+    {
+        count += ( frame % 50 == 0 ) ? 2 + (uint32_t)( frame / 50 % 7 ) : 1;
+        counts.push_back(count);
+        pLog->Append( frame, FramesToTimecode( count, rate ), bmdTimecodeIsDropFrame );
+    }
+
+    // every run but the first starts with a gap
+    pLog->GetStats(&stats);
+    mismatches += ( stats.runs != stats.capacity || stats.gaps != stats.runs - 1 );
+    seekNs.reserve(seeks);
+
+    for( unsigned i = 0; i < seeks; ++i )
+    {
+        // the oldest run may be overwritten at any time, as far as readers know
+        const uint64_t frame = 50 + ( i * 2654435761u ) % ( ( stats.capacity - 1 ) * 50 );
+        uint64_t found = 0;
+        const BMDTimecodeBCD target = FramesToTimecode( counts[frame], rate );
+        const uint64_t t0 = BenchNowNs();
+        const bool ok = pLog->Seek( target, &found );
+
+        seekNs.push_back( BenchNowNs() - t0 );
+        mismatches += ( !ok || found != frame );
+    }
+
+    char name[64];
+
+    snprintf( name, sizeof(name), "seek, %u runs", stats.capacity );
+    PrintLatencyRow( name, ComputeLatencyStats(seekNs), -1.0 );
+    pLog->Release();
+
+    if( mismatches != 0 )
+    {
+        fprintf( stderr, "timecode: %u seeks found the wrong frame, or the gaps were miscounted\n", mismatches );
+        return 1;
+    }
+
+    return 0;
+}
+
+#ifndef _WIN32
+//---------------------------------------------------------------------------------------------------------------------
+// Frame i of the recording: its timecode's count, and its rate, 0 = none. The timecode starts at 12:00:00;00 and
+// jumps a few frames ahead every 10 minutes, and 2 seconds of every hour have none.
+static uint8_t IndexFrame( uint64_t frame, uint32_t* pCount )
+{
+    const uint8_t rate = 60 | kTimecodeDropFrame;
+    const uint64_t hour = 216000;
+
+    *pCount = (uint32_t)( ( TimecodeToFrames( 0x12000000, rate ) + frame + frame / 36000 * 3 ) %
+                          TimecodeDayFrames(rate) );
+    return frame % hour < hour - 120 ? rate : 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static int SeekIndex( const CTimecodeIndex& index, uint64_t frames, unsigned seeks, const char* what )
+{
+    std::vector<uint64_t> timeNs;
+    std::vector<uint64_t> timecodeNs;
+    unsigned mismatches = 0;
+
+    timeNs.reserve(seeks);
+    timecodeNs.reserve(seeks);
+
+    for( unsigned i = 0; i < seeks; ++i )
+    {
+        const uint64_t frame = ( i * 2654435761u + (uint64_t)i * i * 40503u ) % frames;
+        uint32_t count = 0;
+        const uint8_t rate = IndexFrame( frame, &count );
+        uint64_t found = 0;
+
+        // anywhere within the frame's duration finds it
+        uint64_t t0 = BenchNowNs();
+        bool ok = index.SeekStreamTime( (BMDTimeValue)( frame * 1001 + i % 1001 ), &found );
+
+        timeNs.push_back( BenchNowNs() - t0 );
+        mismatches += ( !ok || found != frame );
+
+        // a full day's timecode comes round to the first frames' in the last few seconds
+        if( rate != 0 && frame + 2000 < frames )
+        {
+            const BMDTimecodeBCD target = FramesToTimecode( count, rate );
+
+            t0 = BenchNowNs();
+            ok = index.SeekTimecode( target, &found );
+            timecodeNs.push_back( BenchNowNs() - t0 );
+            mismatches += ( !ok || found != frame );
+        }
+    }
+
+    char name[64];
+
+    snprintf( name, sizeof(name), "%s, by stream time", what );
+    PrintLatencyRow( name, ComputeLatencyStats(timeNs), -1.0 );
+    snprintf( name, sizeof(name), "%s, by timecode", what );
+    PrintLatencyRow( name, ComputeLatencyStats(timecodeNs), -1.0 );
+    return (int)mismatches;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The index of a recording at 59.94, stream times in 1/60000 s as the card gives them, offsets of 8-bit 1080 frames.
+static int BenchIndex( unsigned hours, const char* path )
+{
+    const uint64_t frames = (uint64_t)hours * 60 * 60 * 60 * 1000 / 1001;
+    const uint32_t frameBytes = 1920 * 1080 * 2;
+    CTimecodeIndex index;
+    CTimecodeIndex::SStats stats;
+    uint64_t untimed = 0;
+    int mismatches = 0;
+
+    if( !index.Create( path, 60000, frames, 4096 ) )
+    {
+        fprintf( stderr, "timecode: creating %s failed: %s\n", path, strerror(errno) );
+        return 1;
+    }
+
+    uint64_t t0 = BenchNowNs();
+    uint64_t allocs = BenchAllocCount();
+
+    for( uint64_t frame = 0; frame < frames; ++frame )
+    {
+        uint32_t count = 0;
+        const uint8_t rate = IndexFrame( frame, &count );
+
+        untimed += ( rate == 0 );
+        mismatches += !index.Append( (BMDTimeValue)( frame * 1001 ), frame * frameBytes, frameBytes,
+                                     rate ? FramesToTimecode( count, rate ) : 0, rate );
+    }
+
+    const double appendNs = (double)( BenchNowNs() - t0 ) / (double)frames;
+
+    allocs = BenchAllocCount() - allocs;
+    index.GetStats(&stats);
+    printf( "\nindex of %u hours: %llu frames, %llu runs, %llu segments, %llu without timecode, %.1f MB; "
+            "%.0f ns and %llu allocations per frame appended\n",
+            hours, (unsigned long long)stats.entries, (unsigned long long)stats.runs,
+            (unsigned long long)stats.segments, (unsigned long long)stats.untimed, stats.bytes / 1048576.0, appendNs,
+            (unsigned long long)( allocs / frames ) );
+
+    // a segment a day, so far as the timecode goes past midnight
+    mismatches += ( stats.entries != frames || stats.untimed != untimed || stats.segments != ( hours > 11 ? 2u : 1u ) );
+
+    PrintLatencyHeader();
+    mismatches += SeekIndex( index, frames, 1000, "written" );
+    index.Close();
+
+    CTimecodeIndex reader;
+
+    t0 = BenchNowNs();
+
+    if( !reader.Open(path) )
+    {
+        fprintf( stderr, "timecode: opening %s failed: %s\n", path, strerror(errno) );
+        unlink(path);
+        return 1;
+    }
+
+    printf( "\nreopened in %.1f us, %s\n", ( BenchNowNs() - t0 ) / 1000.0, reader.Complete() ? "complete" : "open" );
+    PrintLatencyHeader();
+    mismatches += SeekIndex( reader, frames, 1000, "reopened" );
+    mismatches += !reader.Complete() || reader.Entries() != frames;
+    reader.Close();
+    unlink(path);
+
+    if( mismatches != 0 )
+    {
+        fprintf( stderr, "timecode: the index lost frames, or %d seeks found the wrong frame\n", mismatches );
+        return 1;
+    }
+
+    return 0;
+}
+#endif // _WIN32
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunTimecodeBench( int argc, char** argv )
+{
+    unsigned channels = 32;
+    unsigned frames = 2000;
+    unsigned runs = 4096;
+    unsigned hours = 24;
+    const char* path = "timecode-bench.idx";
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--channels" ) == 0 )  channels = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )  frames = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--runs" ) == 0 )  runs = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--index-hours" ) == 0 )  hours = (unsigned)atoi( argv[++i] );
+        else if( i + 1 < argc && strcmp( argv[i], "--index" ) == 0 )  path = argv[++i];
+        else
+        {
+            PrintTimecodeUsage();
+            return 1;
+        }
+    }
+
+    if( channels == 0 || frames == 0 || runs < 2 || hours > 24 )
+    {
+        PrintTimecodeUsage();
+        return 1;
+    }
+
+    printf( "timecode: %u channels, %u frames, best %s; times are per frame of all channels\n\n", channels, frames,
+            CpuIsaName( HasAvx2() ? kIsaAvx2 : kIsaScalar ) );
+    PrintLatencyHeader();
+
+    int failures = BenchConvert( channels, frames, 0, kIsaScalar, "GetString + sscanf" );
+
+    failures += BenchConvert( channels, frames, 1, kIsaScalar, "GetBCD per channel" );
+
+    for( int isa = kIsaScalar; isa < kIsaCount; ++isa )
+    {
+        char name[64];
+
+        // only the AVX2 kernel is distinct; the others would repeat the scalar one's row
+        if( !HasCpuIsa( (ECpuIsa)isa ) || ( isa != kIsaScalar && isa != kIsaAvx2 ) )
+        {
+            continue;
+        }
+
+        snprintf( name, sizeof(name), "GetBCD batch %s", CpuIsaName( (ECpuIsa)isa ) );
+        failures += BenchConvert( channels, frames, 2, (ECpuIsa)isa, name );
+    }
+
+    failures += BenchConvert( channels, frames, 3, kIsaScalar, "CTimecodeLog::Append" );
+    failures += BenchSeek( runs, 1000 );
+
+#ifndef _WIN32
+    if( hours != 0 )
+    {
+        failures += BenchIndex( hours, path );
+    }
+#endif
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include "../DisplayModes.h"
+#include "../V210.h"
+#include "Bench.h"
+
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintV210Usage()
+{
+    fprintf( stderr,
+        "Usage: v210 [--mode <name>] [--frames N]\n"
+        "\n"
+        "v210 to and from planar 4:2:2 10-bit, 4:2:2 8-bit and P010, per frame, with each row kernel the CPU\n"
+        "supports; every result is checked against the plain C kernels. Then the API's converter (v210 to 2vuy) on\n"
+        "the same frame, if there is one.\n"
+        "Defaults: 2160p25, 50 frames.\n" );
+}
+
+//=====================================================================================================================
+// Planes of one image in one of the planar formats, tightly packed.
+struct SBenchPlanes
+{
+    std::vector<uint8_t>  planes[3];
+    SPlanarImage          image;
+
+    SBenchPlanes( EPlanarFormat format, long width, long height )
+    {
+        const long chroma = ( width + 1 ) / 2;
+        const long sample = ( format == kPlanarI422P8 ) ? 1 : 2;
+
+        memset( &image, 0, sizeof(image) );
+
+        for( int i = 0; i < 3; ++i )
+        {
+            long rowBytes = ( i == 0 ) ? width * sample : chroma * sample;
+            long rows = height;
+
+            if( format == kPlanarP010 && i == 1 )
+            {
+                rowBytes = chroma * 2 * sample;
+                rows = ( height + 1 ) / 2;
+            }
+            else if( format == kPlanarP010 && i == 2 )
+            {
+                break;
+            }
+
+            planes[i].resize( rowBytes * rows );
+            image.pPlane[i] = planes[i].data();
+            image.stride[i] = rowBytes;
+        }
+    }
+
+    bool operator==( const SBenchPlanes& other ) const
+    {
+        return planes[0] == other.planes[0] && planes[1] == other.planes[1] && planes[2] == other.planes[2];
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+static const struct
+{
+    EPlanarFormat  format;
+    const char*    name;
+}
+g_PlanarFormats[] =
+{
+    { kPlanarI422P10, "p10" },
+    { kPlanarI422P8,  "p8" },
+    { kPlanarP010,    "p010" },
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+int RunV210Bench( int argc, char** argv )
+{
+    BMDDisplayMode mode = bmdMode4K2160p25;
+    unsigned frames = 50;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        if( i + 1 < argc && strcmp( argv[i], "--mode" ) == 0 && ParseDisplayMode( argv[i + 1], &mode ) )  ++i;
+        else if( i + 1 < argc && strcmp( argv[i], "--frames" ) == 0 )  frames = (unsigned)atoi( argv[++i] );
+        else
+        {
+            PrintV210Usage();
+            return 1;
+        }
+    }
+
+    const SDisplayModeDesc* pMode = FindDisplayMode(mode);
+
+    if( frames == 0 || pMode == NULL )
+    {
+        PrintV210Usage();
+        return 1;
+    }
+
+    const long width = pMode->width;
+    const long height = pMode->height;
+    const long rowBytes = RowBytesForPixelFormat( bmdFormat10BitYUV, width );
+    const SV210Kernels* pScalar = GetV210Kernels(kIsaScalar);
+
+    // source: random samples, packed by the plain C kernels so that the padding is as the hardware leaves it
+    SBenchPlanes random( kPlanarI422P10, width, height );
+    std::mt19937 rng(210);
+
+    for( int i = 0; i < 3; ++i )
+    {
+        uint16_t* p = (uint16_t*)random.planes[i].data();
+
+        for( size_t j = 0; j < random.planes[i].size() / 2; ++j )
+        {
+            p[j] = (uint16_t)( rng() & 0x3FF );
+        }
+    }
+
+    std::vector<uint8_t> source( rowBytes * height ), packed( rowBytes * height );
+    PackV210( random.image, kPlanarI422P10, width, height, source.data(), rowBytes, pScalar );
+
+    printf( "v210: %s %ldx%ld, %u frames per kernel, best %s\n\n", pMode->name, width, height, frames,
+            GetV210Kernels()->name );
+    PrintLatencyHeader();
+
+    int failures = 0;
+
+    for( size_t f = 0; f < sizeof(g_PlanarFormats) / sizeof(g_PlanarFormats[0]); ++f )
+    {
+        const EPlanarFormat format = g_PlanarFormats[f].format;
+        SBenchPlanes reference( format, width, height ), planes( format, width, height );
+
+        UnpackV210( source.data(), rowBytes, width, height, format, reference.image, pScalar );
+
+        for( int isa = 0; isa < kIsaCount; ++isa )
+        {
+            const SV210Kernels* pKernels = GetV210Kernels( (ECpuIsa)isa );
+
+            if( pKernels == NULL )
+            {
+                continue;
+            }
+
+            std::vector<uint64_t> unpackNs, packNs;
+
+            for( unsigned i = 0; i < frames; ++i )
+            {
+                uint64_t t0 = BenchNowNs();
+                UnpackV210( source.data(), rowBytes, width, height, format, planes.image, pKernels );
+                unpackNs.push_back( BenchNowNs() - t0 );
+
+                t0 = BenchNowNs();
+                PackV210( planes.image, format, width, height, packed.data(), rowBytes, pKernels );
+                packNs.push_back( BenchNowNs() - t0 );
+            }
+
+            char name[64];
+
+            snprintf( name, sizeof(name), "%s unpack %s", pKernels->name, g_PlanarFormats[f].name );
+            PrintLatencyRow( name, ComputeLatencyStats(unpackNs), -1.0 );
+            snprintf( name, sizeof(name), "%s pack %s", pKernels->name, g_PlanarFormats[f].name );
+            PrintLatencyRow( name, ComputeLatencyStats(packNs), -1.0 );
+
+            if( !( planes == reference ) )
+            {
+                fprintf( stderr, "v210: %s unpack to %s differs from scalar\n", pKernels->name,
+                         g_PlanarFormats[f].name );
+                ++failures;
+            }
+
+            // lossless only at 10 bits and full chroma; otherwise compare with packing the reference
+            std::vector<uint8_t> expected( source );
+
+            if( format != kPlanarI422P10 )
+            {
+                PackV210( reference.image, format, width, height, expected.data(), rowBytes, pScalar );
+            }
+
+            if( packed != expected )
+            {
+                fprintf( stderr, "v210: %s pack from %s differs from scalar\n", pKernels->name,
+                         g_PlanarFormats[f].name );
+                ++failures;
+            }
+        }
+    }
+
+    // the API's converter, to 8-bit 2vuy, which is the work of unpacking to p8
+    IDeckLinkVideoConversion* pConversion = CreateVideoConversionInst();
+
+    if( pConversion == NULL )
+    {
+        printf( "\nAPI converter: not available\n" );
+        return failures ? 1 : 0;
+    }
+
+    const long rowBytes2vuy = RowBytesForPixelFormat( bmdFormat8BitYUV, width );
+    std::vector<uint8_t> converted( rowBytes2vuy * height );
+    CBenchFrame srcFrame( source.data(), width, height, rowBytes, bmdFormat10BitYUV );
+    CBenchFrame dstFrame( converted.data(), width, height, rowBytes2vuy, bmdFormat8BitYUV );
+    std::vector<uint64_t> convertNs;
+
+    for( unsigned i = 0; i < frames; ++i )
+    {
+        const uint64_t t0 = BenchNowNs();
+
+        if( pConversion->ConvertFrame( &srcFrame, &dstFrame ) != S_OK )
+        {
+            printf( "\nAPI converter: ConvertFrame() v210 to 2vuy failed\n" );
+            convertNs.clear();
+            break;
+        }
+
+        convertNs.push_back( BenchNowNs() - t0 );
+    }
+
+    if( !convertNs.empty() )
+    {
+        PrintLatencyRow( "api convert 2vuy", ComputeLatencyStats(convertNs), -1.0 );
+    }
+
+    pConversion->Release();
+    return failures ? 1 : 0;
+}
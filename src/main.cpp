@@ -1,182 +1,962 @@
-#include <assert.h>
-#include <stdexcept>
-#include <set>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
 #include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CaptureEngine.h"
+#include "DiscoveryBroker.h"
+#include "DiscoveryCallback.h"
+#include "PlayoutEngine.h"
+#include "ShutdownSignal.h"
+#include "StartupProfile.h"
 
-#include <DeckLinkAPI.h>
+//=====================================================================================================================
+CEventLog           g_EventLog;
+CDiscoveryCallback  g_DiscoveryCallback( &g_EventLog );
 
-#ifdef _WIN32
 //=====================================================================================================================
-inline IDeckLinkDiscovery* CreateDiscoveryInst()
+struct SOptions
 {
-    LPVOID  p = NULL;
-    HRESULT  hr = CoCreateInstance(
-                                CLSID_CDeckLinkDiscovery,  NULL,  CLSCTX_ALL,
-                                IID_IDeckLinkDiscovery,  &p
-                                );
-
-    if ( FAILED(hr) )
-    {
-        throw std::runtime_error("creating IDeckLinkDiscovery failed");
-    }
+    bool            daemon;
+    unsigned        shutdownTimeoutMs;
+    const char*     eventOutput;        // NULL = standard error
+    EEventFormat    eventFormat;
+    const char*     brokerPath;         // NULL = no broker
+    bool            startupProfile;
+    bool            capture;
+    SCaptureConfig  captureConfig;
+    bool            playout;
+    SPlayoutConfig  playoutConfig;
+};
 
-    assert( p != NULL );
-    return  static_cast<IDeckLinkDiscovery*>(p);
+//---------------------------------------------------------------------------------------------------------------------
+static void PrintUsage( const char* argv0 )
+{
+    fprintf( stderr,
+        "usage: %s [--daemon] [--shutdown-timeout <ms>] [--events <dest>] [--event-format <fmt>] [--broker <path>]\n"
+        "          [--startup-profile] [--capture] [--capture-mode <mode>] [--capture-format <fmt>]\n"
+        "          [--capture-convert <fmt>] [--convert-threads <n>] [--capture-audio <n>]\n"
+        "          [--capture-audio-bits <n>] [--capture-warm <mode>[,<mode>]] [--capture-vanc]\n"
+        "          [--capture-timecode <fmt>] [--capture-record <dir>] [--record-depth <n>]\n"
+        "          [--playout] [--playout-mode <mode>] [--playout-format <fmt>] [--playout-buffered <min>:<max>]\n"
+        "          [--playout-audio <n>] [--playout-vanc]\n"
+        "          [--driver-buffers] [--numa-node <n>]\n"
+        "\n"
+        "    --daemon                  run until SIGTERM/SIGINT (Ctrl+C on Windows) instead of until ENTER;\n"
+        "                              SIGUSR1 (Ctrl+Break on Windows) prints the known devices\n"
+        "    --shutdown-timeout <ms>   give up waiting for the API to uninstall after this long (default 5000)\n"
+        "    --events <dest>           where to write device events: - (stdout), fd:<n>, unix:<socket path> or a file;\n"
+        "                              standard error by default\n"
+        "    --event-format <fmt>      text (default), ndjson or binary\n"
+        "    --broker <path>           serve the device list and events to local clients on this Unix socket\n"
+        "                              (Linux only, see DiscoveryBroker.h)\n"
+        "    --startup-profile         print where the time to the first device went, on exit and with the device list;\n"
+        "                              on Linux set DECKLINK_API_LAZY=1 to look up only the API factories used\n"
+        "    --capture                 capture video from every device which arrives; the device list shows the counts\n"
+        "    --capture-mode <mode>     display mode to capture, e.g. 1080i50 (implies --capture); by default the first\n"
+        "                              mode the input supports in the capture format\n"
+        "    --capture-format <fmt>    pixel format to capture: 2vuy, v210 (default), ARGB, BGRA, r210, R10l or R10b\n"
+        "                              (implies --capture)\n"
+        "    --capture-convert <fmt>   convert every captured frame to this pixel format, on threads pinned to the\n"
+        "                              CPUs of --numa-node (implies --capture)\n"
+        "    --convert-threads <n>     threads converting captured frames; by default one per CPU of the node\n"
+        "    --capture-audio <n>       also capture n channels of audio (2, 8 or 16) into each device's ring of planar\n"
+        "                              float samples (implies --capture)\n"
+        "    --capture-audio-bits <n>  16 (default) or 32-bit audio samples\n"
+        "    --capture-warm <modes>    up to two display modes the sources are likely to switch to, comma separated;\n"
+        "                              their frame pools are kept ready, so that switching to them loses fewer frames\n"
+        "    --capture-vanc            scan the VANC lines of every captured v210 frame for SMPTE 291 packets; the\n"
+        "                              device list reads them (implies --capture)\n"
+        "    --capture-timecode <fmt>  log the timecode of every captured frame: rp188 (any of VITC1, LTC, VITC2),\n"
+        "                              ltc, vitc or serial; the device list shows the last one (implies --capture)\n"
+        "    --capture-record <dir>    record every captured frame and audio packet to files in dir, with O_DIRECT\n"
+        "                              and io_uring, indexed by stream time and timecode (Linux only, see\n"
+        "                              CaptureRecorder.h; implies --capture)\n"
+        "    --record-depth <n>        frames each recorder writes at a time (default 8)\n"
+        "    --playout                 play out on every device which arrives; the device list shows the counts\n"
+        "    --playout-mode <mode>     display mode to play out (implies --playout); by default the first mode the\n"
+        "                              output supports in the playout format\n"
+        "    --playout-format <fmt>    pixel format to play out, as for --capture-format (implies --playout)\n"
+        "    --playout-buffered <min>:<max>  bounds for the frames scheduled ahead of the output (default 3:12)\n"
+        "    --playout-audio <n>       also play out n channels of 32-bit audio (2, 8 or 16), looped back from the\n"
+        "                              audio captured on another device, resampled to the output's clock; silence\n"
+        "                              without --capture-audio (implies --playout)\n"
+        "    --playout-vanc            insert a CEA-708 caption distribution packet and an SCTE-104 keep-alive into\n"
+        "                              the VANC of every frame played out (implies --playout)\n"
+        "    --driver-buffers          capture into and play out of the driver's buffers instead of a preallocated\n"
+        "                              huge page pool\n"
+        "    --numa-node <n>           NUMA node for the frame buffers and conversion threads; by default the node\n"
+        "                              discovery runs on\n",
+        argv0 );
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-inline void InitCom()  { CoInitialize(NULL); } //  Initialize COM on this thread
+static bool ParseTimecodeFormat( const char* name, BMDTimecodeFormat* pFormat )
+{
+    static const struct { const char* name; BMDTimecodeFormat format; } kFormats[] =
+    {
+        { "rp188",  bmdTimecodeRP188Any },
+        { "ltc",    bmdTimecodeRP188LTC },
+        { "vitc",   bmdTimecodeVITC },
+        { "serial", bmdTimecodeSerial },
+    };
 
-#else
-//=====================================================================================================================
-#define STDMETHODCALLTYPE
+    for( size_t i = 0; i < sizeof(kFormats) / sizeof(kFormats[0]); ++i )
+    {
+        if( strcmp( name, kFormats[i].name ) == 0 )
+        {
+            *pFormat = kFormats[i].format;
+            return true;
+        }
+    }
+
+    return false;
+}
 
 //---------------------------------------------------------------------------------------------------------------------
-inline bool IsEqualGUID( const REFIID& a, const REFIID& b )
+// The channel counts the API captures and plays out: 2, 8 or 16.
+static bool ParseAudioChannels( const char* count, unsigned* pChannels )
 {
-    return memcmp( &a, &b, sizeof(REFIID) ) == 0;
+    if( strcmp( count, "2" ) != 0 && strcmp( count, "8" ) != 0 && strcmp( count, "16" ) != 0 )
+    {
+        return false;
+    }
+
+    *pChannels = (unsigned)atoi(count);
+    return true;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-inline IDeckLinkDiscovery* CreateDiscoveryInst()
+// "1080i50,720p50" into warmModes; false if a name is unknown or there are too many.
+static bool ParseDisplayModes( const char* list, SCaptureConfig* pConfig )
 {
-    IDeckLinkDiscovery* p = CreateDeckLinkDiscoveryInstance();
+    const size_t count = sizeof(pConfig->warmModes) / sizeof(pConfig->warmModes[0]);
+    std::string rest = list;
 
-    if( p == NULL )
+    for( size_t i = 0; i < count; ++i )
     {
-        throw std::runtime_error("creating IDeckLinkDiscovery failed");
+        const size_t comma = rest.find(',');
+
+        if( !ParseDisplayMode( rest.substr( 0, comma ).c_str(), &pConfig->warmModes[i] ) )
+        {
+            return false;
+        }
+
+        if( comma == std::string::npos )
+        {
+            return true;
+        }
+
+        rest.erase( 0, comma + 1 );
     }
 
-    return p;
+    return false;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-inline void InitCom()  {}
+static bool ParseArgs( int argc, char** argv, SOptions* pOpts )
+{
+    pOpts->daemon = false;
+    pOpts->shutdownTimeoutMs = 5000;
+    pOpts->eventOutput = NULL;
+    pOpts->eventFormat = kEventFormatText;
+    pOpts->brokerPath = NULL;
+    pOpts->startupProfile = false;
+    pOpts->capture = false;
+    pOpts->captureConfig.mode = (BMDDisplayMode)0;
+    pOpts->captureConfig.format = bmdFormat10BitYUV;
+    pOpts->captureConfig.queueDepth = 8;
+    pOpts->captureConfig.framePool = true;
+    pOpts->captureConfig.numaNode = -1;
+    pOpts->captureConfig.convertFormat = 0;
+    pOpts->captureConfig.convertThreads = 0;
+    pOpts->captureConfig.audioChannels = 0;
+    pOpts->captureConfig.audioSampleType = bmdAudioSampleType16bitInteger;
+    pOpts->captureConfig.audioFormat = kAudioFloat32;
+    pOpts->captureConfig.audioFrames = 0;
+    memset( pOpts->captureConfig.warmModes, 0, sizeof(pOpts->captureConfig.warmModes) );
+    pOpts->captureConfig.ancillaryPackets = 0;
+    pOpts->captureConfig.timecodeFormat = 0;
+    pOpts->captureConfig.timecodeRuns = 0;
+    pOpts->captureConfig.recordDir = NULL;
+    pOpts->captureConfig.recordDepth = 0;
+    pOpts->playout = false;
+    pOpts->playoutConfig.mode = (BMDDisplayMode)0;
+    pOpts->playoutConfig.format = bmdFormat10BitYUV;
+    pOpts->playoutConfig.minBuffered = 3;
+    pOpts->playoutConfig.maxBuffered = 12;
+    pOpts->playoutConfig.framePool = true;
+    pOpts->playoutConfig.numaNode = -1;
+    pOpts->playoutConfig.audioChannels = 0;
+    pOpts->playoutConfig.audioSampleType = bmdAudioSampleType32bitInteger;
+    pOpts->playoutConfig.audioBuffered = 0;
+    pOpts->playoutConfig.audioLatency = 0;
+    memset( pOpts->playoutConfig.ancillary, 0, sizeof(pOpts->playoutConfig.ancillary) );
+    pOpts->playoutConfig.ancillarySlots = 0;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        std::string arg = argv[i];
 
-//---------------------------------------------------------------------------------------------------------------------
-#ifdef __APPLE__
-const REFIID IID_IUnknown = CFUUIDGetUUIDBytes(IUnknownUUID);
+        if( arg == "--daemon" )
+        {
+            pOpts->daemon = true;
+        }
+        else if( arg == "--shutdown-timeout" && i + 1 < argc )
+        {
+            pOpts->shutdownTimeoutMs = (unsigned)strtoul( argv[++i], NULL, 0 );
+        }
+        else if( arg == "--events" && i + 1 < argc )
+        {
+            pOpts->eventOutput = argv[++i];
+        }
+        else if( arg == "--event-format" && i + 1 < argc && ParseEventFormat( argv[i + 1], &pOpts->eventFormat ) )
+        {
+            ++i;
+        }
+        else if( arg == "--startup-profile" )
+        {
+            pOpts->startupProfile = true;
+        }
+        else if( arg == "--capture" )
+        {
+            pOpts->capture = true;
+        }
+        else if( arg == "--capture-mode" && i + 1 < argc &&
+                 ParseDisplayMode( argv[i + 1], &pOpts->captureConfig.mode ) )
+        {
+            pOpts->capture = true;
+            ++i;
+        }
+        else if( arg == "--capture-format" && i + 1 < argc &&
+                 ParsePixelFormat( argv[i + 1], &pOpts->captureConfig.format ) )
+        {
+            pOpts->capture = true;
+            ++i;
+        }
+        else if( arg == "--capture-convert" && i + 1 < argc &&
+                 ParsePixelFormat( argv[i + 1], &pOpts->captureConfig.convertFormat ) )
+        {
+            pOpts->capture = true;
+            ++i;
+        }
+        else if( arg == "--convert-threads" && i + 1 < argc )
+        {
+            pOpts->captureConfig.convertThreads = (unsigned)strtoul( argv[++i], NULL, 0 );
+        }
+        else if( arg == "--capture-audio" && i + 1 < argc &&
+                 ParseAudioChannels( argv[i + 1], &pOpts->captureConfig.audioChannels ) )
+        {
+            pOpts->capture = true;
+            ++i;
+        }
+        else if( arg == "--capture-audio-bits" && i + 1 < argc &&
+                 ( strcmp( argv[i + 1], "16" ) == 0 || strcmp( argv[i + 1], "32" ) == 0 ) )
+        {
+            pOpts->captureConfig.audioSampleType = (BMDAudioSampleType)atoi( argv[++i] );
+        }
+        else if( arg == "--capture-warm" && i + 1 < argc && ParseDisplayModes( argv[i + 1], &pOpts->captureConfig ) )
+        {
+            ++i;
+        }
+        else if( arg == "--capture-vanc" )
+        {
+            pOpts->captureConfig.ancillaryPackets = 256;
+            pOpts->capture = true;
+        }
+        else if( arg == "--capture-timecode" && i + 1 < argc &&
+                 ParseTimecodeFormat( argv[i + 1], &pOpts->captureConfig.timecodeFormat ) )
+        {
+            pOpts->capture = true;
+            ++i;
+        }
+        else if( arg == "--capture-record" && i + 1 < argc )
+        {
+            pOpts->captureConfig.recordDir = argv[++i];
+            pOpts->capture = true;
+        }
+        else if( arg == "--record-depth" && i + 1 < argc && atoi( argv[i + 1] ) > 0 )
+        {
+            pOpts->captureConfig.recordDepth = (unsigned)atoi( argv[++i] );
+        }
+        else if( arg == "--playout" )
+        {
+            pOpts->playout = true;
+        }
+        else if( arg == "--playout-mode" && i + 1 < argc &&
+                 ParseDisplayMode( argv[i + 1], &pOpts->playoutConfig.mode ) )
+        {
+            pOpts->playout = true;
+            ++i;
+        }
+        else if( arg == "--playout-format" && i + 1 < argc &&
+                 ParsePixelFormat( argv[i + 1], &pOpts->playoutConfig.format ) )
+        {
+            pOpts->playout = true;
+            ++i;
+        }
+        else if( arg == "--playout-audio" && i + 1 < argc &&
+                 ParseAudioChannels( argv[i + 1], &pOpts->playoutConfig.audioChannels ) )
+        {
+            pOpts->playout = true;
+            ++i;
+        }
+        else if( arg == "--playout-vanc" )
+        {
+            // on the first and third VANC line of the mode
+            static const SAncillarySlot kSlots[] =
+            {
+                { 0, kAncillaryLuma, 0x61, 0x01, 96 },
+                { 2, kAncillaryLuma, 0x41, 0x07, 32 },
+            };
+
+            memcpy( pOpts->playoutConfig.ancillary, kSlots, sizeof(kSlots) );
+            pOpts->playoutConfig.ancillarySlots = 2;
+            pOpts->playout = true;
+        }
+        else if( arg == "--playout-buffered" && i + 1 < argc &&
+                 sscanf( argv[i + 1], "%u:%u", &pOpts->playoutConfig.minBuffered,
+                         &pOpts->playoutConfig.maxBuffered ) == 2 )
+        {
+            ++i;
+        }
+        else if( arg == "--driver-buffers" )
+        {
+            pOpts->captureConfig.framePool = false;
+            pOpts->playoutConfig.framePool = false;
+        }
+        else if( arg == "--numa-node" && i + 1 < argc )
+        {
+            pOpts->captureConfig.numaNode = atoi( argv[++i] );
+            pOpts->playoutConfig.numaNode = pOpts->captureConfig.numaNode;
+        }
+#ifdef __linux__
+        else if( arg == "--broker" && i + 1 < argc )
+        {
+            pOpts->brokerPath = argv[++i];
+        }
 #endif
+        else
+        {
+            PrintUsage( argv[0] );
+            return false;
+        }
+    }
 
-#endif
+    return true;
+}
 
 //=====================================================================================================================
-class CDiscoveryCallback : public IDeckLinkDeviceNotificationCallback
+// Plays out the frames as they come, and the audio captured on another device: preferably not the output's own, so
+// that the playout has a foreign clock to follow. With --playout-vanc every frame carries a caption distribution
+// packet without captions and an SCTE-104 keep-alive, both counting the frames.
+class CLoopbackSource : public IPlayoutSource
 {
-    std::set<IDeckLink*>  m_DevPointers;
+    CCaptureEngine*  m_pCapture;      // NULL = silence
 
 public:
-    // overrides IDeckLinkDeviceNotificationCallback
-    virtual HRESULT STDMETHODCALLTYPE DeckLinkDeviceArrived( IDeckLink* pDev );
+    explicit CLoopbackSource( CCaptureEngine* pCapture ) : m_pCapture(pCapture) {}
+
+    virtual void FillFrame( const SDeviceInfo& device, IDeckLinkMutableVideoFrame* pFrame, uint64_t frameNumber ) {}
+
+    virtual void FillAncillary( const SDeviceInfo& device, uint64_t frameNumber, SAncillaryPacket* pPackets )
+    {
+        const uint8_t seqHigh = (uint8_t)( frameNumber >> 8 ), seqLow = (uint8_t)frameNumber;
 
-    virtual HRESULT STDMETHODCALLTYPE DeckLinkDeviceRemoved( IDeckLink* pDev );
+        // CDP header (29.97 Hz, caption service active), footer, and a checksum making the bytes sum to 0
+        const uint8_t cdp[] = { 0x96, 0x69, 11, 0x4F, 0x43, seqHigh, seqLow, 0x74, seqHigh, seqLow, 0 };
+        // keep_alive_request as a single operation message, after the payload descriptor
+        const uint8_t scte[] = { 0x08, 0x00, 0x03, 0x00, 0x0D, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, seqLow,
+                                 0x00, 0x00 };
+        uint8_t sum = 0;
 
-    // overrides IUnknown
-    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+        memcpy( pPackets[0].data, cdp, sizeof(cdp) );
+        pPackets[0].count = sizeof(cdp);
 
-    virtual ULONG STDMETHODCALLTYPE AddRef(void);
-    virtual ULONG STDMETHODCALLTYPE Release(void);
-}  g_DiscoveryCallback;
+        for( size_t k = 0; k + 1 < sizeof(cdp); ++k )
+        {
+            sum = (uint8_t)( sum + cdp[k] );
+        }
+
+        pPackets[0].data[ sizeof(cdp) - 1 ] = (uint8_t)( 256 - sum );
+        memcpy( pPackets[1].data, scte, sizeof(scte) );
+        pPackets[1].count = sizeof(scte);
+    }
+
+    virtual CAudioRing* AcquireAudioRing( const SDeviceInfo& device )
+    {
+        if( m_pCapture == NULL )
+        {
+            return NULL;
+        }
+
+        std::vector<SCaptureStats> stats;
+        m_pCapture->GetStats(&stats);
+
+        for( int own = 0; own < 2; ++own )
+        {
+            for( size_t i = 0; i < stats.size(); ++i )
+            {
+                if( stats[i].audio && ( stats[i].persistentId == device.persistentId ) == ( own != 0 ) )
+                {
+                    return m_pCapture->AcquireAudioRing( stats[i].persistentId );
+                }
+            }
+        }
+
+        return NULL;
+    }
+};
 
 //---------------------------------------------------------------------------------------------------------------------
-HRESULT STDMETHODCALLTYPE CDiscoveryCallback::DeckLinkDeviceArrived( IDeckLink* pDev )
+static int CountListedModes( const SDeviceCaps& caps, ECapsDirection dir )
 {
-    std::ostringstream sstr;
-    sstr << "CDiscoveryCallback::DeckLinkDeviceArrived: IDeckLink pointer = 0x" <<
-                                            std::setw(8) << std::setfill('0') << std::hex << (uintptr_t)pDev << "\n\n";
+    int count = 0;
 
-    m_DevPointers.insert(pDev);
-    pDev->AddRef();
+    for( int i = 0; i < kDisplayModeCount; ++i )
+    {
+        if( caps.Listed( dir, g_DisplayModes[i].mode ) )
+        {
+            ++count;
+        }
+    }
 
-    std::cerr << sstr.str();
-    std::cerr.flush();
+    return count;
+}
 
-    return S_OK;
+//---------------------------------------------------------------------------------------------------------------------
+static void AppendPoolStats( std::string* pText, const CFrameAllocator::SStats& pool )
+{
+    char line[160];
+
+    snprintf( line, sizeof(line), "        pool %u x %.1f MB, %u in use, %s, node %d, %llu failed\n",
+              pool.buffers, pool.bufferSize / 1048576.0, pool.inUse, pool.hugePages ? "huge pages" : "normal pages",
+              pool.numaNode, (unsigned long long)pool.failures );
+    *pText += line;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-HRESULT STDMETHODCALLTYPE CDiscoveryCallback::DeckLinkDeviceRemoved( IDeckLink* pDev )
+// Counts of the packets found, and the packets queued since the last dump, read here as the queue's only consumer.
+static void AppendAncillary( std::string* pText, CCaptureEngine* pCapture, const SCaptureStats& stats )
 {
-    std::ostringstream sstr;
-    sstr << "CDiscoveryCallback::DeckLinkDeviceRemoved: IDeckLink pointer = 0x" <<
-                                                    std::setw(8) << std::setfill('0') << std::hex << (uintptr_t)pDev;
+    const CAncillaryQueue::SStats& anc = stats.ancillaryQueue;
+    char line[320];
+
+    snprintf( line, sizeof(line),
+              "        vanc: frames=%llu packets=%llu (708=%llu 608=%llu afd=%llu scte104=%llu other=%llu) "
+              "errors=%llu overruns=%llu not-v210=%llu, %.1fus/frame\n",
+              (unsigned long long)anc.frames, (unsigned long long)anc.packets,
+              (unsigned long long)anc.types[kAncillaryCaption708], (unsigned long long)anc.types[kAncillaryCaption608],
+              (unsigned long long)anc.types[kAncillaryAfd], (unsigned long long)anc.types[kAncillaryScte104],
+              (unsigned long long)anc.types[kAncillaryOther], (unsigned long long)anc.errors,
+              (unsigned long long)anc.overruns, (unsigned long long)anc.unsupported,
+              anc.frames ? anc.scanNs / 1e3 / anc.frames : 0.0 );
+    *pText += line;
+
+    CAncillaryQueue* pQueue = pCapture->AcquireAncillaryQueue( stats.persistentId );
+
+    if( pQueue == NULL )
+    {
+        return;
+    }
 
-    if( m_DevPointers.erase(pDev) )
+    SAncillaryPacket packet, last;
+    uint64_t read = 0;
+
+    while( pQueue->Pop(&packet) )
     {
-        sstr << " (added earlier)\n\n";
-        pDev->Release();
+        last = packet;
+        ++read;
     }
-    else
+
+    pQueue->Release();
+
+    if( read != 0 )
     {
-        sstr << " (unknown pointer)\n\n";
+        snprintf( line, sizeof(line),
+                  "        vanc: %llu read, the last of frame %llu on line %u: DID %02X SDID %02X, %u bytes\n",
+                  (unsigned long long)read, (unsigned long long)last.frame, last.line, last.did, last.sdid,
+                  last.count );
+        *pText += line;
     }
+}
 
-    std::cerr << sstr.str();
-    std::cerr.flush();
+//---------------------------------------------------------------------------------------------------------------------
+// What went to disk, and how close the recorder came to dropping frames.
+static void AppendRecorder( std::string* pText, const CCaptureRecorder::SStats& rec )
+{
+    char line[320];
 
-    return S_OK;
+    if( !rec.running )
+    {
+        *pText += "        record: not running\n";
+        return;
+    }
+
+    snprintf( line, sizeof(line),
+              "        record: take %u, frames=%llu packets=%llu %.1f MB, %s, %s; dropped=%llu buffered=%llu "
+              "errors=%llu, in flight %u (peak %u) stalls=%llu, write mean=%.2fms max=%.2fms\n",
+              rec.takes, (unsigned long long)rec.frames, (unsigned long long)rec.audioPackets,
+              rec.bytes / 1048576.0, rec.uring ? "io_uring" : "pwrite", rec.direct ? "O_DIRECT" : "page cache",
+              (unsigned long long)rec.dropped, (unsigned long long)rec.buffered, (unsigned long long)rec.errors,
+              rec.inFlight, rec.peakInFlight, (unsigned long long)rec.stalls,
+              rec.writes ? rec.writeNs / 1e6 / rec.writes : 0.0, rec.maxWriteNs / 1e6 );
+    *pText += line;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-HRESULT STDMETHODCALLTYPE CDiscoveryCallback::QueryInterface( REFIID riid, void** ppvObject )
+// The counts, the run going on, and where the timecode of a second before the last one was captured.
+static void AppendTimecode( std::string* pText, CCaptureEngine* pCapture, const SCaptureStats& stats )
 {
-    if( IsEqualGUID( riid, IID_IDeckLinkDeviceNotificationCallback ) )
+    const CTimecodeLog::SStats& log = stats.timecodeLog;
+    char line[320];
+    char last[12] = "-";
+
+    if( log.frames != 0 )
     {
-        *ppvObject = static_cast<IDeckLinkDeviceNotificationCallback*>(this);
-        return S_OK;
+        FormatTimecode( log.last, log.lastRate, last );
     }
 
-    if( IsEqualGUID( riid, IID_IUnknown ) )
+    snprintf( line, sizeof(line),
+              "        timecode: last %s, frames=%llu missing=%llu runs=%llu gaps=%llu skipped=%llu, %.2fus/frame\n",
+              last, (unsigned long long)log.frames, (unsigned long long)log.missing, (unsigned long long)log.runs,
+              (unsigned long long)log.gaps, (unsigned long long)log.skipped,
+              ( log.frames + log.missing ) ? log.appendNs / 1e3 / ( log.frames + log.missing ) : 0.0 );
+    *pText += line;
+
+    CTimecodeLog* pLog = ( log.runs != 0 ) ? pCapture->AcquireTimecodeLog( stats.persistentId ) : NULL;
+
+    if( pLog == NULL )
     {
-        *ppvObject = static_cast<IUnknown*>(this);
-        return S_OK;
+        return;
+    }
+
+    CTimecodeLog::SRun run;
+    uint64_t next;
+    char first[12];
+
+    if( pLog->GetRuns( log.runs - 1, &run, 1, &next ) == 1 )
+    {
+        const uint32_t count = TimecodeToFrames( log.last, log.lastRate );
+        const uint32_t day = TimecodeDayFrames( log.lastRate );
+        const BMDTimecodeBCD target = FramesToTimecode( count + day - ( log.lastRate & 0x7F ), log.lastRate );
+        char seek[12];
+        uint64_t frame;
+
+        FormatTimecode( run.firstBcd, run.rate, first );
+        FormatTimecode( target, log.lastRate, seek );
+
+        if( pLog->Seek( target, &frame ) )
+        {
+            snprintf( line, sizeof(line),
+                      "        timecode: run %llu from frame %llu at %s, %llu frames; %s was frame %llu\n",
+                      (unsigned long long)run.sequence, (unsigned long long)run.firstFrame, first,
+                      (unsigned long long)run.frames, seek, (unsigned long long)frame );
+        }
+        else
+        {
+            snprintf( line, sizeof(line),
+                      "        timecode: run %llu from frame %llu at %s, %llu frames; %s not kept\n",
+                      (unsigned long long)run.sequence, (unsigned long long)run.firstFrame, first,
+                      (unsigned long long)run.frames, seek );
+        }
+
+        *pText += line;
     }
 
-    return E_NOINTERFACE;
+    pLog->Release();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-ULONG STDMETHODCALLTYPE CDiscoveryCallback::AddRef(void)
+// Written with a single fwrite so that it does not interleave with the event log.
+static void DumpState( bool startupProfile, CCaptureEngine* pCapture, CPlayoutEngine* pPlayout )
 {
-    return 2;
+    std::vector<SDeviceInfo> devices;
+    g_DiscoveryCallback.Registry().Snapshot( &devices, true );
+
+    std::string text;
+    char line[320];
+
+    snprintf( line, sizeof(line), "Discovery state: %u present, %u known, %llu events dropped\n",
+              (unsigned)g_DiscoveryCallback.Registry().Count(), (unsigned)devices.size(),
+              (unsigned long long)g_EventLog.Dropped() );
+    text += line;
+
+    for( size_t i = 0; i < devices.size(); ++i )
+    {
+        const SDeviceInfo& info = devices[i];
+
+        snprintf( line, sizeof(line),
+                  "    %-8s id=0x%016llx gen=%u sub=%lld/%lld in=%d out=%d modes  %s (%s)\n",
+                  info.pDev ? "present" : "absent",
+                  (unsigned long long)info.persistentId, info.generation,
+                  (long long)info.subDeviceIndex, (long long)info.numberOfSubDevices,
+                  CountListedModes( info.caps, kCapsInput ), CountListedModes( info.caps, kCapsOutput ),
+                  info.displayName, info.modelName );
+        text += line;
+
+        if( info.pDev != NULL )
+        {
+            info.pDev->Release();
+        }
+    }
+
+    text += "\n";
+
+    if( pCapture != NULL )
+    {
+        std::vector<SCaptureStats> stats;
+        pCapture->GetStats(&stats);
+
+        snprintf( line, sizeof(line), "Capture: %u channels\n", (unsigned)stats.size() );
+        text += line;
+
+        for( size_t i = 0; i < stats.size(); ++i )
+        {
+            const SDisplayModeDesc* pMode = FindDisplayMode( stats[i].mode );
+            const char* format = PixelFormatName( stats[i].format );
+
+            snprintf( line, sizeof(line),
+                      "    id=0x%016llx %-10s %s arrived=%llu no-input=%llu dropped=%llu consumed=%llu queued=%u  %s\n",
+                      (unsigned long long)stats[i].persistentId, pMode ? pMode->name : "?", format ? format : "?",
+                      (unsigned long long)stats[i].arrived, (unsigned long long)stats[i].noInput,
+                      (unsigned long long)stats[i].dropped, (unsigned long long)stats[i].consumed,
+                      stats[i].queued, stats[i].displayName );
+            text += line;
+
+            if( stats[i].framePool )
+            {
+                AppendPoolStats( &text, stats[i].pool );
+            }
+
+            if( stats[i].convertFormat != 0 )
+            {
+                snprintf( line, sizeof(line), "        converted to %s, %llu failed\n",
+                          PixelFormatName( stats[i].convertFormat ), (unsigned long long)stats[i].convertFailures );
+                text += line;
+            }
+
+            if( stats[i].audio )
+            {
+                const CAudioRing::SStats& audio = stats[i].audioRing;
+
+                snprintf( line, sizeof(line),
+                          "        audio: %u channels, ring %ld frames, packets=%llu frames=%llu overruns=%llu "
+                          "readers=%u\n",
+                          audio.channels, audio.capacity, (unsigned long long)audio.packets,
+                          (unsigned long long)audio.frames, (unsigned long long)audio.overruns, audio.readers );
+                text += line;
+            }
+
+            const SSyncStats& sync = stats[i].sync;
+
+            if( sync.jitter.count != 0 )
+            {
+                snprintf( line, sizeof(line),
+                          "        sync: jitter p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus missed=%llu\n",
+                          sync.jitter.p50Ns / 1e3, sync.jitter.p99Ns / 1e3, sync.jitter.p999Ns / 1e3,
+                          sync.jitter.maxNs / 1e3, (unsigned long long)sync.missedFrames );
+                text += line;
+            }
+
+            if( sync.offset.count != 0 )
+            {
+                snprintf( line, sizeof(line),
+                          "        sync: A/V offset mean=%.1fus p50=%.1fus min=%.1fus max=%.1fus, audio gaps=%llu\n",
+                          sync.offset.meanNs / 1e3, sync.offset.p50Ns / 1e3, sync.offset.minNs / 1e3,
+                          sync.offset.maxNs / 1e3, (unsigned long long)sync.audioGaps );
+                text += line;
+            }
+
+            if( stats[i].ancillary )
+            {
+                AppendAncillary( &text, pCapture, stats[i] );
+            }
+
+            if( stats[i].timecode )
+            {
+                AppendTimecode( &text, pCapture, stats[i] );
+            }
+
+            if( stats[i].recording )
+            {
+                AppendRecorder( &text, stats[i].recorder );
+            }
+
+            const SFormatSwitchStats& switches = stats[i].switches;
+
+            if( switches.switches != 0 || switches.colorspaces != 0 || switches.plans > 1 )
+            {
+                snprintf( line, sizeof(line),
+                          "        mode switches=%llu warm=%llu failed=%llu lost=%llu frames, last: prepare=%.2fms "
+                          "restart=%.2fms outage=%.2fms, max outage=%.2fms, %u plans, colorspace changes=%llu\n",
+                          (unsigned long long)switches.switches, (unsigned long long)switches.warm,
+                          (unsigned long long)switches.failures, (unsigned long long)switches.lostFrames,
+                          switches.lastPrepareNs / 1e6, switches.lastRestartNs / 1e6, switches.lastOutageNs / 1e6,
+                          switches.maxOutageNs / 1e6, switches.plans, (unsigned long long)switches.colorspaces );
+                text += line;
+            }
+        }
+
+        CConversionScheduler::SStats conversion;
+
+        if( pCapture->GetConversionStats(&conversion) )
+        {
+            snprintf( line, sizeof(line),
+                      "    conversion: %u threads, node %d, frames=%llu rejected=%llu stripes=%llu steals=%llu\n",
+                      conversion.threads, conversion.numaNode, (unsigned long long)conversion.frames,
+                      (unsigned long long)conversion.rejected, (unsigned long long)conversion.stripes,
+                      (unsigned long long)conversion.steals );
+            text += line;
+        }
+
+        text += "\n";
+    }
+
+    if( pPlayout != NULL )
+    {
+        std::vector<SPlayoutStats> stats;
+        pPlayout->GetStats(&stats);
+
+        snprintf( line, sizeof(line), "Playout: %u channels\n", (unsigned)stats.size() );
+        text += line;
+
+        for( size_t i = 0; i < stats.size(); ++i )
+        {
+            const SDisplayModeDesc* pMode = FindDisplayMode( stats[i].mode );
+            const char* format = PixelFormatName( stats[i].format );
+
+            snprintf( line, sizeof(line),
+                      "    id=0x%016llx %-10s %s scheduled=%llu completed=%llu late=%llu dropped=%llu underruns=%llu"
+                      " buffered=%u/%u frames=%u  %s\n",
+                      (unsigned long long)stats[i].persistentId, pMode ? pMode->name : "?", format ? format : "?",
+                      (unsigned long long)stats[i].scheduled, (unsigned long long)stats[i].completed,
+                      (unsigned long long)stats[i].late, (unsigned long long)stats[i].dropped,
+                      (unsigned long long)stats[i].underruns, stats[i].buffered, stats[i].target, stats[i].frames,
+                      stats[i].displayName );
+            text += line;
+
+            if( stats[i].framePool )
+            {
+                AppendPoolStats( &text, stats[i].pool );
+            }
+
+            if( stats[i].audio )
+            {
+                const SAudioPlayoutStats& audio = stats[i].audioStats;
+
+                snprintf( line, sizeof(line),
+                          "        audio: %u channels%s, scheduled=%llu silence=%llu underruns=%llu skipped=%llu "
+                          "gaps=%llu buffered=%u latency=%ld drift=%+.1fppm ratio=%+.1fppm\n",
+                          audio.channels, audio.source ? "" : " (silence)", (unsigned long long)audio.scheduled,
+                          (unsigned long long)audio.silence, (unsigned long long)audio.underruns,
+                          (unsigned long long)audio.skipped, (unsigned long long)audio.sourceGaps, audio.buffered,
+                          audio.latency, audio.driftPpm, audio.ratioPpm );
+                text += line;
+            }
+
+            if( stats[i].ancillary )
+            {
+                const CAncillaryInserter::SStats& anc = stats[i].ancillaryStats;
+
+                snprintf( line, sizeof(line),
+                          "        vanc: %u slots, frames=%llu packets=%llu bytes=%llu failures=%llu, %.2fus/frame\n",
+                          anc.slots, (unsigned long long)anc.frames, (unsigned long long)anc.packets,
+                          (unsigned long long)anc.bytes, (unsigned long long)anc.failures,
+                          anc.frames ? anc.insertNs / 1e3 / anc.frames : 0.0 );
+                text += line;
+            }
+        }
+
+        text += "\n";
+    }
+
+    fwrite( text.data(), 1, text.size(), stderr );
+
+    if( startupProfile )
+    {
+        PrintStartupProfile(stderr);
+    }
+
+    fflush(stderr);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-ULONG STDMETHODCALLTYPE CDiscoveryCallback::Release(void)
+// Uninstalls the notifications and releases the discovery object on a helper thread, so that a driver which hangs
+// in there cannot keep the process alive. Returns false on timeout; the helper thread is then abandoned.
+static bool ShutdownDiscovery( IDeckLinkDiscovery* pInst, unsigned timeoutMs )
 {
-    return 1;
+    struct SState
+    {
+        std::mutex               mutex;
+        std::condition_variable  cond;
+        bool                     done;
+    };
+
+    // shared with the helper thread, leaked if it never finishes
+    SState* pState = new SState();
+    pState->done = false;
+
+    std::thread worker( [pInst, pState]()
+    {
+        InitCom();
+        pInst->UninstallDeviceNotifications();
+        pInst->Release();
+
+        std::lock_guard<std::mutex> lock(pState->mutex);
+        pState->done = true;
+        pState->cond.notify_one();
+    } );
+
+    bool done;
+    {
+        std::unique_lock<std::mutex> lock(pState->mutex);
+        done = pState->cond.wait_for( lock, std::chrono::milliseconds(timeoutMs), [pState] { return pState->done; } );
+    }
+
+    if( !done )
+    {
+        worker.detach();
+        return false;
+    }
+
+    worker.join();
+    delete pState;
+    return true;
 }
 
 //=====================================================================================================================
 int main( int argc, char** argv )
 {
+    SOptions opts;
+
+    if( !ParseArgs( argc, argv, &opts ) )
+    {
+        return 2;
+    }
+
     InitCom();
 
     int status = 0;
+    CShutdownSignal* pSignal = NULL;
+    CCaptureEngine* pCapture = NULL;
+    CPlayoutEngine* pPlayout = NULL;
+    CLoopbackSource* pLoopback = NULL;
+#ifdef __linux__
+    CDiscoveryBroker broker( &g_DiscoveryCallback.Registry() );
+#endif
 
     try
     {
+        if( opts.daemon )
+        {
+            // before any thread is started, so that the signals reach only the signal handler
+            pSignal = new CShutdownSignal();
+        }
+
+        int eventFd = 2;
+
+        if( opts.eventOutput != NULL )
+        {
+            eventFd = OpenEventOutput( opts.eventOutput );
+
+            if( eventFd < 0 )
+            {
+                throw std::runtime_error( std::string("opening ") + opts.eventOutput + " failed: " + strerror(errno) );
+            }
+        }
+
         std::cerr << "Starting..." << std::endl;
+        g_EventLog.SetOutput( eventFd, opts.eventFormat );
+
+#ifdef __linux__
+        if( opts.brokerPath != NULL )
+        {
+            broker.Start( opts.brokerPath );
+            g_EventLog.SetSink(&broker);
+        }
+#endif
+
+        g_EventLog.Start();
+
+        if( opts.capture )
+        {
+            pCapture = new CCaptureEngine( opts.captureConfig, NULL );
+            g_DiscoveryCallback.AddListener(pCapture);
+        }
+
+        if( opts.playout )
+        {
+            if( opts.playoutConfig.audioChannels != 0 || opts.playoutConfig.ancillarySlots != 0 )
+            {
+                pLoopback = new CLoopbackSource(pCapture);
+            }
+
+            pPlayout = new CPlayoutEngine( opts.playoutConfig, pLoopback );
+            g_DiscoveryCallback.AddListener(pPlayout);
+        }
+
+        StartupMark(kMarkCreateBegin);
         IDeckLinkDiscovery* pInst = CreateDiscoveryInst();
+        StartupMark(kMarkCreateEnd);
+
+        StartupMark(kMarkInstallBegin);
         HRESULT hr = pInst->InstallDeviceNotifications( &g_DiscoveryCallback );
+        StartupMark(kMarkInstallEnd);
 
         if( FAILED(hr) )
         {
             std::cerr << "Error: IDeckLinkDiscovery::InstallDeviceNotifications failed. HRESULT=0x" <<
                                         std::setw(8) << std::setfill('0') << std::left << std::hex << hr << std::endl;
+            pInst->Release();
             status = 1;
         }
         else
         {
-            std::cerr << "IDeckLinkDiscovery::InstallDeviceNotifications succeeded.\n\nPress ENTER to quit...\n\n";
-            std::cerr.flush();
-            std::cin.ignore();
-            pInst->UninstallDeviceNotifications();
+            if( pSignal != NULL )
+            {
+                std::cerr << "IDeckLinkDiscovery::InstallDeviceNotifications succeeded.\n\n";
+                std::cerr.flush();
+
+                while( pSignal->Wait() == CShutdownSignal::kSignalDump )
+                {
+                    DumpState( opts.startupProfile, pCapture, pPlayout );
+                }
+            }
+            else
+            {
+                std::cerr << "IDeckLinkDiscovery::InstallDeviceNotifications succeeded.\n\nPress ENTER to quit...\n\n";
+                std::cerr.flush();
+                std::cin.ignore();
+            }
+
+            if( pCapture != NULL )
+            {
+                pCapture->Stop();
+            }
+
+            if( pPlayout != NULL )
+            {
+                pPlayout->Stop();
+            }
+
+            if( !ShutdownDiscovery( pInst, opts.shutdownTimeoutMs ) )
+            {
+                g_EventLog.Stop();
+                std::cerr << "Error: IDeckLinkDiscovery::UninstallDeviceNotifications did not return within " <<
+                                                                    opts.shutdownTimeoutMs << " ms." << std::endl;
+                // the API may still be calling back into objects which exit() would destroy
+                _Exit(3);
+            }
         }
-
-        pInst->Release();
     }
     catch( const std::exception& ex )
     {
@@ -184,6 +964,20 @@ int main( int argc, char** argv )
         status = 1;
     }
 
+    g_EventLog.Stop();
+#ifdef __linux__
+    broker.Stop();
+#endif
+    delete pSignal;
+    delete pCapture;
+    delete pPlayout;
+    delete pLoopback;
+
+    if( opts.startupProfile )
+    {
+        PrintStartupProfile(stderr);
+    }
+
     std::cerr << "Finished." << std::endl;
     return status;
 }
@@ -0,0 +1,3583 @@
+// Simulated libDeckLinkAPI.so for exercising discovery on machines without DeckLink hardware.
+//
+// Build (Linux):
+//     g++ -std=c++11 -O2 -shared -fPIC -fvisibility=hidden -I DeckLinkSDK/Linux/include src/sim/DeckLinkSim.cpp
+//         -o libDeckLinkAPI.so -lpthread
+//
+// Run the tool against it with LD_LIBRARY_PATH pointing at the directory containing the library.
+//
+// The simulated hardware is driven by a script which starts running when InstallDeviceNotifications() is called.
+// The script is read from the file named by DECKLINK_SIM_SCRIPT, one command per line ('#' starts a comment):
+//
+//     devices <n>        size of the device pool (must precede all other commands)
+//     subdevices <n>     sub-devices per simulated card (must precede all other commands)
+//     threads <n>        number of concurrent notification threads
+//     rate <n>           total events per second over all threads, 0 = unthrottled
+//     arrive <n|all>     plug in n devices which are currently absent
+//     remove <n|all>     unplug n devices which are currently present
+//     churn <n>          n random unplug/re-plug pairs
+//     storm <n>          n cycles of "remove all" followed by "arrive all"
+//     sleep <ms>         pause
+//
+// Without a script the following is executed:
+//
+//     devices $DECKLINK_SIM_DEVICES   (default 4)
+//     subdevices $DECKLINK_SIM_SUBDEVICES (default 1)
+//     threads $DECKLINK_SIM_THREADS   (default 1)
+//     rate    $DECKLINK_SIM_RATE      (default 0)
+//     arrive  all
+//     storm   $DECKLINK_SIM_CYCLES    (default 0)
+//
+// Device i is always handled by notification thread (i % threads), so events of one device are delivered in order
+// while events of different devices are delivered concurrently. Every arrival creates a new IDeckLink object,
+// as the real driver does when a card is re-plugged. Its persistent ID is derived from the slot, so it stays the same.
+// UninstallDeviceNotifications() unplugs the devices still present, without a removal, so that the library holds
+// nothing once the application has released what it kept.
+//
+// Every device has an input and an output which report the SD and HD display modes (see g_SimModes). The input
+// captures: once streams are started it delivers frames at the rate of the mode, scaled by DECKLINK_SIM_SPEED
+// (default 1, 0 = unthrottled), from a pool of DECKLINK_SIM_BUFFERS (default 16) buffers or through the application's
+// allocator. The first 8 bytes of each frame hold its index in the stream. The output plays scheduled frames at the
+// same rate and reports each as completed, late, dropped or flushed. With audio input enabled (48 kHz, 16- or 32-bit,
+// 2, 8 or 16 channels) every frame comes with the packet of its duration; channel c of sample frame n of the stream
+// holds ( n << 8 | c ) * 2654435761, or its top 16 bits. Audio output takes the same formats, scheduled with time
+// stamps: the card holds up to a second of it, plays it continuously from the start of playback and calls the
+// audio callback once per frame period (and every 5 ms while audio is prerolled). The clock of the device in slot n
+// runs n * $DECKLINK_SIM_DRIFT_PPM (default 0) parts per million fast, frame rates and hardware reference clock alike,
+// as the clocks of cards without a common reference drift apart.
+//
+// Inputs support format detection. DECKLINK_SIM_SOURCE_MODES, a comma separated list of mode names from g_SimModes,
+// each optionally followed by ":rgb" for an RGB 4:4:4 signal rather than YCbCr 4:2:2 ("1080i50,720p50:rgb"), makes
+// the source of every input cycle through those modes, DECKLINK_SIM_SOURCE_SECONDS (default 10) each, counted from
+// the input's first StartStreams(). While the source is not in the enabled mode, or is RGB and the enabled pixel
+// format is not or the other way round, frames come without audio and flagged bmdFrameHasNoInputSource; with format
+// detection enabled, the first frame of a stream which finds it so is replaced by a call to
+// VideoInputFormatChanged() with the source's mode, bmdVideoInputDisplayModeChanged and
+// bmdVideoInputColorspaceChanged as they apply, and the source's bmdDetectedVideoInputYCbCr422 or
+// bmdDetectedVideoInputRGB444.
+//
+// Captured 10-bit YUV frames come with ancillary data (see CSimVideoFrameAncillary): every vertical blanking line is
+// blank but two, which carry a CEA-708 caption distribution packet with the frame's index as its sequence counter and
+// an AFD packet, on lines 9 and 11 in the luma stream of HD modes, 12 and 14 in the multiplexed stream of SD modes.
+// The output's CreateAncillaryData() makes writable ancillary data in 10-bit YUV, which the output frames keep.
+//
+// Captured frames with a source carry RP188 timecode in HD modes and VITC in SD ones (see CSimTimecode): 01:00:00:00
+// at the first frame of the stream plus the frame's index, so that frames lost for want of a buffer leave a gap.
+//
+// CreateVideoConversionInstance() returns a plain C converter between 8- and 10-bit YUV (see CSimVideoConversion).
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <DeckLinkAPI.h>
+
+#define SIM_EXPORT extern "C" __attribute__((visibility("default")))
+
+//---------------------------------------------------------------------------------------------------------------------
+inline bool IsEqualGUID( const REFIID& a, const REFIID& b )
+{
+    return memcmp( &a, &b, sizeof(REFIID) ) == 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static unsigned EnvUnsigned( const char* name, unsigned def )
+{
+    const char* s = getenv(name);
+    return ( s != NULL && *s != '\0' ) ? (unsigned)strtoul( s, NULL, 0 ) : def;
+}
+
+//=====================================================================================================================
+// Display modes offered by every simulated device: SD and HD, with 3D on the HD progressive/interlaced modes.
+struct SSimMode
+{
+    BMDDisplayMode       mode;
+    const char*          name;
+    long                 width;
+    long                 height;
+    BMDTimeValue         frameDuration;
+    BMDTimeScale         timeScale;
+    BMDFieldDominance    fieldDominance;
+    BMDDisplayModeFlags  flags;
+};
+
+#define SD    bmdDisplayModeColorspaceRec601
+#define HD    bmdDisplayModeColorspaceRec709
+#define HD3D  ( bmdDisplayModeColorspaceRec709 | bmdDisplayModeSupports3D )
+
+static const SSimMode g_SimModes[] =
+{
+    { bmdModeNTSC,         "NTSC",        720,  486, 1001, 30000, bmdLowerFieldFirst,  SD   },
+    { bmdModeNTSC2398,     "NTSC 23.98",  720,  486, 1001, 24000, bmdLowerFieldFirst,  SD   },
+    { bmdModePAL,          "PAL",         720,  576, 1000, 25000, bmdUpperFieldFirst,  SD   },
+    { bmdModeNTSCp,        "NTSC p",      720,  486, 1001, 60000, bmdProgressiveFrame, SD   },
+    { bmdModePALp,         "PAL p",       720,  576, 1000, 50000, bmdProgressiveFrame, SD   },
+    { bmdModeHD1080p2398,  "1080p23.98", 1920, 1080, 1001, 24000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD1080p24,    "1080p24",    1920, 1080, 1000, 24000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD1080p25,    "1080p25",    1920, 1080, 1000, 25000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD1080p2997,  "1080p29.97", 1920, 1080, 1001, 30000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD1080p30,    "1080p30",    1920, 1080, 1000, 30000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD1080i50,    "1080i50",    1920, 1080, 1000, 25000, bmdUpperFieldFirst,  HD3D },
+    { bmdModeHD1080i5994,  "1080i59.94", 1920, 1080, 1001, 30000, bmdUpperFieldFirst,  HD3D },
+    { bmdModeHD1080i6000,  "1080i60",    1920, 1080, 1000, 30000, bmdUpperFieldFirst,  HD3D },
+    { bmdModeHD1080p50,    "1080p50",    1920, 1080, 1000, 50000, bmdProgressiveFrame, HD   },
+    { bmdModeHD1080p5994,  "1080p59.94", 1920, 1080, 1001, 60000, bmdProgressiveFrame, HD   },
+    { bmdModeHD1080p6000,  "1080p60",    1920, 1080, 1000, 60000, bmdProgressiveFrame, HD   },
+    { bmdModeHD720p50,     "720p50",     1280,  720, 1000, 50000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD720p5994,   "720p59.94",  1280,  720, 1001, 60000, bmdProgressiveFrame, HD3D },
+    { bmdModeHD720p60,     "720p60",     1280,  720, 1000, 60000, bmdProgressiveFrame, HD3D },
+};
+
+#undef SD
+#undef HD
+#undef HD3D
+
+static const unsigned kSimModeCount = sizeof(g_SimModes) / sizeof(g_SimModes[0]);
+
+//---------------------------------------------------------------------------------------------------------------------
+static const SSimMode* FindSimMode( BMDDisplayMode mode )
+{
+    for( unsigned i = 0; i < kSimModeCount; ++i )
+    {
+        if( g_SimModes[i].mode == mode )
+        {
+            return &g_SimModes[i];
+        }
+    }
+
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A signal at an input.
+struct SSimSource
+{
+    const SSimMode*  pMode;
+    bool             rgb;       // RGB 4:4:4, else YCbCr 4:2:2
+};
+
+static bool SimIsRgb( BMDPixelFormat format )
+{
+    return format != bmdFormat8BitYUV && format != bmdFormat10BitYUV;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The sources of $DECKLINK_SIM_SOURCE_MODES, in order; unknown names are skipped.
+static std::vector<SSimSource> SimSources()
+{
+    const char* list = getenv("DECKLINK_SIM_SOURCE_MODES");
+    std::vector<SSimSource> sources;
+    std::stringstream stream( list ? list : "" );
+    std::string name;
+
+    while( std::getline( stream, name, ',' ) )
+    {
+        const size_t colon = name.find(':');
+        const bool rgb = ( colon != std::string::npos && name.compare( colon + 1, std::string::npos, "rgb" ) == 0 );
+
+        name = name.substr( 0, colon );
+
+        for( unsigned i = 0; i < kSimModeCount; ++i )
+        {
+            if( name == g_SimModes[i].name )
+            {
+                SSimSource source = { &g_SimModes[i], rgb };
+                sources.push_back(source);
+            }
+        }
+    }
+
+    return sources;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Capture: 8- and 10-bit YUV, 10-bit RGB (r210). Playout: additionally 8-bit RGB, and the other 10-bit RGB formats
+// with conversion.
+static BMDDisplayModeSupport SimModeSupport( bool output, BMDDisplayMode mode, BMDPixelFormat format, uint32_t flags )
+{
+    const SSimMode* pMode = FindSimMode(mode);
+
+    if( pMode == NULL )
+    {
+        return bmdDisplayModeNotSupported;
+    }
+
+    const uint32_t flags3D = output ? (uint32_t)bmdVideoOutputDualStream3D : (uint32_t)bmdVideoInputDualStream3D;
+
+    if( ( flags & flags3D ) && !( pMode->flags & bmdDisplayModeSupports3D ) )
+    {
+        return bmdDisplayModeNotSupported;
+    }
+
+    switch( format )
+    {
+    case bmdFormat8BitYUV:
+    case bmdFormat10BitYUV:
+        return bmdDisplayModeSupported;
+
+    case bmdFormat8BitARGB:
+    case bmdFormat8BitBGRA:
+        return output ? bmdDisplayModeSupported : bmdDisplayModeNotSupported;
+
+    case bmdFormat10BitRGB:
+        return output ? bmdDisplayModeSupportedWithConversion : bmdDisplayModeSupported;
+
+    case bmdFormat10BitRGBXLE:
+    case bmdFormat10BitRGBX:
+        return output ? bmdDisplayModeSupportedWithConversion : bmdDisplayModeNotSupported;
+
+    default:
+        return bmdDisplayModeNotSupported;
+    }
+}
+
+//=====================================================================================================================
+class CSimDisplayMode : public IDeckLinkDisplayMode
+{
+    std::atomic<ULONG>  m_RefCount;
+    const SSimMode*     m_pMode;
+
+public:
+    explicit CSimDisplayMode( const SSimMode* pMode ) : m_RefCount(1), m_pMode(pMode)  {}
+
+    // overrides IDeckLinkDisplayMode
+    virtual HRESULT STDMETHODCALLTYPE GetName( const char** name );
+    virtual BMDDisplayMode STDMETHODCALLTYPE GetDisplayMode(void)  { return m_pMode->mode; }
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return m_pMode->width; }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return m_pMode->height; }
+    virtual HRESULT STDMETHODCALLTYPE GetFrameRate( BMDTimeValue* frameDuration, BMDTimeScale* timeScale );
+    virtual BMDFieldDominance STDMETHODCALLTYPE GetFieldDominance(void)  { return m_pMode->fieldDominance; }
+    virtual BMDDisplayModeFlags STDMETHODCALLTYPE GetFlags(void)  { return m_pMode->flags; }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDisplayMode::GetName( const char** name )
+{
+    *name = strdup(m_pMode->name);
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDisplayMode::GetFrameRate( BMDTimeValue* frameDuration, BMDTimeScale* timeScale )
+{
+    *frameDuration = m_pMode->frameDuration;
+    *timeScale = m_pMode->timeScale;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDisplayMode::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkDisplayMode ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkDisplayMode*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDisplayMode::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDisplayMode::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+class CSimDisplayModeIterator : public IDeckLinkDisplayModeIterator
+{
+    std::atomic<ULONG>  m_RefCount;
+    unsigned            m_Next;
+
+public:
+    CSimDisplayModeIterator() : m_RefCount(1), m_Next(0)  {}
+
+    // overrides IDeckLinkDisplayModeIterator
+    virtual HRESULT STDMETHODCALLTYPE Next( IDeckLinkDisplayMode** deckLinkDisplayMode );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDisplayModeIterator::Next( IDeckLinkDisplayMode** deckLinkDisplayMode )
+{
+    if( m_Next >= kSimModeCount )
+    {
+        *deckLinkDisplayMode = NULL;
+        return S_FALSE;
+    }
+
+    *deckLinkDisplayMode = new CSimDisplayMode( &g_SimModes[m_Next++] );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDisplayModeIterator::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkDisplayModeIterator ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkDisplayModeIterator*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDisplayModeIterator::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDisplayModeIterator::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static HRESULT SimDoesSupportVideoMode( bool output, BMDDisplayMode mode, BMDPixelFormat format, uint32_t flags,
+                                        BMDDisplayModeSupport* result, IDeckLinkDisplayMode** resultDisplayMode )
+{
+    *result = SimModeSupport( output, mode, format, flags );
+
+    if( resultDisplayMode != NULL )
+    {
+        const SSimMode* pMode = FindSimMode(mode);
+        *resultDisplayMode = ( *result != bmdDisplayModeNotSupported ) ? new CSimDisplayMode(pMode) : NULL;
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static long SimRowBytes( BMDPixelFormat format, long width )
+{
+    switch( format )
+    {
+    case bmdFormat8BitYUV:      return width * 2;
+    case bmdFormat10BitYUV:     return ( ( width + 47 ) / 48 ) * 128;
+    case bmdFormat8BitARGB:
+    case bmdFormat8BitBGRA:     return width * 4;
+    default:                    return ( ( width + 63 ) / 64 ) * 256;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static uint64_t SimMonotonicNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                    std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// ns in units of 1/timeScale s, without overflowing for large ns
+static BMDTimeValue SimScaleNs( uint64_t ns, BMDTimeScale timeScale )
+{
+    return (BMDTimeValue)( ( ns / 1000000000 ) * timeScale + ( ns % 1000000000 ) * timeScale / 1000000000 );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static unsigned SimDriftPpm( unsigned slot )
+{
+    return EnvUnsigned( "DECKLINK_SIM_DRIFT_PPM", 0 ) * slot;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// ns of the host's clock as counted by the clock of a device ppm parts per million fast
+static uint64_t SimDeviceNs( uint64_t ns, unsigned ppm )
+{
+    return ns + ns / 1000000 * ppm + ns % 1000000 * ppm / 1000000;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A period of ns on the clock of such a device, in ns of the host's clock
+static std::chrono::nanoseconds SimDevicePeriod( int64_t ns, unsigned ppm )
+{
+    return std::chrono::nanoseconds( ns * 1000000 / ( 1000000 + ppm ) );
+}
+
+//=====================================================================================================================
+// Frame buffers of one EnableVideoInput() session. Like the driver, the simulation has a limited number of buffers:
+// while the application holds on to all of them, incoming frames are dropped. With an application allocator every
+// frame's buffer is obtained from it and given back when the frame is released; Commit() and Decommit() bracket
+// the session. Otherwise buffers are recycled internally.
+class CSimFramePool
+{
+    std::mutex                 m_Mutex;
+    IDeckLinkMemoryAllocator*  m_pAllocator;
+    uint32_t                   m_BufferSize;
+    unsigned                   m_MaxBuffers;
+    unsigned                   m_Outstanding;
+    std::vector<void*>         m_Free;
+
+    CSimFramePool( const CSimFramePool& );
+    CSimFramePool& operator=( const CSimFramePool& );
+
+public:
+    CSimFramePool( IDeckLinkMemoryAllocator* pAllocator, uint32_t bufferSize, unsigned maxBuffers );
+    ~CSimFramePool();
+
+    // NULL if all buffers are in use
+    void* Get();
+    void Put( void* pBuffer );
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimFramePool::CSimFramePool( IDeckLinkMemoryAllocator* pAllocator, uint32_t bufferSize, unsigned maxBuffers )
+    : m_pAllocator(pAllocator), m_BufferSize(bufferSize), m_MaxBuffers(maxBuffers), m_Outstanding(0)
+{
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->AddRef();
+        m_pAllocator->Commit();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimFramePool::~CSimFramePool()
+{
+    for( size_t i = 0; i < m_Free.size(); ++i )
+    {
+        free( m_Free[i] );
+    }
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->Decommit();
+        m_pAllocator->Release();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void* CSimFramePool::Get()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Outstanding >= m_MaxBuffers )
+    {
+        return NULL;
+    }
+
+    void* pBuffer = NULL;
+
+    if( m_pAllocator != NULL )
+    {
+        if( m_pAllocator->AllocateBuffer( m_BufferSize, &pBuffer ) != S_OK )
+        {
+            return NULL;
+        }
+    }
+    else if( !m_Free.empty() )
+    {
+        pBuffer = m_Free.back();
+        m_Free.pop_back();
+    }
+    else if( posix_memalign( &pBuffer, 4096, m_BufferSize ) != 0 )
+    {
+        return NULL;
+    }
+
+    ++m_Outstanding;
+    return pBuffer;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimFramePool::Put( void* pBuffer )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    --m_Outstanding;
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->ReleaseBuffer(pBuffer);
+    }
+    else
+    {
+        m_Free.push_back(pBuffer);
+    }
+}
+
+//=====================================================================================================================
+// Vertical blanking of a 10-bit YUV frame. A captured frame's is a blank line (Cb Cr 200, Y 040) for every line
+// number, but for the two lines with a SMPTE 291 packet each, built when the frame is, like the frame's audio packet.
+// An output frame's is writable: every line has its own buffer, blank when it is first asked for.
+class CSimVideoFrameAncillary : public IDeckLinkVideoFrameAncillary
+{
+    std::atomic<ULONG>                          m_RefCount;
+    const SSimMode*                             m_pMode;
+    bool                                        m_Writable;
+    std::vector<uint32_t>                       m_Blank;
+    std::map<uint32_t, std::vector<uint32_t> >  m_Lines;
+
+    CSimVideoFrameAncillary( const CSimVideoFrameAncillary& );
+    CSimVideoFrameAncillary& operator=( const CSimVideoFrameAncillary& );
+
+    static void SetSample( std::vector<uint32_t>* pLine, size_t s, unsigned value );
+    void WritePacket( std::vector<uint32_t>* pLine, uint8_t did, uint8_t sdid, const uint8_t* pData, unsigned count );
+
+    void Init( const SSimMode* pMode );
+
+public:
+    explicit CSimVideoFrameAncillary( const SSimMode* pMode );              // writable
+    CSimVideoFrameAncillary( const SSimMode* pMode, uint64_t index );       // captured
+
+    // overrides IDeckLinkVideoFrameAncillary
+    virtual HRESULT STDMETHODCALLTYPE GetBufferForVerticalBlankingLine( uint32_t lineNumber, void** buffer );
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return bmdFormat10BitYUV; }
+    virtual BMDDisplayMode STDMETHODCALLTYPE GetDisplayMode(void)  { return m_pMode->mode; }
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimVideoFrameAncillary::Init( const SSimMode* pMode )
+{
+    const size_t samples = (size_t)pMode->width * 2;
+
+    m_Blank.assign( SimRowBytes( bmdFormat10BitYUV, pMode->width ) / 4, 0 );
+
+    for( size_t s = 0; s < samples; ++s )
+    {
+        SetSample( &m_Blank, s, ( s & 1 ) ? 0x040 : 0x200 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimVideoFrameAncillary::CSimVideoFrameAncillary( const SSimMode* pMode )
+    : m_RefCount(1), m_pMode(pMode), m_Writable(true)
+{
+    Init(pMode);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimVideoFrameAncillary::CSimVideoFrameAncillary( const SSimMode* pMode, uint64_t index )
+    : m_RefCount(1), m_pMode(pMode), m_Writable(false)
+{
+    const bool sd = ( pMode->height <= 576 );
+
+    Init(pMode);
+
+    // A caption distribution packet without caption data: header, sequence counter, footer.
+    const uint8_t cdp[] = { 0x96, 0x69, 11, 0x4F, 0x43, (uint8_t)( index >> 8 ), (uint8_t)index, 0x74,
+                            (uint8_t)( index >> 8 ), (uint8_t)index, 0 };
+    // AFD 1000 (the full frame) on a 16:9 frame, no bar data.
+    const uint8_t afd[] = { 0x44, 0, 0, 0, 0, 0, 0, 0 };
+
+    std::vector<uint32_t>& caption = m_Lines[ sd ? 12 : 9 ];
+    std::vector<uint32_t>& format = m_Lines[ sd ? 14 : 11 ];
+
+    caption = m_Blank;
+    format = m_Blank;
+    WritePacket( &caption, 0x61, 0x01, cdp, sizeof(cdp) );
+    WritePacket( &format, 0x41, 0x05, afd, sizeof(afd) );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Sample s of the multiplexed Cb Y Cr Y stream, three to a v210 word.
+void CSimVideoFrameAncillary::SetSample( std::vector<uint32_t>* pLine, size_t s, unsigned value )
+{
+    const unsigned shift = (unsigned)( s % 3 * 10 );
+    uint32_t& word = (*pLine)[s / 3];
+
+    word = ( word & ~( 0x3FFu << shift ) ) | ( value << shift );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// At the start of the luma stream in HD, of the multiplexed stream in SD. Every word after the flag carries even
+// parity in bit 8 and its inverse in bit 9; the checksum is the 9-bit sum of the words from the DID on.
+void CSimVideoFrameAncillary::WritePacket( std::vector<uint32_t>* pLine, uint8_t did, uint8_t sdid,
+                                           const uint8_t* pData, unsigned count )
+{
+    const size_t step = ( m_pMode->height <= 576 ) ? 1 : 2;
+    size_t s = step - 1;
+    unsigned sum = 0;
+
+    SetSample( pLine, s, 0x000 );
+    SetSample( pLine, s += step, 0x3FF );
+    SetSample( pLine, s += step, 0x3FF );
+
+    for( unsigned k = 0; k < 3 + count; ++k )
+    {
+        const unsigned byte = ( k == 0 ) ? did : ( k == 1 ) ? sdid : ( k == 2 ) ? count : pData[k - 3];
+        unsigned parity = byte;
+
+        parity ^= parity >> 4;
+        parity ^= parity >> 2;
+        parity ^= parity >> 1;
+        parity &= 1;
+
+        const unsigned word = byte | parity << 8 | ( parity ^ 1 ) << 9;
+
+        sum += word & 0x1FF;
+        SetSample( pLine, s += step, word );
+    }
+
+    sum &= 0x1FF;
+    SetSample( pLine, s += step, sum | ( ( ~sum >> 8 ) & 1 ) << 9 );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoFrameAncillary::GetBufferForVerticalBlankingLine( uint32_t lineNumber,
+                                                                                    void** buffer )
+{
+    if( lineNumber == 0 || lineNumber > (uint32_t)m_pMode->height )
+    {
+        *buffer = NULL;
+        return E_INVALIDARG;
+    }
+
+    std::map<uint32_t, std::vector<uint32_t> >::iterator it = m_Lines.find(lineNumber);
+
+    if( it != m_Lines.end() )
+    {
+        *buffer = it->second.data();
+    }
+    else if( m_Writable )
+    {
+        *buffer = ( m_Lines[lineNumber] = m_Blank ).data();
+    }
+    else
+    {
+        *buffer = m_Blank.data();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoFrameAncillary::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkVideoFrameAncillary ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkVideoFrameAncillary*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimVideoFrameAncillary::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimVideoFrameAncillary::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+// Timecode of a captured frame: 01:00:00:00 at the first frame of the stream, counting at the whole rate of the mode,
+// drop-frame at 29.97 and 59.94.
+class CSimTimecode : public IDeckLinkTimecode
+{
+    std::atomic<ULONG>  m_RefCount;
+    uint8_t             m_Digits[4];   // hours, minutes, seconds, frames
+    BMDTimecodeFlags    m_Flags;
+    char                m_String[16];
+
+    CSimTimecode( const CSimTimecode& );
+    CSimTimecode& operator=( const CSimTimecode& );
+
+public:
+    CSimTimecode( const SSimMode* pMode, uint64_t index );
+
+    // overrides IDeckLinkTimecode
+    virtual BMDTimecodeBCD STDMETHODCALLTYPE GetBCD(void);
+    virtual HRESULT STDMETHODCALLTYPE GetComponents( uint8_t* hours, uint8_t* minutes, uint8_t* seconds,
+                                                     uint8_t* frames );
+    virtual HRESULT STDMETHODCALLTYPE GetString( const char** timecode );
+    virtual BMDTimecodeFlags STDMETHODCALLTYPE GetFlags(void)  { return m_Flags; }
+    virtual HRESULT STDMETHODCALLTYPE GetTimecodeUserBits( BMDTimecodeUserBits* userBits );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// Drop-frame skips the first fps / 15 frame numbers of every minute but every tenth; the frame count is stretched by
+// the numbers skipped before it, then split up as if none were.
+CSimTimecode::CSimTimecode( const SSimMode* pMode, uint64_t index )
+    : m_RefCount(1)
+{
+    const uint64_t fps = ( pMode->timeScale + pMode->frameDuration / 2 ) / pMode->frameDuration;
+    const uint64_t drop = ( pMode->frameDuration == 1001 && fps % 30 == 0 ) ? fps / 15 : 0;
+    const uint64_t day = fps * 86400 - drop * ( 1440 - 144 );
+    uint64_t frames = ( index + 3600 * fps - drop * 54 ) % day;
+
+    if( drop != 0 )
+    {
+        const uint64_t perTen = fps * 600 - drop * 9;
+        const uint64_t rest = frames % perTen;
+
+        frames += drop * 9 * ( frames / perTen ) + ( ( rest > drop ) ? drop * ( ( rest - drop ) / ( fps * 60 - drop ) )
+                                                                     : 0 );
+    }
+
+    m_Digits[0] = (uint8_t)( frames / fps / 3600 );
+    m_Digits[1] = (uint8_t)( frames / fps / 60 % 60 );
+    m_Digits[2] = (uint8_t)( frames / fps % 60 );
+    m_Digits[3] = (uint8_t)( frames % fps );
+    m_Flags = drop ? bmdTimecodeIsDropFrame : bmdTimecodeFlagDefault;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+BMDTimecodeBCD STDMETHODCALLTYPE CSimTimecode::GetBCD(void)
+{
+    BMDTimecodeBCD bcd = 0;
+
+    for( int i = 0; i < 4; ++i )
+    {
+        bcd = bcd << 8 | (uint32_t)( m_Digits[i] / 10 ) << 4 | m_Digits[i] % 10;
+    }
+
+    return bcd;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimTimecode::GetComponents( uint8_t* hours, uint8_t* minutes, uint8_t* seconds,
+                                                       uint8_t* frames )
+{
+    *hours = m_Digits[0];
+    *minutes = m_Digits[1];
+    *seconds = m_Digits[2];
+    *frames = m_Digits[3];
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimTimecode::GetString( const char** timecode )
+{
+    snprintf( m_String, sizeof(m_String), "%02u:%02u:%02u%c%02u", m_Digits[0], m_Digits[1], m_Digits[2],
+              ( m_Flags & bmdTimecodeIsDropFrame ) ? ';' : ':', m_Digits[3] );
+    *timecode = m_String;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimTimecode::GetTimecodeUserBits( BMDTimecodeUserBits* userBits )
+{
+    *userBits = 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimTimecode::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkTimecode ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkTimecode*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimTimecode::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimTimecode::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+class CSimVideoInputFrame : public IDeckLinkVideoInputFrame
+{
+    std::atomic<ULONG>              m_RefCount;
+    std::shared_ptr<CSimFramePool>  m_pPool;
+    void*                           m_pBuffer;
+    const SSimMode*                 m_pMode;
+    BMDPixelFormat                  m_Format;
+    BMDFrameFlags                   m_Flags;
+    uint64_t                        m_Index;       // frames since StartStreams()
+    uint64_t                        m_ArrivalNs;
+
+public:
+    CSimVideoInputFrame( const std::shared_ptr<CSimFramePool>& pPool, void* pBuffer, const SSimMode* pMode,
+                         BMDPixelFormat format, BMDFrameFlags flags, uint64_t index, uint64_t arrivalNs )
+        : m_RefCount(1), m_pPool(pPool), m_pBuffer(pBuffer), m_pMode(pMode), m_Format(format), m_Flags(flags),
+          m_Index(index), m_ArrivalNs(arrivalNs)  {}
+
+    ~CSimVideoInputFrame()  { m_pPool->Put(m_pBuffer); }
+
+    // overrides IDeckLinkVideoFrame
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return m_pMode->width; }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return m_pMode->height; }
+    virtual long STDMETHODCALLTYPE GetRowBytes(void)  { return SimRowBytes( m_Format, m_pMode->width ); }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return m_Format; }
+    virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void)  { return m_Flags; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer );
+    virtual HRESULT STDMETHODCALLTYPE GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode );
+    virtual HRESULT STDMETHODCALLTYPE GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary );
+
+    // overrides IDeckLinkVideoInputFrame
+    virtual HRESULT STDMETHODCALLTYPE GetStreamTime( BMDTimeValue* frameTime, BMDTimeValue* frameDuration,
+                                                     BMDTimeScale timeScale );
+    virtual HRESULT STDMETHODCALLTYPE GetHardwareReferenceTimestamp( BMDTimeScale timeScale, BMDTimeValue* frameTime,
+                                                                     BMDTimeValue* frameDuration );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoInputFrame::GetBytes( void** buffer )
+{
+    *buffer = m_pBuffer;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// RP188 in HD modes, VITC in SD ones; none without a source.
+HRESULT STDMETHODCALLTYPE CSimVideoInputFrame::GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode )
+{
+    const bool sd = ( m_pMode->height <= 576 );
+    const bool rp188 = ( format == bmdTimecodeRP188VITC1 || format == bmdTimecodeRP188VITC2 ||
+                         format == bmdTimecodeRP188LTC || format == bmdTimecodeRP188Any );
+    const bool vitc = ( format == bmdTimecodeVITC || format == bmdTimecodeVITCField2 );
+
+    if( ( m_Flags & bmdFrameHasNoInputSource ) != 0 || !( sd ? vitc : rp188 ) )
+    {
+        *timecode = NULL;
+        return S_FALSE;
+    }
+
+    *timecode = new CSimTimecode( m_pMode, m_Index );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only 10-bit YUV frames with a source have any.
+HRESULT STDMETHODCALLTYPE CSimVideoInputFrame::GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary )
+{
+    if( m_Format != bmdFormat10BitYUV || ( m_Flags & bmdFrameHasNoInputSource ) != 0 )
+    {
+        *ancillary = NULL;
+        return S_FALSE;
+    }
+
+    *ancillary = new CSimVideoFrameAncillary( m_pMode, m_Index );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoInputFrame::GetStreamTime( BMDTimeValue* frameTime, BMDTimeValue* frameDuration,
+                                                              BMDTimeScale timeScale )
+{
+    *frameDuration = m_pMode->frameDuration * timeScale / m_pMode->timeScale;
+    *frameTime = (BMDTimeValue)m_Index * m_pMode->frameDuration * timeScale / m_pMode->timeScale;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoInputFrame::GetHardwareReferenceTimestamp( BMDTimeScale timeScale,
+                                                                              BMDTimeValue* frameTime,
+                                                                              BMDTimeValue* frameDuration )
+{
+    *frameTime = SimScaleNs( m_ArrivalNs, timeScale );
+    *frameDuration = m_pMode->frameDuration * timeScale / m_pMode->timeScale;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoInputFrame::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkVideoInputFrame ) || IsEqualGUID( riid, IID_IDeckLinkVideoFrame ) ||
+        IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkVideoInputFrame*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimVideoInputFrame::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimVideoInputFrame::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+// Audio of one video frame, interleaved.
+class CSimAudioInputPacket : public IDeckLinkAudioInputPacket
+{
+    std::atomic<ULONG>    m_RefCount;
+    std::vector<uint8_t>  m_Bytes;
+    long                  m_Frames;
+    uint64_t              m_FirstSample;     // sample frames since StartStreams()
+
+public:
+    CSimAudioInputPacket( BMDAudioSampleType type, uint32_t channels, long frames, uint64_t firstSample );
+
+    // overrides IDeckLinkAudioInputPacket
+    virtual long STDMETHODCALLTYPE GetSampleFrameCount(void)  { return m_Frames; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer );
+    virtual HRESULT STDMETHODCALLTYPE GetPacketTime( BMDTimeValue* packetTime, BMDTimeScale timeScale );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimAudioInputPacket::CSimAudioInputPacket( BMDAudioSampleType type, uint32_t channels, long frames,
+                                            uint64_t firstSample )
+    : m_RefCount(1), m_Bytes( (size_t)frames * channels * ( type / 8 ) ), m_Frames(frames), m_FirstSample(firstSample)
+{
+    int16_t* p16 = (int16_t*)m_Bytes.data();
+    int32_t* p32 = (int32_t*)m_Bytes.data();
+
+    for( long n = 0; n < frames; ++n )
+    {
+        for( uint32_t c = 0; c < channels; ++c )
+        {
+            const uint32_t value = (uint32_t)( ( ( firstSample + n ) << 8 | c ) * 2654435761u );
+
+            if( type == bmdAudioSampleType16bitInteger )
+            {
+                *p16++ = (int16_t)( value >> 16 );
+            }
+            else
+            {
+                *p32++ = (int32_t)value;
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimAudioInputPacket::GetBytes( void** buffer )
+{
+    *buffer = m_Bytes.data();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimAudioInputPacket::GetPacketTime( BMDTimeValue* packetTime, BMDTimeScale timeScale )
+{
+    *packetTime = (BMDTimeValue)( m_FirstSample * timeScale / bmdAudioSampleRate48kHz );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimAudioInputPacket::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkAudioInputPacket ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkAudioInputPacket*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimAudioInputPacket::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimAudioInputPacket::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+// Frame made by IDeckLinkOutput::CreateVideoFrame(), with a buffer from the application's allocator if one is set.
+class CSimOutputFrame : public IDeckLinkMutableVideoFrame
+{
+    std::atomic<ULONG>             m_RefCount;
+    IDeckLinkMemoryAllocator*      m_pAllocator;
+    void*                          m_pBuffer;
+    long                           m_Width;
+    long                           m_Height;
+    long                           m_RowBytes;
+    BMDPixelFormat                 m_Format;
+    BMDFrameFlags                  m_Flags;
+    IDeckLinkVideoFrameAncillary*  m_pAncillary;
+
+public:
+    CSimOutputFrame( IDeckLinkMemoryAllocator* pAllocator, void* pBuffer, long width, long height, long rowBytes,
+                     BMDPixelFormat format, BMDFrameFlags flags );
+    ~CSimOutputFrame();
+
+    // overrides IDeckLinkVideoFrame
+    virtual long STDMETHODCALLTYPE GetWidth(void)  { return m_Width; }
+    virtual long STDMETHODCALLTYPE GetHeight(void)  { return m_Height; }
+    virtual long STDMETHODCALLTYPE GetRowBytes(void)  { return m_RowBytes; }
+    virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void)  { return m_Format; }
+    virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void)  { return m_Flags; }
+    virtual HRESULT STDMETHODCALLTYPE GetBytes( void** buffer );
+    virtual HRESULT STDMETHODCALLTYPE GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode );
+    virtual HRESULT STDMETHODCALLTYPE GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary );
+
+    // overrides IDeckLinkMutableVideoFrame
+    virtual HRESULT STDMETHODCALLTYPE SetFlags( BMDFrameFlags newFlags );
+    virtual HRESULT STDMETHODCALLTYPE SetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode* timecode );
+    virtual HRESULT STDMETHODCALLTYPE SetTimecodeFromComponents( BMDTimecodeFormat format, uint8_t hours,
+                                                                 uint8_t minutes, uint8_t seconds, uint8_t frames,
+                                                                 BMDTimecodeFlags flags );
+    virtual HRESULT STDMETHODCALLTYPE SetAncillaryData( IDeckLinkVideoFrameAncillary* ancillary );
+    virtual HRESULT STDMETHODCALLTYPE SetTimecodeUserBits( BMDTimecodeFormat format, BMDTimecodeUserBits userBits );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimOutputFrame::CSimOutputFrame( IDeckLinkMemoryAllocator* pAllocator, void* pBuffer, long width, long height,
+                                  long rowBytes, BMDPixelFormat format, BMDFrameFlags flags )
+    : m_RefCount(1), m_pAllocator(pAllocator), m_pBuffer(pBuffer), m_Width(width), m_Height(height),
+      m_RowBytes(rowBytes), m_Format(format), m_Flags(flags), m_pAncillary(NULL)
+{
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->AddRef();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimOutputFrame::~CSimOutputFrame()
+{
+    if( m_pAncillary != NULL )
+    {
+        m_pAncillary->Release();
+    }
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->ReleaseBuffer(m_pBuffer);
+        m_pAllocator->Release();
+    }
+    else
+    {
+        free(m_pBuffer);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::GetBytes( void** buffer )
+{
+    *buffer = m_pBuffer;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::GetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode** timecode )
+{
+    *timecode = NULL;
+    return S_FALSE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::GetAncillaryData( IDeckLinkVideoFrameAncillary** ancillary )
+{
+    *ancillary = m_pAncillary;
+
+    if( m_pAncillary == NULL )
+    {
+        return S_FALSE;
+    }
+
+    m_pAncillary->AddRef();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::SetFlags( BMDFrameFlags newFlags )
+{
+    m_Flags = newFlags;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::SetTimecode( BMDTimecodeFormat format, IDeckLinkTimecode* timecode )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::SetTimecodeFromComponents( BMDTimecodeFormat format, uint8_t hours,
+                                                                      uint8_t minutes, uint8_t seconds,
+                                                                      uint8_t frames, BMDTimecodeFlags flags )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::SetAncillaryData( IDeckLinkVideoFrameAncillary* ancillary )
+{
+    if( ancillary != NULL )
+    {
+        ancillary->AddRef();
+    }
+
+    if( m_pAncillary != NULL )
+    {
+        m_pAncillary->Release();
+    }
+
+    m_pAncillary = ancillary;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::SetTimecodeUserBits( BMDTimecodeFormat format,
+                                                                BMDTimecodeUserBits userBits )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutputFrame::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkMutableVideoFrame ) || IsEqualGUID( riid, IID_IDeckLinkVideoFrame ) ||
+        IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkMutableVideoFrame*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimOutputFrame::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimOutputFrame::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+class CSimDeckLink;
+
+//=====================================================================================================================
+// Input and output interfaces of a CSimDeckLink; they live inside it and share its reference count.
+//
+// The input delivers frames at the rate of the enabled mode (times DECKLINK_SIM_SPEED, 0 = as fast as the callback
+// returns) on a thread of its own, which holds a reference on the device while it runs.
+class CSimInput : public IDeckLinkInput
+{
+    CSimDeckLink*                   m_pOwner;
+
+    std::mutex                      m_Mutex;
+    std::condition_variable         m_Cond;
+    const SSimMode*                 m_pMode;         // NULL while video input is disabled
+    BMDPixelFormat                  m_Format;
+    BMDVideoInputFlags              m_Flags;
+    std::vector<SSimSource>         m_Sources;       // signals the source cycles through, empty = always the enabled one
+    uint64_t                        m_SourceNs;      // per mode
+    uint64_t                        m_SourceStartNs; // 0 until streams are first started
+    std::shared_ptr<CSimFramePool>  m_pPool;
+    IDeckLinkMemoryAllocator*       m_pAllocator;
+    IDeckLinkInputCallback*         m_pCallback;
+    bool                            m_Streaming;
+    unsigned                        m_StreamId;      // identifies the current stream thread
+    uint64_t                        m_FrameIndex;
+    BMDAudioSampleType              m_AudioType;
+    uint32_t                        m_AudioChannels; // 0 while audio input is disabled
+    std::thread                     m_Thread;
+
+    void StreamMain( unsigned streamId, unsigned speed );
+    void Halt();
+    SSimSource Source( uint64_t nowNs ) const;
+
+public:
+    explicit CSimInput( CSimDeckLink* pOwner );
+    ~CSimInput();
+
+    // overrides IDeckLinkInput
+    virtual HRESULT STDMETHODCALLTYPE DoesSupportVideoMode( BMDDisplayMode displayMode, BMDPixelFormat pixelFormat,
+                                                            BMDVideoInputFlags flags, BMDDisplayModeSupport* result,
+                                                            IDeckLinkDisplayMode** resultDisplayMode );
+    virtual HRESULT STDMETHODCALLTYPE GetDisplayModeIterator( IDeckLinkDisplayModeIterator** iterator );
+    virtual HRESULT STDMETHODCALLTYPE SetScreenPreviewCallback( IDeckLinkScreenPreviewCallback* previewCallback );
+
+    virtual HRESULT STDMETHODCALLTYPE EnableVideoInput( BMDDisplayMode displayMode, BMDPixelFormat pixelFormat,
+                                                        BMDVideoInputFlags flags );
+    virtual HRESULT STDMETHODCALLTYPE DisableVideoInput(void);
+    virtual HRESULT STDMETHODCALLTYPE GetAvailableVideoFrameCount( uint32_t* availableFrameCount );
+    virtual HRESULT STDMETHODCALLTYPE SetVideoInputFrameMemoryAllocator( IDeckLinkMemoryAllocator* theAllocator );
+
+    virtual HRESULT STDMETHODCALLTYPE EnableAudioInput( BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType,
+                                                        uint32_t channelCount );
+    virtual HRESULT STDMETHODCALLTYPE DisableAudioInput(void);
+    virtual HRESULT STDMETHODCALLTYPE GetAvailableAudioSampleFrameCount( uint32_t* availableSampleFrameCount );
+
+    virtual HRESULT STDMETHODCALLTYPE StartStreams(void);
+    virtual HRESULT STDMETHODCALLTYPE StopStreams(void);
+    virtual HRESULT STDMETHODCALLTYPE PauseStreams(void);
+    virtual HRESULT STDMETHODCALLTYPE FlushStreams(void);
+    virtual HRESULT STDMETHODCALLTYPE SetCallback( IDeckLinkInputCallback* theCallback );
+
+    virtual HRESULT STDMETHODCALLTYPE GetHardwareReferenceClock( BMDTimeScale desiredTimeScale,
+                                                                 BMDTimeValue* hardwareTime, BMDTimeValue* timeInFrame,
+                                                                 BMDTimeValue* ticksPerFrame );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//=====================================================================================================================
+// The output shows one frame per frame period of the enabled mode (times DECKLINK_SIM_SPEED) once scheduled playback
+// is started, on a thread of its own which holds a reference on the device while it runs. At each period it takes
+// the frames scheduled up to the current stream time: the last of them goes on screen, on time if it was scheduled
+// for this period and late otherwise, the others are dropped. A frame is completed when the next one replaces it;
+// without a new frame the one on screen is repeated. Frames still scheduled when playback stops are flushed.
+class CSimOutput : public IDeckLinkOutput
+{
+    struct SScheduled
+    {
+        IDeckLinkVideoFrame*            pFrame;
+        BMDTimeValue                    time;           // display time, in units of the mode's time scale
+        BMDOutputFrameCompletionResult  result;         // once taken off the schedule
+    };
+
+    CSimDeckLink*                   m_pOwner;
+
+    std::mutex                      m_Mutex;
+    std::condition_variable         m_Cond;
+    const SSimMode*                 m_pMode;          // NULL while video output is disabled
+    IDeckLinkMemoryAllocator*       m_pAllocator;
+    IDeckLinkMemoryAllocator*       m_pCommitted;     // the allocator as of EnableVideoOutput()
+    IDeckLinkVideoOutputCallback*   m_pCallback;
+    std::deque<SScheduled>          m_Scheduled;      // by display time
+    SScheduled                      m_OnScreen;
+    bool                            m_Playing;
+    unsigned                        m_PlayId;         // identifies the current playback thread
+    BMDTimeValue                    m_StreamTime;     // of the period on screen, in units of the mode's time scale
+    BMDTimeValue                    m_StartTime;      // ... at StartScheduledPlayback()
+    uint64_t                        m_StartNs;        // host clock at StartScheduledPlayback()
+    unsigned                        m_Speed;
+    std::thread                     m_Thread;
+
+    uint32_t                        m_AudioChannels;  // 0 while audio output is disabled
+    IDeckLinkAudioOutputCallback*   m_pAudioCallback;
+    uint64_t                        m_AudioEnd;       // just past the last sample scheduled, in 48 kHz stream time
+    bool                            m_Preroll;
+    std::thread                     m_PrerollThread;
+
+    void PlayMain( unsigned playId, unsigned speed );
+    void PrerollMain();
+    void Halt();
+    void EndPreroll( std::unique_lock<std::mutex>& lock );
+    void Flush( std::vector<SScheduled>* pDone );
+    uint64_t AudioPlayed();
+
+public:
+    explicit CSimOutput( CSimDeckLink* pOwner );
+    ~CSimOutput();
+
+    // overrides IDeckLinkOutput
+    virtual HRESULT STDMETHODCALLTYPE DoesSupportVideoMode( BMDDisplayMode displayMode, BMDPixelFormat pixelFormat,
+                                                            BMDVideoOutputFlags flags, BMDDisplayModeSupport* result,
+                                                            IDeckLinkDisplayMode** resultDisplayMode );
+    virtual HRESULT STDMETHODCALLTYPE GetDisplayModeIterator( IDeckLinkDisplayModeIterator** iterator );
+    virtual HRESULT STDMETHODCALLTYPE SetScreenPreviewCallback( IDeckLinkScreenPreviewCallback* previewCallback );
+
+    virtual HRESULT STDMETHODCALLTYPE EnableVideoOutput( BMDDisplayMode displayMode, BMDVideoOutputFlags flags );
+    virtual HRESULT STDMETHODCALLTYPE DisableVideoOutput(void);
+
+    virtual HRESULT STDMETHODCALLTYPE SetVideoOutputFrameMemoryAllocator( IDeckLinkMemoryAllocator* theAllocator );
+    virtual HRESULT STDMETHODCALLTYPE CreateVideoFrame( int32_t width, int32_t height, int32_t rowBytes,
+                                                        BMDPixelFormat pixelFormat, BMDFrameFlags flags,
+                                                        IDeckLinkMutableVideoFrame** outFrame );
+    virtual HRESULT STDMETHODCALLTYPE CreateAncillaryData( BMDPixelFormat pixelFormat,
+                                                           IDeckLinkVideoFrameAncillary** outBuffer );
+
+    virtual HRESULT STDMETHODCALLTYPE DisplayVideoFrameSync( IDeckLinkVideoFrame* theFrame );
+    virtual HRESULT STDMETHODCALLTYPE ScheduleVideoFrame( IDeckLinkVideoFrame* theFrame, BMDTimeValue displayTime,
+                                                          BMDTimeValue displayDuration, BMDTimeScale timeScale );
+    virtual HRESULT STDMETHODCALLTYPE SetScheduledFrameCompletionCallback( IDeckLinkVideoOutputCallback* theCallback );
+    virtual HRESULT STDMETHODCALLTYPE GetBufferedVideoFrameCount( uint32_t* bufferedFrameCount );
+
+    virtual HRESULT STDMETHODCALLTYPE EnableAudioOutput( BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType,
+                                                         uint32_t channelCount, BMDAudioOutputStreamType streamType );
+    virtual HRESULT STDMETHODCALLTYPE DisableAudioOutput(void);
+    virtual HRESULT STDMETHODCALLTYPE WriteAudioSamplesSync( void* buffer, uint32_t sampleFrameCount,
+                                                             uint32_t* sampleFramesWritten );
+    virtual HRESULT STDMETHODCALLTYPE BeginAudioPreroll(void);
+    virtual HRESULT STDMETHODCALLTYPE EndAudioPreroll(void);
+    virtual HRESULT STDMETHODCALLTYPE ScheduleAudioSamples( void* buffer, uint32_t sampleFrameCount,
+                                                            BMDTimeValue streamTime, BMDTimeScale timeScale,
+                                                            uint32_t* sampleFramesWritten );
+    virtual HRESULT STDMETHODCALLTYPE GetBufferedAudioSampleFrameCount( uint32_t* bufferedSampleFrameCount );
+    virtual HRESULT STDMETHODCALLTYPE FlushBufferedAudioSamples(void);
+    virtual HRESULT STDMETHODCALLTYPE SetAudioCallback( IDeckLinkAudioOutputCallback* theCallback );
+
+    virtual HRESULT STDMETHODCALLTYPE StartScheduledPlayback( BMDTimeValue playbackStartTime, BMDTimeScale timeScale,
+                                                              double playbackSpeed );
+    virtual HRESULT STDMETHODCALLTYPE StopScheduledPlayback( BMDTimeValue stopPlaybackAtTime,
+                                                             BMDTimeValue* actualStopTime, BMDTimeScale timeScale );
+    virtual HRESULT STDMETHODCALLTYPE IsScheduledPlaybackRunning( bool* active );
+    virtual HRESULT STDMETHODCALLTYPE GetScheduledStreamTime( BMDTimeScale desiredTimeScale, BMDTimeValue* streamTime,
+                                                              double* playbackSpeed );
+    virtual HRESULT STDMETHODCALLTYPE GetReferenceStatus( BMDReferenceStatus* referenceStatus );
+
+    virtual HRESULT STDMETHODCALLTYPE GetHardwareReferenceClock( BMDTimeScale desiredTimeScale,
+                                                                 BMDTimeValue* hardwareTime, BMDTimeValue* timeInFrame,
+                                                                 BMDTimeValue* ticksPerFrame );
+    virtual HRESULT STDMETHODCALLTYPE GetFrameCompletionReferenceTimestamp( IDeckLinkVideoFrame* theFrame,
+                                                                            BMDTimeScale desiredTimeScale,
+                                                                            BMDTimeValue* frameCompletionTimestamp );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//=====================================================================================================================
+class CSimDeckLink : public IDeckLink, public IDeckLinkAttributes
+{
+    std::atomic<ULONG>  m_RefCount;
+    unsigned            m_Slot;
+    unsigned            m_SubDevices;
+    char                m_DisplayName[64];
+    CSimInput           m_Input;
+    CSimOutput          m_Output;
+
+public:
+    CSimDeckLink( unsigned slot, unsigned subDevices );
+
+    unsigned Slot() const  { return m_Slot; }
+
+    // overrides IDeckLink
+    virtual HRESULT STDMETHODCALLTYPE GetModelName( const char** modelName );
+    virtual HRESULT STDMETHODCALLTYPE GetDisplayName( const char** displayName );
+
+    // overrides IDeckLinkAttributes
+    virtual HRESULT STDMETHODCALLTYPE GetFlag( BMDDeckLinkAttributeID cfgID, bool* value );
+    virtual HRESULT STDMETHODCALLTYPE GetInt( BMDDeckLinkAttributeID cfgID, int64_t* value );
+    virtual HRESULT STDMETHODCALLTYPE GetFloat( BMDDeckLinkAttributeID cfgID, double* value );
+    virtual HRESULT STDMETHODCALLTYPE GetString( BMDDeckLinkAttributeID cfgID, const char** value );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimDeckLink::CSimDeckLink( unsigned slot, unsigned subDevices )
+    : m_RefCount(1), m_Slot(slot), m_SubDevices(subDevices), m_Input(this), m_Output(this)
+{
+    snprintf( m_DisplayName, sizeof(m_DisplayName), "DeckLink Sim (%u)", slot + 1 );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::GetModelName( const char** modelName )
+{
+    *modelName = strdup("DeckLink Sim");
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::GetDisplayName( const char** displayName )
+{
+    *displayName = strdup(m_DisplayName);
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::GetFlag( BMDDeckLinkAttributeID cfgID, bool* value )
+{
+    switch( cfgID )
+    {
+    case BMDDeckLinkSupportsInputFormatDetection:
+        *value = true;
+        return S_OK;
+
+    default:
+        return E_NOTIMPL;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::GetInt( BMDDeckLinkAttributeID cfgID, int64_t* value )
+{
+    switch( cfgID )
+    {
+    case BMDDeckLinkPersistentID:
+        // stable across re-plugging, like the slot of a real card
+        *value = 0x51000000 + m_Slot;
+        return S_OK;
+
+    case BMDDeckLinkSubDeviceIndex:
+        *value = m_Slot % m_SubDevices;
+        return S_OK;
+
+    case BMDDeckLinkNumberOfSubDevices:
+        *value = m_SubDevices;
+        return S_OK;
+
+    case BMDDeckLinkVideoIOSupport:
+        *value = bmdDeviceSupportsCapture | bmdDeviceSupportsPlayback;
+        return S_OK;
+
+    case BMDDeckLinkMaximumAudioChannels:
+        *value = 16;
+        return S_OK;
+
+    default:
+        return E_NOTIMPL;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::GetFloat( BMDDeckLinkAttributeID cfgID, double* value )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::GetString( BMDDeckLinkAttributeID cfgID, const char** value )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDeckLink::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLink ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLink*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    if( IsEqualGUID( riid, IID_IDeckLinkAttributes ) )
+    {
+        *ppvObject = static_cast<IDeckLinkAttributes*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    if( IsEqualGUID( riid, IID_IDeckLinkInput ) )
+    {
+        *ppvObject = static_cast<IDeckLinkInput*>(&m_Input);
+        AddRef();
+        return S_OK;
+    }
+
+    if( IsEqualGUID( riid, IID_IDeckLinkOutput ) )
+    {
+        *ppvObject = static_cast<IDeckLinkOutput*>(&m_Output);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDeckLink::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDeckLink::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimInput::CSimInput( CSimDeckLink* pOwner )
+    : m_pOwner(pOwner), m_pMode(NULL), m_Format(bmdFormat8BitYUV),
+      m_Flags((BMDVideoInputFlags)bmdVideoInputFlagDefault), m_Sources(SimSources()),
+      m_SourceNs((uint64_t)EnvUnsigned( "DECKLINK_SIM_SOURCE_SECONDS", 10 ) * 1000000000), m_SourceStartNs(0),
+      m_pAllocator(NULL), m_pCallback(NULL), m_Streaming(false), m_StreamId(0), m_FrameIndex(0),
+      m_AudioType(bmdAudioSampleType16bitInteger), m_AudioChannels(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only reached once no stream thread holds the device any more.
+CSimInput::~CSimInput()
+{
+    SetCallback(NULL);
+    SetVideoInputFrameMemoryAllocator(NULL);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::DoesSupportVideoMode( BMDDisplayMode displayMode, BMDPixelFormat pixelFormat,
+                                                           BMDVideoInputFlags flags, BMDDisplayModeSupport* result,
+                                                           IDeckLinkDisplayMode** resultDisplayMode )
+{
+    return SimDoesSupportVideoMode( false, displayMode, pixelFormat, flags, result, resultDisplayMode );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::GetDisplayModeIterator( IDeckLinkDisplayModeIterator** iterator )
+{
+    *iterator = new CSimDisplayModeIterator();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::SetScreenPreviewCallback( IDeckLinkScreenPreviewCallback* previewCallback )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::EnableVideoInput( BMDDisplayMode displayMode, BMDPixelFormat pixelFormat,
+                                                       BMDVideoInputFlags flags )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Streaming )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    if( SimModeSupport( false, displayMode, pixelFormat, flags ) != bmdDisplayModeSupported )
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pMode = FindSimMode(displayMode);
+    m_Format = pixelFormat;
+    m_Flags = flags;
+
+    // frames of a previous session keep the old pool alive until they are released
+    const uint32_t bufferSize = (uint32_t)( SimRowBytes( pixelFormat, m_pMode->width ) * m_pMode->height );
+    m_pPool = std::make_shared<CSimFramePool>( m_pAllocator, bufferSize, EnvUnsigned( "DECKLINK_SIM_BUFFERS", 16 ) );
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::DisableVideoInput(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Streaming )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    m_pMode = NULL;
+    m_pPool.reset();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::GetAvailableVideoFrameCount( uint32_t* availableFrameCount )
+{
+    // frames are delivered as soon as they are complete
+    *availableFrameCount = 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::SetVideoInputFrameMemoryAllocator( IDeckLinkMemoryAllocator* theAllocator )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    // takes effect with the next EnableVideoInput()
+    if( theAllocator != NULL )
+    {
+        theAllocator->AddRef();
+    }
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->Release();
+    }
+
+    m_pAllocator = theAllocator;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::EnableAudioInput( BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType,
+                                                       uint32_t channelCount )
+{
+    if( sampleRate != bmdAudioSampleRate48kHz ||
+        ( sampleType != bmdAudioSampleType16bitInteger && sampleType != bmdAudioSampleType32bitInteger ) ||
+        ( channelCount != 2 && channelCount != 8 && channelCount != 16 ) )
+    {
+        return E_INVALIDARG;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Streaming )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    m_AudioType = sampleType;
+    m_AudioChannels = channelCount;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::DisableAudioInput(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Streaming )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    m_AudioChannels = 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::GetAvailableAudioSampleFrameCount( uint32_t* availableSampleFrameCount )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// The signal at the input, under m_Mutex.
+SSimSource CSimInput::Source( uint64_t nowNs ) const
+{
+    if( m_Sources.empty() || m_SourceNs == 0 )
+    {
+        SSimSource source = { m_pMode, SimIsRgb(m_Format) };
+        return source;
+    }
+
+    return m_Sources[ ( nowNs - m_SourceStartNs ) / m_SourceNs % m_Sources.size() ];
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimInput::StreamMain( unsigned streamId, unsigned speed )
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    const SSimMode* pMode = m_pMode;
+    const BMDPixelFormat format = m_Format;
+    const bool detection = ( m_Flags & bmdVideoInputEnableFormatDetection ) != 0;
+    bool reported = false;
+    const BMDAudioSampleType audioType = m_AudioType;
+    const uint32_t audioChannels = m_AudioChannels;
+    const std::chrono::nanoseconds period = SimDevicePeriod( speed == 0 ? 0 :
+                                    pMode->frameDuration * 1000000000 / pMode->timeScale / speed,
+                                    SimDriftPpm( m_pOwner->Slot() ) );
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+    while( m_Streaming && m_StreamId == streamId )
+    {
+        next += period;
+
+        if( m_Cond.wait_until( lock, next, [this, streamId] { return !m_Streaming || m_StreamId != streamId; } ) )
+        {
+            break;
+        }
+
+        std::shared_ptr<CSimFramePool> pPool = m_pPool;
+        IDeckLinkInputCallback* pCallback = m_pCallback;
+        const uint64_t index = m_FrameIndex++;
+        const SSimSource source = Source( SimMonotonicNs() );
+        const bool matches = ( source.pMode == pMode && source.rgb == SimIsRgb(format) );
+
+        if( pCallback != NULL )
+        {
+            pCallback->AddRef();
+        }
+
+        lock.unlock();
+
+        // once per stream, instead of a frame; the callback restarts the stream in the new mode, or not
+        if( !matches && detection && !reported && pCallback != NULL )
+        {
+            CSimDisplayMode* pDetected = new CSimDisplayMode(source.pMode);
+            const uint32_t events = ( source.pMode != pMode ? bmdVideoInputDisplayModeChanged : 0 ) |
+                                    ( source.rgb != SimIsRgb(format) ? bmdVideoInputColorspaceChanged : 0 );
+
+            pCallback->VideoInputFormatChanged( (BMDVideoInputFormatChangedEvents)events, pDetected,
+                                                source.rgb ? bmdDetectedVideoInputRGB444 :
+                                                             bmdDetectedVideoInputYCbCr422 );
+            pDetected->Release();
+            pCallback->Release();
+            reported = true;
+            lock.lock();
+            continue;
+        }
+
+        // without a free buffer the frame is lost, as on the hardware; its audio is delivered on its own
+        void* pBuffer = ( pCallback != NULL ) ? pPool->Get() : NULL;
+        CSimVideoInputFrame* pFrame = NULL;
+        CSimAudioInputPacket* pAudio = NULL;
+
+        if( pBuffer != NULL )
+        {
+            memcpy( pBuffer, &index, sizeof(index) );
+            pFrame = new CSimVideoInputFrame( pPool, pBuffer, pMode, format,
+                                              matches ? bmdFrameFlagDefault : bmdFrameHasNoInputSource,
+                                              index, SimMonotonicNs() );
+        }
+
+        if( pCallback != NULL && audioChannels != 0 && matches )
+        {
+            // samples up to the end of the frame, minus those up to its start, so that the cadence of 29.97 works out
+            const uint64_t perFrame = (uint64_t)pMode->frameDuration * bmdAudioSampleRate48kHz;
+            const uint64_t first = index * perFrame / pMode->timeScale;
+            const uint64_t end = ( index + 1 ) * perFrame / pMode->timeScale;
+
+            pAudio = new CSimAudioInputPacket( audioType, audioChannels, (long)( end - first ), first );
+        }
+
+        if( pFrame != NULL || pAudio != NULL )
+        {
+            pCallback->VideoInputFrameArrived( pFrame, pAudio );
+        }
+
+        if( pFrame != NULL )
+        {
+            pFrame->Release();
+        }
+
+        if( pAudio != NULL )
+        {
+            pAudio->Release();
+        }
+
+        if( pCallback != NULL )
+        {
+            pCallback->Release();
+        }
+
+        lock.lock();
+    }
+
+    lock.unlock();
+
+    // the stream's reference, taken by StartStreams(); may destroy this
+    m_pOwner->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::StartStreams(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL || m_Streaming )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    m_Streaming = true;
+    ++m_StreamId;
+    m_SourceStartNs = ( m_SourceStartNs != 0 ) ? m_SourceStartNs : SimMonotonicNs();
+    m_pOwner->AddRef();
+    m_Thread = std::thread( &CSimInput::StreamMain, this, m_StreamId, EnvUnsigned( "DECKLINK_SIM_SPEED", 1 ) );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stops the stream thread and waits for it, unless called from within a callback on that thread.
+void CSimInput::Halt()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    if( !m_Streaming )
+    {
+        return;
+    }
+
+    m_Streaming = false;
+    m_Cond.notify_all();
+
+    std::thread thread;
+    thread.swap(m_Thread);
+    lock.unlock();
+
+    if( thread.get_id() == std::this_thread::get_id() )
+    {
+        thread.detach();
+    }
+    else
+    {
+        thread.join();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::StopStreams(void)
+{
+    Halt();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_FrameIndex = 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::PauseStreams(void)
+{
+    Halt();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::FlushStreams(void)
+{
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::SetCallback( IDeckLinkInputCallback* theCallback )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( theCallback != NULL )
+    {
+        theCallback->AddRef();
+    }
+
+    if( m_pCallback != NULL )
+    {
+        m_pCallback->Release();
+    }
+
+    m_pCallback = theCallback;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::GetHardwareReferenceClock( BMDTimeScale desiredTimeScale,
+                                                                BMDTimeValue* hardwareTime, BMDTimeValue* timeInFrame,
+                                                                BMDTimeValue* ticksPerFrame )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL )
+    {
+        return E_FAIL;
+    }
+
+    *hardwareTime = SimScaleNs( SimDeviceNs( SimMonotonicNs(), SimDriftPpm( m_pOwner->Slot() ) ), desiredTimeScale );
+    *ticksPerFrame = m_pMode->frameDuration * desiredTimeScale / m_pMode->timeScale;
+    *timeInFrame = ( *ticksPerFrame != 0 ) ? *hardwareTime % *ticksPerFrame : 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimInput::QueryInterface( REFIID riid, void** ppvObject )
+{
+    return m_pOwner->QueryInterface( riid, ppvObject );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimInput::AddRef(void)
+{
+    return m_pOwner->AddRef();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimInput::Release(void)
+{
+    return m_pOwner->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimOutput::CSimOutput( CSimDeckLink* pOwner )
+    : m_pOwner(pOwner), m_pMode(NULL), m_pAllocator(NULL), m_pCommitted(NULL), m_pCallback(NULL), m_Playing(false),
+      m_PlayId(0), m_StreamTime(0), m_StartTime(0), m_StartNs(0), m_Speed(1), m_AudioChannels(0),
+      m_pAudioCallback(NULL), m_AudioEnd(0), m_Preroll(false)
+{
+    m_OnScreen.pFrame = NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only reached once no playback thread holds the device any more.
+CSimOutput::~CSimOutput()
+{
+    DisableVideoOutput();
+    DisableAudioOutput();
+    SetAudioCallback(NULL);
+    SetScheduledFrameCompletionCallback(NULL);
+    SetVideoOutputFrameMemoryAllocator(NULL);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::DoesSupportVideoMode( BMDDisplayMode displayMode, BMDPixelFormat pixelFormat,
+                                                            BMDVideoOutputFlags flags, BMDDisplayModeSupport* result,
+                                                            IDeckLinkDisplayMode** resultDisplayMode )
+{
+    return SimDoesSupportVideoMode( true, displayMode, pixelFormat, flags, result, resultDisplayMode );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetDisplayModeIterator( IDeckLinkDisplayModeIterator** iterator )
+{
+    *iterator = new CSimDisplayModeIterator();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::SetScreenPreviewCallback( IDeckLinkScreenPreviewCallback* previewCallback )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::EnableVideoOutput( BMDDisplayMode displayMode, BMDVideoOutputFlags flags )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode != NULL )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    if( SimModeSupport( true, displayMode, bmdFormat8BitYUV, flags ) == bmdDisplayModeNotSupported )
+    {
+        return E_INVALIDARG;
+    }
+
+    if( m_pAllocator != NULL && m_pAllocator->Commit() != S_OK )
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_pMode = FindSimMode(displayMode);
+    m_pCommitted = m_pAllocator;
+
+    if( m_pCommitted != NULL )
+    {
+        m_pCommitted->AddRef();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::DisableVideoOutput(void)
+{
+    std::vector<SScheduled> done;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    if( m_Playing )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    if( m_pMode == NULL )
+    {
+        return S_OK;
+    }
+
+    Flush(&done);
+    m_pMode = NULL;
+
+    IDeckLinkMemoryAllocator* pCommitted = m_pCommitted;
+    m_pCommitted = NULL;
+    lock.unlock();
+
+    // frames never shown are released without being completed
+    for( size_t i = 0; i < done.size(); ++i )
+    {
+        done[i].pFrame->Release();
+    }
+
+    if( pCommitted != NULL )
+    {
+        pCommitted->Decommit();
+        pCommitted->Release();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::SetVideoOutputFrameMemoryAllocator( IDeckLinkMemoryAllocator* theAllocator )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    // frames created from now on take their buffers from it; committed with the next EnableVideoOutput()
+    if( theAllocator != NULL )
+    {
+        theAllocator->AddRef();
+    }
+
+    if( m_pAllocator != NULL )
+    {
+        m_pAllocator->Release();
+    }
+
+    m_pAllocator = theAllocator;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::CreateVideoFrame( int32_t width, int32_t height, int32_t rowBytes,
+                                                        BMDPixelFormat pixelFormat, BMDFrameFlags flags,
+                                                        IDeckLinkMutableVideoFrame** outFrame )
+{
+    *outFrame = NULL;
+
+    if( width <= 0 || height <= 0 || rowBytes < SimRowBytes( pixelFormat, width ) )
+    {
+        return E_INVALIDARG;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    const uint32_t bufferSize = (uint32_t)rowBytes * (uint32_t)height;
+    void* pBuffer = NULL;
+
+    if( m_pAllocator != NULL )
+    {
+        if( m_pAllocator->AllocateBuffer( bufferSize, &pBuffer ) != S_OK )
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+    else if( posix_memalign( &pBuffer, 4096, bufferSize ) != 0 )
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    *outFrame = new CSimOutputFrame( m_pAllocator, pBuffer, width, height, rowBytes, pixelFormat, flags );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Only in 10-bit YUV, and in the mode of the enabled output.
+HRESULT STDMETHODCALLTYPE CSimOutput::CreateAncillaryData( BMDPixelFormat pixelFormat,
+                                                           IDeckLinkVideoFrameAncillary** outBuffer )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    *outBuffer = NULL;
+
+    if( m_pMode == NULL || pixelFormat != bmdFormat10BitYUV )
+    {
+        return E_INVALIDARG;
+    }
+
+    *outBuffer = new CSimVideoFrameAncillary(m_pMode);
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::DisplayVideoFrameSync( IDeckLinkVideoFrame* theFrame )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::ScheduleVideoFrame( IDeckLinkVideoFrame* theFrame, BMDTimeValue displayTime,
+                                                          BMDTimeValue displayDuration, BMDTimeScale timeScale )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL || theFrame == NULL || timeScale <= 0 )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    SScheduled entry;
+    entry.pFrame = theFrame;
+    entry.time = displayTime * m_pMode->timeScale / timeScale;
+    entry.result = bmdOutputFrameCompleted;
+
+    // frames are normally scheduled in display order, so this is an append
+    std::deque<SScheduled>::iterator it = m_Scheduled.end();
+
+    while( it != m_Scheduled.begin() && ( it - 1 )->time > entry.time )
+    {
+        --it;
+    }
+
+    theFrame->AddRef();
+    m_Scheduled.insert( it, entry );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::SetScheduledFrameCompletionCallback( IDeckLinkVideoOutputCallback* theCallback )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( theCallback != NULL )
+    {
+        theCallback->AddRef();
+    }
+
+    if( m_pCallback != NULL )
+    {
+        m_pCallback->Release();
+    }
+
+    m_pCallback = theCallback;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetBufferedVideoFrameCount( uint32_t* bufferedFrameCount )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    *bufferedFrameCount = (uint32_t)m_Scheduled.size();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::EnableAudioOutput( BMDAudioSampleRate sampleRate, BMDAudioSampleType sampleType,
+                                                         uint32_t channelCount, BMDAudioOutputStreamType streamType )
+{
+    if( sampleRate != bmdAudioSampleRate48kHz ||
+        ( sampleType != bmdAudioSampleType16bitInteger && sampleType != bmdAudioSampleType32bitInteger ) ||
+        ( channelCount != 2 && channelCount != 8 && channelCount != 16 ) || streamType != bmdAudioOutputStreamTimestamped )
+    {
+        return E_INVALIDARG;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_AudioChannels != 0 )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    m_AudioChannels = channelCount;
+    m_AudioEnd = AudioPlayed();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::DisableAudioOutput(void)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    EndPreroll(lock);
+    m_AudioChannels = 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::WriteAudioSamplesSync( void* buffer, uint32_t sampleFrameCount,
+                                                             uint32_t* sampleFramesWritten )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::BeginAudioPreroll(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_AudioChannels == 0 || m_Preroll || m_PrerollThread.joinable() )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    m_Preroll = true;
+    m_pOwner->AddRef();
+    m_PrerollThread = std::thread( &CSimOutput::PrerollMain, this );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::EndAudioPreroll(void)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    EndPreroll(lock);
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Samples scheduled for a time already played are skipped, those beyond the second the card holds are not taken.
+HRESULT STDMETHODCALLTYPE CSimOutput::ScheduleAudioSamples( void* buffer, uint32_t sampleFrameCount,
+                                                            BMDTimeValue streamTime, BMDTimeScale timeScale,
+                                                            uint32_t* sampleFramesWritten )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_AudioChannels == 0 || buffer == NULL || timeScale <= 0 || streamTime < 0 )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    const uint64_t played = AudioPlayed();
+    const uint64_t start = (uint64_t)streamTime * bmdAudioSampleRate48kHz / timeScale;
+    const uint64_t end = std::min<uint64_t>( start + sampleFrameCount, played + bmdAudioSampleRate48kHz );
+
+    if( end > start )
+    {
+        m_AudioEnd = std::max( m_AudioEnd, end );
+    }
+
+    if( sampleFramesWritten != NULL )
+    {
+        *sampleFramesWritten = ( end > start ) ? (uint32_t)( end - start ) : 0;
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetBufferedAudioSampleFrameCount( uint32_t* bufferedSampleFrameCount )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_AudioChannels == 0 )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    const uint64_t played = AudioPlayed();
+
+    *bufferedSampleFrameCount = ( m_AudioEnd > played ) ? (uint32_t)( m_AudioEnd - played ) : 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::FlushBufferedAudioSamples(void)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_AudioEnd = AudioPlayed();
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::SetAudioCallback( IDeckLinkAudioOutputCallback* theCallback )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( theCallback != NULL )
+    {
+        theCallback->AddRef();
+    }
+
+    if( m_pAudioCallback != NULL )
+    {
+        m_pAudioCallback->Release();
+    }
+
+    m_pAudioCallback = theCallback;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// 48 kHz stream time of the sample being played: continuous on the device's clock while playing, the stream time
+// playback stopped or will start at otherwise. Called with m_Mutex held.
+uint64_t CSimOutput::AudioPlayed()
+{
+    if( m_pMode == NULL )
+    {
+        return 0;
+    }
+
+    if( !m_Playing || m_Speed == 0 )
+    {
+        return (uint64_t)m_StreamTime * bmdAudioSampleRate48kHz / m_pMode->timeScale;
+    }
+
+    const uint64_t elapsed = SimDeviceNs( SimMonotonicNs() - m_StartNs, SimDriftPpm( m_pOwner->Slot() ) ) * m_Speed;
+
+    return (uint64_t)m_StartTime * bmdAudioSampleRate48kHz / m_pMode->timeScale +
+           SimScaleNs( elapsed, bmdAudioSampleRate48kHz );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Calls the audio callback to preroll until EndAudioPreroll().
+void CSimOutput::PrerollMain()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    while( m_Preroll )
+    {
+        IDeckLinkAudioOutputCallback* pAudioCallback = m_pAudioCallback;
+
+        if( pAudioCallback != NULL )
+        {
+            pAudioCallback->AddRef();
+            lock.unlock();
+            pAudioCallback->RenderAudioSamples(true);
+            pAudioCallback->Release();
+            lock.lock();
+        }
+
+        m_Cond.wait_for( lock, std::chrono::milliseconds(5), [this] { return !m_Preroll; } );
+    }
+
+    lock.unlock();
+
+    // the preroll's reference, taken by BeginAudioPreroll(); may destroy this
+    m_pOwner->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stops the preroll thread and waits for it, unless called from within a callback on that thread.
+void CSimOutput::EndPreroll( std::unique_lock<std::mutex>& lock )
+{
+    m_Preroll = false;
+    m_Cond.notify_all();
+
+    std::thread thread;
+    thread.swap(m_PrerollThread);
+
+    if( !thread.joinable() )
+    {
+        return;
+    }
+
+    lock.unlock();
+
+    if( thread.get_id() == std::this_thread::get_id() )
+    {
+        thread.detach();
+    }
+    else
+    {
+        thread.join();
+    }
+
+    lock.lock();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Takes the scheduled frames and the one on screen off the output; called with m_Mutex held.
+void CSimOutput::Flush( std::vector<SScheduled>* pDone )
+{
+    if( m_OnScreen.pFrame != NULL )
+    {
+        pDone->push_back(m_OnScreen);
+        m_OnScreen.pFrame = NULL;
+    }
+
+    for( size_t i = 0; i < m_Scheduled.size(); ++i )
+    {
+        pDone->push_back( m_Scheduled[i] );
+        pDone->back().result = bmdOutputFrameFlushed;
+    }
+
+    m_Scheduled.clear();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimOutput::PlayMain( unsigned playId, unsigned speed )
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    const BMDTimeValue frameDuration = m_pMode->frameDuration;
+    const std::chrono::nanoseconds period = SimDevicePeriod( speed == 0 ? 0 :
+                                    frameDuration * 1000000000 / m_pMode->timeScale / speed,
+                                    SimDriftPpm( m_pOwner->Slot() ) );
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    std::vector<SScheduled> done;
+
+    while( m_Playing && m_PlayId == playId )
+    {
+        const BMDTimeValue now = m_StreamTime;
+
+        done.clear();
+
+        if( m_OnScreen.pFrame != NULL && !m_Scheduled.empty() && m_Scheduled.front().time <= now )
+        {
+            done.push_back(m_OnScreen);
+            m_OnScreen.pFrame = NULL;
+        }
+
+        while( !m_Scheduled.empty() && m_Scheduled.front().time <= now )
+        {
+            SScheduled entry = m_Scheduled.front();
+            m_Scheduled.pop_front();
+
+            if( !m_Scheduled.empty() && m_Scheduled.front().time <= now )
+            {
+                entry.result = bmdOutputFrameDropped;
+                done.push_back(entry);
+            }
+            else
+            {
+                entry.result = ( entry.time > now - frameDuration ) ? bmdOutputFrameCompleted
+                                                                    : bmdOutputFrameDisplayedLate;
+                m_OnScreen = entry;
+            }
+        }
+
+        IDeckLinkVideoOutputCallback* pCallback = m_pCallback;
+        IDeckLinkAudioOutputCallback* pAudioCallback = ( m_AudioChannels != 0 ) ? m_pAudioCallback : NULL;
+
+        if( pCallback != NULL )
+        {
+            pCallback->AddRef();
+        }
+
+        if( pAudioCallback != NULL )
+        {
+            pAudioCallback->AddRef();
+        }
+
+        lock.unlock();
+
+        for( size_t i = 0; i < done.size(); ++i )
+        {
+            if( pCallback != NULL )
+            {
+                pCallback->ScheduledFrameCompleted( done[i].pFrame, done[i].result );
+            }
+
+            done[i].pFrame->Release();
+        }
+
+        if( pCallback != NULL )
+        {
+            pCallback->Release();
+        }
+
+        if( pAudioCallback != NULL )
+        {
+            pAudioCallback->RenderAudioSamples(false);
+            pAudioCallback->Release();
+        }
+
+        lock.lock();
+        next += period;
+
+        if( m_Cond.wait_until( lock, next, [this, playId] { return !m_Playing || m_PlayId != playId; } ) )
+        {
+            break;
+        }
+
+        m_StreamTime += frameDuration;
+    }
+
+    lock.unlock();
+
+    // the playback's reference, taken by StartScheduledPlayback(); may destroy this
+    m_pOwner->Release();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::StartScheduledPlayback( BMDTimeValue playbackStartTime, BMDTimeScale timeScale,
+                                                              double playbackSpeed )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL || m_Playing || timeScale <= 0 )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    // only normal speed is simulated
+    m_StreamTime = playbackStartTime * m_pMode->timeScale / timeScale;
+    m_StartTime = m_StreamTime;
+    m_StartNs = SimMonotonicNs();
+    m_Speed = EnvUnsigned( "DECKLINK_SIM_SPEED", 1 );
+    m_Playing = true;
+    ++m_PlayId;
+    m_pOwner->AddRef();
+    m_Thread = std::thread( &CSimOutput::PlayMain, this, m_PlayId, m_Speed );
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stops the playback thread and waits for it, unless called from within a callback on that thread.
+void CSimOutput::Halt()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    if( !m_Playing )
+    {
+        return;
+    }
+
+    m_Playing = false;
+    m_Cond.notify_all();
+
+    std::thread thread;
+    thread.swap(m_Thread);
+    lock.unlock();
+
+    if( thread.get_id() == std::this_thread::get_id() )
+    {
+        thread.detach();
+    }
+    else
+    {
+        thread.join();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Stops at once; a stop time is not simulated.
+HRESULT STDMETHODCALLTYPE CSimOutput::StopScheduledPlayback( BMDTimeValue stopPlaybackAtTime,
+                                                             BMDTimeValue* actualStopTime, BMDTimeScale timeScale )
+{
+    Halt();
+
+    std::vector<SScheduled> done;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    if( actualStopTime != NULL )
+    {
+        *actualStopTime = ( timeScale > 0 ) ? m_StreamTime * timeScale / m_pMode->timeScale : 0;
+    }
+
+    Flush(&done);
+
+    IDeckLinkVideoOutputCallback* pCallback = m_pCallback;
+
+    if( pCallback != NULL )
+    {
+        pCallback->AddRef();
+    }
+
+    lock.unlock();
+
+    for( size_t i = 0; i < done.size(); ++i )
+    {
+        if( pCallback != NULL )
+        {
+            pCallback->ScheduledFrameCompleted( done[i].pFrame, done[i].result );
+        }
+
+        done[i].pFrame->Release();
+    }
+
+    if( pCallback != NULL )
+    {
+        pCallback->ScheduledPlaybackHasStopped();
+        pCallback->Release();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::IsScheduledPlaybackRunning( bool* active )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    *active = m_Playing;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetScheduledStreamTime( BMDTimeScale desiredTimeScale, BMDTimeValue* streamTime,
+                                                              double* playbackSpeed )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL )
+    {
+        return E_ACCESSDENIED;
+    }
+
+    *streamTime = m_StreamTime * desiredTimeScale / m_pMode->timeScale;
+    *playbackSpeed = m_Playing ? 1.0 : 0.0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetReferenceStatus( BMDReferenceStatus* referenceStatus )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetHardwareReferenceClock( BMDTimeScale desiredTimeScale,
+                                                                 BMDTimeValue* hardwareTime, BMDTimeValue* timeInFrame,
+                                                                 BMDTimeValue* ticksPerFrame )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_pMode == NULL )
+    {
+        return E_FAIL;
+    }
+
+    *hardwareTime = SimScaleNs( SimDeviceNs( SimMonotonicNs(), SimDriftPpm( m_pOwner->Slot() ) ), desiredTimeScale );
+    *ticksPerFrame = m_pMode->frameDuration * desiredTimeScale / m_pMode->timeScale;
+    *timeInFrame = ( *ticksPerFrame != 0 ) ? *hardwareTime % *ticksPerFrame : 0;
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::GetFrameCompletionReferenceTimestamp( IDeckLinkVideoFrame* theFrame,
+                                                                            BMDTimeScale desiredTimeScale,
+                                                                            BMDTimeValue* frameCompletionTimestamp )
+{
+    return E_NOTIMPL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimOutput::QueryInterface( REFIID riid, void** ppvObject )
+{
+    return m_pOwner->QueryInterface( riid, ppvObject );
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimOutput::AddRef(void)
+{
+    return m_pOwner->AddRef();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimOutput::Release(void)
+{
+    return m_pOwner->Release();
+}
+
+//=====================================================================================================================
+struct SSimStep
+{
+    enum EKind { kArrive, kRemove, kChurn, kStorm, kSleep, kRate };
+
+    EKind     kind;
+    unsigned  count;  // kAll for "all"
+};
+
+static const unsigned kAll = ~0u;
+
+//---------------------------------------------------------------------------------------------------------------------
+struct SSimScript
+{
+    unsigned               devices;
+    unsigned               subDevices;
+    unsigned               threads;
+    unsigned               rate;
+    std::vector<SSimStep>  steps;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+static bool ParseScript( std::istream& in, SSimScript* pScript )
+{
+    std::string line;
+    unsigned lineNo = 0;
+    bool haveSteps = false;
+
+    while( std::getline( in, line ) )
+    {
+        ++lineNo;
+        line = line.substr( 0, line.find('#') );
+
+        std::istringstream words(line);
+        std::string cmd, arg;
+
+        if( !(words >> cmd) )
+        {
+            continue;
+        }
+
+        words >> arg;
+        unsigned n = ( arg == "all" ) ? kAll : (unsigned)strtoul( arg.c_str(), NULL, 0 );
+
+        if( cmd == "devices" && !haveSteps && n != kAll && n > 0 )
+        {
+            pScript->devices = n;
+            continue;
+        }
+
+        if( cmd == "subdevices" && !haveSteps && n != kAll && n > 0 )
+        {
+            pScript->subDevices = n;
+            continue;
+        }
+
+        if( cmd == "threads" && n != kAll && n > 0 )
+        {
+            pScript->threads = n;
+            continue;
+        }
+
+        SSimStep step;
+        step.count = n;
+
+        if( cmd == "arrive" )       step.kind = SSimStep::kArrive;
+        else if( cmd == "remove" )  step.kind = SSimStep::kRemove;
+        else if( cmd == "churn" )   step.kind = SSimStep::kChurn;
+        else if( cmd == "storm" )   step.kind = SSimStep::kStorm;
+        else if( cmd == "sleep" )   step.kind = SSimStep::kSleep;
+        else if( cmd == "rate" )    step.kind = SSimStep::kRate;
+        else
+        {
+            fprintf( stderr, "DeckLink Sim: script line %u: unknown command '%s'\n", lineNo, cmd.c_str() );
+            return false;
+        }
+
+        pScript->steps.push_back(step);
+        haveSteps = true;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+static SSimScript LoadScript()
+{
+    SSimScript script;
+    script.devices = EnvUnsigned( "DECKLINK_SIM_DEVICES", 4 );
+    script.subDevices = EnvUnsigned( "DECKLINK_SIM_SUBDEVICES", 1 );
+    script.threads = EnvUnsigned( "DECKLINK_SIM_THREADS", 1 );
+    script.rate = EnvUnsigned( "DECKLINK_SIM_RATE", 0 );
+
+    const char* path = getenv("DECKLINK_SIM_SCRIPT");
+
+    if( path != NULL && *path != '\0' )
+    {
+        std::ifstream file(path);
+
+        if( file && ParseScript( file, &script ) )
+        {
+            return script;
+        }
+
+        fprintf( stderr, "DeckLink Sim: cannot use script '%s', falling back to defaults\n", path );
+        script.steps.clear();
+    }
+
+    SSimStep arrive = { SSimStep::kArrive, kAll };
+    SSimStep storm = { SSimStep::kStorm, EnvUnsigned( "DECKLINK_SIM_CYCLES", 0 ) };
+
+    script.steps.push_back(arrive);
+    script.steps.push_back(storm);
+
+    if( script.devices == 0 )  script.devices = 1;
+    if( script.subDevices == 0 )  script.subDevices = 1;
+    if( script.threads == 0 )  script.threads = 1;
+
+    return script;
+}
+
+//=====================================================================================================================
+// The simulated set of attached devices. Shared by the discovery and iterator objects.
+class CSimWorld
+{
+    std::mutex                  m_Mutex;
+    std::vector<CSimDeckLink*>  m_Slots;
+    unsigned                    m_SubDevices;
+
+public:
+    CSimWorld() : m_SubDevices(1)  {}
+
+    static CSimWorld& Instance();
+
+    void Resize( unsigned devices, unsigned subDevices );
+    unsigned Size();
+
+    // Plug/unplug the device in a slot. Return the affected object (holding the world's reference) or NULL.
+    CSimDeckLink* Plug( unsigned slot );
+    CSimDeckLink* Unplug( unsigned slot );
+
+    // Unplugs every device and returns them, each still holding the world's reference.
+    std::vector<CSimDeckLink*> UnplugAll();
+
+    bool IsPresent( unsigned slot );
+
+    // Snapshot of the present devices, each AddRef'ed.
+    std::vector<IDeckLink*> Present();
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimWorld& CSimWorld::Instance()
+{
+    static CSimWorld world;
+    return world;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimWorld::Resize( unsigned devices, unsigned subDevices )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_SubDevices = subDevices;
+
+    if( devices > m_Slots.size() )
+    {
+        m_Slots.resize( devices, NULL );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+unsigned CSimWorld::Size()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return (unsigned)m_Slots.size();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimDeckLink* CSimWorld::Plug( unsigned slot )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if( m_Slots[slot] != NULL )
+    {
+        return NULL;
+    }
+
+    m_Slots[slot] = new CSimDeckLink( slot, m_SubDevices );
+    return m_Slots[slot];
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimDeckLink* CSimWorld::Unplug( unsigned slot )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    CSimDeckLink* p = m_Slots[slot];
+    m_Slots[slot] = NULL;
+    return p;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+std::vector<CSimDeckLink*> CSimWorld::UnplugAll()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<CSimDeckLink*> devices;
+
+    for( size_t i = 0; i < m_Slots.size(); ++i )
+    {
+        if( m_Slots[i] != NULL )
+        {
+            devices.push_back( m_Slots[i] );
+            m_Slots[i] = NULL;
+        }
+    }
+
+    return devices;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CSimWorld::IsPresent( unsigned slot )
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Slots[slot] != NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+std::vector<IDeckLink*> CSimWorld::Present()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<IDeckLink*> devices;
+
+    for( size_t i = 0; i < m_Slots.size(); ++i )
+    {
+        if( m_Slots[i] != NULL )
+        {
+            m_Slots[i]->AddRef();
+            devices.push_back( m_Slots[i] );
+        }
+    }
+
+    return devices;
+}
+
+//=====================================================================================================================
+class CSimIterator : public IDeckLinkIterator
+{
+    std::atomic<ULONG>       m_RefCount;
+    std::vector<IDeckLink*>  m_Devices;
+    size_t                   m_Next;
+
+public:
+    CSimIterator();
+    virtual ~CSimIterator();
+
+    // overrides IDeckLinkIterator
+    virtual HRESULT STDMETHODCALLTYPE Next( IDeckLink** deckLinkInstance );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimIterator::CSimIterator()
+    : m_RefCount(1), m_Devices( CSimWorld::Instance().Present() ), m_Next(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimIterator::~CSimIterator()
+{
+    for( ; m_Next < m_Devices.size(); ++m_Next )
+    {
+        m_Devices[m_Next]->Release();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimIterator::Next( IDeckLink** deckLinkInstance )
+{
+    if( m_Next == m_Devices.size() )
+    {
+        *deckLinkInstance = NULL;
+        return S_FALSE;
+    }
+
+    // the reference taken in the constructor is handed over to the caller
+    *deckLinkInstance = m_Devices[m_Next++];
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimIterator::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkIterator ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkIterator*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimIterator::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimIterator::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+class CSimDiscovery : public IDeckLinkDiscovery
+{
+    std::atomic<ULONG>                    m_RefCount;
+    IDeckLinkDeviceNotificationCallback*  m_pCallback;
+    SSimScript                            m_Script;
+    std::vector<std::thread>              m_Workers;
+    std::atomic<bool>                     m_Stop;
+
+    // step barrier shared by the notification threads
+    std::mutex                            m_BarrierMutex;
+    std::condition_variable               m_BarrierCond;
+    unsigned                              m_BarrierCount;
+    unsigned                              m_BarrierPhase;
+
+    void WorkerMain( unsigned index );
+    bool WaitBarrier();
+    bool Pace( std::chrono::steady_clock::time_point* pDeadline, unsigned rate );
+    void Arrive( unsigned slot );
+    void Remove( unsigned slot );
+
+public:
+    CSimDiscovery();
+    virtual ~CSimDiscovery();
+
+    // overrides IDeckLinkDiscovery
+    virtual HRESULT STDMETHODCALLTYPE InstallDeviceNotifications( IDeckLinkDeviceNotificationCallback* pCallback );
+    virtual HRESULT STDMETHODCALLTYPE UninstallDeviceNotifications(void);
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimDiscovery::CSimDiscovery()
+    : m_RefCount(1), m_pCallback(NULL), m_Stop(false), m_BarrierCount(0), m_BarrierPhase(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+CSimDiscovery::~CSimDiscovery()
+{
+    UninstallDeviceNotifications();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDiscovery::InstallDeviceNotifications( IDeckLinkDeviceNotificationCallback* pCallback )
+{
+    if( pCallback == NULL )
+    {
+        return E_INVALIDARG;
+    }
+
+    if( m_pCallback != NULL )
+    {
+        return E_FAIL;
+    }
+
+    m_Script = LoadScript();
+    CSimWorld::Instance().Resize( m_Script.devices, m_Script.subDevices );
+
+    m_pCallback = pCallback;
+    m_pCallback->AddRef();
+    m_Stop = false;
+    m_BarrierCount = 0;
+
+    for( unsigned i = 0; i < m_Script.threads; ++i )
+    {
+        m_Workers.push_back( std::thread( &CSimDiscovery::WorkerMain, this, i ) );
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDiscovery::UninstallDeviceNotifications(void)
+{
+    if( m_pCallback == NULL )
+    {
+        return S_OK;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_BarrierMutex);
+        m_Stop = true;
+    }
+    m_BarrierCond.notify_all();
+
+    for( size_t i = 0; i < m_Workers.size(); ++i )
+    {
+        m_Workers[i].join();
+    }
+
+    m_Workers.clear();
+    m_pCallback->Release();
+    m_pCallback = NULL;
+
+    // the devices the script left plugged in go away without DeckLinkDeviceRemoved(), as a driver stops reporting to
+    // an uninstalled callback; the next install plugs them in again. Whoever still holds one keeps it alive.
+    std::vector<CSimDeckLink*> plugged = CSimWorld::Instance().UnplugAll();
+
+    for( size_t i = 0; i < plugged.size(); ++i )
+    {
+        plugged[i]->Release();
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CSimDiscovery::WaitBarrier()
+{
+    std::unique_lock<std::mutex> lock(m_BarrierMutex);
+    unsigned phase = m_BarrierPhase;
+
+    if( ++m_BarrierCount == m_Script.threads )
+    {
+        m_BarrierCount = 0;
+        ++m_BarrierPhase;
+        m_BarrierCond.notify_all();
+    }
+    else
+    {
+        while( phase == m_BarrierPhase && !m_Stop )
+        {
+            m_BarrierCond.wait(lock);
+        }
+    }
+
+    return !m_Stop;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+bool CSimDiscovery::Pace( std::chrono::steady_clock::time_point* pDeadline, unsigned rate )
+{
+    if( m_Stop )
+    {
+        return false;
+    }
+
+    if( rate != 0 )
+    {
+        std::this_thread::sleep_until(*pDeadline);
+        *pDeadline += std::chrono::nanoseconds( 1000000000ull * m_Script.threads / rate );
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimDiscovery::Arrive( unsigned slot )
+{
+    CSimDeckLink* p = CSimWorld::Instance().Plug(slot);
+
+    if( p != NULL )
+    {
+        m_pCallback->DeckLinkDeviceArrived(p);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimDiscovery::Remove( unsigned slot )
+{
+    CSimDeckLink* p = CSimWorld::Instance().Unplug(slot);
+
+    if( p != NULL )
+    {
+        m_pCallback->DeckLinkDeviceRemoved(p);
+        p->Release();
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimDiscovery::WorkerMain( unsigned index )
+{
+    CSimWorld& world = CSimWorld::Instance();
+    const unsigned devices = world.Size();
+    const unsigned threads = m_Script.threads;
+
+    std::mt19937 rng( 12345 + index );
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+    unsigned rate = m_Script.rate;
+
+    // slots owned by this thread
+    std::vector<unsigned> own;
+
+    for( unsigned slot = index; slot < devices; slot += threads )
+    {
+        own.push_back(slot);
+    }
+
+    for( size_t s = 0; s < m_Script.steps.size(); ++s )
+    {
+        const SSimStep& step = m_Script.steps[s];
+        // split the count between the threads, the first ones taking the remainder
+        unsigned share = ( step.count == kAll ) ? kAll : step.count / threads + ( index < step.count % threads );
+
+        switch( step.kind )
+        {
+        case SSimStep::kRate:
+            rate = step.count == kAll ? 0 : step.count;
+            break;
+
+        case SSimStep::kSleep:
+            std::this_thread::sleep_for( std::chrono::milliseconds(step.count) );
+            deadline = std::chrono::steady_clock::now();
+            break;
+
+        case SSimStep::kArrive:
+        case SSimStep::kRemove:
+            for( size_t i = 0; i < own.size() && share != 0; ++i )
+            {
+                if( world.IsPresent(own[i]) == ( step.kind == SSimStep::kArrive ) )
+                {
+                    continue;
+                }
+
+                if( !Pace( &deadline, rate ) )
+                {
+                    return;
+                }
+
+                if( step.kind == SSimStep::kArrive )
+                {
+                    Arrive(own[i]);
+                }
+                else
+                {
+                    Remove(own[i]);
+                }
+
+                if( share != kAll )
+                {
+                    --share;
+                }
+            }
+            break;
+
+        case SSimStep::kChurn:
+            for( unsigned i = 0; i < share && !own.empty(); ++i )
+            {
+                unsigned slot = own[ rng() % own.size() ];
+
+                if( world.IsPresent(slot) )
+                {
+                    if( !Pace( &deadline, rate ) )
+                    {
+                        return;
+                    }
+
+                    Remove(slot);
+                }
+
+                if( !Pace( &deadline, rate ) )
+                {
+                    return;
+                }
+
+                Arrive(slot);
+            }
+            break;
+
+        case SSimStep::kStorm:
+            for( unsigned cycle = 0; cycle < step.count; ++cycle )
+            {
+                for( size_t i = 0; i < own.size(); ++i )
+                {
+                    if( !Pace( &deadline, rate ) )
+                    {
+                        return;
+                    }
+
+                    Remove(own[i]);
+                }
+
+                for( size_t i = 0; i < own.size(); ++i )
+                {
+                    if( !Pace( &deadline, rate ) )
+                    {
+                        return;
+                    }
+
+                    Arrive(own[i]);
+                }
+            }
+            break;
+        }
+
+        if( !WaitBarrier() )
+        {
+            return;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimDiscovery::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkDiscovery ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkDiscovery*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDiscovery::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimDiscovery::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+// Stand-in for the driver's software converter, for comparison in benchmarks: plain C, one pixel pair at a time,
+// between 8-bit (2vuy) and 10-bit (v210) YUV only.
+class CSimVideoConversion : public IDeckLinkVideoConversion
+{
+    std::atomic<ULONG>  m_RefCount;
+
+    static void V210To2vuy( const uint32_t* pSrc, uint8_t* pDst, long width );
+    static void V2vuyTo210( const uint8_t* pSrc, uint32_t* pDst, long width );
+
+public:
+    CSimVideoConversion() : m_RefCount(1)  {}
+    virtual ~CSimVideoConversion()  {}
+
+    // overrides IDeckLinkVideoConversion
+    virtual HRESULT STDMETHODCALLTYPE ConvertFrame( IDeckLinkVideoFrame* srcFrame, IDeckLinkVideoFrame* dstFrame );
+
+    // overrides IUnknown
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID iid, void** ppv );
+
+    virtual ULONG STDMETHODCALLTYPE AddRef(void);
+    virtual ULONG STDMETHODCALLTYPE Release(void);
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// v210 words hold Cb0 Y0 Cr0 / Y1 Cb2 Y2 / Cr2 Y3 Cb4 / Y4 Cr4 Y5; 2vuy is Cb Y Cr Y per pixel pair.
+void CSimVideoConversion::V210To2vuy( const uint32_t* pSrc, uint8_t* pDst, long width )
+{
+    for( long x = 0; x < width; x += 2 )
+    {
+        for( int i = 0; i < 4; ++i )
+        {
+            const long sample = x * 2 + i;                  // in 2vuy order, which v210 shares
+            const uint32_t word = pSrc[ sample / 3 ];
+            const unsigned value = ( ( word >> ( sample % 3 * 10 ) ) & 0x3FF ) + 2;
+
+            pDst[sample] = (uint8_t)std::min( value >> 2, 255u );
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void CSimVideoConversion::V2vuyTo210( const uint8_t* pSrc, uint32_t* pDst, long width )
+{
+    const long samples = width * 2;
+    const long words = ( width + 47 ) / 48 * 32;
+
+    memset( pDst, 0, words * sizeof(uint32_t) );
+
+    for( long sample = 0; sample < samples; ++sample )
+    {
+        pDst[ sample / 3 ] |= (uint32_t)pSrc[sample] << ( 2 + sample % 3 * 10 );
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoConversion::ConvertFrame( IDeckLinkVideoFrame* srcFrame,
+                                                             IDeckLinkVideoFrame* dstFrame )
+{
+    const BMDPixelFormat from = srcFrame->GetPixelFormat();
+    const BMDPixelFormat to = dstFrame->GetPixelFormat();
+    const long width = srcFrame->GetWidth();
+    const long height = srcFrame->GetHeight();
+    void* pSrc;
+    void* pDst;
+
+    if( dstFrame->GetWidth() != width || dstFrame->GetHeight() != height ||
+        srcFrame->GetBytes(&pSrc) != S_OK || dstFrame->GetBytes(&pDst) != S_OK )
+    {
+        return E_INVALIDARG;
+    }
+
+    for( long y = 0; y < height; ++y )
+    {
+        const uint8_t* pSrcRow = (const uint8_t*)pSrc + y * srcFrame->GetRowBytes();
+        uint8_t* pDstRow = (uint8_t*)pDst + y * dstFrame->GetRowBytes();
+
+        if( from == bmdFormat10BitYUV && to == bmdFormat8BitYUV )
+        {
+            V210To2vuy( (const uint32_t*)pSrcRow, pDstRow, width );
+        }
+        else if( from == bmdFormat8BitYUV && to == bmdFormat10BitYUV )
+        {
+            V2vuyTo210( pSrcRow, (uint32_t*)pDstRow, width );
+        }
+        else
+        {
+            return E_NOTIMPL;
+        }
+    }
+
+    return S_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+HRESULT STDMETHODCALLTYPE CSimVideoConversion::QueryInterface( REFIID riid, void** ppvObject )
+{
+    if( IsEqualGUID( riid, IID_IDeckLinkVideoConversion ) || IsEqualGUID( riid, IID_IUnknown ) )
+    {
+        *ppvObject = static_cast<IDeckLinkVideoConversion*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimVideoConversion::AddRef(void)
+{
+    return ++m_RefCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+ULONG STDMETHODCALLTYPE CSimVideoConversion::Release(void)
+{
+    ULONG refs = --m_RefCount;
+
+    if( refs == 0 )
+    {
+        delete this;
+    }
+
+    return refs;
+}
+
+//=====================================================================================================================
+SIM_EXPORT IDeckLinkDiscovery* CreateDeckLinkDiscoveryInstance_0001(void)
+{
+    return new CSimDiscovery;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+SIM_EXPORT IDeckLinkIterator* CreateDeckLinkIteratorInstance_0002(void)
+{
+    return new CSimIterator;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Not simulated. Exported so that the dispatcher does not complain about missing symbols.
+SIM_EXPORT IDeckLinkAPIInformation* CreateDeckLinkAPIInformationInstance_0001(void)
+{
+    return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+SIM_EXPORT IDeckLinkVideoConversion* CreateVideoConversionInstance_0001(void)
+{
+    return new CSimVideoConversion;
+}